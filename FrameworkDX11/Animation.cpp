@@ -0,0 +1,149 @@
+#include "Animation.h"
+#include <math.h>
+
+static inline XMVECTOR BlendRotation(FXMVECTOR a, FXMVECTOR b, float weight)
+{
+	// Take the short way round before the normalised lerp
+	XMVECTOR target = b;
+	if (XMVectorGetX(XMVector4Dot(a, b)) < 0.0f)
+		target = XMVectorNegate(b);
+	return XMQuaternionNormalize(XMVectorLerp(a, target, weight));
+}
+
+static inline void StoreBone(BoneTransform& out, FXMVECTOR rotation, FXMVECTOR translation)
+{
+	XMStoreFloat4(&out.Rotation, rotation);
+	XMStoreFloat3(&out.Translation, translation);
+	out.Padding = 0.0f;
+}
+
+void Pose::SetIdentity(BoneTransform* pose, uint32_t boneCount)
+{
+	for (uint32_t i = 0; i < boneCount; ++i)
+	{
+		StoreBone(pose[i], XMQuaternionIdentity(), XMVectorZero());
+	}
+}
+
+void Pose::Copy(const BoneTransform* source, BoneTransform* out, uint32_t boneCount)
+{
+	for (uint32_t i = 0; i < boneCount; ++i)
+	{
+		out[i] = source[i];
+	}
+}
+
+void Pose::Blend(const BoneTransform* a, const BoneTransform* b, float weight, BoneTransform* out, uint32_t boneCount)
+{
+	for (uint32_t i = 0; i < boneCount; ++i)
+	{
+		XMVECTOR rotation = BlendRotation(XMLoadFloat4(&a[i].Rotation), XMLoadFloat4(&b[i].Rotation), weight);
+		XMVECTOR translation = XMVectorLerp(XMLoadFloat3(&a[i].Translation), XMLoadFloat3(&b[i].Translation), weight);
+		StoreBone(out[i], rotation, translation);
+	}
+}
+
+void Pose::BlendMasked(const BoneTransform* a, const BoneTransform* b, const float* boneMask, float weight, BoneTransform* out, uint32_t boneCount)
+{
+	for (uint32_t i = 0; i < boneCount; ++i)
+	{
+		float boneWeight = weight * boneMask[i];
+		if (boneWeight <= 0.0f)
+		{
+			out[i] = a[i];
+			continue;
+		}
+
+		XMVECTOR rotation = BlendRotation(XMLoadFloat4(&a[i].Rotation), XMLoadFloat4(&b[i].Rotation), boneWeight);
+		XMVECTOR translation = XMVectorLerp(XMLoadFloat3(&a[i].Translation), XMLoadFloat3(&b[i].Translation), boneWeight);
+		StoreBone(out[i], rotation, translation);
+	}
+}
+
+void Pose::AddAdditive(const BoneTransform* base, const BoneTransform* additive, float weight, BoneTransform* out, uint32_t boneCount)
+{
+	for (uint32_t i = 0; i < boneCount; ++i)
+	{
+		// Scale the delta rotation towards identity, then apply it before the base rotation
+		XMVECTOR delta = BlendRotation(XMQuaternionIdentity(), XMLoadFloat4(&additive[i].Rotation), weight);
+		XMVECTOR rotation = XMQuaternionNormalize(XMQuaternionMultiply(delta, XMLoadFloat4(&base[i].Rotation)));
+		XMVECTOR translation = XMVectorMultiplyAdd(XMLoadFloat3(&additive[i].Translation), XMVectorReplicate(weight), XMLoadFloat3(&base[i].Translation));
+		StoreBone(out[i], rotation, translation);
+	}
+}
+
+void Pose::MakeAdditive(const BoneTransform* pose, const BoneTransform* reference, BoneTransform* out, uint32_t boneCount)
+{
+	for (uint32_t i = 0; i < boneCount; ++i)
+	{
+		// delta * reference = pose, with the same ordering as AddAdditive
+		XMVECTOR inverse = XMQuaternionInverse(XMLoadFloat4(&reference[i].Rotation));
+		XMVECTOR rotation = XMQuaternionNormalize(XMQuaternionMultiply(XMLoadFloat4(&pose[i].Rotation), inverse));
+		XMVECTOR translation = XMVectorSubtract(XMLoadFloat3(&pose[i].Translation), XMLoadFloat3(&reference[i].Translation));
+		StoreBone(out[i], rotation, translation);
+	}
+}
+
+void Pose::LocalToModel(const BoneTransform* local, const int* parents, uint32_t boneCount, XMFLOAT4X4* out)
+{
+	for (uint32_t i = 0; i < boneCount; ++i)
+	{
+		XMMATRIX transform = XMMatrixRotationQuaternion(XMLoadFloat4(&local[i].Rotation));
+		transform.r[3] = XMVectorSetW(XMLoadFloat3(&local[i].Translation), 1.0f);
+
+		if (parents[i] >= 0)
+			transform = transform * XMLoadFloat4x4(&out[parents[i]]);
+
+		XMStoreFloat4x4(&out[i], transform);
+	}
+}
+
+AnimationClip::AnimationClip(uint32_t boneCount, uint32_t frameCount, float frameRate)
+{
+	m_boneCount = boneCount;
+	m_frameCount = frameCount;
+	m_frameRate = frameRate;
+	m_keys.resize((size_t)boneCount * frameCount);
+	for (uint32_t frame = 0; frame < frameCount; ++frame)
+	{
+		Pose::SetIdentity(GetFrame(frame), boneCount);
+	}
+}
+
+void AnimationClip::Sample(float time, BoneTransform* out) const
+{
+	float frame = fmodf(time * m_frameRate, (float)m_frameCount);
+	if (frame < 0.0f)
+		frame += m_frameCount;
+
+	uint32_t first = (uint32_t)frame % m_frameCount;
+	uint32_t second = (first + 1) % m_frameCount;
+	Pose::Blend(GetFrame(first), GetFrame(second), frame - floorf(frame), out, m_boneCount);
+}
+
+void AnimationClip::MakeAdditive(const BoneTransform* reference)
+{
+	for (uint32_t frame = 0; frame < m_frameCount; ++frame)
+	{
+		Pose::MakeAdditive(GetFrame(frame), reference, GetFrame(frame), m_boneCount);
+	}
+}
+
+AnimationClip* AnimationClip::CreateChainSwing(uint32_t boneCount, float boneLength, XMFLOAT3 axis, float amplitude, float cycles, uint32_t firstBone)
+{
+	const uint32_t frameCount = 30;
+	AnimationClip* pClip = new AnimationClip(boneCount, frameCount, (float)frameCount);
+
+	XMVECTOR swingAxis = XMVector3Normalize(XMLoadFloat3(&axis));
+	for (uint32_t frame = 0; frame < frameCount; ++frame)
+	{
+		float angle = amplitude * sinf(XM_2PI * cycles * frame / frameCount);
+		BoneTransform* pose = pClip->GetFrame(frame);
+		for (uint32_t bone = 0; bone < boneCount; ++bone)
+		{
+			XMVECTOR rotation = bone >= firstBone ? XMQuaternionRotationNormal(swingAxis, angle) : XMQuaternionIdentity();
+			StoreBone(pose[bone], rotation, XMVectorSet(0.0f, bone == 0 ? 0.0f : boneLength, 0.0f, 0.0f));
+		}
+	}
+	return pClip;
+}
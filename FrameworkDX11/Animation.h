@@ -0,0 +1,63 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace DirectX;
+
+// Local bone transform relative to its parent. Poses are plain arrays of these,
+// one entry per bone, so they can live in arena memory.
+struct BoneTransform
+{
+	XMFLOAT4	Rotation;
+	XMFLOAT3	Translation;
+	float		Padding;
+};
+
+namespace Pose
+{
+	void SetIdentity(BoneTransform* pose, uint32_t boneCount);
+	void Copy(const BoneTransform* source, BoneTransform* out, uint32_t boneCount);
+
+	// Normalised lerp from a to b, out may alias either input
+	void Blend(const BoneTransform* a, const BoneTransform* b, float weight, BoneTransform* out, uint32_t boneCount);
+
+	// As Blend, with the weight of every bone scaled by boneMask
+	void BlendMasked(const BoneTransform* a, const BoneTransform* b, const float* boneMask, float weight, BoneTransform* out, uint32_t boneCount);
+
+	// Applies a delta pose made by MakeAdditive on top of base
+	void AddAdditive(const BoneTransform* base, const BoneTransform* additive, float weight, BoneTransform* out, uint32_t boneCount);
+	void MakeAdditive(const BoneTransform* pose, const BoneTransform* reference, BoneTransform* out, uint32_t boneCount);
+
+	// Concatenates local transforms into model space. Parents must come before children.
+	void LocalToModel(const BoneTransform* local, const int* parents, uint32_t boneCount, XMFLOAT4X4* out);
+}
+
+// Looping clip stored as uniformly sampled key poses
+class AnimationClip
+{
+public:
+	AnimationClip(uint32_t boneCount, uint32_t frameCount, float frameRate);
+
+	BoneTransform* GetFrame(uint32_t frame) { return &m_keys[frame * m_boneCount]; }
+	const BoneTransform* GetFrame(uint32_t frame) const { return &m_keys[frame * m_boneCount]; }
+
+	void Sample(float time, BoneTransform* out) const;
+
+	// Turns every key into a delta from the reference pose
+	void MakeAdditive(const BoneTransform* reference);
+
+	// Procedural one second loop for a straight chain along Y: bones from firstBone
+	// onwards swing around axis by amplitude radians, cycles times per loop
+	static AnimationClip* CreateChainSwing(uint32_t boneCount, float boneLength, XMFLOAT3 axis, float amplitude, float cycles, uint32_t firstBone = 1);
+
+	uint32_t GetBoneCount() const { return m_boneCount; }
+	uint32_t GetFrameCount() const { return m_frameCount; }
+	float GetDuration() const { return m_frameCount / m_frameRate; }
+
+private:
+	std::vector<BoneTransform> m_keys;
+	uint32_t m_boneCount;
+	uint32_t m_frameCount;
+	float m_frameRate;
+};
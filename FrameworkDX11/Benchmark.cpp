@@ -0,0 +1,2687 @@
+#include "Benchmark.h"
+#include "BenchmarkScenario.h"
+#include "MicroBenchmark.h"
+#include "JobSystem.h"
+#include "Skinning.h"
+#include "BlendTree.h"
+#include "FrameArena.h"
+#include "IK.h"
+#include "SplineCurve.h"
+#include "CameraPath.h"
+#include "FrameTimer.h"
+#include "Profiler.h"
+#include "GpuProfiler.h"
+#include "FrameGraph.h"
+#include "RenderTargetFormats.h"
+#include "BloomKernel.h"
+#include "TiledBlur.h"
+#include "VelocityTiles.h"
+#include "LightClusters.h"
+#include "Culling.h"
+#include "ShadowCascades.h"
+#include "OcclusionCulling.h"
+#include "TerrainHeightmap.h"
+#include "StateCacheTable.h"
+#include "ConstantRing.h"
+#include "RenderQueue.h"
+#include "CommandRecorder.h"
+#include "ShaderCache.h"
+#include "ShaderPermutation.h"
+#include "ShaderReloader.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <thread>
+
+#define BENCHMARK_SKINNING_VERTICES (256 * 1024)
+#define BENCHMARK_SKINNING_ITERATIONS 20
+#define BENCHMARK_SKINNING_CHECK_VERTICES (3 * 1024 + 37)	// the last batch is a partial one
+#define BENCHMARK_SKINNING_TOLERANCE 1e-4f
+#define BENCHMARK_SKINNING_CLAMP_BONES 5
+#define BENCHMARK_ANIMATION_BONES 32
+#define BENCHMARK_ANIMATION_FRAMES 60
+#define BENCHMARK_ANIMATION_BUDGET_MS 2.0
+#define BENCHMARK_IK_CHAINS 4096
+#define BENCHMARK_IK_ITERATIONS 10
+#define BENCHMARK_IK_CCD_MAX_ITERATIONS 64
+#define BENCHMARK_IK_LIMIT_TOLERANCE 1e-4f	// in cosine
+#define BENCHMARK_SPLINE_CURVES 1000
+#define BENCHMARK_SPLINE_POINTS 256
+#define BENCHMARK_SPLINE_ITERATIONS 10
+#define BENCHMARK_FLYTHROUGH_CURVES 64
+#define BENCHMARK_REPLAY_STEPS 600
+#define BENCHMARK_STATE_DESCS 64
+#define BENCHMARK_STATE_LOOKUPS (1024 * 1024)
+#define BENCHMARK_STATE_CHECK_LOOKUPS 4096
+#define BENCHMARK_RING_CAPACITY (64 * 1024 + 100)	// not a multiple of the alignment
+#define BENCHMARK_RING_ALLOCATIONS (1024 * 1024)
+#define BENCHMARK_RING_MAX_SIZE 1024
+#define BENCHMARK_QUEUE_PACKETS 100000
+#define BENCHMARK_QUEUE_SHADERS 64
+#define BENCHMARK_QUEUE_MATERIALS 512
+#define BENCHMARK_QUEUE_MESHES 2048
+#define BENCHMARK_QUEUE_ITERATIONS 10
+#define BENCHMARK_RECORD_PASSES 32
+#define BENCHMARK_RECORD_DRAWS 4096
+#define BENCHMARK_RECORD_FRAMES 5
+#define BENCHMARK_SHADER_ENTRY_POINTS 16
+#define BENCHMARK_SHADER_COMPILE_MS 20.0
+#define BENCHMARK_PERMUTATION_LOOKUPS (1024 * 1024)
+#define BENCHMARK_RELOAD_POLL_MS 10
+#define BENCHMARK_RELOAD_FRAME_MS 4
+#define BENCHMARK_RELOAD_TIMEOUT_MS 2000
+#define BENCHMARK_TIMER_SECONDS 10.0
+#define BENCHMARK_TIMER_TICKS (1024 * 1024)
+#define BENCHMARK_PROFILER_ZONES (1024 * 1024)
+#define BENCHMARK_PROFILER_BATCH 8192
+#define BENCHMARK_PROFILER_JOBS 1024
+#define BENCHMARK_GPU_FRAMES 240
+#define BENCHMARK_GPU_FREQUENCY 1000000000ull
+#define BENCHMARK_GRAPH_COMPILES 10000
+#define BENCHMARK_GRAPH_SAMPLES 4
+#define BENCHMARK_BLOOM_WIDTH 960
+#define BENCHMARK_BLOOM_HEIGHT 540
+#define BENCHMARK_BLOOM_RADIUS 4
+#define BENCHMARK_BLOOM_OLD_RADIUS 10 // the old mouse blur's widest
+#define BENCHMARK_BLUR_WIDTH 1000 // not a multiple of the tile, the last group is partly empty
+#define BENCHMARK_BLUR_HEIGHT 563
+#define BENCHMARK_MOTION_BLUR_WIDTH 1920
+#define BENCHMARK_MOTION_BLUR_HEIGHT 1080
+#define BENCHMARK_MOTION_BLUR_REPEATS 20
+#define BENCHMARK_CLUSTER_LIGHTS MAX_CLUSTERED_LIGHTS
+#define BENCHMARK_CLUSTER_ITERATIONS 200
+#define BENCHMARK_CLUSTER_POINTS 100000
+#define BENCHMARK_SHADOW_CAMERAS 64
+#define BENCHMARK_SHADOW_CASTERS (16 * 1024)
+#define BENCHMARK_SHADOW_POINTS 10000
+#define BENCHMARK_SHADOW_ITERATIONS 1000
+#define BENCHMARK_OCCLUSION_BOXES 10000
+#define BENCHMARK_OCCLUSION_SAMPLES 16
+#define BENCHMARK_OCCLUSION_ITERATIONS 100
+#define BENCHMARK_OCCLUSION_TERRAIN_SCALE 0.1f	// the scene's terrain transform
+#define BENCHMARK_OCCLUSION_TERRAIN_Y -6.5f
+
+static const unsigned g_benchmarkThreadCounts[] = { 1, 2, 4, 8, 16 };
+static const unsigned g_benchmarkCharacterCounts[] = { 1, 10, 100, 1000 };
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+static double SecondsSince(BenchmarkClock::time_point start)
+{
+	return std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+}
+
+// A correctness check reported as 1 or 0
+static BenchmarkResult CheckResult(const std::string& name, unsigned threads, bool passed)
+{
+	return { name, threads, passed ? 1.0 : 0.0, "bool", passed ? BENCHMARK_CHECK_PASSED : BENCHMARK_CHECK_FAILED };
+}
+
+// A correctness check counting what went wrong, passed only at zero
+static BenchmarkResult ErrorCountResult(const std::string& name, unsigned threads, size_t errors, const std::string& unit)
+{
+	return { name, threads, (double)errors, unit, errors == 0 ? BENCHMARK_CHECK_PASSED : BENCHMARK_CHECK_FAILED };
+}
+
+static float RandomFloat(float minimum, float maximum)
+{
+	return minimum + (maximum - minimum) * rand() / (float)RAND_MAX;
+}
+
+bool Benchmark::IsRequested(const std::string& commandLine)
+{
+	return commandLine.find("-benchmark") != std::string::npos || commandLine.find("-scenario") != std::string::npos ||
+		commandLine.find("-micro") != std::string::npos;
+}
+
+std::string Benchmark::GetArgument(const std::string& commandLine, const std::string& name, const std::string& fallback)
+{
+	std::istringstream stream(commandLine);
+	std::string token;
+	while (stream >> token)
+	{
+		if (token == name && stream >> token)
+			return token;
+	}
+	return fallback;
+}
+
+int Benchmark::Run(const std::string& commandLine)
+{
+	if (commandLine.find("-scenario") != std::string::npos)
+		return ScenarioRunner::Run(commandLine);
+	if (commandLine.find("-micro") != std::string::npos)
+		return MicroBenchmark::Run(commandLine);
+
+	std::string name = GetArgument(commandLine, "-benchmark", "all");
+	std::string path = GetArgument(commandLine, "-out", "benchmark_results.csv");
+	std::string framesPath = GetArgument(commandLine, "-frames", "flythrough_frames.csv");
+
+	std::vector<BenchmarkResult> results;
+	if (name == "all" || name == "skinning")
+		SkinningBenchmark(results);
+	if (name == "all" || name == "animation")
+		AnimationBenchmark(results);
+	if (name == "all" || name == "ik")
+		IKBenchmark(results);
+	if (name == "all" || name == "spline")
+		SplineBenchmark(results);
+	if (name == "all" || name == "states")
+		StateCacheBenchmark(results);
+	if (name == "all" || name == "constantring")
+		ConstantRingBenchmark(results);
+	if (name == "all" || name == "queue")
+		RenderQueueBenchmark(results);
+	if (name == "all" || name == "record")
+		CommandRecordingBenchmark(results);
+	if (name == "all" || name == "shadercache")
+		ShaderCacheBenchmark(results);
+	if (name == "all" || name == "permutations")
+		ShaderPermutationBenchmark(results);
+	if (name == "all" || name == "hotreload")
+		HotReloadBenchmark(results);
+	if (name == "all" || name == "frametimer")
+		FrameTimerBenchmark(results);
+	if (name == "all" || name == "profiler")
+		ProfilerBenchmark(results);
+	if (name == "all" || name == "gpuprofiler")
+		GpuProfilerBenchmark(results);
+	if (name == "all" || name == "framegraph")
+		FrameGraphBenchmark(results);
+	if (name == "all" || name == "rtformats")
+		RenderTargetFormatBenchmark(results);
+	if (name == "all" || name == "bloom")
+		BloomBenchmark(results);
+	if (name == "all" || name == "computeblur")
+		TiledBlurBenchmark(results);
+	if (name == "all" || name == "motionblur")
+		MotionBlurBenchmark(results);
+	if (name == "all" || name == "lightclusters")
+		LightClusterBenchmark(results);
+	if (name == "all" || name == "shadows")
+		ShadowBenchmark(results);
+	if (name == "all" || name == "occlusion")
+		OcclusionBenchmark(results);
+	if (name == "all" || name == "flythrough")
+		FlythroughBenchmark(results, framesPath);
+
+	if (results.empty())
+	{
+		fprintf(stderr, "Unknown benchmark: %s\n", name.c_str());
+		return 1;
+	}
+
+	int failures = 0;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		if (results[i].Check == BENCHMARK_CHECK_FAILED)
+		{
+			fprintf(stderr, "Check failed: %s = %.3f %s\n", results[i].Name.c_str(), results[i].Value, results[i].Unit.c_str());
+			++failures;
+		}
+	}
+
+	if (!WriteResults(path, results))
+		return 1;
+	return failures ? 1 : 0;
+}
+
+bool Benchmark::WriteResults(const std::string& path, const std::vector<BenchmarkResult>& results)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	// check is empty for a measurement
+	const char* checks[] = { "", "passed", "failed" };
+	fprintf(file, "name,threads,value,unit,check\n");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& r = results[i];
+		fprintf(file, "%s,%u,%.3f,%s,%s\n", r.Name.c_str(), r.Threads, r.Value, r.Unit.c_str(), checks[r.Check]);
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool Benchmark::WriteFrameTimings(const std::string& path, const std::vector<FrameTiming>& frames)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "frame,time,eye_x,eye_y,eye_z,cpu_ms\n");
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		const FrameTiming& f = frames[i];
+		fprintf(file, "%u,%.4f,%.4f,%.4f,%.4f,%.4f\n", f.Frame, f.Time, f.Eye[0], f.Eye[1], f.Eye[2], f.CpuMilliseconds);
+	}
+
+	fclose(file);
+	return true;
+}
+
+// Scalar per-vertex skinning to check the four-lane kernels against
+static void TransformReference(const float m[4][4], const XMFLOAT3& in, float w, XMFLOAT3& out, bool normalize)
+{
+	const float v[3] = { in.x, in.y, in.z };
+	float r[3];
+	for (int c = 0; c < 3; ++c)
+	{
+		r[c] = v[0] * m[0][c] + v[1] * m[1][c] + v[2] * m[2][c] + w * m[3][c];
+	}
+	float scale = normalize ? 1.0f / sqrtf(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]) : 1.0f;
+	out = XMFLOAT3(r[0] * scale, r[1] * scale, r[2] * scale);
+}
+
+static void SkinLinearBlendReference(const SkinnedVertex& v, const XMFLOAT4X4* transforms, SimpleVertex& out)
+{
+	const float weights[MAX_BONE_INFLUENCES] = { v.BoneWeights.x, v.BoneWeights.y, v.BoneWeights.z, v.BoneWeights.w };
+	float blended[4][4] = {};
+	for (int k = 0; k < MAX_BONE_INFLUENCES; ++k)
+	{
+		for (int r = 0; r < 4; ++r)
+			for (int c = 0; c < 4; ++c)
+				blended[r][c] += weights[k] * transforms[v.BoneIndices[k]].m[r][c];
+	}
+
+	TransformReference(blended, v.Pos, 1.0f, out.Pos, false);
+	TransformReference(blended, v.Normal, 0.0f, out.Normal, true);
+	TransformReference(blended, v.Tangent, 0.0f, out.Tangent, true);
+	TransformReference(blended, v.BiTangent, 0.0f, out.BiTangent, true);
+	out.TexCoord = v.TexCoord;
+}
+
+// v + 2w(q x v) + 2q x (q x v) for the unit quaternion q = (x, y, z, w)
+static XMFLOAT3 RotateReference(const float q[4], const XMFLOAT3& in)
+{
+	const float v[3] = { in.x, in.y, in.z };
+	const float t[3] = { 2.0f * (q[1] * v[2] - q[2] * v[1]), 2.0f * (q[2] * v[0] - q[0] * v[2]), 2.0f * (q[0] * v[1] - q[1] * v[0]) };
+	return XMFLOAT3(v[0] + q[3] * t[0] + q[1] * t[2] - q[2] * t[1],
+		v[1] + q[3] * t[1] + q[2] * t[0] - q[0] * t[2],
+		v[2] + q[3] * t[2] + q[0] * t[1] - q[1] * t[0]);
+}
+
+static void SkinDualQuaternionReference(const SkinnedVertex& v, const SkinningPalette& palette, SimpleVertex& out)
+{
+	const float weights[MAX_BONE_INFLUENCES] = { v.BoneWeights.x, v.BoneWeights.y, v.BoneWeights.z, v.BoneWeights.w };
+	const XMFLOAT4& pivot = palette.DualQuaternions[v.BoneIndices[0] * 2];
+	float real[4] = {};
+	float dual[4] = {};
+	for (int k = 0; k < MAX_BONE_INFLUENCES; ++k)
+	{
+		const XMFLOAT4& r = palette.DualQuaternions[v.BoneIndices[k] * 2 + 0];
+		const XMFLOAT4& d = palette.DualQuaternions[v.BoneIndices[k] * 2 + 1];
+		float w = r.x * pivot.x + r.y * pivot.y + r.z * pivot.z + r.w * pivot.w < 0.0f ? -weights[k] : weights[k];
+		const float rk[4] = { r.x, r.y, r.z, r.w };
+		const float dk[4] = { d.x, d.y, d.z, d.w };
+		for (int i = 0; i < 4; ++i)
+		{
+			real[i] += w * rk[i];
+			dual[i] += w * dk[i];
+		}
+	}
+
+	float invLength = 1.0f / sqrtf(real[0] * real[0] + real[1] * real[1] + real[2] * real[2] + real[3] * real[3]);
+	for (int i = 0; i < 4; ++i)
+	{
+		real[i] *= invLength;
+		dual[i] *= invLength;
+	}
+
+	// t = 2 * (w_r * d.xyz - w_d * r.xyz + r.xyz x d.xyz)
+	const float translation[3] = {
+		2.0f * (real[3] * dual[0] - dual[3] * real[0] + real[1] * dual[2] - real[2] * dual[1]),
+		2.0f * (real[3] * dual[1] - dual[3] * real[1] + real[2] * dual[0] - real[0] * dual[2]),
+		2.0f * (real[3] * dual[2] - dual[3] * real[2] + real[0] * dual[1] - real[1] * dual[0]) };
+
+	XMFLOAT3 pos = RotateReference(real, v.Pos);
+	out.Pos = XMFLOAT3(pos.x + translation[0], pos.y + translation[1], pos.z + translation[2]);
+	out.Normal = RotateReference(real, v.Normal);
+	out.Tangent = RotateReference(real, v.Tangent);
+	out.BiTangent = RotateReference(real, v.BiTangent);
+	out.TexCoord = v.TexCoord;
+}
+
+static float MaxVertexError(const SimpleVertex& a, const SimpleVertex& b)
+{
+	const float* pA = &a.Pos.x;
+	const float* pB = &b.Pos.x;
+	float error = 0.0f;
+	for (size_t i = 0; i < sizeof(SimpleVertex) / sizeof(float); ++i)
+	{
+		error = std::max(error, fabsf(pA[i] - pB[i]));
+	}
+	return error;
+}
+
+void Benchmark::SkinningBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Random rigid bone transforms and four random influences per vertex
+	srand(1);
+	XMFLOAT4X4 transforms[MAX_BONES];
+	for (int i = 0; i < MAX_BONES; ++i)
+	{
+		XMVECTOR axis = XMVector3Normalize(XMVectorSet(rand() / (float)RAND_MAX + 0.1f, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, 0.0f));
+		XMMATRIX m = XMMatrixRotationAxis(axis, rand() / (float)RAND_MAX * XM_PI) * XMMatrixTranslation((float)(i % 4), (float)(i / 4), 0.0f);
+		XMStoreFloat4x4(&transforms[i], m);
+	}
+
+	SkinningPalette palette;
+	Skinning::BuildPalette(transforms, MAX_BONES, palette);
+
+	std::vector<SkinnedVertex> bindPose(BENCHMARK_SKINNING_VERTICES);
+	for (size_t i = 0; i < bindPose.size(); ++i)
+	{
+		SkinnedVertex& v = bindPose[i];
+		v.Pos = XMFLOAT3(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX);
+		v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		v.TexCoord = XMFLOAT2(0.0f, 0.0f);
+		v.Tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		v.BiTangent = XMFLOAT3(0.0f, 0.0f, 1.0f);
+
+		float total = 0.0f;
+		float weights[MAX_BONE_INFLUENCES];
+		for (int k = 0; k < MAX_BONE_INFLUENCES; ++k)
+		{
+			v.BoneIndices[k] = (uint8_t)(rand() % MAX_BONES);
+			weights[k] = rand() / (float)RAND_MAX + 0.01f;
+			total += weights[k];
+		}
+		v.BoneWeights = XMFLOAT4(weights[0] / total, weights[1] / total, weights[2] / total, weights[3] / total);
+	}
+
+	std::vector<SimpleVertex> output(bindPose.size());
+
+	const SkinningMode modes[] = { LinearBlendSkinning, DualQuaternionSkinning };
+	const char* names[] = { "skinning_lbs", "skinning_dqs" };
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+		for (int m = 0; m < 2; ++m)
+		{
+			// Warm up caches and wake the workers before timing
+			Skinning::SkinVertices(bindPose.data(), output.data(), bindPose.size(), palette, modes[m], &jobs);
+
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			for (int i = 0; i < BENCHMARK_SKINNING_ITERATIONS; ++i)
+			{
+				Skinning::SkinVertices(bindPose.data(), output.data(), bindPose.size(), palette, modes[m], &jobs);
+			}
+			double seconds = SecondsSince(start);
+
+			double verticesPerSecond = (double)bindPose.size() * BENCHMARK_SKINNING_ITERATIONS / seconds;
+			results.push_back({ names[m], threads, verticesPerSecond, "vertices/s" });
+		}
+	}
+
+	// Against the scalar reference, over a count that leaves a partial batch at the
+	// end, with a sentinel after the last vertex that must not be written
+	const size_t checkCount = BENCHMARK_SKINNING_CHECK_VERTICES;
+	JobSystem jobs(4);
+	for (int m = 0; m < 2; ++m)
+	{
+		const XMFLOAT3 marker(FLT_MAX, FLT_MAX, FLT_MAX);
+		const SimpleVertex sentinel = { marker, marker, XMFLOAT2(FLT_MAX, FLT_MAX), marker, marker };
+		std::vector<SimpleVertex> skinned(checkCount + 1, sentinel);
+		Skinning::SkinVertices(bindPose.data(), skinned.data(), checkCount, palette, modes[m], &jobs);
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < checkCount; ++i)
+		{
+			SimpleVertex reference;
+			if (modes[m] == LinearBlendSkinning)
+				SkinLinearBlendReference(bindPose[i], transforms, reference);
+			else
+				SkinDualQuaternionReference(bindPose[i], palette, reference);
+			maxError = std::max(maxError, MaxVertexError(skinned[i], reference));
+		}
+
+		bool untouched = MaxVertexError(skinned[checkCount], sentinel) == 0.0f;
+		results.push_back({ std::string(names[m]) + "_max_error", 4, maxError * 1e6,
+			"1e-6 units", maxError <= BENCHMARK_SKINNING_TOLERANCE ? BENCHMARK_CHECK_PASSED : BENCHMARK_CHECK_FAILED });
+		results.push_back(CheckResult(std::string(names[m]) + "_stops_at_count", 4, untouched));
+	}
+
+	// Indices past a smaller skeleton clamp to its last bone and then skin as that bone
+	const uint32_t boneCount = BENCHMARK_SKINNING_CLAMP_BONES;
+	SkinningPalette smallPalette;
+	Skinning::BuildPalette(transforms, boneCount, smallPalette);
+	std::vector<SkinnedVertex> outOfRange(bindPose.begin(), bindPose.begin() + 2);
+	outOfRange[0].BoneIndices[1] = 70;
+	outOfRange[1].BoneIndices[3] = 200;
+	std::vector<SkinnedVertex> expected(outOfRange);
+	size_t expectedClamps = 0;
+	for (SkinnedVertex& v : expected)
+	{
+		for (int k = 0; k < MAX_BONE_INFLUENCES; ++k)
+		{
+			if (v.BoneIndices[k] >= boneCount)
+			{
+				v.BoneIndices[k] = boneCount - 1;
+				++expectedClamps;
+			}
+		}
+	}
+	size_t clamps = Skinning::ClampBoneIndices(outOfRange.data(), outOfRange.size(), boneCount);
+
+	bool clamped = clamps == expectedClamps;
+	for (size_t i = 0; i < outOfRange.size(); ++i)
+	{
+		clamped = clamped && memcmp(outOfRange[i].BoneIndices, expected[i].BoneIndices, sizeof(expected[i].BoneIndices)) == 0;
+	}
+	for (int m = 0; m < 2; ++m)
+	{
+		std::vector<SimpleVertex> skinned(outOfRange.size());
+		Skinning::SkinVertices(outOfRange.data(), skinned.data(), outOfRange.size(), smallPalette, modes[m]);
+		for (size_t i = 0; i < outOfRange.size(); ++i)
+		{
+			SimpleVertex reference;
+			if (modes[m] == LinearBlendSkinning)
+				SkinLinearBlendReference(expected[i], transforms, reference);
+			else
+				SkinDualQuaternionReference(expected[i], smallPalette, reference);
+			clamped = clamped && MaxVertexError(skinned[i], reference) <= BENCHMARK_SKINNING_TOLERANCE;
+		}
+	}
+	results.push_back(CheckResult("skinning_bone_indices_clamped", 1, clamped));
+}
+
+void Benchmark::AnimationBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Locomotion style 2D blend space of three clips with an additive layer on top
+	const uint32_t bones = BENCHMARK_ANIMATION_BONES;
+	AnimationClip* pIdle = AnimationClip::CreateChainSwing(bones, 0.25f, { 0.0f, 0.0f, 1.0f }, 0.05f, 1.0f);
+	AnimationClip* pWalk = AnimationClip::CreateChainSwing(bones, 0.25f, { 1.0f, 0.0f, 0.0f }, 0.4f, 2.0f);
+	AnimationClip* pStrafe = AnimationClip::CreateChainSwing(bones, 0.25f, { 0.0f, 0.0f, 1.0f }, 0.4f, 2.0f);
+	AnimationClip* pBreathe = AnimationClip::CreateChainSwing(bones, 0.25f, { 0.0f, 1.0f, 0.0f }, 0.1f, 1.0f);
+	pBreathe->MakeAdditive(pIdle->GetFrame(0));
+
+	BlendTree tree(bones);
+	int space = tree.AddBlend2D(0, 1, { tree.AddClip(pIdle), tree.AddClip(pWalk), tree.AddClip(pStrafe) },
+		{ XMFLOAT2(0.0f, 0.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT2(1.0f, 0.0f) });
+	tree.SetRoot(tree.AddAdditive(space, tree.AddClip(pBreathe), 2));
+
+	std::vector<int> parents(bones);
+	for (uint32_t i = 0; i < bones; ++i)
+	{
+		parents[i] = (int)i - 1;
+	}
+
+	unsigned maxCharacters = g_benchmarkCharacterCounts[sizeof(g_benchmarkCharacterCounts) / sizeof(g_benchmarkCharacterCounts[0]) - 1];
+	FrameArena arena(maxCharacters * bones * (sizeof(BoneTransform) * 4 + sizeof(XMFLOAT4X4)) + 64 * 1024);
+
+	srand(1);
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+		for (unsigned characters : g_benchmarkCharacterCounts)
+		{
+			std::vector<AnimationInstance> instances(characters);
+			for (size_t i = 0; i < instances.size(); ++i)
+			{
+				AnimationInstance& instance = instances[i];
+				instance = {};
+				instance.pTree = &tree;
+				instance.pParents = parents.data();
+				instance.Parameters[0] = rand() / (float)RAND_MAX;
+				instance.Parameters[1] = rand() / (float)RAND_MAX;
+				instance.Parameters[2] = 1.0f;
+				instance.Speed = 0.8f + 0.4f * rand() / (float)RAND_MAX;
+			}
+
+			double worst = 0.0;
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			for (int frame = 0; frame < BENCHMARK_ANIMATION_FRAMES; ++frame)
+			{
+				BenchmarkClock::time_point frameStart = BenchmarkClock::now();
+				arena.Reset();
+				Animation::EvaluateInstances(instances.data(), instances.size(), 1.0f / 60.0f, arena, &jobs);
+				worst = std::max(worst, SecondsSince(frameStart));
+			}
+			double averageMs = SecondsSince(start) * 1000.0 / BENCHMARK_ANIMATION_FRAMES;
+
+			std::string name = "animation_" + std::to_string(characters);
+			results.push_back({ name + "_avg", threads, averageMs, "ms/frame" });
+			results.push_back({ name + "_worst", threads, worst * 1000.0, "ms/frame" });
+			results.push_back({ name + "_in_budget", threads, worst * 1000.0 <= BENCHMARK_ANIMATION_BUDGET_MS ? 1.0 : 0.0, "bool" });
+		}
+	}
+
+	delete pIdle;
+	delete pWalk;
+	delete pStrafe;
+	delete pBreathe;
+}
+
+void Benchmark::IKBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Legs for the two-bone solver, four bone chains for CCD and FABRIK
+	const uint32_t jointCounts[] = { 3, 5, 5 };
+	const char* names[] = { "ik_two_bone", "ik_ccd", "ik_fabrik" };
+	// Below the rates documented on IKSettings, with room for a different rand()
+	const double minConverged[] = { 1.0, 0.95, 0.9 };
+
+	srand(1);
+	for (int solver = 0; solver < 3; ++solver)
+	{
+		uint32_t joints = jointCounts[solver];
+		IKChainSet rest(BENCHMARK_IK_CHAINS, joints);
+		for (uint32_t chain = 0; chain < BENCHMARK_IK_CHAINS; ++chain)
+		{
+			XMFLOAT3 positions[MAX_IK_JOINTS];
+			for (uint32_t j = 0; j < joints; ++j)
+			{
+				positions[j] = XMFLOAT3(0.0f, -(float)j, 0.0f);
+			}
+			rest.SetChain(chain, positions);
+
+			// Somewhere reachable under the root, like a foot on uneven ground
+			float reach = (joints - 1) * (0.75f + 0.2f * rand() / (float)RAND_MAX);
+			rest.SetTarget(chain, XMFLOAT3(0.3f * rand() / (float)RAND_MAX, -reach, 0.3f * rand() / (float)RAND_MAX));
+		}
+		for (uint32_t j = 1; j < joints; ++j)
+		{
+			rest.SetJointLimit(j, XM_PIDIV2);
+		}
+
+		for (unsigned threads : g_benchmarkThreadCounts)
+		{
+			JobSystem jobs(threads);
+			IKSettings settings;
+			if (solver == 1)
+				settings.MaxIterations = BENCHMARK_IK_CCD_MAX_ITERATIONS;
+
+			double seconds = 0.0;
+			uint32_t converged = 0;
+			for (int i = 0; i < BENCHMARK_IK_ITERATIONS; ++i)
+			{
+				// Every pass starts from the same rest pose
+				IKChainSet chains = rest;
+				BenchmarkClock::time_point start = BenchmarkClock::now();
+				if (solver == 0)
+					converged = IK::SolveTwoBone(chains, settings, &jobs);
+				else if (solver == 1)
+					converged = IK::SolveCCD(chains, settings, &jobs);
+				else
+					converged = IK::SolveFABRIK(chains, settings, &jobs);
+				seconds += SecondsSince(start);
+			}
+
+			results.push_back({ names[solver], threads, (double)BENCHMARK_IK_CHAINS * BENCHMARK_IK_ITERATIONS / seconds, "chains/s" });
+			double fraction = (double)converged / BENCHMARK_IK_CHAINS;
+			results.push_back({ std::string(names[solver]) + "_converged", threads, fraction, "fraction",
+				fraction >= minConverged[solver] ? BENCHMARK_CHECK_PASSED : BENCHMARK_CHECK_FAILED });
+		}
+
+		// Every solved bend stays inside its joint's cone
+		IKChainSet chains = rest;
+		IKSettings settings;
+		settings.MaxIterations = solver == 1 ? BENCHMARK_IK_CCD_MAX_ITERATIONS : settings.MaxIterations;
+		if (solver == 0)
+			IK::SolveTwoBone(chains, settings);
+		else if (solver == 1)
+			IK::SolveCCD(chains, settings);
+		else
+			IK::SolveFABRIK(chains, settings);
+
+		size_t outside = 0;
+		for (uint32_t chain = 0; chain < BENCHMARK_IK_CHAINS; ++chain)
+		{
+			XMFLOAT3 positions[MAX_IK_JOINTS];
+			chains.GetChain(chain, positions);
+			for (uint32_t j = 1; j + 1 < joints; ++j)
+			{
+				XMVECTOR parent = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&positions[j]), XMLoadFloat3(&positions[j - 1])));
+				XMVECTOR child = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&positions[j + 1]), XMLoadFloat3(&positions[j])));
+				outside += XMVectorGetX(XMVector3Dot(parent, child)) < chains.GetJointLimitCos(j) - BENCHMARK_IK_LIMIT_TOLERANCE;
+			}
+		}
+		results.push_back(ErrorCountResult(std::string(names[solver]) + "_outside_limits", 1, outside, "joints"));
+	}
+}
+
+void Benchmark::SplineBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Closed loops of random wobbly control points, one curve per path or rope
+	srand(1);
+	std::vector<SplineCurve> curves(BENCHMARK_SPLINE_CURVES);
+	std::vector<const SplineCurve*> curvePointers;
+	for (SplineCurve& curve : curves)
+	{
+		std::vector<XMFLOAT3> points;
+		for (int i = 0; i < 12; ++i)
+		{
+			float angle = XM_2PI * i / 11.0f;
+			float radius = 4.0f + rand() / (float)RAND_MAX;
+			points.push_back(XMFLOAT3(radius * cosf(angle), rand() / (float)RAND_MAX, radius * sinf(angle)));
+		}
+		curve.SetControlPoints(points);
+		curvePointers.push_back(&curve);
+	}
+
+	const size_t pointCount = (size_t)BENCHMARK_SPLINE_CURVES * BENCHMARK_SPLINE_POINTS;
+	std::vector<XMFLOAT3> output(pointCount);
+
+	// Scalar reference, one Evaluate call per point
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (int i = 0; i < BENCHMARK_SPLINE_ITERATIONS; ++i)
+	{
+		for (size_t c = 0; c < curves.size(); ++c)
+		{
+			float step = (float)curves[c].GetSegmentCount() / (BENCHMARK_SPLINE_POINTS - 1);
+			for (uint32_t p = 0; p < BENCHMARK_SPLINE_POINTS; ++p)
+			{
+				XMStoreFloat3(&output[c * BENCHMARK_SPLINE_POINTS + p], curves[c].Evaluate(p * step));
+			}
+		}
+	}
+	results.push_back({ "spline_scalar", 1, (double)pointCount * BENCHMARK_SPLINE_ITERATIONS / SecondsSince(start), "points/s" });
+
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+		start = BenchmarkClock::now();
+		for (int i = 0; i < BENCHMARK_SPLINE_ITERATIONS; ++i)
+		{
+			SplineMath::EvaluateCurves(curvePointers.data(), curvePointers.size(), BENCHMARK_SPLINE_POINTS, output.data(), &jobs);
+		}
+		results.push_back({ "spline_simd", threads, (double)pointCount * BENCHMARK_SPLINE_ITERATIONS / SecondsSince(start), "points/s" });
+	}
+
+	// Arc-length table against a dense polyline of the same curve
+	float worstError = 0.0f;
+	for (int c = 0; c < 10; ++c)
+	{
+		SplineCurve& curve = curves[c];
+		const uint32_t samples = 100000;
+		float step = (float)curve.GetSegmentCount() / samples;
+		float reference = 0.0f;
+		XMVECTOR previous = curve.Evaluate(0.0f);
+		for (uint32_t i = 1; i <= samples; ++i)
+		{
+			XMVECTOR point = curve.Evaluate(i * step);
+			reference += XMVectorGetX(XMVector3Length(XMVectorSubtract(point, previous)));
+			previous = point;
+		}
+		worstError = std::max(worstError, fabsf(curve.GetLength() - reference) / reference);
+	}
+	results.push_back({ "spline_arclength_error", 1, worstError * 1e6, "ppm" });
+
+	// Adaptive tessellation as seen from a typical camera distance
+	SplineTessellationSettings settings;
+	settings.CameraPosition = XMFLOAT3(0.0f, 5.0f, -15.0f);
+	std::vector<XMFLOAT3> polyline;
+	size_t vertexCount = 0;
+	start = BenchmarkClock::now();
+	for (SplineCurve& curve : curves)
+	{
+		polyline.clear();
+		curve.Tessellate(settings, polyline);
+		vertexCount += polyline.size();
+	}
+	results.push_back({ "spline_tessellate", 1, (double)curves.size() / SecondsSince(start), "curves/s" });
+	results.push_back({ "spline_tessellate_vertices", 1, (double)vertexCount / curves.size(), "vertices/curve" });
+}
+
+// Same size and layout as D3D11_RASTERIZER_DESC, so the lookup cost matches the real cache
+struct BenchmarkStateDesc
+{
+	int32_t		FillMode;
+	int32_t		CullMode;
+	int32_t		FrontCounterClockwise;
+	int32_t		DepthBias;
+	float		DepthBiasClamp;
+	float		SlopeScaledDepthBias;
+	int32_t		DepthClipEnable;
+	int32_t		ScissorEnable;
+	int32_t		MultisampleEnable;
+	int32_t		AntialiasedLineEnable;
+};
+
+// Puts every descriptor in one bucket, so lookups only succeed by comparing descriptors
+struct BenchmarkCollidingHash
+{
+	size_t operator()(const BenchmarkStateDesc&) const { return 0; }
+};
+
+// Looks up descs in order through a table whose fake create function counts calls
+// per descriptor, and counts everything that went wrong: a descriptor created other
+// than once, or a lookup handed another descriptor's state
+template <typename TTable>
+static size_t CountStateCacheErrors(TTable& table, const std::vector<BenchmarkStateDesc>& descs, const std::vector<uint32_t>& order)
+{
+	// Each state is the index of the descriptor it was made from
+	std::vector<int> states(descs.size());
+	std::vector<uint32_t> creations(descs.size(), 0);
+	auto create = [&](const BenchmarkStateDesc& desc)
+	{
+		int index = desc.DepthBias;
+		++creations[index];
+		states[index] = index;
+		return &states[index];
+	};
+
+	size_t errors = 0;
+	std::vector<bool> used(descs.size(), false);
+	for (uint32_t index : order)
+	{
+		int* pState = table.Get(descs[index], create);
+		errors += !pState || *pState != (int)index;
+		used[index] = true;
+	}
+
+	size_t distinct = 0;
+	for (size_t i = 0; i < descs.size(); ++i)
+	{
+		errors += creations[i] != (used[i] ? 1u : 0u);
+		distinct += used[i];
+	}
+	errors += table.GetCreations() != distinct;
+	errors += table.GetHits() != order.size() - distinct;
+	return errors;
+}
+
+void Benchmark::StateCacheBenchmark(std::vector<BenchmarkResult>& results)
+{
+	std::vector<BenchmarkStateDesc> descs(BENCHMARK_STATE_DESCS);
+	for (int i = 0; i < BENCHMARK_STATE_DESCS; ++i)
+	{
+		BenchmarkStateDesc& d = descs[i];
+		memset(&d, 0, sizeof(d));
+		d.FillMode = 2 + (i & 1);
+		d.CullMode = 1 + (i >> 1) % 3;
+		d.DepthBias = i;
+		d.DepthClipEnable = 1;
+	}
+
+	// Stand-in for the device: hands out a fresh slot per creation
+	std::vector<int> states(BENCHMARK_STATE_DESCS);
+	size_t created = 0;
+	auto create = [&](const BenchmarkStateDesc&) { return &states[created++]; };
+
+	StateCacheTable<BenchmarkStateDesc, int> table;
+	srand(1);
+	std::vector<uint32_t> order(BENCHMARK_STATE_LOOKUPS);
+	for (uint32_t& index : order)
+	{
+		index = rand() % BENCHMARK_STATE_DESCS;
+	}
+
+	size_t found = 0;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (uint32_t index : order)
+	{
+		found += table.Get(descs[index], create) != nullptr;
+	}
+	double seconds = SecondsSince(start);
+
+	results.push_back({ "state_cache_lookup", 1, found / seconds, "lookups/s" });
+	results.push_back({ "state_cache_creations", 1, (double)table.GetCreations(), "states" });
+	results.push_back({ "state_cache_hits", 1, (double)table.GetHits(), "lookups" });
+
+	// Device free checks through the fake create function, over part of the descriptors
+	// so some are never looked up, then with every hash equal
+	std::vector<uint32_t> checkOrder(order.begin(), order.begin() + BENCHMARK_STATE_CHECK_LOOKUPS);
+	for (uint32_t& index : checkOrder)
+	{
+		index %= BENCHMARK_STATE_DESCS / 2;
+	}
+	StateCacheTable<BenchmarkStateDesc, int> checkTable;
+	results.push_back(ErrorCountResult("state_cache_errors", 1, CountStateCacheErrors(checkTable, descs, checkOrder), "errors"));
+	StateCacheTable<BenchmarkStateDesc, int, BenchmarkCollidingHash> collidingTable;
+	results.push_back(ErrorCountResult("state_cache_colliding_hash_errors", 1, CountStateCacheErrors(collidingTable, descs, checkOrder), "errors"));
+}
+
+void Benchmark::ConstantRingBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Object constant sizes from a float4x4 up to a skinning palette's worth
+	srand(1);
+	std::vector<uint32_t> sizes(BENCHMARK_RING_ALLOCATIONS);
+	for (uint32_t& size : sizes)
+	{
+		size = 16 + rand() % BENCHMARK_RING_MAX_SIZE;
+	}
+
+	ConstantRingAllocator ring(BENCHMARK_RING_CAPACITY);
+	size_t allocated = 0;
+	bool wrapped;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (uint32_t size : sizes)
+	{
+		allocated += ring.Allocate(size, wrapped) != ~0u;
+	}
+	double seconds = SecondsSince(start);
+	results.push_back({ "constant_ring_allocate", 1, allocated / seconds, "allocations/s" });
+
+	// Headless checks against a head tracked here: the capacity is truncated to the
+	// alignment, the first allocation discards, offsets are aligned and in range, and
+	// the ring wraps exactly when the head would run past the end
+	size_t errors = 0;
+	ring.Reset(BENCHMARK_RING_CAPACITY);
+	const uint32_t capacity = BENCHMARK_RING_CAPACITY - BENCHMARK_RING_CAPACITY % CONSTANT_RING_ALIGNMENT;
+	errors += ring.GetCapacity() != capacity;
+
+	uint32_t head = capacity;
+	for (size_t i = 0; i < sizes.size(); ++i)
+	{
+		uint32_t aligned = (sizes[i] + CONSTANT_RING_ALIGNMENT - 1) / CONSTANT_RING_ALIGNMENT * CONSTANT_RING_ALIGNMENT;
+		bool expectWrap = head + aligned > capacity;
+		if (expectWrap)
+			head = 0;
+
+		uint32_t offset = ring.Allocate(sizes[i], wrapped);
+		errors += offset != head || wrapped != expectWrap || (i == 0 && !wrapped);
+		errors += offset % CONSTANT_RING_ALIGNMENT != 0 || offset + aligned > capacity;
+		head += aligned;
+	}
+
+	// Too large for the whole ring fails without touching the head
+	uint32_t headBefore = ring.GetHead();
+	errors += ring.Allocate(capacity + 1, wrapped) != ~0u || wrapped || ring.GetHead() != headBefore;
+	errors += ring.Allocate(capacity, wrapped) != 0 || !wrapped;
+
+	// Less than one aligned block leaves nothing to hand out
+	ring.Reset(CONSTANT_RING_ALIGNMENT - 1);
+	errors += ring.GetCapacity() != 0 || ring.Allocate(1, wrapped) != ~0u;
+
+	results.push_back(ErrorCountResult("constant_ring_errors", 1, errors, "errors"));
+}
+
+
+// Stand-in for the device: counts binds and folds the packets so nothing is optimised away
+class BenchmarkRenderBackend : public RenderBackend
+{
+public:
+	void BindShader(uint32_t shader) { ++Binds; Checksum += shader; }
+	void BindMaterial(uint32_t material) { ++Binds; Checksum += material; }
+	void BindMesh(uint32_t mesh) { ++Binds; Checksum += mesh; }
+	void BindObject(uint32_t object) { ++Binds; Checksum += object; }
+	void Draw(const RenderPacket& packet) { ++Draws; Checksum += packet.VertexCount; }
+
+	uint64_t Binds = 0;
+	uint64_t Draws = 0;
+	uint64_t Checksum = 0;
+};
+
+void Benchmark::RenderQueueBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// A scene's worth of draws in submission order: objects share meshes, materials and shaders
+	srand(1);
+	std::vector<RenderPacket> packets(BENCHMARK_QUEUE_PACKETS);
+	for (uint32_t i = 0; i < BENCHMARK_QUEUE_PACKETS; ++i)
+	{
+		RenderPacket& p = packets[i];
+		p.Shader = rand() % BENCHMARK_QUEUE_SHADERS;
+		p.Material = rand() % BENCHMARK_QUEUE_MATERIALS;
+		p.Mesh = rand() % BENCHMARK_QUEUE_MESHES;
+		p.Object = i / 4;
+		p.VertexCount = 36 + (p.Mesh & 255);
+		p.StartVertex = 0;
+
+		uint32_t pass = (i % 8) == 0 ? 1 : 0;
+		RenderLayer layer = (i % 16) == 1 ? RenderLayerTransparent : RenderLayerOpaque;
+		uint32_t depth = DrawKey::QuantizeDepth((float)(rand() % 10000) * 0.01f, 100.0f);
+		p.Key = DrawKey::Make(pass, layer, p.Shader, p.Material, depth);
+	}
+
+	RenderQueue queue;
+	queue.Reserve(BENCHMARK_QUEUE_PACKETS);
+	double submitSeconds = 0.0;
+	double sortSeconds = 0.0;
+	double executeSeconds = 0.0;
+	BenchmarkRenderBackend backend;
+	RenderStateFilter filter;
+	for (int iteration = 0; iteration < BENCHMARK_QUEUE_ITERATIONS; ++iteration)
+	{
+		queue.Clear();
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (const RenderPacket& packet : packets)
+		{
+			queue.Submit(packet);
+		}
+		submitSeconds += SecondsSince(start);
+
+		start = BenchmarkClock::now();
+		queue.Sort();
+		sortSeconds += SecondsSince(start);
+
+		backend = BenchmarkRenderBackend();
+		filter.Reset();
+		filter.ResetStats();
+		start = BenchmarkClock::now();
+		queue.Execute(backend, filter);
+		executeSeconds += SecondsSince(start);
+	}
+
+	// Comparison sort of the same keys for reference
+	std::vector<uint64_t> keys(BENCHMARK_QUEUE_PACKETS);
+	double stdSortSeconds = 0.0;
+	for (int iteration = 0; iteration < BENCHMARK_QUEUE_ITERATIONS; ++iteration)
+	{
+		for (size_t i = 0; i < packets.size(); ++i)
+		{
+			keys[i] = packets[i].Key;
+		}
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		std::stable_sort(keys.begin(), keys.end());
+		stdSortSeconds += SecondsSince(start);
+	}
+
+	// Every sorted key must match the comparison sort, and equal keys keep submission order
+	size_t orderErrors = 0;
+	for (size_t i = 0; i < queue.GetSize(); ++i)
+	{
+		const RenderPacket& packet = queue.GetSorted(i);
+		if (packet.Key != keys[i])
+			++orderErrors;
+		else if (i > 0 && packet.Key == queue.GetSorted(i - 1).Key && &packet < &queue.GetSorted(i - 1))
+			++orderErrors;
+	}
+
+	// The same packets unsorted, to show what the sort saves
+	RenderStateFilter unsortedFilter;
+	for (const RenderPacket& packet : packets)
+	{
+		unsortedFilter.Filter(packet);
+	}
+	const RenderQueueStats& sorted = filter.GetStats();
+	const RenderQueueStats& unsorted = unsortedFilter.GetStats();
+
+	double scale = 1000.0 / BENCHMARK_QUEUE_ITERATIONS;
+	results.push_back({ "queue_submit", 1, submitSeconds * scale, "ms" });
+	results.push_back({ "queue_radix_sort", 1, sortSeconds * scale, "ms" });
+	results.push_back({ "queue_std_sort", 1, stdSortSeconds * scale, "ms" });
+	results.push_back({ "queue_execute", 1, executeSeconds * scale, "ms" });
+	results.push_back(ErrorCountResult("queue_order_errors", 1, orderErrors, "packets"));
+	results.push_back({ "queue_binds_sorted", 1, (double)(sorted.ShaderBinds + sorted.MaterialBinds + sorted.MeshBinds), "binds" });
+	results.push_back({ "queue_binds_unsorted", 1, (double)(unsorted.ShaderBinds + unsorted.MaterialBinds + unsorted.MeshBinds), "binds" });
+	results.push_back({ "queue_shader_binds_sorted", 1, (double)sorted.ShaderBinds, "binds" });
+	results.push_back({ "queue_shader_binds_unsorted", 1, (double)unsorted.ShaderBinds, "binds" });
+	results.push_back({ "queue_draws", 1, (double)backend.Draws, "draws" });
+}
+
+// Replays sorted packets into the mock command backend, one command per bind or draw
+class BenchmarkLogRenderBackend : public RenderBackend
+{
+public:
+	void BindShader(uint32_t shader) { pLog->Emit(Recorder, 0x10000000 | shader); }
+	void BindMaterial(uint32_t material) { pLog->Emit(Recorder, 0x20000000 | material); }
+	void BindMesh(uint32_t mesh) { pLog->Emit(Recorder, 0x30000000 | mesh); }
+	void BindObject(uint32_t object) { pLog->Emit(Recorder, 0x40000000 | object); }
+	void Draw(const RenderPacket& packet) { pLog->Emit(Recorder, packet.VertexCount); }
+
+	LogCommandBackend* pLog = nullptr;
+	uint32_t Recorder = 0;
+};
+
+// Per recorder state, like RecordingContext without the device
+struct BenchmarkRecorder
+{
+	RenderQueue					Queue;
+	RenderStateFilter			Filter;
+	BenchmarkLogRenderBackend	Backend;
+};
+
+void Benchmark::CommandRecordingBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Every pass sorts and replays its own draws, as DrawScene does on each recording context
+	srand(1);
+	std::vector<std::vector<RenderPacket>> passPackets(BENCHMARK_RECORD_PASSES);
+	for (std::vector<RenderPacket>& packets : passPackets)
+	{
+		packets.resize(BENCHMARK_RECORD_DRAWS);
+		for (uint32_t i = 0; i < BENCHMARK_RECORD_DRAWS; ++i)
+		{
+			RenderPacket& p = packets[i];
+			p.Shader = rand() % BENCHMARK_QUEUE_SHADERS;
+			p.Material = rand() % BENCHMARK_QUEUE_MATERIALS;
+			p.Mesh = rand() % BENCHMARK_QUEUE_MESHES;
+			p.Object = i;
+			p.VertexCount = 36 + (p.Mesh & 255);
+			p.StartVertex = 0;
+			p.Key = DrawKey::Make(0, RenderLayerOpaque, p.Shader, p.Material, rand() % (1 << DRAW_KEY_DEPTH_BITS));
+		}
+	}
+
+	std::vector<uint32_t> reference;
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+		LogCommandBackend log(threads);
+		std::vector<BenchmarkRecorder> recorders(threads);
+		for (unsigned r = 0; r < threads; ++r)
+		{
+			recorders[r].Backend.pLog = &log;
+			recorders[r].Backend.Recorder = r;
+		}
+
+		CommandRecorder recorder(&log, &jobs);
+		double seconds = 0.0;
+		size_t orderErrors = 0;
+		for (int frame = 0; frame < BENCHMARK_RECORD_FRAMES; ++frame)
+		{
+			for (uint32_t pass = 0; pass < BENCHMARK_RECORD_PASSES; ++pass)
+			{
+				recorder.AddPass("pass", [&, pass](uint32_t r)
+				{
+					BenchmarkRecorder& state = recorders[r];
+					state.Queue.Clear();
+					for (const RenderPacket& packet : passPackets[pass])
+					{
+						state.Queue.Submit(packet);
+					}
+					state.Filter.Reset();
+					state.Queue.Execute(state.Backend, state.Filter);
+				});
+			}
+
+			log.ClearExecuted();
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			recorder.Flush();
+			seconds += SecondsSince(start);
+
+			// The single thread run is the reference order every other run must match
+			if (reference.empty())
+				reference = log.GetExecuted();
+			const std::vector<uint32_t>& executed = log.GetExecuted();
+			orderErrors += executed.size() != reference.size();
+			for (size_t i = 0; i < executed.size() && i < reference.size(); ++i)
+			{
+				orderErrors += executed[i] != reference[i];
+			}
+		}
+
+		double milliseconds = seconds * 1000.0 / BENCHMARK_RECORD_FRAMES;
+		results.push_back({ "record_frame", threads, milliseconds, "ms" });
+		results.push_back({ "record_draws", threads, BENCHMARK_RECORD_PASSES * BENCHMARK_RECORD_DRAWS / (milliseconds * 0.001), "draws/s" });
+		results.push_back(ErrorCountResult("record_order_errors", threads, orderErrors, "commands"));
+	}
+}
+
+// Cold and warm startup through the cache with the fake compiler, plus the cases
+// that must miss (edited include, changed define, new compiler) and a damaged file
+void Benchmark::ShaderCacheBenchmark(std::vector<BenchmarkResult>& results)
+{
+	MemoryShaderCompiler compiler(BENCHMARK_SHADER_COMPILE_MS);
+	compiler.SetFile("shaders/shader.fx", "#include \"common.fxh\"\nfloat4 PS() : SV_TARGET { return 0; }\n");
+	compiler.SetFile("shaders/common.fxh", "#include \"lighting.fxh\"\ncbuffer Frame : register(b0) {}\n");
+	compiler.SetFile("shaders/lighting.fxh", "#include \"common.fxh\"\nfloat3 Light;\n");
+
+	std::vector<ShaderCompileRequest> requests(BENCHMARK_SHADER_ENTRY_POINTS);
+	for (int i = 0; i < BENCHMARK_SHADER_ENTRY_POINTS; ++i)
+	{
+		requests[i] = { "shaders/shader.fx", "Entry" + std::to_string(i), i & 1 ? "ps_5_0" : "vs_5_0", {}, 0 };
+	}
+
+	std::string saved;
+	std::vector<ShaderCompileResult> compiled;
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+
+		ShaderCache cold(&compiler);
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		bool coldSucceeded = cold.Compile(requests, compiled, &jobs);
+		results.push_back({ "shader_cache_cold", threads, SecondsSince(start) * 1000.0, "ms" });
+
+		std::ostringstream out;
+		cold.Save(out);
+		saved = out.str();
+
+		// Warm start: load the file and fetch the same batch, nothing may compile
+		uint32_t compiles = compiler.GetCompileCount();
+		start = BenchmarkClock::now();
+		ShaderCache warm(&compiler);
+		std::istringstream in(saved);
+		warm.Load(in);
+		std::vector<ShaderCompileResult> loaded;
+		bool warmSucceeded = warm.Compile(requests, loaded, &jobs);
+		results.push_back({ "shader_cache_warm", threads, SecondsSince(start) * 1000.0, "ms" });
+
+		size_t mismatches = coldSucceeded && warmSucceeded ? 0 : requests.size();
+		for (size_t i = 0; i < loaded.size(); ++i)
+		{
+			mismatches += !loaded[i].FromCache || loaded[i].Bytecode != compiled[i].Bytecode;
+		}
+		results.push_back({ "shader_cache_warm_compiles", threads, (double)(compiler.GetCompileCount() - compiles), "compiles" });
+		results.push_back(ErrorCountResult("shader_cache_warm_mismatches", threads, mismatches, "shaders"));
+	}
+
+	// Everything below must miss exactly the expected shaders
+	auto countMisses = [&](ShaderCache& cache, const std::vector<ShaderCompileRequest>& batch)
+	{
+		cache.ResetStats();
+		std::vector<ShaderCompileResult> batchResults;
+		cache.Compile(batch, batchResults, nullptr);
+		return (double)cache.GetStats().Misses;
+	};
+	MemoryShaderCompiler fast;
+	fast.SetFile("shaders/shader.fx", "#include \"common.fxh\"\nfloat4 PS() : SV_TARGET { return 0; }\n");
+	fast.SetFile("shaders/common.fxh", "cbuffer Frame : register(b0) {}\n");
+	ShaderCache cache(&fast);
+	countMisses(cache, requests);
+
+	fast.SetFile("shaders/common.fxh", "cbuffer Frame : register(b1) {}\n");
+	results.push_back({ "shader_cache_include_edit_misses", 1, countMisses(cache, requests), "shaders" });
+
+	std::vector<ShaderCompileRequest> defined = requests;
+	defined[0].Defines.push_back({ "USE_TEXTURE", "1" });
+	results.push_back({ "shader_cache_define_misses", 1, countMisses(cache, defined), "shaders" });
+
+	fast.SetVersion(2);
+	results.push_back({ "shader_cache_version_misses", 1, countMisses(cache, requests), "shaders" });
+
+	// Stale keys from the edits above go when a loaded cache is pruned to one batch
+	std::ostringstream out;
+	cache.Save(out);
+	ShaderCache pruned(&fast);
+	std::istringstream in(out.str());
+	pruned.Load(in);
+	countMisses(pruned, requests);
+	pruned.RemoveUnused();
+	results.push_back({ "shader_cache_pruned_entries", 1, (double)pruned.GetEntryCount(), "entries" });
+
+	// Flip a byte in the last blob: the entries before it load, the damaged one recompiles
+	std::ostringstream prunedOut;
+	pruned.Save(prunedOut);
+	std::string damaged = prunedOut.str();
+	damaged[damaged.size() - 1] ^= 0xff;
+	ShaderCache reloaded(&fast);
+	std::istringstream damagedIn(damaged);
+	reloaded.Load(damagedIn);
+	results.push_back({ "shader_cache_damaged_entries_kept", 1, (double)reloaded.GetEntryCount(), "entries" });
+	results.push_back({ "shader_cache_damaged_misses", 1, countMisses(reloaded, requests), "shaders" });
+}
+
+// Index packing for every feature mask, lazy table creation, the valid scene variants
+// and the lookup rate DrawScene pays per object instead of a constant upload
+void Benchmark::ShaderPermutationBenchmark(std::vector<BenchmarkResult>& results)
+{
+	const uint32_t allFeatures = (1u << SHADER_FEATURE_COUNT) - 1;
+	size_t indexErrors = 0;
+	for (uint32_t mask = 0; mask <= allFeatures; ++mask)
+	{
+		uint32_t count = ShaderPermutation::GetVariantCount(mask);
+		for (uint32_t features = 0; features <= allFeatures; ++features)
+		{
+			uint32_t index = ShaderPermutation::GetIndex(features, mask);
+			indexErrors += index >= count || ShaderPermutation::GetFeatures(index, mask) != (features & mask);
+		}
+	}
+	results.push_back(ErrorCountResult("permutation_index_errors", 1, indexErrors, "keys"));
+
+	// The scene pixel shader: terrain times the five material modes
+	const uint32_t sceneMask = ShaderFeatureTerrain | SHADER_FEATURES_MATERIAL;
+	uint32_t validVariants = 0;
+	std::vector<std::string> defineSets;
+	for (uint32_t i = 0; i < ShaderPermutation::GetVariantCount(sceneMask); ++i)
+	{
+		uint32_t features = ShaderPermutation::GetFeatures(i, sceneMask);
+		if (!ShaderPermutation::IsValid(features))
+			continue;
+		++validVariants;
+
+		std::vector<ShaderDefine> defines;
+		ShaderPermutation::GetDefines(features, defines);
+		std::string joined;
+		for (const ShaderDefine& define : defines)
+		{
+			joined += define.Name + "=" + define.Value + ";";
+		}
+		defineSets.push_back(joined);
+	}
+	std::sort(defineSets.begin(), defineSets.end());
+	size_t uniqueDefineSets = std::unique(defineSets.begin(), defineSets.end()) - defineSets.begin();
+	results.push_back({ "permutation_scene_variants", 1, (double)validVariants, "variants" });
+	results.push_back({ "permutation_unique_define_sets", 1, (double)uniqueDefineSets, "variants" });
+
+	// Depth only draws go with or without the terrain and nothing else
+	bool depthOnlyValid = ShaderPermutation::IsValid(ShaderFeatureDepthOnly) && ShaderPermutation::IsValid(ShaderFeatureDepthOnly | ShaderFeatureTerrain) &&
+		!ShaderPermutation::IsValid(ShaderFeatureDepthOnly | ShaderFeatureVelocity) && !ShaderPermutation::IsValid(ShaderFeatureDepthOnly | ShaderFeatureNormalMap);
+	results.push_back(CheckResult("permutation_depth_only_valid", 1, depthOnlyValid));
+
+	// Bits outside the mask (the blur direction here) must land on the same slot
+	ShaderPermutationTable<uint32_t> table(sceneMask);
+	uint32_t created = 0;
+	auto create = [&](uint32_t features, uint32_t& value) { value = features; ++created; return true; };
+	srand(1);
+	std::vector<uint32_t> order(BENCHMARK_PERMUTATION_LOOKUPS);
+	for (uint32_t& features : order)
+	{
+		features = ShaderPermutation::GetMaterialFeatures(rand() % 5) | (rand() & 1 ? ShaderFeatureTerrain : 0) | (rand() & 1 ? ShaderFeatureHorizontal : 0);
+	}
+
+	size_t wrongVariants = 0;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (uint32_t features : order)
+	{
+		uint32_t value = 0;
+		table.Get(features, value, create);
+		wrongVariants += value != (features & sceneMask);
+	}
+	double seconds = SecondsSince(start);
+
+	results.push_back({ "permutation_lookup", 1, BENCHMARK_PERMUTATION_LOOKUPS / seconds, "lookups/s" });
+	results.push_back({ "permutation_creations", 1, (double)table.GetCreations(), "variants" });
+	results.push_back({ "permutation_wrong_variants", 1, (double)wrongVariants, "lookups" });
+}
+
+// Edits sources while a stand-in frame loop takes reloads, the way Render does. Only
+// the entry points that use the edited file may recompile, and the loop must never wait.
+void Benchmark::HotReloadBenchmark(std::vector<BenchmarkResult>& results)
+{
+	MemoryShaderCompiler compiler(BENCHMARK_SHADER_COMPILE_MS);
+	compiler.SetFile("shaders/shader.fx", "#include \"common.fxh\"\nfloat4 PS() : SV_TARGET { return 0; }\n");
+	compiler.SetFile("shaders/common.fxh", "cbuffer Frame : register(b0) {}\n");
+	compiler.SetFile("shaders/quad.fx", "float4 PS() : SV_TARGET { return 1; }\n");
+
+	// Slots 0-2 include common.fxh, 3-4 don't
+	ShaderReloader reloader(&compiler);
+	const char* entryPoints[] = { "VS", "HS", "PS" };
+	for (const char* entryPoint : entryPoints)
+	{
+		reloader.Watch({ "shaders/shader.fx", entryPoint, "ps_5_0", {}, 0 });
+	}
+	reloader.Watch({ "shaders/quad.fx", "RTT_VS", "vs_5_0", {}, 0 });
+	reloader.Watch({ "shaders/quad.fx", "RTT_PS", "ps_5_0", {}, 0 });
+	reloader.Scan();
+	reloader.Start(BENCHMARK_RELOAD_POLL_MS);
+
+	double maxTakeMilliseconds = 0.0;
+	double latencyMilliseconds = 0.0;
+	uint32_t swaps = 0;
+	uint32_t unrelated = 0;
+	uint32_t failuresWithErrors = 0;
+
+	// Frames until the expected slots have all come back, plus a few polls for strays
+	auto runFrames = [&](const std::string& file, const std::string& source, uint32_t firstSlot, uint32_t slotCount)
+	{
+		BenchmarkClock::time_point edited = BenchmarkClock::now();
+		compiler.SetFile(file, source);
+
+		uint32_t received = 0;
+		BenchmarkClock::time_point settled = BenchmarkClock::time_point::max();
+		while (SecondsSince(edited) * 1000.0 < BENCHMARK_RELOAD_TIMEOUT_MS)
+		{
+			if (received >= slotCount && settled == BenchmarkClock::time_point::max())
+				settled = BenchmarkClock::now();
+			if (settled != BenchmarkClock::time_point::max() && SecondsSince(settled) * 1000.0 > 4 * BENCHMARK_RELOAD_POLL_MS)
+				break;
+
+			std::vector<ShaderReload> reloads;
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			reloader.TakeReloads(reloads);
+			maxTakeMilliseconds = std::max(maxTakeMilliseconds, SecondsSince(start) * 1000.0);
+
+			for (const ShaderReload& reload : reloads)
+			{
+				if (reload.Slot < firstSlot || reload.Slot >= firstSlot + slotCount)
+				{
+					++unrelated;
+					continue;
+				}
+				++received;
+				if (!reload.Result.Succeeded)
+				{
+					failuresWithErrors += !reload.Result.Errors.empty();
+					continue;
+				}
+				++swaps;
+				latencyMilliseconds += SecondsSince(edited) * 1000.0;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(BENCHMARK_RELOAD_FRAME_MS));
+		}
+		return (double)received;
+	};
+
+	results.push_back({ "hot_reload_file_edit_reloads", 1, runFrames("shaders/quad.fx", "float4 PS() : SV_TARGET { return 2; }\n", 3, 2), "shaders" });
+	results.push_back({ "hot_reload_include_edit_reloads", 1, runFrames("shaders/common.fxh", "cbuffer Frame : register(b1) {}\n", 0, 3), "shaders" });
+	runFrames("shaders/quad.fx", "#error broken\n", 3, 2);
+	reloader.Stop();
+
+	results.push_back({ "hot_reload_unrelated_reloads", 1, (double)unrelated, "shaders" });
+	results.push_back({ "hot_reload_failures_with_errors", 1, (double)failuresWithErrors, "shaders" });
+	results.push_back({ "hot_reload_change_to_swap", 1, swaps ? latencyMilliseconds / swaps : 0.0, "ms" });
+	results.push_back({ "hot_reload_take_max", 1, maxTakeMilliseconds, "ms" });
+}
+
+// Drives the fixed step with uneven frame times the way Render does. Simulated time
+// must track real time, a stall must drop steps instead of spiralling, and the
+// interpolated camera must move at an even speed where the stepped one stutters.
+void Benchmark::FrameTimerBenchmark(std::vector<BenchmarkResult>& results)
+{
+	FrameTimer timer(CAMERA_PATH_TIMESTEP);
+	CameraPathPlayer player;
+	CameraInputFrame forward = { 0.0f, 0.0f, CameraKeyForward };
+
+	srand(1);
+	double now = 0.0;
+	timer.Tick(now);
+	size_t alphaErrors = 0;
+	double steppedError = 0.0;
+	double interpolatedError = 0.0;
+	uint32_t frames = 0;
+	XMFLOAT3 lastStepped = player.GetPose().Eye;
+	XMFLOAT3 lastInterpolated = player.GetInterpolatedPose(0.0f).Eye;
+	while (now < BENCHMARK_TIMER_SECONDS)
+	{
+		// 4 to 20 ms frames, faster and slower than the 60 Hz step
+		double delta = 0.004 + rand() / (double)RAND_MAX * 0.016;
+		now += delta;
+		uint32_t steps = timer.Tick(now);
+		double alpha = timer.GetAlpha();
+		alphaErrors += alpha < 0.0 || alpha >= 1.0;
+		player.RunSteps(steps, forward);
+
+		// Distance covered this frame against what the real time should have covered
+		XMFLOAT3 stepped = player.GetPose().Eye;
+		XMFLOAT3 interpolated = player.GetInterpolatedPose((float)alpha).Eye;
+		double expected = CAMERA_MOVE_SPEED * delta;
+		steppedError += fabs((stepped.z - lastStepped.z) - expected);
+		interpolatedError += fabs((interpolated.z - lastInterpolated.z) - expected);
+		lastStepped = stepped;
+		lastInterpolated = interpolated;
+		++frames;
+	}
+
+	double drift = fabs(now - (timer.GetSimulatedTime() + timer.GetAlpha() * timer.GetFixedStep()));
+	results.push_back({ "frame_timer_steps", 1, (double)timer.GetStats().Steps, "steps" });
+	results.push_back({ "frame_timer_drift", 1, drift * 1000.0, "ms" });
+	results.push_back(ErrorCountResult("frame_timer_alpha_errors", 1, alphaErrors, "frames"));
+	results.push_back({ "frame_timer_stepped_motion_error", 1, steppedError / frames * 1000.0, "mm/frame" });
+	results.push_back({ "frame_timer_interpolated_motion_error", 1, interpolatedError / frames * 1000.0, "mm/frame" });
+
+	FrameTimerStats stats = timer.GetStats();
+	results.push_back({ "frame_timer_p99", 1, stats.P99Milliseconds, "ms" });
+
+	// A one second hitch: only FRAME_TIMER_MAX_STEPS run, the rest are dropped
+	now += 1.0;
+	uint32_t stallSteps = timer.Tick(now);
+	results.push_back({ "frame_timer_stall_steps", 1, (double)stallSteps, "steps" });
+	results.push_back({ "frame_timer_stall_dropped", 1, (double)timer.GetStats().DroppedSteps, "steps" });
+
+	// What the main loop pays per frame to read the clock and tick
+	FrameTimer clockTimer(CAMERA_PATH_TIMESTEP);
+	uint64_t totalSteps = 0;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (int i = 0; i < BENCHMARK_TIMER_TICKS; ++i)
+	{
+		totalSteps += clockTimer.Tick(FrameTimer::Now());
+	}
+	double seconds = SecondsSince(start);
+	results.push_back({ "frame_timer_tick", 1, seconds / BENCHMARK_TIMER_TICKS * 1e9, "ns" });
+	results.push_back({ "frame_timer_tick_steps", 1, (double)totalSteps, "steps" });
+}
+
+// Zone cost, the tree built from a known nesting, zones from worker threads, ring
+// overflow and the trace export
+void Benchmark::ProfilerBenchmark(std::vector<BenchmarkResult>& results)
+{
+	Profiler::EndFrame();
+
+	double seconds = 0.0;
+	for (int batch = 0; batch < BENCHMARK_PROFILER_ZONES / BENCHMARK_PROFILER_BATCH; ++batch)
+	{
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (int i = 0; i < BENCHMARK_PROFILER_BATCH; ++i)
+		{
+			PROFILE_ZONE("Empty");
+		}
+		seconds += SecondsSince(start);
+		Profiler::EndFrame();
+	}
+	results.push_back({ "profiler_zone", 1, seconds / BENCHMARK_PROFILER_ZONES * 1e9, "ns" });
+
+	// Frame { Update { Animate x3 }, Draw { Animate } }: Animate under Draw stays apart
+	{
+		PROFILE_ZONE("Frame");
+		{
+			PROFILE_ZONE("Update");
+			for (int i = 0; i < 3; ++i)
+			{
+				PROFILE_ZONE("Animate");
+			}
+		}
+		{
+			PROFILE_ZONE("Draw");
+			PROFILE_ZONE("Animate");
+		}
+	}
+	Profiler::EndFrame();
+	const std::vector<ProfilerNode>& tree = Profiler::GetFrameTree();
+	const char* expectedNames[] = { "Frame", "Update", "Animate", "Draw", "Animate" };
+	const uint32_t expectedDepths[] = { 0, 1, 2, 1, 2 };
+	const int32_t expectedParents[] = { -1, 0, 1, 0, 3 };
+	const uint32_t expectedCalls[] = { 1, 1, 3, 1, 1 };
+	size_t treeErrors = tree.size() == 5 ? 0 : 1;
+	for (size_t i = 0; i < tree.size() && i < 5; ++i)
+	{
+		treeErrors += strcmp(tree[i].Name, expectedNames[i]) != 0 || tree[i].Depth != expectedDepths[i] ||
+			tree[i].Parent != expectedParents[i] || tree[i].Calls != expectedCalls[i] || tree[i].SelfMilliseconds < -1e-6;
+	}
+	results.push_back(ErrorCountResult("profiler_tree_errors", 1, treeErrors, "nodes"));
+
+	// Zones from every worker, merged into one node per name
+	JobSystem jobs(4);
+	{
+		PROFILE_ZONE("Jobs");
+		jobs.ParallelFor(BENCHMARK_PROFILER_JOBS, 16, [](size_t begin, size_t end, unsigned)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				PROFILE_ZONE("Job");
+			}
+		});
+	}
+	uint64_t droppedBefore = Profiler::GetDroppedEvents();
+	size_t collected = Profiler::EndFrame();
+	size_t jobCalls = 0;
+	for (const ProfilerNode& node : Profiler::GetFrameTree())
+	{
+		if (strcmp(node.Name, "Job") == 0)
+			jobCalls += node.Calls;
+	}
+	results.push_back({ "profiler_thread_zones", jobs.GetThreadCount(), (double)collected, "zones" });
+	results.push_back({ "profiler_thread_job_calls", jobs.GetThreadCount(), (double)jobCalls, "zones" });
+
+	// Nothing drains the ring here, so everything past its size is dropped
+	for (int i = 0; i < PROFILER_RING_EVENTS + 1000; ++i)
+	{
+		PROFILE_ZONE("Overflow");
+	}
+	uint64_t dropped = Profiler::GetDroppedEvents() - droppedBefore;
+	Profiler::EndFrame();
+	results.push_back({ "profiler_overflow_dropped", 1, (double)dropped, "zones" });
+
+	// One complete event per zone in the trace
+	std::ostringstream trace;
+	Profiler::WriteChromeTrace(trace, Profiler::GetFrameEvents());
+	std::string json = trace.str();
+	size_t completeEvents = 0;
+	for (size_t found = json.find("\"ph\":\"X\""); found != std::string::npos; found = json.find("\"ph\":\"X\"", found + 1))
+	{
+		++completeEvents;
+	}
+	results.push_back({ "profiler_trace_events", 1, (double)completeEvents, "zones" });
+	results.push_back({ "profiler_trace_bytes", 1, (double)json.size(), "bytes" });
+}
+
+// The query ring against a fake GPU: pass times must come back exact, frames must
+// be skipped rather than waited on when the GPU falls further behind than the ring,
+// and disjoint frames must be thrown away
+void Benchmark::GpuProfilerBenchmark(std::vector<BenchmarkResult>& results)
+{
+	const uint64_t ticksPerMillisecond = BENCHMARK_GPU_FREQUENCY / 1000;
+
+	// Passes go through the recorder the way Render adds them
+	auto runFrames = [](GpuProfiler& profiler, int frames)
+	{
+		LogCommandBackend backend(1);
+		CommandRecorder recorder(&backend, nullptr);
+		recorder.SetGpuProfiler(&profiler);
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			profiler.BeginFrame();
+			recorder.AddPass("Scene", [](uint32_t) {});
+			recorder.AddPass("Screen Quad", [](uint32_t) {});
+			recorder.Flush();
+			profiler.EndFrame();
+		}
+	};
+
+	// The fake clock only moves between timestamps, so advance it as each pass executes
+	class TimedBackend : public GpuQueryBackend
+	{
+	public:
+		TimedBackend(FakeGpuQueryBackend* pFake, uint64_t ticksPerMillisecond) : m_pFake(pFake), m_ticks(ticksPerMillisecond) {}
+		void BeginFrame(uint32_t slot) { m_query = 0; m_pFake->BeginFrame(slot); }
+		void EndFrame(uint32_t slot) { m_pFake->EndFrame(slot); }
+		void Timestamp(uint32_t slot, uint32_t query)
+		{
+			// Frame begin, Scene 2 ms, Screen Quad 0.5 ms, then 0.25 ms to the end of the frame
+			static const uint64_t quarters[] = { 0, 0, 8, 0, 2, 1 };
+			m_pFake->Advance(quarters[std::min<uint32_t>(m_query++, 5)] * m_ticks / 4);
+			m_pFake->Timestamp(slot, query);
+		}
+		bool GetFrameData(uint32_t slot, uint64_t& frequency, bool& disjoint) { return m_pFake->GetFrameData(slot, frequency, disjoint); }
+		bool GetTimestamp(uint32_t slot, uint32_t query, uint64_t& ticks) { return m_pFake->GetTimestamp(slot, query, ticks); }
+
+	private:
+		FakeGpuQueryBackend* m_pFake;
+		uint64_t m_ticks;
+		uint32_t m_query = 0;
+	};
+
+	// GPU two frames behind a three slot ring: every frame measured, read two frames late
+	{
+		FakeGpuQueryBackend fake(GPU_PROFILER_LATENCY, 2, BENCHMARK_GPU_FREQUENCY);
+		TimedBackend queries(&fake, ticksPerMillisecond);
+		GpuProfiler profiler(&queries);
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		runFrames(profiler, BENCHMARK_GPU_FRAMES);
+		double seconds = SecondsSince(start);
+
+		const GpuProfilerStats& stats = profiler.GetStats();
+		const GpuZoneTiming* pScene = profiler.FindZone("Scene");
+		const GpuZoneTiming* pQuad = profiler.FindZone("Screen Quad");
+		const GpuZoneTiming* pFrame = profiler.FindZone("Frame");
+		results.push_back({ "gpu_profiler_resolved", 1, (double)stats.FramesResolved, "frames" });
+		results.push_back({ "gpu_profiler_skipped", 1, (double)stats.FramesSkipped, "frames" });
+		results.push_back({ "gpu_profiler_latency", 1, (double)stats.Latency, "frames" });
+		results.push_back({ "gpu_profiler_scene", 1, pScene ? pScene->AverageMilliseconds : -1.0, "ms" });
+		results.push_back({ "gpu_profiler_screen_quad", 1, pQuad ? pQuad->AverageMilliseconds : -1.0, "ms" });
+		results.push_back({ "gpu_profiler_frame", 1, pFrame ? pFrame->AverageMilliseconds : -1.0, "ms" });
+		results.push_back({ "gpu_profiler_cpu_per_frame", 1, seconds / BENCHMARK_GPU_FRAMES * 1e6, "us" });
+	}
+
+	// Four frames behind: the ring runs out, so frames go unmeasured but nothing waits
+	{
+		FakeGpuQueryBackend fake(GPU_PROFILER_LATENCY, 4, BENCHMARK_GPU_FREQUENCY);
+		TimedBackend queries(&fake, ticksPerMillisecond);
+		GpuProfiler profiler(&queries);
+		runFrames(profiler, BENCHMARK_GPU_FRAMES);
+		results.push_back({ "gpu_profiler_slow_gpu_resolved", 1, (double)profiler.GetStats().FramesResolved, "frames" });
+		results.push_back({ "gpu_profiler_slow_gpu_skipped", 1, (double)profiler.GetStats().FramesSkipped, "frames" });
+	}
+
+	// One disjoint frame is counted and contributes no samples
+	{
+		FakeGpuQueryBackend fake(GPU_PROFILER_LATENCY, 2, BENCHMARK_GPU_FREQUENCY);
+		TimedBackend queries(&fake, ticksPerMillisecond);
+		GpuProfiler profiler(&queries);
+		runFrames(profiler, 10);
+		fake.SetNextDisjoint(true);
+		runFrames(profiler, 10);
+		const GpuZoneTiming* pScene = profiler.FindZone("Scene");
+		results.push_back({ "gpu_profiler_disjoint", 1, (double)profiler.GetStats().FramesDisjoint, "frames" });
+		results.push_back({ "gpu_profiler_disjoint_scene", 1, pScene ? pScene->AverageMilliseconds : -1.0, "ms" });
+	}
+}
+
+// Same passes and targets as BuildFrameGraph in main.cpp, less the shadow map passes,
+// which write an imported texture and allocate nothing
+static void BuildPostGraph(FrameGraph& graph, uint32_t width, uint32_t height, bool motionBlur, bool blur, bool bloomChain, bool depthView,
+	const RenderTargetFormatPolicy& policy = RenderTargetFormats::GetFullPolicy())
+{
+	auto getDesc = [&](RenderTargetUse use, uint32_t sampleCount)
+	{
+		RenderTargetPrecision precision = RenderTargetFormats::Select(policy, use, ~0u);
+		FrameGraphTextureDesc desc = { width, height, RenderTargetFormats::GetFormat(precision),
+			RenderTargetFormats::GetBytesPerPixel(precision), sampleCount, 0, 0 };
+		return desc;
+	};
+
+	graph.Reset();
+	uint32_t backBuffer = graph.ImportTexture("Back Buffer");
+	uint32_t rtt = graph.CreateTexture("RTT", getDesc(TargetSceneColour, BENCHMARK_GRAPH_SAMPLES));
+	uint32_t noMSAARTT = graph.CreateTexture("No MSAA RTT", getDesc(TargetSceneColour, 1));
+	uint32_t depth = graph.CreateTexture("Depth", getDesc(TargetDepthView, 1));
+	uint32_t motionBlurTarget = graph.CreateTexture("Motion Blur", getDesc(TargetBlur, 1));
+	FrameGraphTextureDesc velocityDesc = { width, height, RENDER_TARGET_FORMAT_R16G16_FLOAT, RENDER_TARGET_VELOCITY_BYTES_PER_PIXEL, 1, 0, 0 };
+	uint32_t velocity = graph.CreateTexture("Velocity", velocityDesc);
+	FrameGraphTextureDesc tileDesc = velocityDesc;
+	tileDesc.Width = VelocityTiles::GetTileCount(width);
+	tileDesc.Height = VelocityTiles::GetTileCount(height);
+	uint32_t neighbourMax = graph.CreateTexture("Velocity Neighbour Max", tileDesc);
+	tileDesc.UnorderedAccess = 1;
+	uint32_t tileMax = graph.CreateTexture("Velocity Tile Max", tileDesc);
+	uint32_t blurHorizontal = graph.CreateTexture("Blur Horizontal", getDesc(TargetBlur, 1));
+	uint32_t blurVertical = graph.CreateTexture("Blur Vertical", getDesc(TargetBlur, 1));
+
+	uint32_t bloomDownsample[BLOOM_LEVELS], bloomHorizontal[BLOOM_LEVELS], bloomVertical[BLOOM_LEVELS], bloomUpsample[BLOOM_LEVELS];
+	for (uint32_t level = 0; level < BLOOM_LEVELS; ++level)
+	{
+		FrameGraphTextureDesc levelDesc = getDesc(TargetBloom, 1);
+		levelDesc.Width = BloomKernel::GetLevelSize(width, level);
+		levelDesc.Height = BloomKernel::GetLevelSize(height, level);
+		bloomDownsample[level] = graph.CreateTexture("Bloom Downsample", levelDesc);
+		bloomHorizontal[level] = graph.CreateTexture("Bloom Horizontal", levelDesc);
+		bloomVertical[level] = graph.CreateTexture("Bloom Vertical", levelDesc);
+		bloomUpsample[level] = level + 1 < BLOOM_LEVELS ? graph.CreateTexture("Bloom Upsample", levelDesc) : bloomVertical[level];
+	}
+
+	uint32_t pass = graph.AddPass("Depth", nullptr);
+	graph.Write(pass, depth);
+	pass = graph.AddPass("Scene", nullptr);
+	graph.Write(pass, backBuffer);
+	pass = graph.AddPass("Scene Colour", nullptr);
+	graph.Write(pass, rtt);
+	graph.Write(pass, noMSAARTT);
+	pass = graph.AddPass("Velocity", nullptr);
+	graph.Write(pass, velocity);
+	pass = graph.AddPass("Velocity Tile Max", nullptr);
+	graph.Read(pass, velocity);
+	graph.Write(pass, tileMax);
+	pass = graph.AddPass("Velocity Neighbour Max", nullptr);
+	graph.Read(pass, tileMax);
+	graph.Write(pass, neighbourMax);
+	pass = graph.AddPass("Motion Blur", nullptr);
+	graph.Read(pass, noMSAARTT);
+	graph.Read(pass, velocity);
+	graph.Read(pass, neighbourMax);
+	graph.Write(pass, motionBlurTarget);
+	pass = graph.AddPass("Blur Horizontal", nullptr);
+	graph.Read(pass, motionBlur ? motionBlurTarget : noMSAARTT);
+	graph.Write(pass, blurHorizontal);
+	pass = graph.AddPass("Blur Vertical", nullptr);
+	graph.Read(pass, blurHorizontal);
+	graph.Write(pass, blurVertical);
+	for (uint32_t level = 0; level < BLOOM_LEVELS; ++level)
+	{
+		pass = graph.AddPass("Bloom Downsample", nullptr);
+		graph.Read(pass, level ? bloomDownsample[level - 1] : noMSAARTT);
+		graph.Write(pass, bloomDownsample[level]);
+	}
+	for (uint32_t level = BLOOM_LEVELS; level-- > 0;)
+	{
+		pass = graph.AddPass("Bloom Horizontal", nullptr);
+		graph.Read(pass, bloomDownsample[level]);
+		graph.Write(pass, bloomHorizontal[level]);
+		pass = graph.AddPass("Bloom Vertical", nullptr);
+		graph.Read(pass, bloomHorizontal[level]);
+		graph.Write(pass, bloomVertical[level]);
+		if (level + 1 < BLOOM_LEVELS)
+		{
+			pass = graph.AddPass("Bloom Upsample", nullptr);
+			graph.Read(pass, bloomVertical[level]);
+			graph.Read(pass, bloomUpsample[level + 1]);
+			graph.Write(pass, bloomUpsample[level]);
+		}
+	}
+	pass = graph.AddPass("Screen Quad", nullptr);
+	graph.Write(pass, backBuffer);
+	if (depthView)
+	{
+		graph.Read(pass, depth);
+	}
+	else
+	{
+		graph.Read(pass, blur ? blurVertical : motionBlur ? motionBlurTarget : noMSAARTT);
+		if (bloomChain)
+			graph.Read(pass, bloomUpsample[0]);
+	}
+	pass = graph.AddPass("Spline", nullptr);
+	graph.Write(pass, backBuffer);
+	graph.Compile();
+}
+
+void Benchmark::FrameGraphBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Render target memory for each render mode: declared is what InitDevice used to keep
+	// resident, allocated what the pool holds after culling and sharing
+	struct GraphCase
+	{
+		const char*	Name;
+		uint32_t	Width;
+		uint32_t	Height;
+		bool		MotionBlur;
+		bool		Blur;
+		bool		Bloom;
+		bool		DepthView;
+	};
+	const GraphCase cases[] =
+	{
+		{ "framegraph_720p_default", 1280, 720, false, false, true, false },
+		{ "framegraph_720p_no_bloom", 1280, 720, false, false, false, false },
+		{ "framegraph_720p_motion_blur", 1280, 720, true, false, true, false },
+		{ "framegraph_720p_blur", 1280, 720, false, true, true, false },
+		{ "framegraph_720p_depth_view", 1280, 720, false, false, true, true },
+		{ "framegraph_1080p_motion_blur", 1920, 1080, true, false, true, false },
+		{ "framegraph_4k_motion_blur", 3840, 2160, true, false, true, false }
+	};
+
+	FrameGraph graph;
+	for (const GraphCase& graphCase : cases)
+	{
+		BuildPostGraph(graph, graphCase.Width, graphCase.Height, graphCase.MotionBlur, graphCase.Blur, graphCase.Bloom, graphCase.DepthView);
+		const FrameGraphStats& stats = graph.GetStats();
+		std::string name = graphCase.Name;
+		results.push_back({ name + "_declared", 1, stats.DeclaredBytes / 1048576.0, "MB" });
+		results.push_back({ name + "_allocated", 1, stats.AllocatedBytes / 1048576.0, "MB" });
+		results.push_back({ name + "_peak_live", 1, stats.PeakLiveBytes / 1048576.0, "MB" });
+		results.push_back({ name + "_textures", 1, (double)stats.PhysicalTextures, "textures" });
+		results.push_back({ name + "_culled_passes", 1, (double)stats.CulledPasses, "passes" });
+	}
+
+	// Lifetimes in the motion blur graph: velocity lives from its pass to the gather,
+	// each tile target from its pass to the next, and the blurred scene to the screen quad
+	BuildPostGraph(graph, 1280, 720, true, false, false, false);
+	const uint32_t motionBlurTarget = 4, velocity = 5, neighbourMax = 6, tileMax = 7, blurHorizontal = 8, blurVertical = 9;
+	const uint32_t velocityPass = 3, tileMaxPass = 4, neighbourMaxPass = 5, motionBlurPass = 6, blurHorizontalPass = 7, blurVerticalPass = 8;
+	const uint32_t screenQuad = graph.GetPassCount() - 2;
+	bool lifetimesCorrect = graph.GetFirstUse(velocity) == velocityPass && graph.GetLastUse(velocity) == motionBlurPass &&
+		graph.GetFirstUse(tileMax) == tileMaxPass && graph.GetLastUse(tileMax) == neighbourMaxPass &&
+		graph.GetFirstUse(neighbourMax) == neighbourMaxPass && graph.GetLastUse(neighbourMax) == motionBlurPass &&
+		graph.GetFirstUse(motionBlurTarget) == motionBlurPass && graph.GetLastUse(motionBlurTarget) == screenQuad;
+	results.push_back(CheckResult("framegraph_lifetimes_correct", 1, lifetimesCorrect));
+
+	// With motion blur off nothing reads the blurred scene, so all four of its passes go
+	BuildPostGraph(graph, 1280, 720, false, false, false, false);
+	bool culled = true;
+	for (uint32_t pass = velocityPass; pass <= motionBlurPass; ++pass)
+	{
+		culled = culled && graph.IsCulled(pass);
+	}
+	culled = culled && graph.IsCulled(blurHorizontalPass) && graph.IsCulled(blurVerticalPass);
+	results.push_back(CheckResult("framegraph_motion_blur_culled_when_off", 1, culled));
+
+	// Blurring the motion blurred scene: the motion blur target is done with before the
+	// vertical blur starts, so they share a texture, while the horizontal blur overlaps both
+	BuildPostGraph(graph, 1280, 720, true, true, false, false);
+	bool aliased = graph.GetFirstUse(blurHorizontal) == blurHorizontalPass && graph.GetLastUse(motionBlurTarget) == blurHorizontalPass &&
+		graph.GetPhysicalTexture(motionBlurTarget) == graph.GetPhysicalTexture(blurVertical) &&
+		graph.GetPhysicalTexture(blurHorizontal) != graph.GetPhysicalTexture(motionBlurTarget);
+	results.push_back(CheckResult("framegraph_motion_blur_aliases_blur", 1, aliased));
+
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (int i = 0; i < BENCHMARK_GRAPH_COMPILES; ++i)
+	{
+		BuildPostGraph(graph, 1280, 720, (i & 1) != 0, (i & 2) != 0, true, false);
+	}
+	results.push_back({ "framegraph_build_and_compile", 1, SecondsSince(start) / BENCHMARK_GRAPH_COMPILES * 1e6, "us" });
+}
+
+void Benchmark::RenderTargetFormatBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Memory the pool allocates and the estimated traffic through the targets each
+	// frame, everything in RGBA32F against the bandwidth policy, with motion blur, the
+	// blur and bloom on since together they run every target but the depth view
+	struct FormatCase
+	{
+		const char*	Name;
+		uint32_t	Width;
+		uint32_t	Height;
+	};
+	const FormatCase cases[] =
+	{
+		{ "rtformats_1080p", 1920, 1080 },
+		{ "rtformats_4k", 3840, 2160 }
+	};
+	const RenderTargetFormatPolicy fullPolicy = RenderTargetFormats::GetFullPolicy();
+	const RenderTargetFormatPolicy bandwidthPolicy = RenderTargetFormats::GetBandwidthPolicy();
+
+	FrameGraph graph;
+	for (const FormatCase& formatCase : cases)
+	{
+		std::string name = formatCase.Name;
+		BuildPostGraph(graph, formatCase.Width, formatCase.Height, true, true, true, false, fullPolicy);
+		uint64_t fullAllocated = graph.GetStats().AllocatedBytes;
+		BuildPostGraph(graph, formatCase.Width, formatCase.Height, true, true, true, false, bandwidthPolicy);
+		uint64_t bandwidthAllocated = graph.GetStats().AllocatedBytes;
+
+		RenderTargetBudget full = RenderTargetFormats::GetBudget(fullPolicy, formatCase.Width, formatCase.Height,
+			BENCHMARK_GRAPH_SAMPLES, ~0u, ~0u, true, true, true, false);
+		RenderTargetBudget bandwidth = RenderTargetFormats::GetBudget(bandwidthPolicy, formatCase.Width, formatCase.Height,
+			BENCHMARK_GRAPH_SAMPLES, ~0u, ~0u, true, true, true, false);
+
+		results.push_back({ name + "_full_allocated", 1, fullAllocated / 1048576.0, "MB" });
+		results.push_back({ name + "_bandwidth_allocated", 1, bandwidthAllocated / 1048576.0, "MB" });
+		results.push_back({ name + "_full_traffic", 1, full.TrafficBytes / 1048576.0, "MB" });
+		results.push_back({ name + "_bandwidth_traffic", 1, bandwidth.TrafficBytes / 1048576.0, "MB" });
+		results.push_back({ name + "_memory_saved", 1, 100.0 * (1.0 - (double)bandwidthAllocated / fullAllocated), "%" });
+		results.push_back({ name + "_traffic_saved", 1, 100.0 * (1.0 - (double)bandwidth.TrafficBytes / full.TrafficBytes), "%" });
+	}
+
+	// A device without packed float render targets gets half floats for bloom and blur,
+	// and one without multisampled half floats keeps the scene at full precision
+	bool fallsBack = RenderTargetFormats::Select(bandwidthPolicy, TargetBloom, 1u << PrecisionHalf) == PrecisionHalf &&
+		RenderTargetFormats::Select(bandwidthPolicy, TargetSceneColour, 1u << PrecisionPacked) == PrecisionFull &&
+		RenderTargetFormats::Select(bandwidthPolicy, TargetBlur, ~0u) == PrecisionPacked;
+	results.push_back(CheckResult("rtformats_fallback_correct", 1, fallsBack));
+}
+
+void Benchmark::BloomBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// Random HDR colour, a few texels far over the threshold like lights and speculars
+	BloomImage scene;
+	scene.Resize(BENCHMARK_BLOOM_WIDTH, BENCHMARK_BLOOM_HEIGHT);
+	srand(7);
+	for (float& channel : scene.Pixels)
+	{
+		channel = (float)rand() / RAND_MAX;
+		if (rand() % 64 == 0)
+			channel *= 20.0f;
+	}
+
+	// Kernel maths: the discrete weights sum to 1 and the paired bilinear taps give
+	// back the discrete blur, clamped edges included
+	std::vector<float> weights;
+	BloomKernel::GetGaussianWeights(BENCHMARK_BLOOM_RADIUS, BloomKernel::GetSigma(BENCHMARK_BLOOM_RADIUS), weights);
+	double weightSum = weights[0];
+	for (size_t i = 1; i < weights.size(); ++i)
+	{
+		weightSum += weights[i] * 2.0;
+	}
+	results.push_back({ "bloom_weight_sum_error", 1, fabs(weightSum - 1.0), "error" });
+
+	double maxError = 0.0;
+	for (uint32_t radius = 1; radius <= BLOOM_MAX_RADIUS; ++radius)
+	{
+		BloomTap taps[BLOOM_MAX_TAPS];
+		uint32_t tapCount = BloomKernel::GetLinearTaps(radius, BloomKernel::GetSigma(radius), taps);
+		BloomImage discrete, linear;
+		BloomKernel::BlurDiscrete(scene, radius, BloomKernel::GetSigma(radius), (radius & 1) != 0, discrete);
+		BloomKernel::BlurLinear(scene, taps, tapCount, (radius & 1) != 0, linear);
+		for (size_t i = 0; i < discrete.Pixels.size(); ++i)
+		{
+			maxError = std::max(maxError, (double)fabs(discrete.Pixels[i] - linear.Pixels[i]));
+		}
+	}
+	results.push_back({ "bloom_linear_vs_discrete_max_error", 1, maxError, "error" });
+
+	BloomTap taps[BLOOM_MAX_TAPS];
+	uint32_t tapCount = BloomKernel::GetLinearTaps(BENCHMARK_BLOOM_RADIUS, BloomKernel::GetSigma(BENCHMARK_BLOOM_RADIUS), taps);
+	results.push_back({ "bloom_fetches_per_direction_discrete", 1, BENCHMARK_BLOOM_RADIUS * 2.0 + 1.0, "fetches" });
+	results.push_back({ "bloom_fetches_per_direction_linear", 1, tapCount * 2.0 - 1.0, "fetches" });
+
+	// GPU cost at 4K by texture fetches and the bytes they read: PS_Blur takes 2 * radius
+	// a direction at full resolution from RGBA32F targets, the chain runs at half
+	// resolution and below from targets in the bandwidth policy's bloom format. The
+	// fetch count alone falls short of 10x; the rest of the bytes reduction is the
+	// smaller format, which the format policy gives any blur, so it is reported apart.
+	const uint32_t width = 3840, height = 2160;
+	const RenderTargetPrecision bloomPrecision = RenderTargetFormats::Select(RenderTargetFormats::GetBandwidthPolicy(), TargetBloom, ~0u);
+	double fullResolutionFetches = (double)width * height * 2 * 2 * BENCHMARK_BLOOM_OLD_RADIUS;
+	double chainFetches = (double)BloomKernel::GetChainFetches(width, height, BLOOM_LEVELS, tapCount);
+	double fullResolutionBytes = fullResolutionFetches * RenderTargetFormats::GetBytesPerPixel(PrecisionFull);
+	double chainBytes = chainFetches * RenderTargetFormats::GetBytesPerPixel(bloomPrecision);
+	results.push_back({ "bloom_4k_full_resolution_fetches", 1, fullResolutionFetches / 1e6, "M" });
+	results.push_back({ "bloom_4k_chain_fetches", 1, chainFetches / 1e6, "M" });
+	results.push_back({ "bloom_4k_fetch_reduction", 1, fullResolutionFetches / chainFetches, "x" });
+	results.push_back({ "bloom_4k_format_bytes_reduction", 1,
+		(double)RenderTargetFormats::GetBytesPerPixel(PrecisionFull) / RenderTargetFormats::GetBytesPerPixel(bloomPrecision), "x" });
+	results.push_back({ "bloom_4k_fetched_bytes_reduction", 1, fullResolutionBytes / chainBytes, "x" });
+
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	BloomImage bloom;
+	BloomKernel::Run(scene, BLOOM_LEVELS, BENCHMARK_BLOOM_RADIUS, 0.8f, 1.0f, bloom);
+	results.push_back({ "bloom_cpu_reference_chain", 1, SecondsSince(start) * 1e3, "ms" });
+
+	// Nothing under the threshold makes it through
+	BloomImage dark;
+	dark.Resize(BENCHMARK_BLOOM_WIDTH, BENCHMARK_BLOOM_HEIGHT);
+	for (float& channel : dark.Pixels)
+	{
+		channel = 0.5f;
+	}
+	BloomKernel::Run(dark, BLOOM_LEVELS, BENCHMARK_BLOOM_RADIUS, 0.8f, 1.0f, bloom);
+	bool thresholdCorrect = *std::max_element(bloom.Pixels.begin(), bloom.Pixels.end()) == 0.0f;
+	results.push_back(CheckResult("bloom_threshold_correct", 1, thresholdCorrect));
+}
+
+void Benchmark::TiledBlurBenchmark(std::vector<BenchmarkResult>& results)
+{
+	BloomImage scene;
+	scene.Resize(BENCHMARK_BLUR_WIDTH, BENCHMARK_BLUR_HEIGHT);
+	srand(11);
+	for (float& channel : scene.Pixels)
+	{
+		channel = (float)rand() / RAND_MAX;
+	}
+
+	// CS_Blur's tiles against PS_Blur's taps, every radius the slider can pick, both ways
+	double maxError = 0.0;
+	double referenceSeconds = 0.0;
+	double tiledSeconds = 0.0;
+	for (uint32_t radius = 1; radius <= BLUR_MAX_RADIUS; ++radius)
+	{
+		for (int horizontal = 0; horizontal < 2; ++horizontal)
+		{
+			BloomImage reference, tiled;
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			TiledBlur::BlurReference(scene, radius, horizontal != 0, reference);
+			referenceSeconds += SecondsSince(start);
+			start = BenchmarkClock::now();
+			TiledBlur::BlurTiled(scene, radius, horizontal != 0, tiled);
+			tiledSeconds += SecondsSince(start);
+			for (size_t i = 0; i < reference.Pixels.size(); ++i)
+			{
+				maxError = std::max(maxError, (double)fabs(reference.Pixels[i] - tiled.Pixels[i]));
+			}
+		}
+	}
+	results.push_back({ "computeblur_tiled_vs_reference_max_error", 1, maxError, "error" });
+
+	// A flat image stays flat, the weights are normalised and the edges clamp
+	BloomImage flat, blurred;
+	flat.Resize(BENCHMARK_BLUR_WIDTH, BENCHMARK_BLUR_HEIGHT);
+	for (float& channel : flat.Pixels)
+	{
+		channel = 0.5f;
+	}
+	TiledBlur::BlurTiled(flat, BLUR_MAX_RADIUS, false, blurred);
+	double flatError = 0.0;
+	for (float channel : blurred.Pixels)
+	{
+		flatError = std::max(flatError, (double)fabs(channel - 0.5f));
+	}
+	results.push_back({ "computeblur_flat_max_error", 1, flatError, "error" });
+
+	// CPU throughput of the two loops, per megapixel and direction
+	double megapixels = BENCHMARK_BLUR_WIDTH * BENCHMARK_BLUR_HEIGHT / 1e6 * BLUR_MAX_RADIUS * 2;
+	results.push_back({ "computeblur_cpu_reference", 1, referenceSeconds * 1e3 / megapixels, "ms/MP" });
+	results.push_back({ "computeblur_cpu_tiled", 1, tiledSeconds * 1e3 / megapixels, "ms/MP" });
+
+	// Texture fetches a pixel for both directions at 1080p and 4K, at the widest
+	// radius the slider gives PS_Blur
+	const uint32_t sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	const char* names[] = { "1080p", "4k" };
+	for (int i = 0; i < 2; ++i)
+	{
+		uint32_t width = sizes[i][0], height = sizes[i][1];
+		double pixels = width * (double)height;
+		double pixelShaderFetches = 2.0 * TiledBlur::GetPixelShaderFetches(width, height, BLUR_MAX_RADIUS);
+		double computeShaderFetches = (double)TiledBlur::GetComputeShaderFetches(width, height, true) +
+			TiledBlur::GetComputeShaderFetches(width, height, false);
+		results.push_back({ std::string("computeblur_") + names[i] + "_ps_fetches", 1, pixelShaderFetches / pixels, "fetches/pixel" });
+		results.push_back({ std::string("computeblur_") + names[i] + "_cs_fetches", 1, computeShaderFetches / pixels, "fetches/pixel" });
+		results.push_back({ std::string("computeblur_") + names[i] + "_fetch_reduction", 1, pixelShaderFetches / computeShaderFetches, "x" });
+	}
+}
+
+void Benchmark::MotionBlurBenchmark(std::vector<BenchmarkResult>& results)
+{
+	const uint32_t width = BENCHMARK_MOTION_BLUR_WIDTH, height = BENCHMARK_MOTION_BLUR_HEIGHT;
+
+	// A point moved 5 pixels right under an orthographic camera the size of the screen
+	// moves 5 pixels, and nothing moves when the matrices don't change
+	XMMATRIX viewProjection = XMMatrixOrthographicLH((float)width, (float)height, 0.1f, 100.0f);
+	XMMATRIX previousWorld = XMMatrixTranslation(10.0f, 20.0f, 5.0f);
+	XMMATRIX world = XMMatrixTranslation(15.0f, 20.0f, 5.0f);
+	XMFLOAT2 moved = VelocityTiles::GetVelocity(XMVectorZero(), world, previousWorld, viewProjection, viewProjection);
+	XMFLOAT2 still = VelocityTiles::GetVelocity(XMVectorSet(1.0f, 2.0f, 3.0f, 1.0f), world, world, viewProjection, viewProjection);
+	results.push_back({ "motionblur_velocity_pixels", 1, moved.x * width, "pixels" });
+	bool velocityCorrect = fabsf(moved.x * width - 5.0f) < 1e-3f && fabsf(moved.y) < 1e-6f && still.x == 0.0f && still.y == 0.0f;
+	results.push_back(CheckResult("motionblur_velocity_correct", 1, velocityCorrect));
+
+	// A still frame, a disc moving across a still background and a camera pan. The
+	// tile max and neighbour max passes must find the same velocity as looking at
+	// every pixel of each 3x3 neighbourhood, and only tiles near motion blur at all.
+	struct MotionCase
+	{
+		const char*	Name;
+		float		DiscSpeed;
+		float		PanSpeed;
+	};
+	const MotionCase cases[] =
+	{
+		{ "still", 0.0f, 0.0f },
+		{ "disc", 24.0f, 0.0f },
+		{ "pan", 0.0f, 6.0f }
+	};
+	const float scaleX = (float)width, scaleY = (float)height;
+	for (const MotionCase& motionCase : cases)
+	{
+		VelocityImage velocity;
+		velocity.Resize(width, height);
+		const float centreX = width * 0.5f, centreY = height * 0.5f, radius = height * 0.2f;
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				float* pixel = velocity.GetPixel(x, y);
+				float dx = x - centreX, dy = y - centreY;
+				bool disc = dx * dx + dy * dy < radius * radius;
+				pixel[0] = (motionCase.PanSpeed + (disc ? motionCase.DiscSpeed : 0.0f)) / scaleX;
+				pixel[1] = (disc ? motionCase.DiscSpeed * 0.5f : 0.0f) / scaleY;
+			}
+		}
+
+		VelocityImage tiles, neighbourMax, reference;
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (int i = 0; i < BENCHMARK_MOTION_BLUR_REPEATS; ++i)
+		{
+			VelocityTiles::TileMax(velocity, scaleX, scaleY, tiles);
+			VelocityTiles::NeighbourMax(tiles, neighbourMax);
+		}
+		double tileSeconds = SecondsSince(start) / BENCHMARK_MOTION_BLUR_REPEATS;
+		VelocityTiles::NeighbourMaxReference(velocity, scaleX, scaleY, reference);
+
+		// Lengths, not vectors, two pixels of the same length can be kept in either order
+		double maxError = 0.0;
+		for (size_t i = 0; i < reference.Pixels.size(); i += 2)
+		{
+			double tilesLength = sqrt(neighbourMax.Pixels[i] * neighbourMax.Pixels[i] + neighbourMax.Pixels[i + 1] * neighbourMax.Pixels[i + 1]);
+			double referenceLength = sqrt(reference.Pixels[i] * reference.Pixels[i] + reference.Pixels[i + 1] * reference.Pixels[i + 1]);
+			maxError = std::max(maxError, fabs(tilesLength - referenceLength));
+		}
+
+		uint32_t staticTiles = VelocityTiles::CountStaticTiles(neighbourMax, MOTION_BLUR_MIN_PIXELS);
+		double staticFraction = (double)staticTiles / (neighbourMax.Width * neighbourMax.Height);
+		std::string name = std::string("motionblur_") + motionCase.Name;
+		results.push_back({ name + "_tiles_vs_reference_max_error", 1, maxError, "pixels" });
+		results.push_back({ name + "_static_tiles", 1, staticFraction * 100.0, "%" });
+		results.push_back({ name + "_cpu_tiles", 1, tileSeconds * 1e3, "ms" });
+
+		// Fetches a pixel: the velocity read by the tile max, nine neighbour max reads a
+		// tile, then in moving tiles the centre and a colour and velocity for each sample.
+		// The old blur fetched 2 x 10 taps each way and drew the scene again for every pixel.
+		double tilePixels = (double)VELOCITY_TILE_SIZE * VELOCITY_TILE_SIZE;
+		double fetches = 1.0 + 9.0 / tilePixels + 1.0 + (1.0 - staticFraction) * (2.0 + MOTION_BLUR_SAMPLES * 2.0);
+		results.push_back({ name + "_fetches", 1, fetches, "fetches/pixel" });
+	}
+	results.push_back({ "motionblur_old_blur_fetches", 1, 2.0 * 2.0 * BENCHMARK_BLOOM_OLD_RADIUS, "fetches/pixel" });
+}
+
+void Benchmark::LightClusterBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// A 16:9 camera over a field of point lights, some behind it or past the far plane
+	XMFLOAT4X4 projection, view;
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+	XMStoreFloat4x4(&view, XMMatrixLookAtLH(XMVectorSet(0.0f, 5.0f, -10.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 30.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+
+	srand(17);
+	std::vector<ClusterLight> lights(BENCHMARK_CLUSTER_LIGHTS);
+	for (ClusterLight& light : lights)
+	{
+		light.Position = XMFLOAT3(RandomFloat(-60.0f, 60.0f), RandomFloat(-2.0f, 10.0f), RandomFloat(-20.0f, 110.0f));
+		light.Range = RandomFloat(0.5f, 4.0f);
+		light.Colour = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		light.Padding = 0.0f;
+	}
+
+	// The slices are spaced between the depths recovered from the projection
+	float nearZ, farZ;
+	Culling::GetDepthRange(projection, nearZ, farZ);
+	results.push_back(CheckResult("lightclusters_depth_range", 1, fabsf(nearZ - 0.1f) <= 1e-5f && fabsf(farZ - 100.0f) <= 1e-2f));
+
+	LightClusterer clusterer;
+	clusterer.SetProjection(projection);
+	clusterer.Bin(lights.data(), (uint32_t)lights.size(), view);
+
+	// Every cluster's list against every light tested on its own
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
+	std::vector<XMFLOAT4> spheres(lights.size());
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		XMStoreFloat4(&spheres[i], XMVectorSetW(XMVector3TransformCoord(XMLoadFloat3(&lights[i].Position), viewMatrix), lights[i].Range));
+	}
+	bool matches = true;
+	std::vector<uint32_t> expected;
+	for (uint32_t cluster = 0; cluster < LIGHT_CLUSTER_COUNT && matches; ++cluster)
+	{
+		expected.clear();
+		for (uint32_t i = 0; i < spheres.size(); ++i)
+		{
+			if (LightClusterer::IsSphereInBounds(clusterer.GetBounds(cluster), spheres[i]))
+				expected.push_back(i);
+		}
+		const ClusterRange& range = clusterer.GetRanges()[cluster];
+		matches = range.Count == expected.size() &&
+			std::equal(expected.begin(), expected.end(), clusterer.GetIndices().begin() + range.Offset);
+	}
+	results.push_back(CheckResult("lightclusters_matches_reference", 1, matches));
+
+	// Points inside the frustum find their cluster the way the pixel shader does, and
+	// every light that reaches a point has to be in that cluster's list
+	bool covered = true;
+	for (int i = 0; i < BENCHMARK_CLUSTER_POINTS && covered; ++i)
+	{
+		float ndcX = RandomFloat(-0.999f, 0.999f), ndcY = RandomFloat(-0.999f, 0.999f);
+		float z = expf(RandomFloat(logf(0.1001f), logf(99.9f)));
+		XMFLOAT3 point(ndcX * z / projection._11, ndcY * z / projection._22, z);
+		uint32_t tileX = (uint32_t)((ndcX * 0.5f + 0.5f) * LIGHT_CLUSTERS_X);
+		uint32_t tileY = (uint32_t)((0.5f - ndcY * 0.5f) * LIGHT_CLUSTERS_Y);
+		int slice = (int)(logf(z) * clusterer.GetSliceScale() + clusterer.GetSliceBias());
+		slice = std::min(std::max(slice, 0), LIGHT_CLUSTERS_Z - 1);
+		const ClusterRange& range = clusterer.GetRanges()[LightClusterer::GetClusterIndex(tileX, tileY, slice)];
+		const uint32_t* first = clusterer.GetIndices().data() + range.Offset;
+		for (uint32_t l = 0; l < spheres.size() && covered; ++l)
+		{
+			float dx = point.x - spheres[l].x, dy = point.y - spheres[l].y, dz = point.z - spheres[l].z;
+			if (dx * dx + dy * dy + dz * dz <= spheres[l].w * spheres[l].w)
+				covered = std::find(first, first + range.Count, l) != first + range.Count;
+		}
+	}
+	results.push_back(CheckResult("lightclusters_points_covered", 1, covered));
+
+	const LightClusterStats& stats = clusterer.GetStats();
+	results.push_back({ "lightclusters_visible_lights", 1, (double)stats.VisibleLights, "lights" });
+	results.push_back({ "lightclusters_indices", 1, (double)stats.Indices, "indices" });
+	results.push_back({ "lightclusters_occupied_clusters", 1, (double)stats.OccupiedClusters, "clusters" });
+	results.push_back({ "lightclusters_max_cluster_lights", 1, (double)stats.MaxClusterLights, "lights" });
+	results.push_back({ "lightclusters_average_cluster_lights", 1, stats.OccupiedClusters ? (double)stats.Indices / stats.OccupiedClusters : 0.0, "lights" });
+
+	// Binning every light into the 16x9x24 grid, one slice a batch
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+		clusterer.Bin(lights.data(), (uint32_t)lights.size(), view, &jobs);
+
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (int i = 0; i < BENCHMARK_CLUSTER_ITERATIONS; ++i)
+		{
+			clusterer.Bin(lights.data(), (uint32_t)lights.size(), view, &jobs);
+		}
+		results.push_back({ "lightclusters_bin_4k", threads, SecondsSince(start) / BENCHMARK_CLUSTER_ITERATIONS * 1e3, "ms" });
+	}
+}
+
+// A camera at eye turned by yaw and pitch, row vectors
+static XMFLOAT4X4 GetShadowBenchmarkView(XMFLOAT3 eye, float yaw, float pitch)
+{
+	XMVECTOR forward = XMVectorSet(cosf(pitch) * sinf(yaw), sinf(pitch), cosf(pitch) * cosf(yaw), 0.0f);
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMLoadFloat3(&eye), forward, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+	return view;
+}
+
+void Benchmark::ShadowBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// The scene camera's projection and a low sun
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.01f, 100.0f));
+	XMFLOAT3 lightDirection(-0.5f, -0.6f, 0.6f);
+
+	// Splits run from the near plane to the far one, even at lambda 0 and logarithmic at 1
+	float splits[SHADOW_MAX_CASCADES + 1];
+	bool splitsValid = true;
+	for (uint32_t count = SHADOW_MIN_CASCADES; count <= SHADOW_MAX_CASCADES; ++count)
+	{
+		ShadowCascades::ComputeSplits(0.01f, SHADOW_DISTANCE, count, SHADOW_SPLIT_LAMBDA, splits);
+		splitsValid &= splits[0] == 0.01f && splits[count] == SHADOW_DISTANCE;
+		for (uint32_t i = 0; i < count; ++i)
+			splitsValid &= splits[i] < splits[i + 1];
+
+		ShadowCascades::ComputeSplits(1.0f, 81.0f, count, 0.0f, splits);
+		for (uint32_t i = 0; i <= count; ++i)
+			splitsValid &= fabsf(splits[i] - (1.0f + 80.0f * i / count)) < 1e-4f;
+		ShadowCascades::ComputeSplits(1.0f, 81.0f, count, 1.0f, splits);
+		for (uint32_t i = 0; i <= count; ++i)
+			splitsValid &= fabsf(splits[i] - powf(81.0f, (float)i / count)) < 1e-3f;
+	}
+	results.push_back(CheckResult("shadows_splits_valid", 1, splitsValid));
+
+	// Every corner of every slice is inside its sphere and its map, from cameras all over
+	srand(23);
+	ShadowCascade cascades[SHADOW_MAX_CASCADES];
+	bool cornersContained = true, cornersInMap = true;
+	for (int c = 0; c < BENCHMARK_SHADOW_CAMERAS; ++c)
+	{
+		XMFLOAT3 eye(RandomFloat(-50.0f, 50.0f), RandomFloat(1.0f, 20.0f), RandomFloat(-50.0f, 50.0f));
+		XMFLOAT4X4 view = GetShadowBenchmarkView(eye, RandomFloat(-XM_PI, XM_PI), RandomFloat(-1.2f, 1.2f));
+		ShadowCascades::FitCascades(view, projection, lightDirection, SHADOW_MAX_CASCADES, SHADOW_SPLIT_LAMBDA, SHADOW_DISTANCE, SHADOW_MAP_SIZE, cascades);
+		XMMATRIX inverseView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&view));
+		for (const ShadowCascade& cascade : cascades)
+		{
+			XMVECTOR centre = XMLoadFloat4(&cascade.Sphere);
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				float z = corner & 4 ? cascade.SplitFar : cascade.SplitNear;
+				float x = (corner & 1 ? z : -z) / projection._11, y = (corner & 2 ? z : -z) / projection._22;
+				XMVECTOR world = XMVector3TransformCoord(XMVectorSet(x, y, z, 1.0f), inverseView);
+				cornersContained &= XMVectorGetX(XMVector3Length(XMVectorSubtract(world, XMVectorSetW(centre, 0.0f)))) <= cascade.Sphere.w * 1.0001f;
+
+				XMFLOAT3 clip;
+				XMStoreFloat3(&clip, XMVector3TransformCoord(world, XMLoadFloat4x4(&cascade.ViewProjection)));
+				cornersInMap &= fabsf(clip.x) <= 1.0001f && fabsf(clip.y) <= 1.0001f && clip.z >= -0.0001f && clip.z <= 1.0001f;
+			}
+		}
+	}
+	results.push_back(CheckResult("shadows_slice_spheres_contain_corners", 1, cornersContained));
+	results.push_back(CheckResult("shadows_corners_in_map", 1, cornersInMap));
+
+	// A fixed world point sits at the same place within its texel however the camera
+	// moves and turns, and texels stay the same size, so edges can't shimmer
+	XMVECTOR point = XMVectorSet(2.0f, 1.0f, 3.0f, 1.0f);
+	float firstTexel[2] = {}, worstDrift = 0.0f, firstTexelSize = 0.0f;
+	bool texelSizeStable = true;
+	for (int c = 0; c < BENCHMARK_SHADOW_CAMERAS; ++c)
+	{
+		XMFLOAT3 eye(2.0f + RandomFloat(-1.0f, 1.0f), 2.0f + RandomFloat(-0.5f, 0.5f), -1.0f + RandomFloat(-1.0f, 1.0f));
+		XMFLOAT4X4 view = GetShadowBenchmarkView(eye, RandomFloat(-0.3f, 0.3f), RandomFloat(-0.3f, 0.3f));
+		ShadowCascades::FitCascades(view, projection, lightDirection, SHADOW_MAX_CASCADES, SHADOW_SPLIT_LAMBDA, SHADOW_DISTANCE, SHADOW_MAP_SIZE, cascades);
+		const ShadowCascade& cascade = cascades[SHADOW_MAX_CASCADES - 1];
+		XMFLOAT3 clip;
+		XMStoreFloat3(&clip, XMVector3TransformCoord(point, XMLoadFloat4x4(&cascade.ViewProjection)));
+		float texel[2] = { (clip.x * 0.5f + 0.5f) * SHADOW_MAP_SIZE, (clip.y * 0.5f + 0.5f) * SHADOW_MAP_SIZE };
+		for (int axis = 0; axis < 2; ++axis)
+		{
+			float fraction = texel[axis] - floorf(texel[axis]);
+			if (c == 0)
+				firstTexel[axis] = fraction;
+			float drift = fabsf(fraction - firstTexel[axis]);
+			worstDrift = std::max(worstDrift, std::min(drift, 1.0f - drift));
+		}
+		if (c == 0)
+			firstTexelSize = cascade.TexelSize;
+		texelSizeStable &= cascade.TexelSize == firstTexelSize;
+	}
+	results.push_back(CheckResult("shadows_texel_size_stable", 1, texelSizeStable));
+	results.push_back({ "shadows_worst_subtexel_drift", 1, worstDrift, "texels" });
+
+	// Casters scattered over the terrain and up towards the light
+	XMFLOAT4X4 view = GetShadowBenchmarkView(XMFLOAT3(0.0f, 5.0f, -10.0f), 0.3f, -0.2f);
+	ShadowCascades::FitCascades(view, projection, lightDirection, SHADOW_MAX_CASCADES, SHADOW_SPLIT_LAMBDA, SHADOW_DISTANCE, SHADOW_MAP_SIZE, cascades);
+	std::vector<XMFLOAT4> casters(BENCHMARK_SHADOW_CASTERS);
+	for (XMFLOAT4& caster : casters)
+	{
+		caster = XMFLOAT4(RandomFloat(-80.0f, 80.0f), RandomFloat(-5.0f, 40.0f), RandomFloat(-80.0f, 80.0f), RandomFloat(0.2f, 3.0f));
+	}
+
+	// The batched cull against each cascade's own test
+	std::vector<uint8_t> visible(casters.size() * SHADOW_MAX_CASCADES);
+	uint32_t counts[SHADOW_MAX_CASCADES];
+	bool cullMatches = true;
+	{
+		JobSystem jobs(4);
+		ShadowCascades::CullCasters(cascades, SHADOW_MAX_CASCADES, casters.data(), casters.size(), visible.data(), counts, &jobs);
+	}
+	for (uint32_t i = 0; i < SHADOW_MAX_CASCADES; ++i)
+	{
+		uint32_t expected = 0;
+		for (size_t s = 0; s < casters.size(); ++s)
+		{
+			bool reference = ShadowCascades::IsCasterVisible(cascades[i], casters[s]);
+			expected += reference;
+			cullMatches &= (visible[i * casters.size() + s] != 0) == reference;
+		}
+		cullMatches &= counts[i] == expected;
+		results.push_back({ "shadows_cascade" + std::to_string(i) + "_casters", 1, (double)counts[i], "casters" });
+	}
+	results.push_back(CheckResult("shadows_cull_matches_reference", 1, cullMatches));
+
+	// Nothing that can land in a map is culled from it: points across each map's box
+	// and out in front of it towards the light, including casters above a map's near plane
+	bool conservative = true;
+	for (const ShadowCascade& cascade : cascades)
+	{
+		XMMATRIX inverseViewProjection = XMMatrixInverse(nullptr, XMLoadFloat4x4(&cascade.ViewProjection));
+		for (int i = 0; i < BENCHMARK_SHADOW_POINTS && conservative; ++i)
+		{
+			XMVECTOR clip = XMVectorSet(RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-4.0f, 1.0f), 1.0f);
+			XMFLOAT4 sphere;
+			XMStoreFloat4(&sphere, XMVectorSetW(XMVector3TransformCoord(clip, inverseViewProjection), 0.05f));
+			conservative = ShadowCascades::IsCasterVisible(cascade, sphere);
+		}
+	}
+
+	// And the spot light's map, down its cone
+	ShadowCascade spot;
+	XMFLOAT3 spotPosition(5.0f, 8.0f, -5.0f), spotDirection(-0.4f, -0.8f, 0.4f);
+	ShadowCascades::FitSpot(spotPosition, spotDirection, XM_PIDIV4, 60.0f, spot);
+	XMVECTOR spotForward = XMVector3Normalize(XMLoadFloat3(&spotDirection));
+	for (int i = 0; i < BENCHMARK_SHADOW_POINTS && conservative; ++i)
+	{
+		XMFLOAT4 sphere;
+		XMStoreFloat4(&sphere, XMVectorSetW(XMVectorAdd(XMLoadFloat3(&spotPosition), XMVectorScale(spotForward, RandomFloat(0.1f, 59.0f))), 0.05f));
+		conservative = ShadowCascades::IsCasterVisible(spot, sphere);
+	}
+	results.push_back(CheckResult("shadows_cull_conservative", 1, conservative));
+
+	// Fitting every cascade, which happens once a frame on the main thread
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (int i = 0; i < BENCHMARK_SHADOW_ITERATIONS; ++i)
+	{
+		ShadowCascades::FitCascades(view, projection, lightDirection, SHADOW_MAX_CASCADES, SHADOW_SPLIT_LAMBDA, SHADOW_DISTANCE, SHADOW_MAP_SIZE, cascades);
+	}
+	results.push_back({ "shadows_fit_4_cascades", 1, SecondsSince(start) / BENCHMARK_SHADOW_ITERATIONS * 1e6, "us" });
+
+	// Culling the casters against every cascade
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+		start = BenchmarkClock::now();
+		for (int i = 0; i < BENCHMARK_SHADOW_ITERATIONS / 10; ++i)
+		{
+			ShadowCascades::CullCasters(cascades, SHADOW_MAX_CASCADES, casters.data(), casters.size(), visible.data(), counts, &jobs);
+		}
+		results.push_back({ "shadows_cull_16k_casters_4_cascades", threads, SecondsSince(start) / (BENCHMARK_SHADOW_ITERATIONS / 10) * 1e3, "ms" });
+	}
+}
+
+// The occluders' nearest depth at each pixel centre, from barycentrics rather than the
+// buffer's edge functions. inside is set where a triangle covers the centre with some room.
+static void RasterizeOcclusionReference(const std::vector<OcclusionMesh>& meshes, const XMFLOAT4X4& viewProjection,
+	std::vector<float>& depths, std::vector<uint8_t>& inside)
+{
+	depths.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+	inside.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 0);
+	for (const OcclusionMesh& mesh : meshes)
+	{
+		XMMATRIX transform = XMLoadFloat4x4(&mesh.World) * XMLoadFloat4x4(&viewProjection);
+		for (uint32_t t = 0; t + 2 < mesh.IndexCount; t += 3)
+		{
+			double x[3], y[3], z[3];
+			bool clipped = false;
+			for (int v = 0; v < 3; ++v)
+			{
+				XMFLOAT4 clip;
+				XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&mesh.pVertices[mesh.pIndices[t + v]]), transform));
+				clipped |= clip.z < 0.0f;
+				x[v] = (clip.x / clip.w * 0.5 + 0.5) * OCCLUSION_WIDTH;
+				y[v] = (0.5 - clip.y / clip.w * 0.5) * OCCLUSION_HEIGHT;
+				z[v] = clip.z / clip.w;
+			}
+			double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (clipped || fabs(area) < 1e-6)
+				continue;
+
+			int left = std::max((int)floor(std::min(x[0], std::min(x[1], x[2]))), 0);
+			int right = std::min((int)ceil(std::max(x[0], std::max(x[1], x[2]))), OCCLUSION_WIDTH - 1);
+			int top = std::max((int)floor(std::min(y[0], std::min(y[1], y[2]))), 0);
+			int bottom = std::min((int)ceil(std::max(y[0], std::max(y[1], y[2]))), OCCLUSION_HEIGHT - 1);
+			for (int py = top; py <= bottom; ++py)
+			{
+				for (int px = left; px <= right; ++px)
+				{
+					double cx = px + 0.5, cy = py + 0.5;
+					double b0 = ((x[1] - cx) * (y[2] - cy) - (x[2] - cx) * (y[1] - cy)) / area;
+					double b1 = ((x[2] - cx) * (y[0] - cy) - (x[0] - cx) * (y[2] - cy)) / area;
+					double b2 = 1.0 - b0 - b1;
+					double lowest = std::min(b0, std::min(b1, b2));
+					if (lowest < 0.0)
+						continue;
+					float& depth = depths[py * OCCLUSION_WIDTH + px];
+					depth = std::min(depth, (float)(b0 * z[0] + b1 * z[1] + b2 * z[2]));
+					inside[py * OCCLUSION_WIDTH + px] |= lowest > 0.01;
+				}
+			}
+		}
+	}
+}
+
+void Benchmark::OcclusionBenchmark(std::vector<BenchmarkResult>& results)
+{
+	// A camera with the buffer's aspect, looking down +z at a wall
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMMatrixPerspectiveFovLH(XM_PIDIV2, (float)OCCLUSION_WIDTH / OCCLUSION_HEIGHT, 0.1f, 100.0f));
+	XMFLOAT3 wall[4] = { XMFLOAT3(-5.0f, -5.0f, 10.0f), XMFLOAT3(5.0f, -5.0f, 10.0f), XMFLOAT3(-5.0f, 5.0f, 10.0f), XMFLOAT3(5.0f, 5.0f, 10.0f) };
+	uint32_t wallIndices[6] = { 0, 2, 1, 1, 2, 3 };
+	OcclusionMesh wallMesh = { wall, wallIndices, 6, {} };
+	XMStoreFloat4x4(&wallMesh.World, XMMatrixIdentity());
+
+	OcclusionBuffer buffer;
+	buffer.Begin(viewProjection);
+	buffer.Rasterize(&wallMesh, 1);
+	struct { OcclusionBounds Bounds; bool Visible; } cases[] =
+	{
+		{ { XMFLOAT3(-1.0f, -1.0f, 20.0f), XMFLOAT3(1.0f, 1.0f, 21.0f) }, false },	// behind the middle
+		{ { XMFLOAT3(-9.0f, -9.0f, 30.0f), XMFLOAT3(9.0f, 9.0f, 40.0f) }, false },	// behind, nearly as wide as it
+		{ { XMFLOAT3(-1.0f, -1.0f, 5.0f), XMFLOAT3(1.0f, 1.0f, 6.0f) }, true },		// in front
+		{ { XMFLOAT3(8.0f, -1.0f, 20.0f), XMFLOAT3(14.0f, 1.0f, 21.0f) }, true },	// behind but out past its edge
+		{ { XMFLOAT3(-1.0f, -1.0f, 9.0f), XMFLOAT3(1.0f, 1.0f, 11.0f) }, true },	// through it
+		{ { XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(1.0f, 1.0f, 20.0f) }, true },	// across the near plane
+		{ { XMFLOAT3(200.0f, -1.0f, 20.0f), XMFLOAT3(201.0f, 1.0f, 21.0f) }, true },	// off screen
+	};
+	bool wallCases = true;
+	for (const auto& test : cases)
+	{
+		wallCases &= buffer.IsVisible(test.Bounds) == test.Visible;
+	}
+	results.push_back(CheckResult("occlusion_wall_cases", 1, wallCases));
+
+	// The scene's terrain, its chunks' occluders under its surface everywhere
+	srand(31);
+	TerrainHeightmap heightmap;
+	heightmap.Generate(TerrainDiamondSquare);
+	std::vector<XMFLOAT3> occluderVertices;
+	std::vector<uint32_t> occluderIndices;
+	std::vector<uint32_t> occluderOffsets(1, 0);
+	for (int chunk = 0; chunk < heightmap.GetChunkCount(); ++chunk)
+	{
+		heightmap.BuildChunkOccluder(chunk, occluderVertices, occluderIndices);
+		occluderOffsets.push_back((uint32_t)occluderIndices.size());
+	}
+
+	const float* const* heights = heightmap.GetHeights();
+	int gridOffset = heightmap.GetSize() / 4;
+	float worstGap = -FLT_MAX;
+	for (size_t t = 0; t < occluderIndices.size(); t += 3)
+	{
+		for (int sample = 0; sample < BENCHMARK_OCCLUSION_SAMPLES; ++sample)
+		{
+			// A point on the occluder triangle against the terrain's triangle under it
+			float b0 = RandomFloat(0.0f, 1.0f), b1 = RandomFloat(0.0f, 1.0f - b0);
+			const XMFLOAT3& v0 = occluderVertices[occluderIndices[t]];
+			const XMFLOAT3& v1 = occluderVertices[occluderIndices[t + 1]];
+			const XMFLOAT3& v2 = occluderVertices[occluderIndices[t + 2]];
+			float b2 = 1.0f - b0 - b1;
+			float u = b0 * v0.x + b1 * v1.x + b2 * v2.x + gridOffset, v = b0 * v0.z + b1 * v1.z + b2 * v2.z + gridOffset;
+			int i = std::min((int)u, heightmap.GetSize() - 2), j = std::min((int)v, heightmap.GetSize() - 2);
+			float fu = u - i, fv = v - j;
+			float surface = fu + fv <= 1.0f ?
+				heights[i][j] + fu * (heights[i + 1][j] - heights[i][j]) + fv * (heights[i][j + 1] - heights[i][j]) :
+				heights[i + 1][j + 1] + (1.0f - fu) * (heights[i][j + 1] - heights[i + 1][j + 1]) + (1.0f - fv) * (heights[i + 1][j] - heights[i + 1][j + 1]);
+			worstGap = std::max(worstGap, b0 * v0.y + b1 * v1.y + b2 * v2.y - surface);
+		}
+	}
+	results.push_back(CheckResult("occlusion_terrain_occluders_below_surface", 1, worstGap <= 1e-4f));
+
+	// One occluder per chunk under the scene's transform, seen from just above the ground
+	XMFLOAT4X4 world;
+	XMStoreFloat4x4(&world, XMMatrixScaling(BENCHMARK_OCCLUSION_TERRAIN_SCALE, BENCHMARK_OCCLUSION_TERRAIN_SCALE, BENCHMARK_OCCLUSION_TERRAIN_SCALE) *
+		XMMatrixTranslation(0.0f, BENCHMARK_OCCLUSION_TERRAIN_Y, 0.0f));
+	std::vector<OcclusionMesh> meshes;
+	for (size_t chunk = 0; chunk + 1 < occluderOffsets.size(); ++chunk)
+	{
+		OcclusionMesh mesh = { occluderVertices.data(), occluderIndices.data() + occluderOffsets[chunk], occluderOffsets[chunk + 1] - occluderOffsets[chunk], world };
+		meshes.push_back(mesh);
+	}
+	auto groundHeight = [&](float x, float z)
+	{
+		return heightmap.Sample(x / BENCHMARK_OCCLUSION_TERRAIN_SCALE + gridOffset, z / BENCHMARK_OCCLUSION_TERRAIN_SCALE + gridOffset) *
+			BENCHMARK_OCCLUSION_TERRAIN_SCALE + BENCHMARK_OCCLUSION_TERRAIN_Y;
+	};
+	XMFLOAT3 eye(2.0f, 0.0f, 2.0f);
+	eye.y = groundHeight(eye.x, eye.z) + 0.3f;
+	XMFLOAT4X4 view, projection;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMLoadFloat3(&eye), XMVectorSet(1.0f, -0.1f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.01f, 100.0f));
+	XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+
+	// The buffer is never nearer than the occluders really are, and has them wherever
+	// they clearly cover a pixel
+	buffer.Begin(viewProjection);
+	buffer.Rasterize(meshes.data(), meshes.size());
+	std::vector<float> referenceDepths;
+	std::vector<uint8_t> referenceInside;
+	RasterizeOcclusionReference(meshes, viewProjection, referenceDepths, referenceInside);
+	bool neverNearer = true, covered = true;
+	float worstOffset = 0.0f;
+	for (int p = 0; p < OCCLUSION_WIDTH * OCCLUSION_HEIGHT; ++p)
+	{
+		float depth = buffer.GetDepths()[p];
+		neverNearer &= depth >= referenceDepths[p] - 1e-5f;
+		covered &= !referenceInside[p] || depth < 1.0f;
+		if (referenceInside[p])
+			worstOffset = std::max(worstOffset, depth - referenceDepths[p]);
+	}
+	results.push_back(CheckResult("occlusion_buffer_never_nearer", 1, neverNearer));
+	results.push_back(CheckResult("occlusion_buffer_covered", 1, covered));
+	results.push_back({ "occlusion_worst_depth_offset", 1, worstOffset, "depth" });
+
+	// The same buffer from every thread count
+	std::vector<float> singleThreaded(buffer.GetDepths(), buffer.GetDepths() + OCCLUSION_WIDTH * OCCLUSION_HEIGHT);
+	bool threadsMatch = true;
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+		buffer.Begin(viewProjection);
+		buffer.Rasterize(meshes.data(), meshes.size(), &jobs);
+		threadsMatch &= memcmp(singleThreaded.data(), buffer.GetDepths(), singleThreaded.size() * sizeof(float)) == 0;
+	}
+	results.push_back(CheckResult("occlusion_threads_match", 1, threadsMatch));
+
+	// The terrain's own chunks and boxes on the ground around the camera. Skipping whole
+	// tiles has to agree with testing every pixel, and a hidden box has every one of its
+	// points behind the occluders' real depth.
+	std::vector<OcclusionBounds> boxes;
+	for (int chunk = 0; chunk < heightmap.GetChunkCount(); ++chunk)
+	{
+		TerrainChunkBounds chunkBounds = heightmap.GetChunkBounds(chunk);
+		XMVECTOR minimum = XMVector3Transform(XMLoadFloat3(&chunkBounds.Min), XMLoadFloat4x4(&world));
+		XMVECTOR maximum = XMVector3Transform(XMLoadFloat3(&chunkBounds.Max), XMLoadFloat4x4(&world));
+		OcclusionBounds bounds;
+		XMStoreFloat3(&bounds.Min, minimum);
+		XMStoreFloat3(&bounds.Max, maximum);
+		boxes.push_back(bounds);
+	}
+	for (int i = 0; i < BENCHMARK_OCCLUSION_BOXES; ++i)
+	{
+		float x = RandomFloat(-12.0f, 38.0f), z = RandomFloat(-12.0f, 38.0f), size = RandomFloat(0.05f, 0.5f);
+		float ground = groundHeight(x, z);
+		OcclusionBounds bounds = { XMFLOAT3(x - size, ground, z - size), XMFLOAT3(x + size, ground + size * 2.0f, z + size) };
+		boxes.push_back(bounds);
+	}
+
+	std::vector<uint8_t> visible(boxes.size());
+	uint32_t occluded = buffer.Test(boxes.data(), boxes.size(), visible.data());
+	bool hierarchyMatches = true, hiddenBehind = true;
+	XMMATRIX viewProjectionMatrix = XMLoadFloat4x4(&viewProjection);
+	for (size_t b = 0; b < boxes.size(); ++b)
+	{
+		// Every pixel under the box's rectangle, no tiles
+		const OcclusionBounds& bounds = boxes[b];
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+		bool crossesNear = false;
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(corner & 1 ? bounds.Max.x : bounds.Min.x, corner & 2 ? bounds.Max.y : bounds.Min.y,
+				corner & 4 ? bounds.Max.z : bounds.Min.z, 1.0f), viewProjectionMatrix));
+			crossesNear |= clip.z < 0.0f;
+			minX = std::min(minX, (clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH);
+			maxX = std::max(maxX, (clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH);
+			minY = std::min(minY, (0.5f - clip.y / clip.w * 0.5f) * OCCLUSION_HEIGHT);
+			maxY = std::max(maxY, (0.5f - clip.y / clip.w * 0.5f) * OCCLUSION_HEIGHT);
+			nearest = std::min(nearest, clip.z / clip.w);
+		}
+		int left = std::max((int)floorf(minX), 0), right = std::min((int)floorf(maxX), OCCLUSION_WIDTH - 1);
+		int top = std::max((int)floorf(minY), 0), bottom = std::min((int)floorf(maxY), OCCLUSION_HEIGHT - 1);
+		bool expected = crossesNear || left > right || top > bottom;
+		for (int y = top; y <= bottom && !expected; ++y)
+		{
+			for (int x = left; x <= right && !expected; ++x)
+			{
+				expected = buffer.GetDepths()[y * OCCLUSION_WIDTH + x] >= nearest;
+			}
+		}
+		hierarchyMatches &= (visible[b] != 0) == expected;
+
+		for (int sample = 0; sample < BENCHMARK_OCCLUSION_SAMPLES && !visible[b]; ++sample)
+		{
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(RandomFloat(bounds.Min.x, bounds.Max.x), RandomFloat(bounds.Min.y, bounds.Max.y),
+				RandomFloat(bounds.Min.z, bounds.Max.z), 1.0f), viewProjectionMatrix));
+			int x = (int)((clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH), y = (int)((0.5f - clip.y / clip.w * 0.5f) * OCCLUSION_HEIGHT);
+			if (x >= 0 && x < OCCLUSION_WIDTH && y >= 0 && y < OCCLUSION_HEIGHT)
+				hiddenBehind &= referenceDepths[y * OCCLUSION_WIDTH + x] < clip.z / clip.w;
+		}
+	}
+	results.push_back(CheckResult("occlusion_hierarchy_matches_pixels", 1, hierarchyMatches));
+	results.push_back(CheckResult("occlusion_hidden_boxes_behind", 1, hiddenBehind));
+	results.push_back({ "occlusion_occluder_triangles", 1, (double)buffer.GetStats().Triangles, "triangles" });
+	results.push_back({ "occlusion_boxes_tested", 1, (double)boxes.size(), "boxes" });
+	results.push_back({ "occlusion_boxes_occluded", 1, (double)occluded, "boxes" });
+
+	// Rasterising the terrain's occluders and testing every box, per frame
+	for (unsigned threads : g_benchmarkThreadCounts)
+	{
+		JobSystem jobs(threads);
+		double rasterSeconds = 0.0, testSeconds = 0.0;
+		for (int i = 0; i < BENCHMARK_OCCLUSION_ITERATIONS; ++i)
+		{
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			buffer.Begin(viewProjection);
+			buffer.Rasterize(meshes.data(), meshes.size(), &jobs);
+			rasterSeconds += SecondsSince(start);
+			start = BenchmarkClock::now();
+			buffer.Test(boxes.data(), boxes.size(), visible.data(), &jobs);
+			testSeconds += SecondsSince(start);
+		}
+		results.push_back({ "occlusion_rasterize_terrain", threads, rasterSeconds / BENCHMARK_OCCLUSION_ITERATIONS * 1e3, "ms" });
+		results.push_back({ "occlusion_test_10k_boxes", threads, testSeconds / BENCHMARK_OCCLUSION_ITERATIONS * 1e3, "ms" });
+	}
+}
+
+void Benchmark::FlythroughBenchmark(std::vector<BenchmarkResult>& results, const std::string& framesPath)
+{
+	// Camera dependent CPU work for one frame: the view matrix and screen space
+	// tessellation of a field of spline curves from the current eye position
+	srand(1);
+	std::vector<SplineCurve> curves(BENCHMARK_FLYTHROUGH_CURVES);
+	for (size_t c = 0; c < curves.size(); ++c)
+	{
+		std::vector<XMFLOAT3> points;
+		for (int i = 0; i < 8; ++i)
+		{
+			points.push_back(XMFLOAT3((float)(c % 8) * 3.0f, rand() / (float)RAND_MAX * 2.0f, (float)(c / 8) * 3.0f + i * 0.5f));
+		}
+		curves[c].SetControlPoints(points);
+	}
+
+	CameraTrack track = CameraTrack::CreateDefault();
+	CameraPathPlayer player;
+	player.PlayTrack(&track);
+
+	std::vector<FrameTiming> frames;
+	std::vector<XMFLOAT3> polyline;
+	CameraInputFrame noInput = { 0.0f, 0.0f, 0 };
+	while (!player.IsFinished())
+	{
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		player.Advance(player.GetTimestep(), noInput);
+
+		const CameraPose& pose = player.GetPose();
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, CameraControl::GetViewMatrix(pose));
+
+		SplineTessellationSettings settings;
+		settings.CameraPosition = pose.Eye;
+		for (SplineCurve& curve : curves)
+		{
+			polyline.clear();
+			curve.Tessellate(settings, polyline);
+		}
+
+		FrameTiming frame = { (unsigned)frames.size(), player.GetTime(), { pose.Eye.x, pose.Eye.y, pose.Eye.z }, SecondsSince(start) * 1000.0 };
+		frames.push_back(frame);
+	}
+
+	double total = 0.0;
+	double worst = 0.0;
+	for (const FrameTiming& frame : frames)
+	{
+		total += frame.CpuMilliseconds;
+		worst = std::max(worst, frame.CpuMilliseconds);
+	}
+	results.push_back({ "flythrough_frames", 1, (double)frames.size(), "frames" });
+	results.push_back({ "flythrough_avg", 1, total / frames.size(), "ms/frame" });
+	results.push_back({ "flythrough_worst", 1, worst, "ms/frame" });
+	if (!WriteFrameTimings(framesPath, frames))
+		fprintf(stderr, "Could not write %s\n", framesPath.c_str());
+
+	// Record scripted input at an uneven frame rate, save and reload it, then replay
+	CameraPathPlayer recorder;
+	recorder.SetPose(player.GetPose());
+	recorder.StartRecording();
+	for (int i = 0; i < BENCHMARK_REPLAY_STEPS; ++i)
+	{
+		CameraInputFrame input = { (float)(i % 7) - 3.0f, (float)(i % 5) - 2.0f, (uint32_t)(1 << (i / 50 % 6)) };
+		recorder.Advance((i % 3 + 1) * 0.011f, input);
+	}
+	CameraPose recorded = recorder.GetPose();
+
+	std::stringstream stream;
+	recorder.SaveRecording(stream);
+	CameraPathPlayer replayer;
+	replayer.LoadRecording(stream);
+	replayer.StartReplay();
+	while (!replayer.IsFinished())
+	{
+		replayer.Advance(replayer.GetTimestep(), noInput);
+	}
+
+	const CameraPose& replayed = replayer.GetPose();
+	XMVECTOR drift = XMVectorSubtract(XMLoadFloat3(&recorded.Eye), XMLoadFloat3(&replayed.Eye));
+	results.push_back({ "flythrough_replay_drift", 1, XMVectorGetX(XMVector3Length(drift)), "units" });
+	results.push_back({ "flythrough_replay_steps", 1, (double)recorder.GetRecordingLength(), "steps" });
+}
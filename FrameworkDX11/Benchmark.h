@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Headless CPU benchmarks, started with "-benchmark <name|all> [-out <file>]", whole
+// frames of a scenario with "-scenario" (see BenchmarkScenario.h) or single kernels
+// with "-micro" (see MicroBenchmark.h). Nothing here touches the window or the
+// device, so the benchmarks can run on machines without a GPU and the results are
+// written as plain CSV lines.
+enum BenchmarkCheck
+{
+	BENCHMARK_CHECK_NONE,		// a measurement
+	BENCHMARK_CHECK_PASSED,
+	BENCHMARK_CHECK_FAILED,		// the run exits with 1
+};
+
+struct BenchmarkResult
+{
+	std::string		Name;
+	unsigned		Threads;
+	double			Value;
+	std::string		Unit;
+	BenchmarkCheck	Check = BENCHMARK_CHECK_NONE;
+};
+
+// One rendered or simulated frame of a camera flythrough
+struct FrameTiming
+{
+	unsigned	Frame;
+	float		Time;
+	float		Eye[3];
+	double		CpuMilliseconds;
+};
+
+class Benchmark
+{
+public:
+	static bool IsRequested(const std::string& commandLine);
+
+	// Runs the requested benchmarks and writes the results, returns the process exit code
+	static int Run(const std::string& commandLine);
+
+	static std::string GetArgument(const std::string& commandLine, const std::string& name, const std::string& fallback);
+	static bool WriteFrameTimings(const std::string& path, const std::vector<FrameTiming>& frames);
+
+private:
+	static bool WriteResults(const std::string& path, const std::vector<BenchmarkResult>& results);
+
+	static void SkinningBenchmark(std::vector<BenchmarkResult>& results);
+	static void AnimationBenchmark(std::vector<BenchmarkResult>& results);
+	static void IKBenchmark(std::vector<BenchmarkResult>& results);
+	static void SplineBenchmark(std::vector<BenchmarkResult>& results);
+	static void StateCacheBenchmark(std::vector<BenchmarkResult>& results);
+	static void ConstantRingBenchmark(std::vector<BenchmarkResult>& results);
+	static void RenderQueueBenchmark(std::vector<BenchmarkResult>& results);
+	static void CommandRecordingBenchmark(std::vector<BenchmarkResult>& results);
+	static void ShaderCacheBenchmark(std::vector<BenchmarkResult>& results);
+	static void ShaderPermutationBenchmark(std::vector<BenchmarkResult>& results);
+	static void HotReloadBenchmark(std::vector<BenchmarkResult>& results);
+	static void FrameTimerBenchmark(std::vector<BenchmarkResult>& results);
+	static void ProfilerBenchmark(std::vector<BenchmarkResult>& results);
+	static void GpuProfilerBenchmark(std::vector<BenchmarkResult>& results);
+	static void FrameGraphBenchmark(std::vector<BenchmarkResult>& results);
+	static void RenderTargetFormatBenchmark(std::vector<BenchmarkResult>& results);
+	static void BloomBenchmark(std::vector<BenchmarkResult>& results);
+	static void TiledBlurBenchmark(std::vector<BenchmarkResult>& results);
+	static void MotionBlurBenchmark(std::vector<BenchmarkResult>& results);
+	static void LightClusterBenchmark(std::vector<BenchmarkResult>& results);
+	static void ShadowBenchmark(std::vector<BenchmarkResult>& results);
+	static void OcclusionBenchmark(std::vector<BenchmarkResult>& results);
+	static void FlythroughBenchmark(std::vector<BenchmarkResult>& results, const std::string& framesPath);
+};
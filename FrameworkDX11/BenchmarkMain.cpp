@@ -0,0 +1,28 @@
+// Entry point for the headless benchmarks where there is no wWinMain. Only the
+// device independent sources are needed, e.g. on Linux with the DirectXMath headers:
+//   g++ -std=c++14 -O2 -I<DirectXMath>/Inc BenchmarkMain.cpp Benchmark.cpp BenchmarkScenario.cpp
+//     JobSystem.cpp Skinning.cpp Animation.cpp BlendTree.cpp FrameArena.cpp IK.cpp SplineCurve.cpp
+//     CameraPath.cpp RenderQueue.cpp CommandRecorder.cpp ShaderCache.cpp ShaderPermutation.cpp
+//     ShaderReloader.cpp FrameTimer.cpp Profiler.cpp GpuProfiler.cpp TerrainHeightmap.cpp
+//     MeshVectors.cpp Culling.cpp MicroBenchmark.cpp DDSHeader.cpp FrameGraph.cpp RenderTargetFormats.cpp BloomKernel.cpp
+//     TiledBlur.cpp VelocityTiles.cpp LightClusters.cpp ShadowCascades.cpp OcclusionCulling.cpp -lpthread -o benchmark
+//   ./benchmark -scenario all -count 600 -out scenario_results.json
+//   ./benchmark -micro all -baseline micro_results.csv -out micro_now.csv
+#ifndef _WIN32
+#include "Benchmark.h"
+
+int main(int argc, char** argv)
+{
+	std::string commandLine;
+	for (int i = 1; i < argc; ++i)
+	{
+		commandLine += argv[i];
+		commandLine += ' ';
+	}
+
+	// Same defaults as the Windows build, which only benchmarks when asked to
+	if (!Benchmark::IsRequested(commandLine))
+		commandLine = "-benchmark all " + commandLine;
+	return Benchmark::Run(commandLine);
+}
+#endif
@@ -0,0 +1,462 @@
+#include "BenchmarkScenario.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "BlendTree.h"
+#include "Skinning.h"
+#include "CameraPath.h"
+#include "TerrainHeightmap.h"
+#include "Culling.h"
+#include "RenderQueue.h"
+#include "CommandRecorder.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define SCENARIO_CHARACTER_BONES 32
+#define SCENARIO_CHARACTER_VERTICES 2048
+#define SCENARIO_OBJECT_RADIUS 0.75f
+#define SCENARIO_CHARACTER_RADIUS 1.5f
+#define SCENARIO_FAR_PLANE 100.0f
+#define SCENARIO_SEED 1
+
+// Where main places the terrain
+#define SCENARIO_TERRAIN_Y -6.5f
+#define SCENARIO_TERRAIN_SCALE 0.1f
+
+static const char* g_scenarioTerrainNames[TerrainTypeCount] = { "From File", "Fault Lines", "Particle Deposition", "Diamond Square" };
+
+// Counts the draws the queue would issue, the scenario has no device to give them to
+class ScenarioRenderBackend : public RenderBackend
+{
+public:
+	void BindShader(uint32_t /*shader*/) {}
+	void BindMaterial(uint32_t /*material*/) {}
+	void BindMesh(uint32_t /*mesh*/) {}
+	void BindObject(uint32_t /*object*/) {}
+	void Draw(const RenderPacket& /*packet*/) { ++Draws; }
+
+	uint32_t Draws = 0;
+};
+
+static float GetTerrainHeight(const TerrainHeightmap& heightmap, float x, float z)
+{
+	// Same mapping as TerrainGameObject::GetHeight
+	float u = x / SCENARIO_TERRAIN_SCALE + TERRAIN_GRID_SIZE / 4;
+	float v = z / SCENARIO_TERRAIN_SCALE + TERRAIN_GRID_SIZE / 4;
+	return heightmap.Sample(u, v) * SCENARIO_TERRAIN_SCALE + SCENARIO_TERRAIN_Y;
+}
+
+static float RandomRange(float low, float high)
+{
+	return low + (high - low) * rand() / (float)RAND_MAX;
+}
+
+const std::vector<BenchmarkScenario>& ScenarioRunner::GetScenarios()
+{
+	static const std::vector<BenchmarkScenario> scenarios =
+	{
+		{ "default", TerrainFromFile, 16, 1, 0 },
+		{ "fault_lines", TerrainFaultLines, 512, 16, ScenarioPostBloom },
+		{ "diamond_square_crowd", TerrainDiamondSquare, 2048, 128, ScenarioPostBloom | ScenarioPostDepth },
+		{ "particle_deposition_heavy", TerrainParticleDeposition, 8192, 256, ScenarioPostBloom | ScenarioPostDepth }
+	};
+	return scenarios;
+}
+
+const BenchmarkScenario* ScenarioRunner::FindScenario(const std::string& name)
+{
+	for (const BenchmarkScenario& scenario : GetScenarios())
+	{
+		if (name == scenario.Name)
+			return &scenario;
+	}
+	return nullptr;
+}
+
+int ScenarioRunner::Run(const std::string& commandLine)
+{
+	std::string name = Benchmark::GetArgument(commandLine, "-scenario", "all");
+	std::string path = Benchmark::GetArgument(commandLine, "-out", SCENARIO_RESULTS_FILE);
+	int frames = atoi(Benchmark::GetArgument(commandLine, "-count", std::to_string(SCENARIO_DEFAULT_FRAMES)).c_str());
+	int threads = atoi(Benchmark::GetArgument(commandLine, "-threads", "0").c_str());
+
+	std::vector<const BenchmarkScenario*> selected;
+	for (const BenchmarkScenario& scenario : GetScenarios())
+	{
+		if (name == "all" || name == scenario.Name)
+			selected.push_back(&scenario);
+	}
+	if (selected.empty() || frames <= 0 || threads < 0)
+	{
+		fprintf(stderr, "Unknown scenario or bad arguments: %s\nScenarios:", commandLine.c_str());
+		for (const BenchmarkScenario& scenario : GetScenarios())
+		{
+			fprintf(stderr, " %s", scenario.Name);
+		}
+		fprintf(stderr, "\n");
+		return 1;
+	}
+
+	std::vector<ScenarioReport> reports(selected.size());
+	for (size_t i = 0; i < selected.size(); ++i)
+	{
+		RunScenario(*selected[i], (uint32_t)frames, (unsigned)threads, reports[i]);
+		const ScenarioStatistics& frame = reports[i].FrameMilliseconds;
+		printf("%s: %u frames, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+			selected[i]->Name, frame.Samples, frame.P50, frame.P95, frame.P99, frame.Max);
+	}
+
+	std::ofstream file(path);
+	if (!file || !WriteJson(file, reports))
+	{
+		fprintf(stderr, "Could not write %s\n", path.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+void ScenarioRunner::RunScenario(const BenchmarkScenario& scenario, uint32_t frames, unsigned threads, ScenarioReport& report)
+{
+	report = {};
+	report.pScenario = &scenario;
+	report.Frames = frames;
+
+	JobSystem jobs(threads);
+	report.Threads = jobs.GetThreadCount();
+	srand(SCENARIO_SEED);
+
+	// Setup: the terrain and its mesh, timed once
+	TerrainHeightmap heightmap;
+	uint64_t start = Profiler::Now();
+	heightmap.Generate(scenario.TerrainType);
+	report.TerrainMilliseconds = (Profiler::Now() - start) / 1000000.0;
+
+	std::vector<SimpleVertex> terrainVertices(heightmap.GetVertexCount());
+	start = Profiler::Now();
+	heightmap.BuildVertices(terrainVertices.data());
+	report.MeshMilliseconds = (Profiler::Now() - start) / 1000000.0;
+
+	// Characters share one blend tree and bind pose, like the animation benchmark
+	const uint32_t bones = SCENARIO_CHARACTER_BONES;
+	AnimationClip* pIdle = AnimationClip::CreateChainSwing(bones, 0.25f, { 0.0f, 0.0f, 1.0f }, 0.05f, 1.0f);
+	AnimationClip* pWalk = AnimationClip::CreateChainSwing(bones, 0.25f, { 1.0f, 0.0f, 0.0f }, 0.4f, 2.0f);
+	AnimationClip* pStrafe = AnimationClip::CreateChainSwing(bones, 0.25f, { 0.0f, 0.0f, 1.0f }, 0.4f, 2.0f);
+	BlendTree tree(bones);
+	tree.SetRoot(tree.AddBlend2D(0, 1, { tree.AddClip(pIdle), tree.AddClip(pWalk), tree.AddClip(pStrafe) },
+		{ XMFLOAT2(0.0f, 0.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT2(1.0f, 0.0f) }));
+
+	std::vector<int> parents(bones);
+	for (uint32_t i = 0; i < bones; ++i)
+	{
+		parents[i] = (int)i - 1;
+	}
+
+	std::vector<AnimationInstance> instances(scenario.Characters);
+	for (AnimationInstance& instance : instances)
+	{
+		instance = {};
+		instance.pTree = &tree;
+		instance.pParents = parents.data();
+		instance.Parameters[0] = RandomRange(0.0f, 1.0f);
+		instance.Parameters[1] = RandomRange(0.0f, 1.0f);
+		instance.Speed = RandomRange(0.8f, 1.2f);
+	}
+
+	std::vector<SkinnedVertex> bindPose(SCENARIO_CHARACTER_VERTICES);
+	for (size_t i = 0; i < bindPose.size(); ++i)
+	{
+		SkinnedVertex& v = bindPose[i];
+		v = {};
+		v.Pos = XMFLOAT3(RandomRange(-0.5f, 0.5f), i * 0.25f * bones / bindPose.size(), RandomRange(-0.5f, 0.5f));
+		v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		uint8_t bone = (uint8_t)(i * bones / bindPose.size());
+		v.BoneIndices[0] = bone;
+		v.BoneIndices[1] = bone + 1u < bones ? bone + 1 : bone;
+		v.BoneWeights = XMFLOAT4(0.75f, 0.25f, 0.0f, 0.0f);
+	}
+	std::vector<std::vector<SimpleVertex>> skinned(scenario.Characters, std::vector<SimpleVertex>(bindPose.size()));
+	FrameArena arena(scenario.Characters * bones * (sizeof(BoneTransform) * 4 + sizeof(XMFLOAT4X4)) + 64 * 1024);
+
+	// Objects and characters wander around anchors spread over the terrain, y holds the phase
+	const float low = -TERRAIN_GRID_SIZE / 4 * SCENARIO_TERRAIN_SCALE;
+	const float high = low + (TERRAIN_GRID_SIZE - 1) * SCENARIO_TERRAIN_SCALE;
+	uint32_t drawables = scenario.Objects + scenario.Characters;
+	std::vector<XMFLOAT3> anchors(drawables);
+	for (XMFLOAT3& anchor : anchors)
+	{
+		anchor = XMFLOAT3(RandomRange(low, high), RandomRange(0.0f, XM_2PI), RandomRange(low, high));
+	}
+	std::vector<XMFLOAT4> spheres(drawables);
+	std::vector<uint8_t> visible(drawables);
+
+	CameraTrack track = CameraTrack::CreateDefault();
+	CameraPathPlayer player;
+	player.PlayTrack(&track);
+	CameraInputFrame noInput = { 0.0f, 0.0f, 0 };
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, SCENARIO_FAR_PLANE);
+
+	RenderQueue queue;
+	RenderStateFilter filter;
+	ScenarioRenderBackend renderBackend;
+	LogCommandBackend commandBackend(report.Threads);
+	CommandRecorder recorder(&commandBackend, &jobs);
+
+	report.SetupPeakBytes = GetPeakProcessMemory();
+
+	// Anything left from before the run shouldn't land in the first frame
+	Profiler::EndFrame();
+
+	std::vector<double> frameTimes;
+	std::vector<std::vector<double>> subsystemTimes;
+	double visibleTotal = 0.0;
+	float time = 0.0f;
+	for (uint32_t frame = 0; frame < frames; ++frame)
+	{
+		uint64_t frameStart = Profiler::Now();
+		{
+			PROFILE_ZONE("Scenario Frame");
+			time += SCENARIO_TIMESTEP;
+
+			XMMATRIX view;
+			{
+				PROFILE_ZONE("Camera");
+				if (player.IsFinished())
+					player.PlayTrack(&track);
+				player.Advance(SCENARIO_TIMESTEP, noInput);
+				view = CameraControl::GetViewMatrix(player.GetPose());
+			}
+
+			{
+				PROFILE_ZONE("Animation");
+				arena.Reset();
+				Animation::EvaluateInstances(instances.data(), instances.size(), SCENARIO_TIMESTEP, arena, &jobs);
+			}
+
+			{
+				PROFILE_ZONE("Skinning");
+				for (size_t c = 0; c < instances.size(); ++c)
+				{
+					SkinningPalette palette;
+					Skinning::BuildPalette(instances[c].pModelTransforms, bones, palette);
+					Skinning::SkinVertices(bindPose.data(), skinned[c].data(), bindPose.size(), palette, LinearBlendSkinning, &jobs);
+				}
+			}
+
+			{
+				PROFILE_ZONE("Terrain");
+				for (uint32_t i = 0; i < drawables; ++i)
+				{
+					float angle = anchors[i].y + time * (0.2f + (i % 7) * 0.05f);
+					float x = anchors[i].x + cosf(angle);
+					float z = anchors[i].z + sinf(angle);
+					float radius = i < scenario.Objects ? SCENARIO_OBJECT_RADIUS : SCENARIO_CHARACTER_RADIUS;
+					spheres[i] = XMFLOAT4(x, GetTerrainHeight(heightmap, x, z) + radius, z, radius);
+				}
+			}
+
+			uint32_t visibleCount;
+			{
+				PROFILE_ZONE("Culling");
+				XMFLOAT4X4 viewProjection;
+				XMStoreFloat4x4(&viewProjection, view * projection);
+				CullingFrustum frustum;
+				Culling::ExtractFrustum(viewProjection, frustum);
+				visibleCount = Culling::CullSpheres(frustum, spheres.data(), spheres.size(), visible.data(), &jobs);
+				visibleTotal += visibleCount;
+			}
+
+			{
+				PROFILE_ZONE("Render Queue");
+				queue.Clear();
+				queue.Reserve(visibleCount + 1);
+				const XMFLOAT3& eye = player.GetPose().Eye;
+				for (uint32_t i = 0; i < drawables; ++i)
+				{
+					if (!visible[i])
+						continue;
+					float dx = spheres[i].x - eye.x;
+					float dy = spheres[i].y - eye.y;
+					float dz = spheres[i].z - eye.z;
+					uint32_t depth = DrawKey::QuantizeDepth(sqrtf(dx * dx + dy * dy + dz * dz), SCENARIO_FAR_PLANE);
+					bool character = i >= scenario.Objects;
+					RenderPacket packet = { 0, character ? 4u : i % 4, i % 16, character ? 1u : 2u + i % 8, i, 36, 0 };
+					packet.Key = DrawKey::Make(0, RenderLayerOpaque, packet.Shader, packet.Material, depth);
+					queue.Submit(packet);
+				}
+				RenderPacket terrain = { DrawKey::Make(0, RenderLayerOpaque, 5, 16, 0), 5, 16, 0, drawables, (uint32_t)heightmap.GetVertexCount(), 0 };
+				queue.Submit(terrain);
+				queue.Sort();
+				report.MaxQueuePackets = std::max<uint64_t>(report.MaxQueuePackets, queue.GetSize());
+			}
+
+			{
+				PROFILE_ZONE("Record");
+				commandBackend.ClearExecuted();
+				renderBackend.Draws = 0;
+				size_t packets = queue.GetSize();
+				if (scenario.PostEffects & ScenarioPostDepth)
+				{
+					recorder.AddPass("Depth", [&](uint32_t r)
+					{
+						for (size_t i = 0; i < packets; ++i)
+						{
+							commandBackend.Emit(r, queue.GetSorted(i).Object);
+						}
+					});
+				}
+				recorder.AddPass("Scene", [&](uint32_t r)
+				{
+					queue.Execute(renderBackend, filter);
+					commandBackend.Emit(r, renderBackend.Draws);
+				});
+				if (scenario.PostEffects & ScenarioPostBloom)
+				{
+					recorder.AddPass("Bloom", [&](uint32_t r)
+					{
+						for (uint32_t i = 0; i < 4; ++i)
+						{
+							commandBackend.Emit(r, i);
+						}
+					});
+				}
+				recorder.AddPass("Screen Quad", [&](uint32_t r) { commandBackend.Emit(r, 0); });
+				recorder.Flush();
+			}
+		}
+		frameTimes.push_back((Profiler::Now() - frameStart) / 1000000.0);
+
+		// Direct children of the frame zone, in the order they first ran
+		Profiler::EndFrame();
+		const std::vector<ProfilerNode>& nodes = Profiler::GetFrameTree();
+		for (size_t n = 0; n < nodes.size(); ++n)
+		{
+			if (nodes[n].Parent < 0 || nodes[nodes[n].Parent].Depth != 0 || strcmp(nodes[nodes[n].Parent].Name, "Scenario Frame") != 0)
+				continue;
+
+			size_t index = 0;
+			while (index < report.Subsystems.size() && report.Subsystems[index].Name != nodes[n].Name)
+			{
+				++index;
+			}
+			if (index == report.Subsystems.size())
+			{
+				report.Subsystems.push_back({ nodes[n].Name, {} });
+				subsystemTimes.emplace_back();
+			}
+			subsystemTimes[index].push_back(nodes[n].TotalMilliseconds);
+		}
+	}
+
+	report.FrameMilliseconds = GetStatistics(frameTimes);
+	for (size_t i = 0; i < report.Subsystems.size(); ++i)
+	{
+		report.Subsystems[i].Milliseconds = GetStatistics(subsystemTimes[i]);
+	}
+	report.AverageVisibleObjects = frames > 0 ? visibleTotal / frames : 0.0;
+	report.FrameArenaHighWater = arena.GetHighWater();
+	report.PeakBytes = GetPeakProcessMemory();
+
+	delete pIdle;
+	delete pWalk;
+	delete pStrafe;
+}
+
+ScenarioStatistics ScenarioRunner::GetStatistics(std::vector<double> samples)
+{
+	ScenarioStatistics stats = {};
+	stats.Samples = (uint32_t)samples.size();
+	if (samples.empty())
+		return stats;
+
+	std::sort(samples.begin(), samples.end());
+	double total = 0.0;
+	for (double sample : samples)
+	{
+		total += sample;
+	}
+
+	size_t last = samples.size() - 1;
+	stats.Mean = total / samples.size();
+	stats.Min = samples.front();
+	stats.Max = samples.back();
+	stats.P50 = samples[last * 50 / 100];
+	stats.P95 = samples[last * 95 / 100];
+	stats.P99 = samples[last * 99 / 100];
+	return stats;
+}
+
+static void WriteStatistics(std::ostream& stream, const ScenarioStatistics& stats)
+{
+	stream << "{\"samples\":" << stats.Samples << ",\"mean\":" << stats.Mean << ",\"min\":" << stats.Min
+		<< ",\"p50\":" << stats.P50 << ",\"p95\":" << stats.P95 << ",\"p99\":" << stats.P99 << ",\"max\":" << stats.Max << "}";
+}
+
+bool ScenarioRunner::WriteJson(std::ostream& stream, const std::vector<ScenarioReport>& reports)
+{
+	// Times in milliseconds, memory in bytes. Names are plain identifiers, so nothing needs escaping.
+	stream.setf(std::ios::fixed);
+	stream.precision(6);
+	stream << "{\"timestep\":" << SCENARIO_TIMESTEP << ",\"scenarios\":[";
+	stream.precision(4);
+	for (size_t i = 0; i < reports.size(); ++i)
+	{
+		const ScenarioReport& report = reports[i];
+		const BenchmarkScenario& scenario = *report.pScenario;
+		stream << (i ? ",\n" : "\n") << "{\"name\":\"" << scenario.Name << "\",\"terrain\":\"" << g_scenarioTerrainNames[scenario.TerrainType]
+			<< "\",\"objects\":" << scenario.Objects << ",\"characters\":" << scenario.Characters << ",\"post_effects\":[";
+		bool first = true;
+		if (scenario.PostEffects & ScenarioPostBloom)
+		{
+			stream << "\"bloom\"";
+			first = false;
+		}
+		if (scenario.PostEffects & ScenarioPostDepth)
+			stream << (first ? "" : ",") << "\"depth\"";
+
+		stream << "],\"frames\":" << report.Frames << ",\"threads\":" << report.Threads
+			<< ",\n \"setup_ms\":{\"terrain\":" << report.TerrainMilliseconds << ",\"mesh\":" << report.MeshMilliseconds << "}"
+			<< ",\n \"frame_ms\":";
+		WriteStatistics(stream, report.FrameMilliseconds);
+		stream << ",\n \"subsystems_ms\":{";
+		for (size_t s = 0; s < report.Subsystems.size(); ++s)
+		{
+			stream << (s ? ",\n  \"" : "\n  \"") << report.Subsystems[s].Name << "\":";
+			WriteStatistics(stream, report.Subsystems[s].Milliseconds);
+		}
+		stream << "},\n \"average_visible\":" << report.AverageVisibleObjects << ",\"max_queue_packets\":" << report.MaxQueuePackets
+			<< ",\n \"memory\":{\"setup_peak_bytes\":" << report.SetupPeakBytes << ",\"peak_bytes\":" << report.PeakBytes
+			<< ",\"frame_arena_high_water_bytes\":" << report.FrameArenaHighWater << "}}";
+	}
+	stream << "\n]}\n";
+	return !stream.fail();
+}
+
+uint64_t ScenarioRunner::GetPeakProcessMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	// Kilobytes on Linux
+	struct rusage usage = {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
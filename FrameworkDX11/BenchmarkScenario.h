@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#define SCENARIO_DEFAULT_FRAMES 600
+#define SCENARIO_TIMESTEP (1.0f / 60.0f)
+#define SCENARIO_RESULTS_FILE "scenario_results.json"
+
+enum ScenarioPostEffects
+{
+	ScenarioPostBloom = 1 << 0,
+	ScenarioPostDepth = 1 << 1
+};
+
+// A scene to run headless. The terrain type is a TerrainType, objects are static
+// drawables scattered over it and characters are animated and skinned on the CPU.
+struct BenchmarkScenario
+{
+	const char*	Name;
+	int			TerrainType;
+	uint32_t	Objects;
+	uint32_t	Characters;
+	uint32_t	PostEffects;
+};
+
+struct ScenarioStatistics
+{
+	uint32_t	Samples;
+	double		Mean;
+	double		Min;
+	double		Max;
+	double		P50;
+	double		P95;
+	double		P99;
+};
+
+struct ScenarioSubsystem
+{
+	std::string			Name;
+	ScenarioStatistics	Milliseconds;
+};
+
+// Everything measured for one scenario. Process peaks are for the whole process so
+// far, so later scenarios of an "all" run report at least the earlier ones' peak.
+struct ScenarioReport
+{
+	const BenchmarkScenario*		pScenario;
+	uint32_t						Frames;
+	unsigned						Threads;
+	double							TerrainMilliseconds;
+	double							MeshMilliseconds;
+	ScenarioStatistics				FrameMilliseconds;
+	std::vector<ScenarioSubsystem>	Subsystems;
+	double							AverageVisibleObjects;
+	uint64_t						SetupPeakBytes;
+	uint64_t						PeakBytes;
+	uint64_t						FrameArenaHighWater;
+	uint64_t						MaxQueuePackets;
+};
+
+// Runs the CPU side of a frame for a named scenario, with no window or device: camera,
+// animation, skinning, terrain queries, culling, the render queue and pass recording
+// into a log backend. Frames advance by SCENARIO_TIMESTEP however long they take, so
+// every run simulates exactly the same frames. Subsystem times come from the profiler.
+class ScenarioRunner
+{
+public:
+	// "-scenario <name|all> [-count <frames>] [-threads <n>] [-out <file>]", returns the exit code
+	static int Run(const std::string& commandLine);
+
+	static const std::vector<BenchmarkScenario>& GetScenarios();
+	static const BenchmarkScenario* FindScenario(const std::string& name);
+
+	// threads includes the calling thread, 0 uses every hardware thread
+	static void RunScenario(const BenchmarkScenario& scenario, uint32_t frames, unsigned threads, ScenarioReport& report);
+
+	// Nearest rank percentiles, like the frame timer
+	static ScenarioStatistics GetStatistics(std::vector<double> samples);
+
+	static bool WriteJson(std::ostream& stream, const std::vector<ScenarioReport>& reports);
+
+	// Peak working set on Windows, peak resident set elsewhere; 0 if unknown
+	static uint64_t GetPeakProcessMemory();
+};
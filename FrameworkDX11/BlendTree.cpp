@@ -0,0 +1,230 @@
+#include "BlendTree.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+
+#define ANIMATION_BATCH_SIZE 8
+#define BLEND_WEIGHT_EPSILON 0.0001f
+
+BlendTree::BlendTree(uint32_t boneCount)
+{
+	m_boneCount = boneCount;
+}
+
+int BlendTree::AddClip(const AnimationClip* pClip)
+{
+	BlendNode node;
+	node.Type = BlendNodeClip;
+	node.pClip = pClip;
+	m_nodes.push_back(node);
+	return (int)m_nodes.size() - 1;
+}
+
+int BlendTree::AddBlend1D(int parameter, const std::vector<int>& children, const std::vector<float>& thresholds)
+{
+	BlendNode node;
+	node.Type = BlendNode1D;
+	node.Parameters[0] = parameter;
+	node.Children = children;
+	for (size_t i = 0; i < thresholds.size(); ++i)
+	{
+		node.Positions.push_back(XMFLOAT2(thresholds[i], 0.0f));
+	}
+	m_nodes.push_back(node);
+	return (int)m_nodes.size() - 1;
+}
+
+int BlendTree::AddBlend2D(int parameterX, int parameterY, const std::vector<int>& children, const std::vector<XMFLOAT2>& positions)
+{
+	BlendNode node;
+	node.Type = BlendNode2D;
+	node.Parameters[0] = parameterX;
+	node.Parameters[1] = parameterY;
+	node.Children = children;
+	node.Positions = positions;
+	m_nodes.push_back(node);
+	return (int)m_nodes.size() - 1;
+}
+
+int BlendTree::AddAdditive(int base, int additive, int weightParameter)
+{
+	BlendNode node;
+	node.Type = BlendNodeAdditive;
+	node.Parameters[0] = weightParameter;
+	node.Children = { base, additive };
+	m_nodes.push_back(node);
+	return (int)m_nodes.size() - 1;
+}
+
+int BlendTree::AddMasked(int base, int layer, const std::vector<float>& boneMask, int weightParameter)
+{
+	BlendNode node;
+	node.Type = BlendNodeMasked;
+	node.Parameters[0] = weightParameter;
+	node.Children = { base, layer };
+	node.BoneMask = boneMask;
+	node.BoneMask.resize(m_boneCount, 0.0f);
+	m_nodes.push_back(node);
+	return (int)m_nodes.size() - 1;
+}
+
+bool BlendTree::Evaluate(const float* parameters, float time, FrameArena& arena, BoneTransform* out) const
+{
+	if (m_root < 0)
+	{
+		Pose::SetIdentity(out, m_boneCount);
+		return true;
+	}
+	return EvaluateNode(m_root, parameters, time, arena, out);
+}
+
+bool BlendTree::EvaluateNode(int index, const float* parameters, float time, FrameArena& arena, BoneTransform* out) const
+{
+	const BlendNode& node = m_nodes[index];
+	switch (node.Type)
+	{
+	case BlendNodeClip:
+		node.pClip->Sample(time, out);
+		return true;
+
+	case BlendNode1D:
+		return EvaluateBlend1D(node, parameters, time, arena, out);
+
+	case BlendNode2D:
+		return EvaluateBlend2D(node, parameters, time, arena, out);
+
+	case BlendNodeAdditive:
+	case BlendNodeMasked:
+	{
+		float weight = parameters[node.Parameters[0]];
+		if (!EvaluateNode(node.Children[0], parameters, time, arena, out))
+			return false;
+		if (weight <= BLEND_WEIGHT_EPSILON)
+			return true;
+
+		BoneTransform* layer = arena.Allocate<BoneTransform>(m_boneCount);
+		if (!layer || !EvaluateNode(node.Children[1], parameters, time, arena, layer))
+			return false;
+
+		if (node.Type == BlendNodeAdditive)
+			Pose::AddAdditive(out, layer, weight, out, m_boneCount);
+		else
+			Pose::BlendMasked(out, layer, node.BoneMask.data(), weight, out, m_boneCount);
+		return true;
+	}
+	}
+	return false;
+}
+
+bool BlendTree::EvaluateBlend1D(const BlendNode& node, const float* parameters, float time, FrameArena& arena, BoneTransform* out) const
+{
+	float value = parameters[node.Parameters[0]];
+	size_t count = node.Children.size();
+
+	// Clamp to the ends, otherwise only the two children either side are evaluated
+	if (value <= node.Positions[0].x || count == 1)
+		return EvaluateNode(node.Children[0], parameters, time, arena, out);
+	if (value >= node.Positions[count - 1].x)
+		return EvaluateNode(node.Children[count - 1], parameters, time, arena, out);
+
+	size_t upper = 1;
+	while (value > node.Positions[upper].x)
+		++upper;
+
+	float range = node.Positions[upper].x - node.Positions[upper - 1].x;
+	float weight = range > 0.0f ? (value - node.Positions[upper - 1].x) / range : 0.0f;
+
+	if (!EvaluateNode(node.Children[upper - 1], parameters, time, arena, out))
+		return false;
+	if (weight <= BLEND_WEIGHT_EPSILON)
+		return true;
+
+	BoneTransform* second = arena.Allocate<BoneTransform>(m_boneCount);
+	if (!second || !EvaluateNode(node.Children[upper], parameters, time, arena, second))
+		return false;
+
+	Pose::Blend(out, second, weight, out, m_boneCount);
+	return true;
+}
+
+bool BlendTree::EvaluateBlend2D(const BlendNode& node, const float* parameters, float time, FrameArena& arena, BoneTransform* out) const
+{
+	XMVECTOR point = XMVectorSet(parameters[node.Parameters[0]], parameters[node.Parameters[1]], 0.0f, 0.0f);
+
+	// Inverse distance weights, an exact hit on a sample point takes it outright
+	float weights[16];
+	size_t count = node.Children.size();
+	if (count > 16)
+		count = 16;
+
+	float total = 0.0f;
+	for (size_t i = 0; i < count; ++i)
+	{
+		float distanceSq = XMVectorGetX(XMVector2LengthSq(XMVectorSubtract(point, XMLoadFloat2(&node.Positions[i]))));
+		if (distanceSq < 1e-6f)
+			return EvaluateNode(node.Children[i], parameters, time, arena, out);
+
+		weights[i] = 1.0f / distanceSq;
+		total += weights[i];
+	}
+
+	// Fold the children in one at a time, each lerp weighted by its share so far
+	BoneTransform* child = nullptr;
+	float accumulated = 0.0f;
+	bool first = true;
+	for (size_t i = 0; i < count; ++i)
+	{
+		float weight = weights[i] / total;
+		if (weight <= BLEND_WEIGHT_EPSILON)
+			continue;
+
+		accumulated += weight;
+		if (first)
+		{
+			if (!EvaluateNode(node.Children[i], parameters, time, arena, out))
+				return false;
+			first = false;
+			continue;
+		}
+
+		if (!child)
+		{
+			child = arena.Allocate<BoneTransform>(m_boneCount);
+			if (!child)
+				return false;
+		}
+		if (!EvaluateNode(node.Children[i], parameters, time, arena, child))
+			return false;
+		Pose::Blend(out, child, weight / accumulated, out, m_boneCount);
+	}
+	return true;
+}
+
+void Animation::EvaluateInstances(AnimationInstance* instances, size_t count, float deltaTime, FrameArena& arena, JobSystem* pJobs)
+{
+	auto job = [&](size_t begin, size_t end, unsigned)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			AnimationInstance& instance = instances[i];
+			uint32_t boneCount = instance.pTree->GetBoneCount();
+			instance.Time += deltaTime * instance.Speed;
+
+			instance.pLocalPose = arena.Allocate<BoneTransform>(boneCount);
+			instance.pModelTransforms = arena.Allocate<XMFLOAT4X4>(boneCount);
+			if (!instance.pLocalPose || !instance.pModelTransforms ||
+				!instance.pTree->Evaluate(instance.Parameters, instance.Time, arena, instance.pLocalPose))
+			{
+				instance.pLocalPose = nullptr;
+				instance.pModelTransforms = nullptr;
+				continue;
+			}
+
+			Pose::LocalToModel(instance.pLocalPose, instance.pParents, boneCount, instance.pModelTransforms);
+		}
+	};
+
+	if (pJobs)
+		pJobs->ParallelFor(count, ANIMATION_BATCH_SIZE, job);
+	else
+		job(0, count, 0);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "Animation.h"
+
+class FrameArena;
+class JobSystem;
+
+#define MAX_BLEND_PARAMETERS 4
+
+enum BlendNodeType
+{
+	BlendNodeClip = 0,
+	BlendNode1D,
+	BlendNode2D,
+	BlendNodeAdditive,
+	BlendNodeMasked
+};
+
+struct BlendNode
+{
+	BlendNodeType			Type;
+	const AnimationClip*	pClip = nullptr;
+	int						Parameters[2] = { -1, -1 };
+	std::vector<int>		Children;
+	std::vector<XMFLOAT2>	Positions;	// thresholds in x for 1D, blend space points for 2D
+	std::vector<float>		BoneMask;
+};
+
+// Tree of clips and blend nodes shared by every character using it. Evaluation
+// only reads the tree, temporary poses come from the frame arena.
+class BlendTree
+{
+public:
+	BlendTree(uint32_t boneCount);
+
+	int AddClip(const AnimationClip* pClip);
+	// thresholds must be ascending
+	int AddBlend1D(int parameter, const std::vector<int>& children, const std::vector<float>& thresholds);
+	int AddBlend2D(int parameterX, int parameterY, const std::vector<int>& children, const std::vector<XMFLOAT2>& positions);
+	// additive should evaluate to a pose made with AnimationClip::MakeAdditive
+	int AddAdditive(int base, int additive, int weightParameter);
+	int AddMasked(int base, int layer, const std::vector<float>& boneMask, int weightParameter);
+
+	void SetRoot(int node) { m_root = node; }
+	uint32_t GetBoneCount() const { return m_boneCount; }
+
+	// Returns false if the arena ran out of space
+	bool Evaluate(const float* parameters, float time, FrameArena& arena, BoneTransform* out) const;
+
+private:
+	bool EvaluateNode(int node, const float* parameters, float time, FrameArena& arena, BoneTransform* out) const;
+	bool EvaluateBlend1D(const BlendNode& node, const float* parameters, float time, FrameArena& arena, BoneTransform* out) const;
+	bool EvaluateBlend2D(const BlendNode& node, const float* parameters, float time, FrameArena& arena, BoneTransform* out) const;
+
+	std::vector<BlendNode> m_nodes;
+	uint32_t m_boneCount;
+	int m_root = -1;
+};
+
+// One animated character. pModelTransforms is filled from the frame arena by
+// EvaluateInstances and stays valid until the arena is reset.
+struct AnimationInstance
+{
+	const BlendTree*	pTree;
+	const int*			pParents;
+	float				Parameters[MAX_BLEND_PARAMETERS];
+	float				Time;
+	float				Speed;
+	BoneTransform*		pLocalPose;
+	XMFLOAT4X4*			pModelTransforms;
+};
+
+namespace Animation
+{
+	// Advances and evaluates every instance, spread across the job system when given one
+	void EvaluateInstances(AnimationInstance* instances, size_t count, float deltaTime, FrameArena& arena, JobSystem* pJobs = nullptr);
+}
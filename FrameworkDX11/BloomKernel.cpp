@@ -0,0 +1,246 @@
+#include "BloomKernel.h"
+#include <algorithm>
+#include <cmath>
+
+float BloomKernel::GetSigma(uint32_t radius)
+{
+	return std::max(radius / 3.0f, 0.5f);
+}
+
+void BloomKernel::GetGaussianWeights(uint32_t radius, float sigma, std::vector<float>& weights)
+{
+	weights.resize(radius + 1);
+	float total = 0.0f;
+	for (uint32_t i = 0; i <= radius; ++i)
+	{
+		weights[i] = expf(-(float)(i * i) / (2.0f * sigma * sigma));
+		total += i ? weights[i] * 2.0f : weights[i];
+	}
+	for (float& weight : weights)
+	{
+		weight /= total;
+	}
+}
+
+uint32_t BloomKernel::GetLinearTaps(uint32_t radius, float sigma, BloomTap* taps)
+{
+	radius = std::min(radius, (uint32_t)BLOOM_MAX_RADIUS);
+	std::vector<float> weights;
+	GetGaussianWeights(radius, sigma, weights);
+	weights.push_back(0.0f);
+
+	// An odd radius leaves the last texel without a partner, it pairs with a zero weight
+	taps[0] = { 0.0f, weights[0] };
+	uint32_t count = 1;
+	for (uint32_t i = 1; i <= radius; i += 2)
+	{
+		float weight = weights[i] + weights[i + 1];
+		taps[count++] = { (i * weights[i] + (i + 1) * weights[i + 1]) / weight, weight };
+	}
+	return count;
+}
+
+uint32_t BloomKernel::GetLevelSize(uint32_t size, uint32_t level)
+{
+	return std::max(size >> (level + 1), 1u);
+}
+
+uint64_t BloomKernel::GetChainFetches(uint32_t width, uint32_t height, uint32_t levels, uint32_t tapCount)
+{
+	// Downsample 4, each blur direction 2 per tap less the centre's second, upsample 2
+	uint64_t fetches = 0;
+	for (uint32_t level = 0; level < levels; ++level)
+	{
+		uint64_t pixels = (uint64_t)GetLevelSize(width, level) * GetLevelSize(height, level);
+		fetches += pixels * (4 + 2 * (tapCount * 2 - 1));
+		if (level + 1 < levels)
+			fetches += pixels * 2;
+	}
+	return fetches;
+}
+
+void BloomKernel::SampleBilinear(const BloomImage& image, float u, float v, float* colour)
+{
+	float x = u * image.Width - 0.5f;
+	float y = v * image.Height - 0.5f;
+	float x0 = floorf(x);
+	float y0 = floorf(y);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	int maxX = (int)image.Width - 1;
+	int maxY = (int)image.Height - 1;
+	int ix0 = std::min(std::max((int)x0, 0), maxX);
+	int ix1 = std::min(std::max((int)x0 + 1, 0), maxX);
+	int iy0 = std::min(std::max((int)y0, 0), maxY);
+	int iy1 = std::min(std::max((int)y0 + 1, 0), maxY);
+
+	const float* p00 = image.GetPixel(ix0, iy0);
+	const float* p10 = image.GetPixel(ix1, iy0);
+	const float* p01 = image.GetPixel(ix0, iy1);
+	const float* p11 = image.GetPixel(ix1, iy1);
+	for (int c = 0; c < 4; ++c)
+	{
+		float top = p00[c] + (p10[c] - p00[c]) * fx;
+		float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+		colour[c] = top + (bottom - top) * fy;
+	}
+}
+
+void BloomKernel::Downsample(const BloomImage& source, float threshold, BloomImage& target)
+{
+	float texelU = 1.0f / source.Width;
+	float texelV = 1.0f / source.Height;
+	for (uint32_t y = 0; y < target.Height; ++y)
+	{
+		for (uint32_t x = 0; x < target.Width; ++x)
+		{
+			float u = (x + 0.5f) / target.Width;
+			float v = (y + 0.5f) / target.Height;
+			float total[4] = {};
+			float colour[4];
+			for (int tap = 0; tap < 4; ++tap)
+			{
+				SampleBilinear(source, u + ((tap & 1) ? texelU : -texelU), v + ((tap & 2) ? texelV : -texelV), colour);
+				for (int c = 0; c < 4; ++c)
+				{
+					total[c] += colour[c] * 0.25f;
+				}
+			}
+
+			if (threshold > 0.0f)
+			{
+				float brightness = std::max(total[0], std::max(total[1], total[2]));
+				float contribution = std::max(brightness - threshold, 0.0f) / std::max(brightness, 1e-4f);
+				for (float& channel : total)
+				{
+					channel *= contribution;
+				}
+			}
+
+			float* pixel = target.GetPixel(x, y);
+			for (int c = 0; c < 4; ++c)
+			{
+				pixel[c] = total[c];
+			}
+		}
+	}
+}
+
+void BloomKernel::BlurDiscrete(const BloomImage& source, uint32_t radius, float sigma, bool horizontal, BloomImage& target)
+{
+	std::vector<float> weights;
+	GetGaussianWeights(radius, sigma, weights);
+
+	target.Resize(source.Width, source.Height);
+	int maxX = (int)source.Width - 1;
+	int maxY = (int)source.Height - 1;
+	for (uint32_t y = 0; y < source.Height; ++y)
+	{
+		for (uint32_t x = 0; x < source.Width; ++x)
+		{
+			float* pixel = target.GetPixel(x, y);
+			for (int i = -(int)radius; i <= (int)radius; ++i)
+			{
+				int sx = horizontal ? std::min(std::max((int)x + i, 0), maxX) : (int)x;
+				int sy = horizontal ? (int)y : std::min(std::max((int)y + i, 0), maxY);
+				const float* texel = source.GetPixel(sx, sy);
+				float weight = weights[std::abs(i)];
+				for (int c = 0; c < 4; ++c)
+				{
+					pixel[c] += texel[c] * weight;
+				}
+			}
+		}
+	}
+}
+
+void BloomKernel::BlurLinear(const BloomImage& source, const BloomTap* taps, uint32_t tapCount, bool horizontal, BloomImage& target)
+{
+	target.Resize(source.Width, source.Height);
+	float stepU = horizontal ? 1.0f / source.Width : 0.0f;
+	float stepV = horizontal ? 0.0f : 1.0f / source.Height;
+	for (uint32_t y = 0; y < source.Height; ++y)
+	{
+		for (uint32_t x = 0; x < source.Width; ++x)
+		{
+			float u = (x + 0.5f) / source.Width;
+			float v = (y + 0.5f) / source.Height;
+			float* pixel = target.GetPixel(x, y);
+			float colour[4];
+			SampleBilinear(source, u, v, colour);
+			for (int c = 0; c < 4; ++c)
+			{
+				pixel[c] = colour[c] * taps[0].Weight;
+			}
+			for (uint32_t i = 1; i < tapCount; ++i)
+			{
+				float du = stepU * taps[i].Offset;
+				float dv = stepV * taps[i].Offset;
+				float other[4];
+				SampleBilinear(source, u + du, v + dv, colour);
+				SampleBilinear(source, u - du, v - dv, other);
+				for (int c = 0; c < 4; ++c)
+				{
+					pixel[c] += (colour[c] + other[c]) * taps[i].Weight;
+				}
+			}
+		}
+	}
+}
+
+void BloomKernel::Upsample(const BloomImage& level, const BloomImage& coarser, float scale, BloomImage& target)
+{
+	target.Resize(level.Width, level.Height);
+	for (uint32_t y = 0; y < level.Height; ++y)
+	{
+		for (uint32_t x = 0; x < level.Width; ++x)
+		{
+			float colour[4];
+			SampleBilinear(coarser, (x + 0.5f) / level.Width, (y + 0.5f) / level.Height, colour);
+			const float* texel = level.GetPixel(x, y);
+			float* pixel = target.GetPixel(x, y);
+			for (int c = 0; c < 4; ++c)
+			{
+				pixel[c] = (texel[c] + colour[c]) * scale;
+			}
+		}
+	}
+}
+
+void BloomKernel::Run(const BloomImage& scene, uint32_t levels, uint32_t radius, float threshold, float intensity, BloomImage& result)
+{
+	BloomTap taps[BLOOM_MAX_TAPS];
+	uint32_t tapCount = GetLinearTaps(radius, GetSigma(radius), taps);
+
+	std::vector<BloomImage> downsampled(levels);
+	std::vector<BloomImage> blurred(levels);
+	BloomImage horizontal;
+	for (uint32_t level = 0; level < levels; ++level)
+	{
+		downsampled[level].Resize(GetLevelSize(scene.Width, level), GetLevelSize(scene.Height, level));
+		Downsample(level ? downsampled[level - 1] : scene, level ? 0.0f : threshold, downsampled[level]);
+	}
+
+	// Coarsest first, each upsample needs the level below it finished. The sum of every
+	// level is scaled once at the top.
+	for (uint32_t level = levels; level-- > 0;)
+	{
+		BlurLinear(downsampled[level], taps, tapCount, true, horizontal);
+		BlurLinear(horizontal, taps, tapCount, false, blurred[level]);
+		if (level + 1 < levels)
+		{
+			BloomImage combined;
+			Upsample(blurred[level], blurred[level + 1], level ? 1.0f : intensity / levels, combined);
+			blurred[level].Pixels.swap(combined.Pixels);
+		}
+		else if (level == 0)
+		{
+			for (float& channel : blurred[0].Pixels)
+			{
+				channel *= intensity;
+			}
+		}
+	}
+	result = blurred[0];
+}
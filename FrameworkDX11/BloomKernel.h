@@ -0,0 +1,76 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Bilinear taps a blur pass can take each side of the centre, shader.fx has the same
+#define BLOOM_MAX_TAPS 8
+// Widest discrete radius that still pairs down to BLOOM_MAX_TAPS bilinear taps
+#define BLOOM_MAX_RADIUS (2 * (BLOOM_MAX_TAPS - 1))
+// Half, quarter, ... down to 1/32 resolution
+#define BLOOM_LEVELS 5
+
+// Offset in texels from the centre and the weight of both taps at that offset.
+// Tap 0 is the centre and is only taken once.
+struct BloomTap
+{
+	float	Offset;
+	float	Weight;
+};
+
+// RGBA floats, rows top to bottom, for the CPU reference passes
+struct BloomImage
+{
+	uint32_t			Width;
+	uint32_t			Height;
+	std::vector<float>	Pixels;
+
+	void Resize(uint32_t width, uint32_t height) { Width = width; Height = height; Pixels.assign((size_t)width * height * 4, 0.0f); }
+	float* GetPixel(uint32_t x, uint32_t y) { return &Pixels[((size_t)y * Width + x) * 4]; }
+	const float* GetPixel(uint32_t x, uint32_t y) const { return &Pixels[((size_t)y * Width + x) * 4]; }
+};
+
+// The bloom chain: a thresholded downsample from the scene into the first level, plain
+// downsamples below it, a separable Gaussian on every level and an upsample that adds
+// each level to the one above it on the way back up. The blur weights are worked out
+// here so each pair of neighbouring texels costs one bilinear fetch instead of two.
+// The CPU versions of each pass match the shaders, clamp addressing included, and
+// are what the benchmark checks the kernel maths against.
+namespace BloomKernel
+{
+	// radius / 3, so the kernel covers three standard deviations
+	float GetSigma(uint32_t radius);
+
+	// Discrete Gaussian, weights[0] is the centre and weights[i] each of the two texels
+	// i away. Normalised so the whole kernel sums to 1.
+	void GetGaussianWeights(uint32_t radius, float sigma, std::vector<float>& weights);
+
+	// Pairs texels 1 and 2, 3 and 4, ... into one tap between them, weighted so bilinear
+	// filtering gives back both weights. Returns the tap count, 1 + ceil(radius / 2).
+	uint32_t GetLinearTaps(uint32_t radius, float sigma, BloomTap* taps);
+
+	// Size of a bloom level along one axis, level 0 is half the scene
+	uint32_t GetLevelSize(uint32_t size, uint32_t level);
+
+	// Texture fetches for the whole chain on a width x height scene
+	uint64_t GetChainFetches(uint32_t width, uint32_t height, uint32_t levels, uint32_t tapCount);
+
+	// Texture2D.Sample with a linear clamp sampler
+	void SampleBilinear(const BloomImage& image, float u, float v, float* colour);
+
+	// Four bilinear taps a source texel from the centre, a 4x4 box. A threshold of 0 or
+	// less keeps everything, otherwise the average is scaled down by how far its
+	// brightest channel is over the threshold.
+	void Downsample(const BloomImage& source, float threshold, BloomImage& target);
+
+	// Reference blur, every texel of the discrete kernel fetched on its own
+	void BlurDiscrete(const BloomImage& source, uint32_t radius, float sigma, bool horizontal, BloomImage& target);
+	// What PS_BloomBlur does with GetLinearTaps
+	void BlurLinear(const BloomImage& source, const BloomTap* taps, uint32_t tapCount, bool horizontal, BloomImage& target);
+
+	// (level + bilinear coarser) * scale, at the level's size
+	void Upsample(const BloomImage& level, const BloomImage& coarser, float scale, BloomImage& target);
+
+	// Every pass in the order the frame graph runs them, the result is the size of level 0
+	void Run(const BloomImage& scene, uint32_t levels, uint32_t radius, float threshold, float intensity, BloomImage& result);
+}
@@ -4,7 +4,8 @@
 
 Bone::Bone()
 {
-	m_orientation = { 0,0,0,0 };
+	m_orientation = { 1,0,0,0 };
+	XMStoreFloat4x4(&m_skeletonTransform, XMMatrixIdentity());
 }
 
 Bone::~Bone()
@@ -91,9 +92,9 @@ HRESULT Bone::initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext)
 	sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
 	sampDesc.MinLOD = 0;
 	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	hr = pd3dDevice->CreateSamplerState(&sampDesc, &m_pSamplerLinear);
+	m_pSamplerLinear = m_pStateCache->GetSamplerState(sampDesc);
 
-	return hr;
+	return m_pSamplerLinear ? S_OK : E_FAIL;
 }
 
 void Bone::boneUpdate(ID3D11DeviceContext* pContext)
@@ -101,6 +102,20 @@ void Bone::boneUpdate(ID3D11DeviceContext* pContext)
 
 }
 
+void Bone::UpdateSkeleton(FXMMATRIX parentTransform)
+{
+	// Quaternion stores the real part in r
+	XMVECTOR orientation = XMQuaternionNormalize(XMVectorSet(m_orientation.i, m_orientation.j, m_orientation.k, m_orientation.r));
+	XMMATRIX local = XMMatrixRotationQuaternion(orientation) * XMMatrixTranslation(m_localOffset.x, m_localOffset.y, m_localOffset.z);
+	XMMATRIX transform = local * parentTransform;
+	XMStoreFloat4x4(&m_skeletonTransform, transform);
+
+	for (size_t i = 0; i < m_childBones.size(); ++i)
+	{
+		m_childBones.at(i)->UpdateSkeleton(transform);
+	}
+}
+
 void Bone::draw(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* texture)
 {
     draw(pContext);
@@ -131,4 +146,15 @@ void Bone::draw(ID3D11DeviceContext* pContext)
 	{
 		m_childBones.at(i)->draw(pContext);
 	}
+}
+
+void Bone::Submit(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info)
+{
+	// Children share the caller's object constants, as in draw
+	SubmitPacket(pQueue, pBackend, info, GetDefaultMaterial(), NUM_VERTICES);
+
+	for (size_t i = 0; i < m_childBones.size(); ++i)
+	{
+		m_childBones.at(i)->Submit(pQueue, pBackend, info);
+	}
 }
\ No newline at end of file
@@ -13,10 +13,21 @@ public:
 
 	void draw(ID3D11DeviceContext* pContext);
 	void draw(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* texture);
+	void Submit(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info);
 
 	void boneUpdate(ID3D11DeviceContext* pContext);
 
+	// Skeleton hierarchy, the offset and orientation are relative to the parent bone
+	void AddChild(Bone* pChild) { m_childBones.push_back(pChild); }
+	void SetLocalOffset(XMFLOAT3 offset) { m_localOffset = offset; }
+	void SetOrientation(const Quaternion& orientation) { m_orientation = orientation; }
+	Quaternion GetOrientation() { return m_orientation; }
+	void UpdateSkeleton(FXMMATRIX parentTransform);
+	XMFLOAT4X4* GetSkeletonTransform() { return &m_skeletonTransform; }
+
 private:
 	Quaternion m_orientation;
 	std::vector<Bone*> m_childBones;
+	XMFLOAT3 m_localOffset = { 0.0f, 0.0f, 0.0f };
+	XMFLOAT4X4 m_skeletonTransform;
 };
\ No newline at end of file
@@ -18,6 +18,7 @@ Camera::Camera(int windowHeight, int windowWidth, XMFLOAT3 eye, XMFLOAT3 at, XMF
 
 void Camera::Update(HWND hWnd)
 {
+    _mouseChange = { 0.0f, 0.0f };
     if (isActive)
     {
         // Get screen coords
@@ -29,21 +30,24 @@ void Camera::Update(HWND hWnd)
         /*g_Debug.Print(float(point.x - (0.5 * rc.right + 0.5 * rc.left)));
         g_Debug.Print(float(point.y - (0.5 * rc.bottom + 0.5 * rc.top)));*/
         _mouseChange = { float(point.x - (0.5 * rc.right + 0.5 * rc.left)), float(point.y - (0.5 * rc.bottom + 0.5 * rc.top)) };
-        POINT newPoint = { point.x - (0.5 * rc.right + 0.5 * rc.left), point.y - (0.5 * rc.bottom + 0.5 * rc.top) };
-
-        // Do player rotation
-        Rotate(newPoint.x, newPoint.y);
 
         // Reset position
         SetCursorPos(0.5 * rc.right + 0.5 * rc.left, 0.5 * rc.bottom + 0.5 * rc.top);
+    }
+}
+
+void Camera::SetPose(const CameraPose& pose)
+{
+    _eye = pose.Eye;
+    pitch = pose.Pitch;
+    yaw = pose.Yaw;
 
-        XMStoreFloat4x4(&_view, GetMatrix1st());
+    XMStoreFloat4x4(&_view, GetMatrix1st());
 
-        // Update up vector
-        XMFLOAT3 tempUp = XMFLOAT3(0.0f, 1.0f, 0.0f);
-        XMStoreFloat3(&tempUp, XMVector3Transform(XMLoadFloat3(&tempUp), XMMatrixRotationRollPitchYaw(pitch, yaw, 0.0f)));
-        _up = tempUp;
-    }
+    // Update up vector
+    XMFLOAT3 tempUp = XMFLOAT3(0.0f, 1.0f, 0.0f);
+    XMStoreFloat3(&tempUp, XMVector3Transform(XMLoadFloat3(&tempUp), XMMatrixRotationRollPitchYaw(pitch, yaw, 0.0f)));
+    _up = tempUp;
 }
 
 void Camera::Reshape(UINT windowWidth, UINT windowHeight, FLOAT nearDepth, FLOAT farDepth)
@@ -53,25 +57,22 @@ void Camera::Reshape(UINT windowWidth, UINT windowHeight, FLOAT nearDepth, FLOAT
 
 void Camera::CameraTranslate(XMFLOAT3 d, float pitch, float yaw)
 {
-    XMStoreFloat3(&d, XMVector3Transform(XMLoadFloat3(&d), XMMatrixRotationRollPitchYaw(pitch, yaw, 0.0f)));
-    _eye = { _eye.x + d.x, _eye.y + d.y, _eye.z + d.z };
+    CameraPose pose = GetPose();
+    CameraControl::Translate(pose, d, pitch, yaw);
+    _eye = pose.Eye;
 }
 
 void Camera::Rotate(float dx, float dy)
 {
-    yaw = WrapAngle(yaw + (dx * rotationSpeed));
-    pitch = Clamp(pitch + (dy * rotationSpeed), 0.995f * XM_PI / 2.0f, 0.995f * -XM_PI / 2.0f);
+    CameraPose pose = GetPose();
+    CameraControl::Rotate(pose, dx, dy);
+    pitch = pose.Pitch;
+    yaw = pose.Yaw;
 }
 
 XMMATRIX Camera::GetMatrix1st()
 {
-    const XMVECTOR lookVector = XMVector3Transform(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMMatrixRotationRollPitchYaw(pitch, yaw, 0.0f));
-
-    XMFLOAT3 tempMatrix = { _eye.x, _eye.y, _eye.z };
-    const XMVECTOR camPosition = XMLoadFloat3(&tempMatrix);
-    const XMVECTOR camTarget = camPosition + lookVector;
-
-    return XMMatrixLookAtLH(camPosition, camTarget, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    return CameraControl::GetViewMatrix(GetPose());
 }
 
 float Camera::WrapAngle(float ang)
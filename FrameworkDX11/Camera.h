@@ -3,6 +3,7 @@
 #include <directxmath.h>
 #include "Math.h"
 #include "Debug.h"
+#include "CameraPath.h"
 
 using namespace DirectX;
 
@@ -33,8 +34,12 @@ public:
 	Camera() {}
 	Camera(int windowHeight, int windowWidth, XMFLOAT3 eye, XMFLOAT3 at, XMFLOAT3 up);
 
+	// Samples the mouse movement since the last frame, the pose is set separately
 	void Update(HWND hWnd);
 
+	CameraPose GetPose() { return { _eye, pitch, yaw }; }
+	void SetPose(const CameraPose& pose);
+
 	XMFLOAT4X4 GetView() { return _view; }
 	XMFLOAT4X4 GetProjection() { return _projection; }
 	XMFLOAT4 GetEye() { return XMFLOAT4(_eye.x, _eye.y, _eye.z, 1.0f); }
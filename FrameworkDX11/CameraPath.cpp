@@ -0,0 +1,328 @@
+#include "CameraPath.h"
+#include <algorithm>
+#include <istream>
+#include <math.h>
+#include <ostream>
+
+void CameraControl::Rotate(CameraPose& pose, float dx, float dy)
+{
+	// Same wrap as Camera::WrapAngle
+	float yaw = fmodf(pose.Yaw + dx * CAMERA_ROTATION_SPEED + 180.0f, 360.0f);
+	if (yaw < 0.0f)
+		yaw += 360.0f;
+	pose.Yaw = yaw - 180.0f;
+
+	float limit = 0.995f * XM_PIDIV2;
+	pose.Pitch = std::max(-limit, std::min(pose.Pitch + dy * CAMERA_ROTATION_SPEED, limit));
+}
+
+void CameraControl::Translate(CameraPose& pose, XMFLOAT3 d, float pitch, float yaw)
+{
+	XMVECTOR offset = XMVector3Transform(XMLoadFloat3(&d), XMMatrixRotationRollPitchYaw(pitch, yaw, 0.0f));
+	XMStoreFloat3(&pose.Eye, XMVectorAdd(XMLoadFloat3(&pose.Eye), offset));
+}
+
+void CameraControl::ApplyInput(CameraPose& pose, const CameraInputFrame& input, float dt)
+{
+	Rotate(pose, input.MouseX, input.MouseY);
+
+	float step = CAMERA_MOVE_SPEED * dt;
+	if (input.Keys & CameraKeyForward)
+		Translate(pose, { 0.0f, 0.0f, step }, pose.Pitch, pose.Yaw);
+	if (input.Keys & CameraKeyLeft)
+		Translate(pose, { -step, 0.0f, 0.0f }, pose.Pitch, pose.Yaw);
+	if (input.Keys & CameraKeyBack)
+		Translate(pose, { 0.0f, 0.0f, -step }, pose.Pitch, pose.Yaw);
+	if (input.Keys & CameraKeyRight)
+		Translate(pose, { step, 0.0f, 0.0f }, pose.Pitch, pose.Yaw);
+	if (input.Keys & CameraKeyUp)
+		Translate(pose, { 0.0f, step, 0.0f }, 0.0f, 0.0f);
+	if (input.Keys & CameraKeyDown)
+		Translate(pose, { 0.0f, -step, 0.0f }, 0.0f, 0.0f);
+}
+
+CameraPose CameraControl::Interpolate(const CameraPose& from, const CameraPose& to, float t)
+{
+	float yawChange = to.Yaw - from.Yaw;
+	if (yawChange > 180.0f)
+		yawChange -= 360.0f;
+	else if (yawChange < -180.0f)
+		yawChange += 360.0f;
+
+	CameraPose pose;
+	XMStoreFloat3(&pose.Eye, XMVectorLerp(XMLoadFloat3(&from.Eye), XMLoadFloat3(&to.Eye), t));
+	pose.Pitch = from.Pitch + (to.Pitch - from.Pitch) * t;
+	pose.Yaw = from.Yaw + yawChange * t;
+	return pose;
+}
+
+CameraPose CameraControl::LookAt(FXMVECTOR eye, FXMVECTOR target)
+{
+	// Inverse of the roll-pitch-yaw look vector (cos p sin y, -sin p, cos p cos y)
+	XMFLOAT3 d;
+	XMStoreFloat3(&d, XMVector3Normalize(XMVectorSubtract(target, eye)));
+
+	CameraPose pose;
+	XMStoreFloat3(&pose.Eye, eye);
+	pose.Pitch = -asinf(std::max(-1.0f, std::min(d.y, 1.0f)));
+	pose.Yaw = atan2f(d.x, d.z);
+	return pose;
+}
+
+XMMATRIX CameraControl::GetViewMatrix(const CameraPose& pose)
+{
+	XMVECTOR look = XMVector3Transform(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMMatrixRotationRollPitchYaw(pose.Pitch, pose.Yaw, 0.0f));
+	XMVECTOR eye = XMLoadFloat3(&pose.Eye);
+	return XMMatrixLookAtLH(eye, XMVectorAdd(eye, look), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+}
+
+void CameraTrack::AddKeyframe(XMFLOAT3 eye, XMFLOAT3 target)
+{
+	m_eyes.push_back(eye);
+	m_targets.push_back(target);
+	RebuildCurves();
+}
+
+void CameraTrack::Clear()
+{
+	m_eyes.clear();
+	m_targets.clear();
+	RebuildCurves();
+}
+
+void CameraTrack::RebuildCurves()
+{
+	// Repeat the end keys so the Catmull-Rom curves pass through every keyframe
+	std::vector<XMFLOAT3> eyes;
+	std::vector<XMFLOAT3> targets;
+	if (!m_eyes.empty())
+	{
+		eyes.push_back(m_eyes.front());
+		targets.push_back(m_targets.front());
+		eyes.insert(eyes.end(), m_eyes.begin(), m_eyes.end());
+		targets.insert(targets.end(), m_targets.begin(), m_targets.end());
+		eyes.push_back(m_eyes.back());
+		targets.push_back(m_targets.back());
+	}
+	m_eyeCurve.SetControlPoints(eyes);
+	m_targetCurve.SetControlPoints(targets);
+}
+
+CameraPose CameraTrack::Evaluate(float time)
+{
+	if (m_eyes.size() < 2)
+	{
+		XMFLOAT3 eye = m_eyes.empty() ? XMFLOAT3(0.0f, 0.0f, 0.0f) : m_eyes[0];
+		XMFLOAT3 target = m_targets.empty() ? XMFLOAT3(0.0f, 0.0f, 1.0f) : m_targets[0];
+		return CameraControl::LookAt(XMLoadFloat3(&eye), XMLoadFloat3(&target));
+	}
+
+	// Constant speed along the eye curve, the target follows by curve parameter
+	float fraction = m_duration > 0.0f ? std::max(0.0f, std::min(time / m_duration, 1.0f)) : 1.0f;
+	float u = m_eyeCurve.DistanceToParameter(fraction * m_eyeCurve.GetLength());
+	return CameraControl::LookAt(m_eyeCurve.Evaluate(u), m_targetCurve.Evaluate(u));
+}
+
+bool CameraTrack::Save(std::ostream& stream) const
+{
+	stream.precision(9);
+	stream << "duration " << m_duration << "\n";
+	for (size_t i = 0; i < m_eyes.size(); ++i)
+	{
+		const XMFLOAT3& e = m_eyes[i];
+		const XMFLOAT3& t = m_targets[i];
+		stream << "key " << e.x << " " << e.y << " " << e.z << " " << t.x << " " << t.y << " " << t.z << "\n";
+	}
+	return !stream.fail();
+}
+
+bool CameraTrack::Load(std::istream& stream)
+{
+	m_eyes.clear();
+	m_targets.clear();
+
+	std::string token;
+	while (stream >> token)
+	{
+		if (token == "duration")
+		{
+			stream >> m_duration;
+		}
+		else if (token == "key")
+		{
+			XMFLOAT3 e, t;
+			stream >> e.x >> e.y >> e.z >> t.x >> t.y >> t.z;
+			m_eyes.push_back(e);
+			m_targets.push_back(t);
+		}
+		if (stream.fail())
+			break;
+	}
+
+	RebuildCurves();
+	return !stream.bad() && m_eyes.size() >= 2;
+}
+
+CameraTrack CameraTrack::CreateDefault()
+{
+	CameraTrack track;
+	const int keys = 9;
+	for (int i = 0; i < keys; ++i)
+	{
+		// Dips low on the far side and swings the look target across the spline
+		float angle = XM_2PI * i / (keys - 1) - XM_PIDIV2;
+		float radius = (i % 2) ? 9.0f : 12.0f;
+		XMFLOAT3 eye(12.0f + radius * cosf(angle), 3.0f + 2.0f * cosf(angle), 12.0f + radius * sinf(angle));
+		XMFLOAT3 target(12.0f + 2.0f * sinf(angle), 0.5f, 12.0f + 2.0f * cosf(angle));
+		track.AddKeyframe(eye, target);
+	}
+	track.SetDuration(20.0f);
+	return track;
+}
+
+CameraPathPlayer::CameraPathPlayer(float timestep)
+{
+	m_timestep = timestep;
+}
+
+uint32_t CameraPathPlayer::Advance(float realDelta, const CameraInputFrame& input)
+{
+	m_accumulator += realDelta;
+	uint32_t steps = 0;
+	while (m_accumulator >= m_timestep)
+	{
+		m_accumulator -= m_timestep;
+		++steps;
+	}
+	RunSteps(steps, input);
+	return steps;
+}
+
+void CameraPathPlayer::RunSteps(uint32_t steps, const CameraInputFrame& input)
+{
+	// Mouse movement belongs to the next step that runs, held keys to every step
+	m_pendingMouse.x += input.MouseX;
+	m_pendingMouse.y += input.MouseY;
+	for (uint32_t i = 0; i < steps; ++i)
+	{
+		CameraInputFrame frame = { m_pendingMouse.x, m_pendingMouse.y, input.Keys };
+		m_pendingMouse = { 0.0f, 0.0f };
+		Step(frame);
+	}
+}
+
+void CameraPathPlayer::Step(const CameraInputFrame& input)
+{
+	m_previousPose = m_pose;
+	switch (m_mode)
+	{
+	case CameraPlayerRecording:
+		m_recording.push_back(input);
+		CameraControl::ApplyInput(m_pose, input, m_timestep);
+		break;
+	case CameraPlayerReplaying:
+		if (m_step < m_recording.size())
+		{
+			CameraControl::ApplyInput(m_pose, m_recording[m_step], m_timestep);
+		}
+		else
+		{
+			m_finished = true;
+			m_mode = CameraPlayerFree;
+		}
+		break;
+	case CameraPlayerTrack:
+		m_pose = m_pTrack->Evaluate((m_step + 1) * m_timestep);
+		if ((m_step + 1) * m_timestep >= m_pTrack->GetDuration())
+		{
+			m_finished = true;
+			m_mode = CameraPlayerFree;
+		}
+		break;
+	default:
+		CameraControl::ApplyInput(m_pose, input, m_timestep);
+		break;
+	}
+	++m_step;
+}
+
+void CameraPathPlayer::StartRecording()
+{
+	m_recording.clear();
+	m_recordingStart = m_pose;
+	m_mode = CameraPlayerRecording;
+	m_step = 0;
+	m_finished = false;
+}
+
+void CameraPathPlayer::StartReplay()
+{
+	m_pose = m_recordingStart;
+	m_previousPose = m_pose;
+	m_mode = CameraPlayerReplaying;
+	m_step = 0;
+	m_accumulator = 0.0f;
+	m_pendingMouse = { 0.0f, 0.0f };
+	m_finished = false;
+}
+
+void CameraPathPlayer::PlayTrack(CameraTrack* pTrack)
+{
+	if (!pTrack || pTrack->GetKeyframeCount() == 0)
+		return;
+
+	m_pTrack = pTrack;
+	m_pose = pTrack->Evaluate(0.0f);
+	m_previousPose = m_pose;
+	m_mode = CameraPlayerTrack;
+	m_step = 0;
+	m_accumulator = 0.0f;
+	m_pendingMouse = { 0.0f, 0.0f };
+	m_finished = false;
+}
+
+void CameraPathPlayer::Stop()
+{
+	m_mode = CameraPlayerFree;
+}
+
+bool CameraPathPlayer::SaveRecording(std::ostream& stream) const
+{
+	const CameraPose& s = m_recordingStart;
+	stream.precision(9);
+	stream << "timestep " << m_timestep << "\n";
+	stream << "start " << s.Eye.x << " " << s.Eye.y << " " << s.Eye.z << " " << s.Pitch << " " << s.Yaw << "\n";
+	for (const CameraInputFrame& input : m_recording)
+	{
+		stream << "input " << input.MouseX << " " << input.MouseY << " " << input.Keys << "\n";
+	}
+	return !stream.fail();
+}
+
+bool CameraPathPlayer::LoadRecording(std::istream& stream)
+{
+	m_recording.clear();
+
+	std::string token;
+	while (stream >> token)
+	{
+		if (token == "timestep")
+		{
+			stream >> m_timestep;
+		}
+		else if (token == "start")
+		{
+			CameraPose& s = m_recordingStart;
+			stream >> s.Eye.x >> s.Eye.y >> s.Eye.z >> s.Pitch >> s.Yaw;
+		}
+		else if (token == "input")
+		{
+			CameraInputFrame input;
+			stream >> input.MouseX >> input.MouseY >> input.Keys;
+			m_recording.push_back(input);
+		}
+		if (stream.fail())
+			break;
+	}
+	return !stream.bad() && !m_recording.empty();
+}
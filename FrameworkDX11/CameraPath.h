@@ -0,0 +1,145 @@
+#pragma once
+#include "SplineCurve.h"
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+#define CAMERA_PATH_TIMESTEP (1.0f / 60.0f)
+#define CAMERA_MOVE_SPEED 5.0f
+#define CAMERA_ROTATION_SPEED 0.004f
+
+enum CameraKeys
+{
+	CameraKeyForward = 1 << 0,
+	CameraKeyLeft = 1 << 1,
+	CameraKeyBack = 1 << 2,
+	CameraKeyRight = 1 << 3,
+	CameraKeyUp = 1 << 4,
+	CameraKeyDown = 1 << 5
+};
+
+// Everything needed to place the first person camera
+struct CameraPose
+{
+	XMFLOAT3	Eye;
+	float		Pitch;
+	float		Yaw;
+};
+
+// One fixed step of input: mouse movement in pixels and the held CameraKeys
+struct CameraInputFrame
+{
+	float		MouseX;
+	float		MouseY;
+	uint32_t	Keys;
+};
+
+// Camera movement without any window, so recorded input plays back the same anywhere
+namespace CameraControl
+{
+	void Rotate(CameraPose& pose, float dx, float dy);
+	void Translate(CameraPose& pose, XMFLOAT3 d, float pitch, float yaw);
+	void ApplyInput(CameraPose& pose, const CameraInputFrame& input, float dt);
+
+	// Yaw takes the short way round the wrap
+	CameraPose Interpolate(const CameraPose& from, const CameraPose& to, float t);
+
+	CameraPose LookAt(FXMVECTOR eye, FXMVECTOR target);
+	XMMATRIX GetViewMatrix(const CameraPose& pose);
+}
+
+// Authored flythrough. The eye moves along a Catmull-Rom spline at constant speed
+// and looks at a second spline sampled at the same curve parameter.
+class CameraTrack
+{
+public:
+	void AddKeyframe(XMFLOAT3 eye, XMFLOAT3 target);
+	void Clear();
+
+	void SetDuration(float seconds) { m_duration = seconds; }
+	float GetDuration() const { return m_duration; }
+	size_t GetKeyframeCount() const { return m_eyes.size(); }
+
+	CameraPose Evaluate(float time);
+
+	// Text format: "duration <seconds>" then one "key ex ey ez tx ty tz" line per keyframe
+	bool Save(std::ostream& stream) const;
+	bool Load(std::istream& stream);
+
+	// Slow orbit around the middle of the terrain
+	static CameraTrack CreateDefault();
+
+private:
+	void RebuildCurves();
+
+	std::vector<XMFLOAT3> m_eyes;
+	std::vector<XMFLOAT3> m_targets;
+	SplineCurve m_eyeCurve;
+	SplineCurve m_targetCurve;
+	float m_duration = 20.0f;
+};
+
+enum CameraPlayerMode
+{
+	CameraPlayerFree = 0,
+	CameraPlayerRecording,
+	CameraPlayerReplaying,
+	CameraPlayerTrack
+};
+
+// Moves the camera in fixed timesteps, whatever the frame rate. Free and recording
+// modes apply live input, replay feeds back a recording from its start pose and
+// track mode follows a CameraTrack.
+class CameraPathPlayer
+{
+public:
+	CameraPathPlayer(float timestep = CAMERA_PATH_TIMESTEP);
+
+	// Runs as many fixed steps as realDelta covers, returns how many ran
+	uint32_t Advance(float realDelta, const CameraInputFrame& input);
+
+	// For callers that keep their own accumulator, such as FrameTimer
+	void RunSteps(uint32_t steps, const CameraInputFrame& input);
+	void Step(const CameraInputFrame& input);
+
+	void SetPose(const CameraPose& pose) { m_pose = pose; m_previousPose = pose; }
+	const CameraPose& GetPose() const { return m_pose; }
+
+	// Between the pose before the last step (0) and after it (1)
+	CameraPose GetInterpolatedPose(float alpha) const { return CameraControl::Interpolate(m_previousPose, m_pose, alpha); }
+
+	void StartRecording();
+	void StartReplay();
+	void PlayTrack(CameraTrack* pTrack);
+	void Stop();
+
+	CameraPlayerMode GetMode() const { return m_mode; }
+	bool IsFinished() const { return m_finished; }
+	uint32_t GetStep() const { return m_step; }
+	float GetTime() const { return m_step * m_timestep; }
+	float GetTimestep() const { return m_timestep; }
+	size_t GetRecordingLength() const { return m_recording.size(); }
+
+	// Text format: "timestep", "start" pose, then one "input mx my keys" line per step
+	bool SaveRecording(std::ostream& stream) const;
+	bool LoadRecording(std::istream& stream);
+
+private:
+	float m_timestep;
+	float m_accumulator = 0.0f;
+	XMFLOAT2 m_pendingMouse = { 0.0f, 0.0f };
+
+	CameraPlayerMode m_mode = CameraPlayerFree;
+	CameraPose m_pose = {};
+	CameraPose m_previousPose = {};
+	uint32_t m_step = 0;
+	bool m_finished = false;
+
+	CameraPose m_recordingStart = {};
+	std::vector<CameraInputFrame> m_recording;
+	CameraTrack* m_pTrack = nullptr;
+};
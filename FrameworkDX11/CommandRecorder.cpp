@@ -0,0 +1,113 @@
+#include "CommandRecorder.h"
+#include "JobSystem.h"
+#include "GpuProfiler.h"
+#include <chrono>
+
+CommandRecorder::CommandRecorder(CommandBackend* pBackend, JobSystem* pJobs)
+{
+	m_pBackend = pBackend;
+	m_pJobs = pJobs;
+}
+
+uint32_t CommandRecorder::AddPass(const char* name, const RecordFunction& record)
+{
+	m_names.push_back(name);
+	m_passes.push_back(record);
+	return (uint32_t)m_passes.size() - 1;
+}
+
+void CommandRecorder::Flush()
+{
+	uint32_t passCount = (uint32_t)m_passes.size();
+	m_stats.Passes = passCount;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	m_pBackend->BeginFrame(passCount);
+
+	// Worker threads index their recorder, so only go wide if every thread has one
+	bool parallel = m_pJobs && m_pJobs->GetThreadCount() > 1 && m_pBackend->GetRecorderCount() >= m_pJobs->GetThreadCount();
+	if (parallel)
+	{
+		m_stats.Recorders = m_pJobs->GetThreadCount();
+		m_pJobs->ParallelFor(passCount, 1, [this](size_t begin, size_t end, unsigned threadIndex)
+		{
+			for (size_t pass = begin; pass < end; ++pass)
+			{
+				RecordPass(threadIndex, (uint32_t)pass);
+			}
+		});
+	}
+	else
+	{
+		m_stats.Recorders = 1;
+		for (uint32_t pass = 0; pass < passCount; ++pass)
+		{
+			// Only here can the backend be drawing as it records, always on this thread
+			bool timed = m_pGpuProfiler && !m_pBackend->IsDeferred();
+			if (timed)
+				m_pGpuProfiler->BeginZone(m_names[pass].c_str());
+			RecordPass(0, pass);
+			if (timed)
+				m_pGpuProfiler->EndZone();
+		}
+	}
+
+	std::chrono::steady_clock::time_point recorded = std::chrono::steady_clock::now();
+	bool timed = m_pGpuProfiler && m_pBackend->IsDeferred();
+	for (uint32_t pass = 0; pass < passCount; ++pass)
+	{
+		if (timed)
+			m_pGpuProfiler->BeginZone(m_names[pass].c_str());
+		m_pBackend->ExecutePass(pass);
+		if (timed)
+			m_pGpuProfiler->EndZone();
+	}
+	std::chrono::steady_clock::time_point executed = std::chrono::steady_clock::now();
+
+	m_stats.RecordMilliseconds = std::chrono::duration<double, std::milli>(recorded - start).count();
+	m_stats.ExecuteMilliseconds = std::chrono::duration<double, std::milli>(executed - recorded).count();
+
+	m_names.clear();
+	m_passes.clear();
+}
+
+void CommandRecorder::RecordPass(uint32_t recorder, uint32_t pass)
+{
+	m_pBackend->BeginPass(recorder, pass);
+	m_passes[pass](recorder);
+	m_pBackend->EndPass(recorder, pass);
+}
+
+LogCommandBackend::LogCommandBackend(uint32_t recorders)
+{
+	m_currentPass.assign(recorders, ~0u);
+}
+
+void LogCommandBackend::Emit(uint32_t recorder, uint32_t command)
+{
+	m_passCommands[m_currentPass[recorder]].push_back(command);
+}
+
+void LogCommandBackend::BeginFrame(uint32_t passCount)
+{
+	// Sized up front so recording threads never resize shared vectors
+	m_passCommands.assign(passCount, std::vector<uint32_t>());
+	m_passRecorders.assign(passCount, ~0u);
+}
+
+void LogCommandBackend::BeginPass(uint32_t recorder, uint32_t pass)
+{
+	m_currentPass[recorder] = pass;
+	m_passRecorders[pass] = recorder;
+}
+
+void LogCommandBackend::EndPass(uint32_t recorder, uint32_t /*pass*/)
+{
+	m_currentPass[recorder] = ~0u;
+}
+
+void LogCommandBackend::ExecutePass(uint32_t pass)
+{
+	const std::vector<uint32_t>& commands = m_passCommands[pass];
+	m_executed.insert(m_executed.end(), commands.begin(), commands.end());
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+class JobSystem;
+class GpuProfiler;
+
+// Where recorded passes go. The D3D11 backend gives every worker its own deferred
+// context and keeps one command list per pass, LogCommandBackend only remembers
+// what each pass emitted so the scheduling can be checked without a device.
+class CommandBackend
+{
+public:
+	virtual ~CommandBackend() {}
+
+	// How many passes can record at once. A recorder index is only used by one thread at a time.
+	virtual uint32_t GetRecorderCount() const = 0;
+
+	// False when passes draw as they record, so ExecutePass has nothing left to do
+	virtual bool IsDeferred() const { return true; }
+
+	// Main thread, before any pass records
+	virtual void BeginFrame(uint32_t passCount) = 0;
+
+	// Recording thread, around one pass
+	virtual void BeginPass(uint32_t recorder, uint32_t pass) = 0;
+	virtual void EndPass(uint32_t recorder, uint32_t pass) = 0;
+
+	// Main thread, once per pass in the order the passes were added
+	virtual void ExecutePass(uint32_t pass) = 0;
+};
+
+struct CommandRecorderStats
+{
+	uint32_t	Passes;
+	uint32_t	Recorders;
+	double		RecordMilliseconds;
+	double		ExecuteMilliseconds;
+};
+
+// Records a frame's passes on the job system, then executes them in the order
+// they were added. Passes must not use the job system themselves.
+class CommandRecorder
+{
+public:
+	typedef std::function<void(uint32_t recorder)> RecordFunction;
+
+	CommandRecorder(CommandBackend* pBackend, JobSystem* pJobs);
+
+	uint32_t AddPass(const char* name, const RecordFunction& record);
+
+	// Records every pass, executes them in order and empties the pass list
+	void Flush();
+
+	const CommandRecorderStats& GetStats() const { return m_stats; }
+	const char* GetPassName(uint32_t pass) const { return m_names[pass].c_str(); }
+
+	// Times every pass on the GPU, around its execution or its recording if that draws directly
+	void SetGpuProfiler(GpuProfiler* pProfiler) { m_pGpuProfiler = pProfiler; }
+
+private:
+	void RecordPass(uint32_t recorder, uint32_t pass);
+
+	CommandBackend* m_pBackend;
+	JobSystem* m_pJobs;
+	GpuProfiler* m_pGpuProfiler = nullptr;
+	std::vector<std::string> m_names;
+	std::vector<RecordFunction> m_passes;
+	CommandRecorderStats m_stats = {};
+};
+
+// Mock backend: passes append commands to their recorder's current pass and
+// executing a pass copies its commands to one log, so the log must come out the
+// same as recording every pass in order on one thread.
+class LogCommandBackend : public CommandBackend
+{
+public:
+	LogCommandBackend(uint32_t recorders);
+
+	void Emit(uint32_t recorder, uint32_t command);
+
+	uint32_t GetRecorderCount() const { return (uint32_t)m_currentPass.size(); }
+	void BeginFrame(uint32_t passCount);
+	void BeginPass(uint32_t recorder, uint32_t pass);
+	void EndPass(uint32_t recorder, uint32_t pass);
+	void ExecutePass(uint32_t pass);
+
+	const std::vector<uint32_t>& GetExecuted() const { return m_executed; }
+	const std::vector<uint32_t>& GetPassRecorders() const { return m_passRecorders; }
+	void ClearExecuted() { m_executed.clear(); }
+
+private:
+	std::vector<uint32_t> m_currentPass;
+	std::vector<std::vector<uint32_t>> m_passCommands;
+	std::vector<uint32_t> m_passRecorders;
+	std::vector<uint32_t> m_executed;
+};
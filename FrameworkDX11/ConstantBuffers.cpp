@@ -0,0 +1,239 @@
+#include "ConstantBuffers.h"
+#include <string.h>
+
+static HRESULT CreateDynamicConstantBuffer(ID3D11Device* pd3dDevice, UINT size, ID3D11Buffer** ppBuffer)
+{
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = ConstantRingAllocator::GetAlignedSize(size);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	return pd3dDevice->CreateBuffer(&bd, nullptr, ppBuffer);
+}
+
+static void SetConstantBuffers(ID3D11DeviceContext* pContext, UINT slot, UINT stages, ID3D11Buffer* pBuffer)
+{
+	if (stages & ShaderStageVS)
+		pContext->VSSetConstantBuffers(slot, 1, &pBuffer);
+	if (stages & ShaderStageHS)
+		pContext->HSSetConstantBuffers(slot, 1, &pBuffer);
+	if (stages & ShaderStageDS)
+		pContext->DSSetConstantBuffers(slot, 1, &pBuffer);
+	if (stages & ShaderStageGS)
+		pContext->GSSetConstantBuffers(slot, 1, &pBuffer);
+	if (stages & ShaderStagePS)
+		pContext->PSSetConstantBuffers(slot, 1, &pBuffer);
+	if (stages & ShaderStageCS)
+		pContext->CSSetConstantBuffers(slot, 1, &pBuffer);
+}
+
+CachedConstantBuffer::~CachedConstantBuffer()
+{
+	if (m_pBuffer) m_pBuffer->Release();
+}
+
+HRESULT CachedConstantBuffer::Create(ID3D11Device* pd3dDevice, UINT size, ConstantUploadStats* pStats)
+{
+	m_contents.resize(size);
+	m_uploaded = false;
+	m_pStats = pStats;
+	return CreateDynamicConstantBuffer(pd3dDevice, size, &m_pBuffer);
+}
+
+bool CachedConstantBuffer::Update(ID3D11DeviceContext* pContext, const void* pData)
+{
+	if (m_uploaded && memcmp(m_contents.data(), pData, m_contents.size()) == 0)
+	{
+		++m_pStats->SkippedUploads;
+		return false;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(pContext->Map(m_pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+	memcpy(mapped.pData, pData, m_contents.size());
+	pContext->Unmap(m_pBuffer, 0);
+
+	memcpy(m_contents.data(), pData, m_contents.size());
+	m_uploaded = true;
+	++m_pStats->MapCalls;
+	m_pStats->BytesUploaded += m_contents.size();
+	return true;
+}
+
+void CachedConstantBuffer::Bind(ID3D11DeviceContext* pContext, UINT slot, UINT stages)
+{
+	SetConstantBuffers(pContext, slot, stages, m_pBuffer);
+}
+
+ConstantRingBuffer::~ConstantRingBuffer()
+{
+	if (m_pRing) m_pRing->Release();
+	if (m_pFallback) m_pFallback->Release();
+}
+
+HRESULT ConstantRingBuffer::Create(ID3D11Device* pd3dDevice, ID3D11DeviceContext1* pContext1, UINT capacity, UINT maxObjectSize, ConstantUploadStats* pStats)
+{
+	m_pStats = pStats;
+	m_pContext1 = pContext1;
+
+	// Offsets need the 11.1 runtime plus driver support for mapping constant buffers with NO_OVERWRITE
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	HRESULT hr = pd3dDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	m_useOffsets = SUCCEEDED(hr) && pContext1 && options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+
+	if (m_useOffsets)
+	{
+		m_allocator.Reset(capacity);
+		return CreateDynamicConstantBuffer(pd3dDevice, m_allocator.GetCapacity(), &m_pRing);
+	}
+	m_fallbackSize = maxObjectSize;
+	return CreateDynamicConstantBuffer(pd3dDevice, maxObjectSize, &m_pFallback);
+}
+
+void ConstantRingBuffer::Bind(ID3D11DeviceContext* pContext, UINT slot, UINT stages, const void* pData, UINT size)
+{
+	if (!m_useOffsets)
+	{
+		BindFallback(pContext, slot, stages, pData, size);
+		return;
+	}
+
+	bool wrapped;
+	UINT offset = m_allocator.Allocate(size, wrapped);
+	if (offset == ~0u)
+		return;
+
+	// Ranges handed out since the last wrap may still be in flight, only a wrap discards
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	D3D11_MAP mapType = wrapped ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (FAILED(pContext->Map(m_pRing, 0, mapType, 0, &mapped)))
+		return;
+	memcpy(static_cast<uint8_t*>(mapped.pData) + offset, pData, size);
+	pContext->Unmap(m_pRing, 0);
+
+	++m_pStats->MapCalls;
+	m_pStats->BytesUploaded += size;
+	if (wrapped)
+		++m_pStats->RingWraps;
+
+	UINT firstConstant = offset / 16;
+	UINT numConstants = ConstantRingAllocator::GetAlignedSize(size) / 16;
+	if (stages & ShaderStageVS)
+		m_pContext1->VSSetConstantBuffers1(slot, 1, &m_pRing, &firstConstant, &numConstants);
+	if (stages & ShaderStageHS)
+		m_pContext1->HSSetConstantBuffers1(slot, 1, &m_pRing, &firstConstant, &numConstants);
+	if (stages & ShaderStageDS)
+		m_pContext1->DSSetConstantBuffers1(slot, 1, &m_pRing, &firstConstant, &numConstants);
+	if (stages & ShaderStageGS)
+		m_pContext1->GSSetConstantBuffers1(slot, 1, &m_pRing, &firstConstant, &numConstants);
+	if (stages & ShaderStagePS)
+		m_pContext1->PSSetConstantBuffers1(slot, 1, &m_pRing, &firstConstant, &numConstants);
+	if (stages & ShaderStageCS)
+		m_pContext1->CSSetConstantBuffers1(slot, 1, &m_pRing, &firstConstant, &numConstants);
+}
+
+void ConstantRingBuffer::BindFallback(ID3D11DeviceContext* pContext, UINT slot, UINT stages, const void* pData, UINT size)
+{
+	// 11.0 path: the driver renames the buffer on every discard
+	if (size > m_fallbackSize)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(pContext->Map(m_pFallback, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, pData, size);
+	pContext->Unmap(m_pFallback, 0);
+
+	++m_pStats->MapCalls;
+	m_pStats->BytesUploaded += size;
+	SetConstantBuffers(pContext, slot, stages, m_pFallback);
+}
+
+DynamicStructuredBuffer::~DynamicStructuredBuffer()
+{
+	if (m_pView) m_pView->Release();
+	if (m_pBuffer) m_pBuffer->Release();
+}
+
+HRESULT DynamicStructuredBuffer::Create(ID3D11Device* pd3dDevice, UINT stride, UINT capacity, ConstantUploadStats* pStats)
+{
+	m_pDevice = pd3dDevice;
+	m_stride = stride;
+	m_pStats = pStats;
+	return Resize(capacity);
+}
+
+HRESULT DynamicStructuredBuffer::Resize(UINT capacity)
+{
+	if (m_pView) m_pView->Release();
+	if (m_pBuffer) m_pBuffer->Release();
+	m_pView = nullptr;
+	m_pBuffer = nullptr;
+	m_capacity = 0;
+
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = m_stride * capacity;
+	bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bd.StructureByteStride = m_stride;
+	HRESULT hr = m_pDevice->CreateBuffer(&bd, nullptr, &m_pBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = capacity;
+	hr = m_pDevice->CreateShaderResourceView(m_pBuffer, &srvDesc, &m_pView);
+	if (SUCCEEDED(hr))
+		m_capacity = capacity;
+	return hr;
+}
+
+HRESULT DynamicStructuredBuffer::Update(ID3D11DeviceContext* pContext, const void* pData, UINT count)
+{
+	if (count > m_capacity)
+	{
+		UINT capacity = m_capacity ? m_capacity : 1;
+		while (capacity < count)
+		{
+			capacity *= 2;
+		}
+		HRESULT hr = Resize(capacity);
+		if (FAILED(hr))
+			return hr;
+	}
+	if (count == 0)
+		return S_OK;
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = pContext->Map(m_pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	if (FAILED(hr))
+		return hr;
+	memcpy(mapped.pData, pData, (size_t)m_stride * count);
+	pContext->Unmap(m_pBuffer, 0);
+
+	++m_pStats->MapCalls;
+	m_pStats->BytesUploaded += (uint64_t)m_stride * count;
+	return S_OK;
+}
+
+void DynamicStructuredBuffer::Bind(ID3D11DeviceContext* pContext, UINT slot, UINT stages)
+{
+	if (stages & ShaderStageVS)
+		pContext->VSSetShaderResources(slot, 1, &m_pView);
+	if (stages & ShaderStageHS)
+		pContext->HSSetShaderResources(slot, 1, &m_pView);
+	if (stages & ShaderStageDS)
+		pContext->DSSetShaderResources(slot, 1, &m_pView);
+	if (stages & ShaderStageGS)
+		pContext->GSSetShaderResources(slot, 1, &m_pView);
+	if (stages & ShaderStagePS)
+		pContext->PSSetShaderResources(slot, 1, &m_pView);
+	if (stages & ShaderStageCS)
+		pContext->CSSetShaderResources(slot, 1, &m_pView);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <d3d11_1.h>
+#include <vector>
+#include "ConstantRing.h"
+
+enum ShaderStage
+{
+	ShaderStageVS = 1 << 0,
+	ShaderStageHS = 1 << 1,
+	ShaderStageDS = 1 << 2,
+	ShaderStageGS = 1 << 3,
+	ShaderStagePS = 1 << 4,
+	ShaderStageAll = 0x1f,	// every graphics stage
+	ShaderStageCS = 1 << 5
+};
+
+// Reset at the start of every frame
+struct ConstantUploadStats
+{
+	uint32_t	MapCalls;
+	uint32_t	SkippedUploads;
+	uint32_t	RingWraps;
+	uint64_t	BytesUploaded;
+};
+
+// Per-frame, per-pass and per-material constants. Keeps a copy of the last upload
+// and only maps the buffer when the new contents differ.
+class CachedConstantBuffer
+{
+public:
+	CachedConstantBuffer() {}
+	~CachedConstantBuffer();
+
+	HRESULT Create(ID3D11Device* pd3dDevice, UINT size, ConstantUploadStats* pStats);
+
+	// Returns true if the data had changed and was uploaded
+	bool Update(ID3D11DeviceContext* pContext, const void* pData);
+	void Bind(ID3D11DeviceContext* pContext, UINT slot, UINT stages);
+
+	ID3D11Buffer* GetBuffer() { return m_pBuffer; }
+
+private:
+	ID3D11Buffer* m_pBuffer = nullptr;
+	std::vector<uint8_t> m_contents;
+	bool m_uploaded = false;
+	ConstantUploadStats* m_pStats = nullptr;
+};
+
+// Per-object constants. Every draw gets its own range of one large dynamic buffer,
+// written with MAP_WRITE_NO_OVERWRITE and bound with *SSetConstantBuffers1 offsets.
+// Without 11.1 offset support it falls back to one buffer rewritten per draw.
+class ConstantRingBuffer
+{
+public:
+	ConstantRingBuffer() {}
+	~ConstantRingBuffer();
+
+	HRESULT Create(ID3D11Device* pd3dDevice, ID3D11DeviceContext1* pContext1, UINT capacity, UINT maxObjectSize, ConstantUploadStats* pStats);
+
+	// Copies the constants into fresh space and binds them to slot on the given stages
+	void Bind(ID3D11DeviceContext* pContext, UINT slot, UINT stages, const void* pData, UINT size);
+
+	// The next bind discards, e.g. at the start of a deferred context's command list
+	void Restart() { m_allocator.Reset(m_allocator.GetCapacity()); }
+
+	bool UsesOffsets() { return m_useOffsets; }
+
+private:
+	void BindFallback(ID3D11DeviceContext* pContext, UINT slot, UINT stages, const void* pData, UINT size);
+
+	ConstantRingAllocator m_allocator;
+	ID3D11Buffer* m_pRing = nullptr;
+	ID3D11Buffer* m_pFallback = nullptr;
+	UINT m_fallbackSize = 0;
+	ID3D11DeviceContext1* m_pContext1 = nullptr;
+	bool m_useOffsets = false;
+	ConstantUploadStats* m_pStats = nullptr;
+};
+
+// Per-frame arrays the shaders read as StructuredBuffers, rewritten with a discard
+// each Update. The buffer and its view are recreated, twice as large, when an
+// update has more elements than fit.
+class DynamicStructuredBuffer
+{
+public:
+	DynamicStructuredBuffer() {}
+	~DynamicStructuredBuffer();
+
+	HRESULT Create(ID3D11Device* pd3dDevice, UINT stride, UINT capacity, ConstantUploadStats* pStats);
+
+	HRESULT Update(ID3D11DeviceContext* pContext, const void* pData, UINT count);
+	void Bind(ID3D11DeviceContext* pContext, UINT slot, UINT stages);
+
+	UINT GetCapacity() { return m_capacity; }
+
+private:
+	HRESULT Resize(UINT capacity);
+
+	ID3D11Device* m_pDevice = nullptr;
+	ID3D11Buffer* m_pBuffer = nullptr;
+	ID3D11ShaderResourceView* m_pView = nullptr;
+	UINT m_stride = 0;
+	UINT m_capacity = 0;
+	ConstantUploadStats* m_pStats = nullptr;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+// D3D11.1 constant buffer offsets are counted in 16 constants of 16 bytes
+#define CONSTANT_RING_ALIGNMENT 256
+
+// Hands out aligned ranges of one large buffer front to back. When a range no
+// longer fits, the ring starts over at zero and reports the wrap, so the owner can
+// map with WRITE_DISCARD once and keep using WRITE_NO_OVERWRITE in between.
+class ConstantRingAllocator
+{
+public:
+	ConstantRingAllocator(uint32_t capacity = 0) { Reset(capacity); }
+
+	void Reset(uint32_t capacity)
+	{
+		m_capacity = capacity - capacity % CONSTANT_RING_ALIGNMENT;
+		m_head = m_capacity;	// the first allocation always discards
+		m_wraps = 0;
+	}
+
+	// Returns the byte offset of size bytes, or ~0u if size can never fit
+	uint32_t Allocate(uint32_t size, bool& wrapped)
+	{
+		uint32_t aligned = GetAlignedSize(size);
+		wrapped = false;
+		if (aligned > m_capacity)
+			return ~0u;
+
+		if (m_head + aligned > m_capacity)
+		{
+			m_head = 0;
+			wrapped = true;
+			++m_wraps;
+		}
+
+		uint32_t offset = m_head;
+		m_head += aligned;
+		return offset;
+	}
+
+	static uint32_t GetAlignedSize(uint32_t size) { return (size + CONSTANT_RING_ALIGNMENT - 1) & ~(uint32_t)(CONSTANT_RING_ALIGNMENT - 1); }
+
+	uint32_t GetCapacity() const { return m_capacity; }
+	uint32_t GetHead() const { return m_head; }
+	uint32_t GetWrapCount() const { return m_wraps; }
+
+private:
+	uint32_t m_capacity;
+	uint32_t m_head;
+	uint32_t m_wraps;
+};
@@ -123,9 +123,9 @@ HRESULT CubeGameObject::initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext*
 	sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
 	sampDesc.MinLOD = 0;
 	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	hr = pd3dDevice->CreateSamplerState(&sampDesc, &m_pSamplerLinear);
+	m_pSamplerLinear = m_pStateCache->GetSamplerState(sampDesc);
 
-	return hr;
+	return m_pSamplerLinear ? S_OK : E_FAIL;
 }
 
 void CubeGameObject::draw(ID3D11DeviceContext* pContext)
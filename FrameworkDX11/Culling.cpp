@@ -0,0 +1,70 @@
+#include "Culling.h"
+#include "JobSystem.h"
+#include <atomic>
+#include <cmath>
+
+#define CULLING_BATCH 256
+
+void Culling::ExtractFrustum(const XMFLOAT4X4& m, CullingFrustum& frustum)
+{
+	// Clip space is v * M, so each plane is a sum or difference of the matrix columns
+	const XMFLOAT4 planes[6] =
+	{
+		XMFLOAT4(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41),
+		XMFLOAT4(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41),
+		XMFLOAT4(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42),
+		XMFLOAT4(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42),
+		XMFLOAT4(m._13, m._23, m._33, m._43),
+		XMFLOAT4(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43)
+	};
+
+	for (int i = 0; i < 6; ++i)
+	{
+		const XMFLOAT4& p = planes[i];
+		float length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		frustum.Planes[i] = XMFLOAT4(p.x * scale, p.y * scale, p.z * scale, p.w * scale);
+	}
+}
+
+void Culling::GetDepthRange(const XMFLOAT4X4& projection, float& nearZ, float& farZ)
+{
+	// A perspective matrix maps view z to z * _33 + _43 over w = z
+	nearZ = -projection._43 / projection._33;
+	farZ = projection._43 / (1.0f - projection._33);
+}
+
+bool Culling::IsSphereVisible(const CullingFrustum& frustum, const XMFLOAT4& sphere)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		const XMFLOAT4& p = frustum.Planes[i];
+		if (p.x * sphere.x + p.y * sphere.y + p.z * sphere.z + p.w < -sphere.w)
+			return false;
+	}
+	return true;
+}
+
+uint32_t Culling::CullSpheres(const CullingFrustum& frustum, const XMFLOAT4* spheres, size_t count, uint8_t* visible, JobSystem* pJobs)
+{
+	auto cullRange = [&](size_t begin, size_t end)
+	{
+		uint32_t passed = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			visible[i] = IsSphereVisible(frustum, spheres[i]) ? 1 : 0;
+			passed += visible[i];
+		}
+		return passed;
+	};
+
+	if (!pJobs || count <= CULLING_BATCH)
+		return cullRange(0, count);
+
+	std::atomic<uint32_t> passed(0);
+	pJobs->ParallelFor(count, CULLING_BATCH, [&](size_t begin, size_t end, unsigned)
+	{
+		passed.fetch_add(cullRange(begin, end), std::memory_order_relaxed);
+	});
+	return passed.load();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace DirectX;
+
+class JobSystem;
+
+// Six planes facing into the frustum, normalised so a dot product with a point is
+// its distance from the plane: left, right, bottom, top, near, far
+struct CullingFrustum
+{
+	XMFLOAT4	Planes[6];
+};
+
+namespace Culling
+{
+	// From a row vector view projection matrix with D3D's 0 to 1 clip depth
+	void ExtractFrustum(const XMFLOAT4X4& viewProjection, CullingFrustum& frustum);
+
+	// View space near and far distances of a row vector perspective projection
+	void GetDepthRange(const XMFLOAT4X4& projection, float& nearZ, float& farZ);
+
+	// Sphere centre in xyz, radius in w. Conservative: spheres near a frustum corner can pass.
+	bool IsSphereVisible(const CullingFrustum& frustum, const XMFLOAT4& sphere);
+
+	// Sets visible[i] to 1 for every sphere that passes and returns how many did.
+	// With a job system the spheres are split into batches across its threads.
+	uint32_t CullSpheres(const CullingFrustum& frustum, const XMFLOAT4* spheres, size_t count, uint8_t* visible, JobSystem* pJobs = nullptr);
+}
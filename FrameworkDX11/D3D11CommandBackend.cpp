@@ -0,0 +1,152 @@
+#include "D3D11CommandBackend.h"
+
+D3D11CommandBackend::~D3D11CommandBackend()
+{
+	for (ID3D11CommandList* pList : m_commandLists)
+	{
+		if (pList) pList->Release();
+	}
+
+	ReleaseContexts();
+}
+
+void D3D11CommandBackend::ReleaseContexts()
+{
+	for (RecordingContext* pContext : m_contexts)
+	{
+		delete pContext->pRenderBackend;
+		delete pContext->pObjectConstants;
+		if (pContext->pContext1) pContext->pContext1->Release();
+		if (pContext->pContext != m_pImmediateContext) pContext->pContext->Release();
+		delete pContext;
+	}
+	m_contexts.clear();
+}
+
+HRESULT D3D11CommandBackend::Create(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pImmediateContext, uint32_t recorders, UINT objectRingSize)
+{
+	m_pImmediateContext = pImmediateContext;
+
+	// The runtime emulates command lists when the driver doesn't build them itself
+	D3D11_FEATURE_DATA_THREADING threading = {};
+	if (SUCCEEDED(pd3dDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))))
+		m_driverCommandLists = threading.DriverCommandLists != FALSE;
+
+	m_deferred = true;
+	for (uint32_t i = 0; i < recorders; ++i)
+	{
+		ID3D11DeviceContext* pDeferred = nullptr;
+		HRESULT hr = pd3dDevice->CreateDeferredContext(0, &pDeferred);
+		if (SUCCEEDED(hr))
+			hr = AddContext(pd3dDevice, pDeferred, objectRingSize);
+		if (FAILED(hr))
+		{
+			if (pDeferred) pDeferred->Release();
+			m_deferred = false;
+			break;
+		}
+	}
+
+	if (m_deferred)
+		return S_OK;
+
+	// Single threaded device: record on the immediate context instead
+	ReleaseContexts();
+	return AddContext(pd3dDevice, pImmediateContext, objectRingSize);
+}
+
+HRESULT D3D11CommandBackend::AddContext(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext, UINT objectRingSize)
+{
+	RecordingContext* pRecording = new RecordingContext();
+	pRecording->pContext = pContext;
+	pRecording->pContext1 = nullptr;
+	pRecording->ConstantStats = {};
+	(void)pContext->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&pRecording->pContext1));
+
+	pRecording->pObjectConstants = new ConstantRingBuffer();
+	HRESULT hr = pRecording->pObjectConstants->Create(pd3dDevice, pRecording->pContext1, objectRingSize, sizeof(ObjectConstants), &pRecording->ConstantStats);
+	if (FAILED(hr))
+	{
+		delete pRecording->pObjectConstants;
+		if (pRecording->pContext1) pRecording->pContext1->Release();
+		delete pRecording;
+		return hr;
+	}
+
+	pRecording->pRenderBackend = new D3D11RenderBackend(pContext, pRecording->pObjectConstants);
+	m_contexts.push_back(pRecording);
+	return S_OK;
+}
+
+uint32_t D3D11CommandBackend::AddShaderProgram(const RenderShaderProgram& program)
+{
+	uint32_t id = 0;
+	for (RecordingContext* pContext : m_contexts)
+	{
+		id = pContext->pRenderBackend->AddShaderProgram(program);
+	}
+	return id;
+}
+
+void D3D11CommandBackend::SetShaderProgram(uint32_t shader, const RenderShaderProgram& program)
+{
+	for (RecordingContext* pContext : m_contexts)
+	{
+		pContext->pRenderBackend->SetShaderProgram(shader, program);
+	}
+}
+
+void D3D11CommandBackend::BeginFrame(uint32_t passCount)
+{
+	m_commandLists.assign(passCount, nullptr);
+}
+
+void D3D11CommandBackend::BeginPass(uint32_t recorder, uint32_t pass)
+{
+	// Each command list must start its use of the ring with a discard
+	if (m_deferred)
+		m_contexts[recorder]->pObjectConstants->Restart();
+}
+
+void D3D11CommandBackend::EndPass(uint32_t recorder, uint32_t pass)
+{
+	if (!m_deferred)
+		return;
+
+	// FALSE: the deferred context starts the next pass from default state
+	if (FAILED(m_contexts[recorder]->pContext->FinishCommandList(FALSE, &m_commandLists[pass])))
+		m_commandLists[pass] = nullptr;
+}
+
+void D3D11CommandBackend::ExecutePass(uint32_t pass)
+{
+	ID3D11CommandList* pList = m_commandLists[pass];
+	if (!pList)
+		return;
+
+	m_pImmediateContext->ExecuteCommandList(pList, FALSE);
+	pList->Release();
+	m_commandLists[pass] = nullptr;
+}
+
+void D3D11CommandBackend::CollectStats(ConstantUploadStats& constants, RenderQueueStats& queue)
+{
+	for (RecordingContext* pContext : m_contexts)
+	{
+		const ConstantUploadStats& c = pContext->ConstantStats;
+		constants.MapCalls += c.MapCalls;
+		constants.SkippedUploads += c.SkippedUploads;
+		constants.RingWraps += c.RingWraps;
+		constants.BytesUploaded += c.BytesUploaded;
+		pContext->ConstantStats = {};
+
+		const RenderQueueStats& q = pContext->Filter.GetStats();
+		queue.Packets += q.Packets;
+		queue.ShaderBinds += q.ShaderBinds;
+		queue.MaterialBinds += q.MaterialBinds;
+		queue.MeshBinds += q.MeshBinds;
+		queue.ObjectBinds += q.ObjectBinds;
+		queue.SkippedBinds += q.SkippedBinds;
+		pContext->Filter.ResetStats();
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <d3d11_1.h>
+#include <vector>
+#include "CommandRecorder.h"
+#include "D3D11RenderBackend.h"
+
+// Everything a pass needs to record on one thread. Each recorder owns its
+// context, object constant ring and render queue, so passes never share them.
+struct RecordingContext
+{
+	ID3D11DeviceContext*	pContext;
+	ID3D11DeviceContext1*	pContext1;
+	ConstantRingBuffer*		pObjectConstants;
+	D3D11RenderBackend*		pRenderBackend;
+	RenderQueue				Queue;
+	RenderStateFilter		Filter;
+	ConstantUploadStats		ConstantStats;
+};
+
+// Records passes into deferred contexts, one per recorder, and plays the command
+// lists back on the immediate context. If the device can't make deferred contexts
+// there is a single recorder that draws straight to the immediate context.
+class D3D11CommandBackend : public CommandBackend
+{
+public:
+	D3D11CommandBackend() {}
+	~D3D11CommandBackend();
+
+	HRESULT Create(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pImmediateContext, uint32_t recorders, UINT objectRingSize);
+
+	// Registers the program with every recorder, the id is the same for all of them
+	uint32_t AddShaderProgram(const RenderShaderProgram& program);
+
+	// Replaces a program on every recorder, only between frames
+	void SetShaderProgram(uint32_t shader, const RenderShaderProgram& program);
+
+	RecordingContext& GetContext(uint32_t recorder) { return *m_contexts[recorder]; }
+	bool IsDeferred() const { return m_deferred; }
+	bool HasDriverCommandLists() const { return m_driverCommandLists; }
+
+	uint32_t GetRecorderCount() const { return (uint32_t)m_contexts.size(); }
+	void BeginFrame(uint32_t passCount);
+	void BeginPass(uint32_t recorder, uint32_t pass);
+	void EndPass(uint32_t recorder, uint32_t pass);
+	void ExecutePass(uint32_t pass);
+
+	// Adds every recorder's counters since the last call to the totals and clears them
+	void CollectStats(ConstantUploadStats& constants, RenderQueueStats& queue);
+
+private:
+	void ReleaseContexts();
+	HRESULT AddContext(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext, UINT objectRingSize);
+
+	ID3D11DeviceContext* m_pImmediateContext = nullptr;
+	std::vector<RecordingContext*> m_contexts;
+	std::vector<ID3D11CommandList*> m_commandLists;
+	bool m_deferred = false;
+	bool m_driverCommandLists = false;
+};
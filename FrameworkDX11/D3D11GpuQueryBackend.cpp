@@ -0,0 +1,72 @@
+#include "D3D11GpuQueryBackend.h"
+
+D3D11GpuQueryBackend::~D3D11GpuQueryBackend()
+{
+	for (ID3D11Query* pQuery : m_disjoint)
+	{
+		if (pQuery) pQuery->Release();
+	}
+	for (ID3D11Query* pQuery : m_timestamps)
+	{
+		if (pQuery) pQuery->Release();
+	}
+}
+
+HRESULT D3D11GpuQueryBackend::Create(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pImmediateContext, uint32_t slots)
+{
+	m_pContext = pImmediateContext;
+	m_disjoint.assign(slots, nullptr);
+	m_timestamps.assign(slots * GPU_PROFILER_MAX_QUERIES, nullptr);
+
+	D3D11_QUERY_DESC desc = {};
+	desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	for (ID3D11Query*& pQuery : m_disjoint)
+	{
+		HRESULT hr = pd3dDevice->CreateQuery(&desc, &pQuery);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	desc.Query = D3D11_QUERY_TIMESTAMP;
+	for (ID3D11Query*& pQuery : m_timestamps)
+	{
+		HRESULT hr = pd3dDevice->CreateQuery(&desc, &pQuery);
+		if (FAILED(hr))
+			return hr;
+	}
+	return S_OK;
+}
+
+void D3D11GpuQueryBackend::BeginFrame(uint32_t slot)
+{
+	m_pContext->Begin(m_disjoint[slot]);
+}
+
+void D3D11GpuQueryBackend::EndFrame(uint32_t slot)
+{
+	m_pContext->End(m_disjoint[slot]);
+}
+
+void D3D11GpuQueryBackend::Timestamp(uint32_t slot, uint32_t query)
+{
+	m_pContext->End(m_timestamps[slot * GPU_PROFILER_MAX_QUERIES + query]);
+}
+
+bool D3D11GpuQueryBackend::GetFrameData(uint32_t slot, uint64_t& frequency, bool& disjoint)
+{
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT data = {};
+	if (m_pContext->GetData(m_disjoint[slot], &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+	frequency = data.Frequency;
+	disjoint = data.Disjoint != FALSE;
+	return true;
+}
+
+bool D3D11GpuQueryBackend::GetTimestamp(uint32_t slot, uint32_t query, uint64_t& ticks)
+{
+	UINT64 data = 0;
+	if (m_pContext->GetData(m_timestamps[slot * GPU_PROFILER_MAX_QUERIES + query], &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+	ticks = data;
+	return true;
+}
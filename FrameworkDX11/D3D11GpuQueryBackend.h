@@ -0,0 +1,28 @@
+#pragma once
+#include <d3d11_1.h>
+#include <vector>
+#include "GpuProfiler.h"
+
+// D3D11_QUERY_TIMESTAMP_DISJOINT per slot around D3D11_QUERY_TIMESTAMP pairs, all
+// issued on the immediate context. Reads use D3D11_ASYNC_GETDATA_DONOTFLUSH so a
+// query that isn't ready costs one failed GetData.
+class D3D11GpuQueryBackend : public GpuQueryBackend
+{
+public:
+	D3D11GpuQueryBackend() {}
+	~D3D11GpuQueryBackend();
+
+	HRESULT Create(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pImmediateContext, uint32_t slots);
+
+	void BeginFrame(uint32_t slot);
+	void EndFrame(uint32_t slot);
+	void Timestamp(uint32_t slot, uint32_t query);
+
+	bool GetFrameData(uint32_t slot, uint64_t& frequency, bool& disjoint);
+	bool GetTimestamp(uint32_t slot, uint32_t query, uint64_t& ticks);
+
+private:
+	ID3D11DeviceContext* m_pContext = nullptr;
+	std::vector<ID3D11Query*> m_disjoint;
+	std::vector<ID3D11Query*> m_timestamps;
+};
@@ -0,0 +1,86 @@
+#include "D3D11RenderBackend.h"
+
+D3D11RenderBackend::D3D11RenderBackend(ID3D11DeviceContext* pContext, ConstantRingBuffer* pObjectConstants)
+{
+	m_pContext = pContext;
+	m_pObjectConstants = pObjectConstants;
+}
+
+uint32_t D3D11RenderBackend::AddShaderProgram(const RenderShaderProgram& program)
+{
+	m_programs.push_back(program);
+	return (uint32_t)m_programs.size() - 1;
+}
+
+uint32_t D3D11RenderBackend::GetMaterialId(const RenderMaterial& material)
+{
+	auto it = m_materialIds.find(material);
+	if (it != m_materialIds.end())
+		return it->second;
+
+	uint32_t id = (uint32_t)m_materials.size();
+	m_materials.push_back(material);
+	m_materialIds.emplace(material, id);
+	return id;
+}
+
+uint32_t D3D11RenderBackend::GetMeshId(const RenderMesh& mesh)
+{
+	auto it = m_meshIds.find(mesh);
+	if (it != m_meshIds.end())
+		return it->second;
+
+	uint32_t id = (uint32_t)m_meshes.size();
+	m_meshes.push_back(mesh);
+	m_meshIds.emplace(mesh, id);
+	return id;
+}
+
+uint32_t D3D11RenderBackend::AddObject(FXMMATRIX world, CXMMATRIX previousWorld, XMFLOAT4 colour)
+{
+	ObjectConstants constants;
+	constants.mWorld = XMMatrixTranspose(world);
+	constants.mPreviousWorld = XMMatrixTranspose(previousWorld);
+	constants.vOutputColor = colour;
+	m_objects.push_back(constants);
+	return (uint32_t)m_objects.size() - 1;
+}
+
+void D3D11RenderBackend::BindShader(uint32_t shader)
+{
+	const RenderShaderProgram& program = m_programs[shader];
+	m_pContext->VSSetShader(program.VertexShader, nullptr, 0);
+	m_pContext->HSSetShader(program.HullShader, nullptr, 0);
+	m_pContext->DSSetShader(program.DomainShader, nullptr, 0);
+	m_pContext->GSSetShader(program.GeometryShader, nullptr, 0);
+	m_pContext->PSSetShader(program.PixelShader, nullptr, 0);
+	m_pContext->IASetInputLayout(program.InputLayout);
+}
+
+void D3D11RenderBackend::BindMaterial(uint32_t material)
+{
+	const RenderMaterial& m = m_materials[material];
+	m_pContext->PSSetShaderResources(0, RENDER_MATERIAL_PS_RESOURCES, m.PixelResources);
+	m_pContext->DSSetShaderResources(0, RENDER_MATERIAL_DS_RESOURCES, m.DomainResources);
+	m_pContext->DSSetSamplers(0, 1, &m.Sampler);
+	m_pContext->PSSetSamplers(0, 1, &m.Sampler);
+}
+
+void D3D11RenderBackend::BindMesh(uint32_t mesh)
+{
+	const RenderMesh& m = m_meshes[mesh];
+	UINT offset = 0;
+	m_pContext->IASetVertexBuffers(0, 1, &m.VertexBuffer, &m.Stride, &offset);
+	m_pContext->IASetPrimitiveTopology(m.Topology);
+}
+
+void D3D11RenderBackend::BindObject(uint32_t object)
+{
+	m_pObjectConstants->Bind(m_pContext, 0, ShaderStageAll, &m_objects[object], sizeof(ObjectConstants));
+}
+
+void D3D11RenderBackend::Draw(const RenderPacket& packet)
+{
+	m_pContext->Draw(packet.VertexCount, packet.StartVertex);
+	++m_drawCalls;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <d3d11_1.h>
+#include <unordered_map>
+#include <vector>
+#include "RenderQueue.h"
+#include "ConstantBuffers.h"
+#include "StateCacheTable.h"
+#include "structures.h"
+
+#define RENDER_MATERIAL_PS_RESOURCES 8
+#define RENDER_MATERIAL_DS_RESOURCES 2
+
+// Shaders and input layout set together by one packet, null stages are unbound
+struct RenderShaderProgram
+{
+	ID3D11VertexShader*		VertexShader;
+	ID3D11HullShader*		HullShader;
+	ID3D11DomainShader*		DomainShader;
+	ID3D11GeometryShader*	GeometryShader;
+	ID3D11PixelShader*		PixelShader;
+	ID3D11InputLayout*		InputLayout;
+};
+
+// Textures by register, so every slot is written in one call per stage
+struct RenderMaterial
+{
+	ID3D11ShaderResourceView*	PixelResources[RENDER_MATERIAL_PS_RESOURCES];
+	ID3D11ShaderResourceView*	DomainResources[RENDER_MATERIAL_DS_RESOURCES];
+	ID3D11SamplerState*			Sampler;
+};
+
+struct RenderMesh
+{
+	ID3D11Buffer*				VertexBuffer;
+	UINT						Stride;
+	D3D11_PRIMITIVE_TOPOLOGY	Topology;
+};
+
+// Turns queue indices into device calls. Materials and meshes are interned by
+// value, so objects can describe themselves every frame and still share ids.
+// Objects only live until ClearObjects, normally once per queue flush.
+class D3D11RenderBackend : public RenderBackend
+{
+public:
+	D3D11RenderBackend(ID3D11DeviceContext* pContext, ConstantRingBuffer* pObjectConstants);
+
+	uint32_t AddShaderProgram(const RenderShaderProgram& program);
+	void SetShaderProgram(uint32_t shader, const RenderShaderProgram& program) { m_programs[shader] = program; }
+	uint32_t GetMaterialId(const RenderMaterial& material);
+	uint32_t GetMeshId(const RenderMesh& mesh);
+
+	// The previous world matrix is last frame's, the velocity programs need it
+	uint32_t AddObject(FXMMATRIX world, CXMMATRIX previousWorld, XMFLOAT4 colour);
+	void ClearObjects() { m_objects.clear(); }
+
+	void BindShader(uint32_t shader);
+	void BindMaterial(uint32_t material);
+	void BindMesh(uint32_t mesh);
+	void BindObject(uint32_t object);
+	void Draw(const RenderPacket& packet);
+
+	uint32_t GetDrawCalls() const { return m_drawCalls; }
+	void ResetDrawCalls() { m_drawCalls = 0; }
+
+private:
+	template <typename T>
+	struct BytesHash
+	{
+		size_t operator()(const T& value) const { return (size_t)StateCache::HashBytes(&value, sizeof(T)); }
+	};
+
+	template <typename T>
+	struct BytesEqual
+	{
+		bool operator()(const T& a, const T& b) const { return memcmp(&a, &b, sizeof(T)) == 0; }
+	};
+
+	ID3D11DeviceContext* m_pContext;
+	ConstantRingBuffer* m_pObjectConstants;
+
+	std::vector<RenderShaderProgram> m_programs;
+	std::vector<RenderMaterial> m_materials;
+	std::vector<RenderMesh> m_meshes;
+	std::vector<ObjectConstants> m_objects;
+	std::unordered_map<RenderMaterial, uint32_t, BytesHash<RenderMaterial>, BytesEqual<RenderMaterial>> m_materialIds;
+	std::unordered_map<RenderMesh, uint32_t, BytesHash<RenderMesh>, BytesEqual<RenderMesh>> m_meshIds;
+	uint32_t m_drawCalls = 0;
+};
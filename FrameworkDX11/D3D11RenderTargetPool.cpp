@@ -0,0 +1,84 @@
+#include "D3D11RenderTargetPool.h"
+
+D3D11RenderTargetPool::~D3D11RenderTargetPool()
+{
+	for (TextureSet& target : m_targets)
+	{
+		Release(target);
+	}
+}
+
+HRESULT D3D11RenderTargetPool::Update(ID3D11Device* pd3dDevice, const std::vector<FrameGraphTextureDesc>& descs)
+{
+	for (size_t i = descs.size(); i < m_targets.size(); ++i)
+	{
+		Release(m_targets[i]);
+	}
+	m_targets.resize(descs.size());
+	m_descs.resize(descs.size(), {});
+
+	for (size_t i = 0; i < descs.size(); ++i)
+	{
+		if (m_targets[i].texture && FrameGraph::IsSameDesc(m_descs[i], descs[i]))
+			continue;
+
+		Release(m_targets[i]);
+		HRESULT hr = Create(pd3dDevice, descs[i], m_targets[i]);
+		if (FAILED(hr))
+		{
+			Release(m_targets[i]);
+			return hr;
+		}
+		m_descs[i] = descs[i];
+		++m_created;
+	}
+	return S_OK;
+}
+
+HRESULT D3D11RenderTargetPool::Create(ID3D11Device* pd3dDevice, const FrameGraphTextureDesc& desc, TextureSet& target)
+{
+	bool multisampled = desc.SampleCount > 1;
+
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = desc.Width;
+	textureDesc.Height = desc.Height;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = (DXGI_FORMAT)desc.Format;
+	textureDesc.SampleDesc.Count = desc.SampleCount;
+	textureDesc.SampleDesc.Quality = desc.SampleQuality;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE | (desc.UnorderedAccess ? D3D11_BIND_UNORDERED_ACCESS : 0);
+	HRESULT hr = pd3dDevice->CreateTexture2D(&textureDesc, nullptr, &target.texture);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc = {};
+	renderTargetViewDesc.Format = textureDesc.Format;
+	renderTargetViewDesc.ViewDimension = multisampled ? D3D11_RTV_DIMENSION_TEXTURE2DMS : D3D11_RTV_DIMENSION_TEXTURE2D;
+	hr = pd3dDevice->CreateRenderTargetView(target.texture, &renderTargetViewDesc, &target.view);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc = {};
+	shaderResourceViewDesc.Format = textureDesc.Format;
+	shaderResourceViewDesc.ViewDimension = multisampled ? D3D11_SRV_DIMENSION_TEXTURE2DMS : D3D11_SRV_DIMENSION_TEXTURE2D;
+	shaderResourceViewDesc.Texture2D.MipLevels = 1;
+	hr = pd3dDevice->CreateShaderResourceView(target.texture, &shaderResourceViewDesc, &target.resource);
+	if (FAILED(hr) || !desc.UnorderedAccess)
+		return hr;
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC unorderedAccessViewDesc = {};
+	unorderedAccessViewDesc.Format = textureDesc.Format;
+	unorderedAccessViewDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+	return pd3dDevice->CreateUnorderedAccessView(target.texture, &unorderedAccessViewDesc, &target.access);
+}
+
+void D3D11RenderTargetPool::Release(TextureSet& target)
+{
+	if (target.texture) target.texture->Release();
+	if (target.view) target.view->Release();
+	if (target.resource) target.resource->Release();
+	if (target.access) target.access->Release();
+	target = TextureSet();
+}
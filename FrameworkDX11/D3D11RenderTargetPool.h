@@ -0,0 +1,34 @@
+#pragma once
+#include <d3d11_1.h>
+#include <vector>
+#include "structures.h"
+#include "FrameGraph.h"
+
+// The frame graph's physical textures, each with a render target and shader
+// resource view, plus an unordered access view if the description asks. Update keeps every texture whose description is unchanged, so a
+// graph that compiles to the same textures each frame creates nothing after the
+// first; textures the graph no longer needs are released.
+class D3D11RenderTargetPool
+{
+public:
+	D3D11RenderTargetPool() {}
+	~D3D11RenderTargetPool();
+
+	D3D11RenderTargetPool(const D3D11RenderTargetPool&) = delete;
+	D3D11RenderTargetPool& operator=(const D3D11RenderTargetPool&) = delete;
+
+	HRESULT Update(ID3D11Device* pd3dDevice, const std::vector<FrameGraphTextureDesc>& descs);
+
+	TextureSet& Get(uint32_t physical) { return m_targets[physical]; }
+
+	// Textures created since the pool was made, 1 per target if nothing churns
+	uint32_t GetCreatedCount() const { return m_created; }
+
+private:
+	HRESULT Create(ID3D11Device* pd3dDevice, const FrameGraphTextureDesc& desc, TextureSet& target);
+	static void Release(TextureSet& target);
+
+	std::vector<TextureSet> m_targets;
+	std::vector<FrameGraphTextureDesc> m_descs;
+	uint32_t m_created = 0;
+};
@@ -0,0 +1,61 @@
+#include "D3DShaderCompiler.h"
+#include <fstream>
+#include <sstream>
+
+uint32_t D3DShaderCompiler::GetDefaultFlags()
+{
+	uint32_t flags = D3DCOMPILE_ENABLE_STRICTNESS;
+#ifdef _DEBUG
+	flags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+	return flags;
+}
+
+uint64_t D3DShaderCompiler::GetVersion() const
+{
+	return D3D_COMPILER_VERSION;
+}
+
+bool D3DShaderCompiler::ReadSource(const std::string& path, std::string& source)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	source = contents.str();
+	return true;
+}
+
+bool D3DShaderCompiler::Compile(const ShaderCompileRequest& request, const std::string& source, std::vector<uint8_t>& bytecode, std::string& errors)
+{
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (const ShaderDefine& define : request.Defines)
+	{
+		macros.push_back({ define.Name.c_str(), define.Value.c_str() });
+	}
+	macros.push_back({ nullptr, nullptr });
+
+	ID3DBlob* pBlob = nullptr;
+	ID3DBlob* pErrorBlob = nullptr;
+	HRESULT hr = D3DCompile(source.data(), source.size(), request.File.c_str(), macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE,
+		request.EntryPoint.c_str(), request.Profile.c_str(), request.Flags, 0, &pBlob, &pErrorBlob);
+
+	if (pErrorBlob)
+	{
+		errors.assign(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()), pErrorBlob->GetBufferSize());
+		pErrorBlob->Release();
+	}
+
+	if (FAILED(hr))
+	{
+		if (pBlob) pBlob->Release();
+		return false;
+	}
+
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pBlob->GetBufferPointer());
+	bytecode.assign(pBytes, pBytes + pBlob->GetBufferSize());
+	pBlob->Release();
+	return true;
+}
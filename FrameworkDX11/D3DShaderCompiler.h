@@ -0,0 +1,17 @@
+#pragma once
+#include <d3d11_1.h>
+#include <d3dcompiler.h>
+#include "ShaderCache.h"
+
+// Compiles with D3DCompile from source the cache has already read, so the file
+// is only read once per startup. Includes resolve like D3DCompileFromFile would.
+class D3DShaderCompiler : public ShaderCompiler
+{
+public:
+	// The flags CompileShaderFromFile has always used for this configuration
+	static uint32_t GetDefaultFlags();
+
+	uint64_t GetVersion() const;
+	bool ReadSource(const std::string& path, std::string& source);
+	bool Compile(const ShaderCompileRequest& request, const std::string& source, std::vector<uint8_t>& bytecode, std::string& errors);
+};
@@ -0,0 +1,113 @@
+#include "DDSHeader.h"
+#include <cstring>
+
+// Byte offsets in the file, the DDS_HEADER starts after the four byte magic
+#define DDS_FILE_MAGIC 0
+#define DDS_FILE_HEADER_SIZE 4
+#define DDS_FILE_FLAGS 8
+#define DDS_FILE_HEIGHT 12
+#define DDS_FILE_WIDTH 16
+#define DDS_FILE_DEPTH 24
+#define DDS_FILE_MIP_COUNT 28
+#define DDS_FILE_PIXEL_FORMAT_SIZE 76
+#define DDS_FILE_PIXEL_FORMAT_FLAGS 80
+#define DDS_FILE_FOURCC 84
+#define DDS_FILE_CAPS2 112
+#define DDS_FILE_DX10_FORMAT 128
+#define DDS_FILE_DX10_DIMENSION 132
+#define DDS_FILE_DX10_MISC 136
+#define DDS_FILE_DX10_ARRAY_SIZE 140
+
+#define DDS_HEADER_BYTES 124
+#define DDS_PIXEL_FORMAT_BYTES 32
+#define DDS_DX10_HEADER_BYTES 20
+#define DDS_PIXEL_FORMAT_FOURCC 0x4
+#define DDS_FLAGS_VOLUME 0x00800000
+#define DDS_CAPS2_CUBEMAP 0x00000200
+#define DDS_CAPS2_CUBEMAP_ALLFACES 0x0000fe00
+#define DDS_MAX_MIP_LEVELS 15	// D3D11_REQ_MIP_LEVELS
+
+// Files are little endian, as is everything the app runs on
+static uint32_t ReadValue(const uint8_t* data, size_t offset)
+{
+	uint32_t value;
+	memcpy(&value, data + offset, sizeof(value));
+	return value;
+}
+
+bool DDSHeader::Parse(const uint8_t* data, size_t size, DDSHeaderInfo& info)
+{
+	info = {};
+	size_t headers = DDS_FILE_HEADER_SIZE + DDS_HEADER_BYTES;
+	if (!data || size < headers)
+		return false;
+	if (ReadValue(data, DDS_FILE_MAGIC) != MAKEFOURCC('D', 'D', 'S', ' ') ||
+		ReadValue(data, DDS_FILE_HEADER_SIZE) != DDS_HEADER_BYTES ||
+		ReadValue(data, DDS_FILE_PIXEL_FORMAT_SIZE) != DDS_PIXEL_FORMAT_BYTES)
+		return false;
+
+	uint32_t flags = ReadValue(data, DDS_FILE_FLAGS);
+	info.Width = ReadValue(data, DDS_FILE_WIDTH);
+	info.Height = ReadValue(data, DDS_FILE_HEIGHT);
+	info.Depth = ReadValue(data, DDS_FILE_DEPTH);
+	info.MipCount = ReadValue(data, DDS_FILE_MIP_COUNT);
+	info.MipCount = info.MipCount ? info.MipCount : 1;
+	info.ArraySize = 1;
+	if (ReadValue(data, DDS_FILE_PIXEL_FORMAT_FLAGS) & DDS_PIXEL_FORMAT_FOURCC)
+		info.FourCC = ReadValue(data, DDS_FILE_FOURCC);
+
+	if (info.FourCC == MAKEFOURCC('D', 'X', '1', '0'))
+	{
+		headers += DDS_DX10_HEADER_BYTES;
+		if (size < headers)
+			return false;
+
+		info.Format = ReadValue(data, DDS_FILE_DX10_FORMAT);
+		info.ArraySize = ReadValue(data, DDS_FILE_DX10_ARRAY_SIZE);
+		if (info.Format == 0 || info.ArraySize == 0)
+			return false;
+
+		switch (ReadValue(data, DDS_FILE_DX10_DIMENSION))
+		{
+		case DDS_DIMENSION_TEXTURE1D:
+			info.Height = info.Depth = 1;
+			break;
+
+		case DDS_DIMENSION_TEXTURE2D:
+			if (ReadValue(data, DDS_FILE_DX10_MISC) & DDS_MISC_TEXTURECUBE)
+			{
+				info.ArraySize *= 6;
+				info.IsCubeMap = true;
+			}
+			info.Depth = 1;
+			break;
+
+		case DDS_DIMENSION_TEXTURE3D:
+			if (info.ArraySize > 1)
+				return false;
+			break;
+
+		default:
+			return false;
+		}
+	}
+	else if (!(flags & DDS_FLAGS_VOLUME))
+	{
+		uint32_t caps2 = ReadValue(data, DDS_FILE_CAPS2);
+		if (caps2 & DDS_CAPS2_CUBEMAP)
+		{
+			// Partial cube maps aren't supported by D3D11
+			if ((caps2 & DDS_CAPS2_CUBEMAP_ALLFACES) != DDS_CAPS2_CUBEMAP_ALLFACES)
+				return false;
+			info.ArraySize = 6;
+			info.IsCubeMap = true;
+		}
+		info.Depth = 1;
+	}
+
+	if (info.MipCount > DDS_MAX_MIP_LEVELS)
+		return false;
+
+	info.DataOffset = headers;
+	return true;
+}
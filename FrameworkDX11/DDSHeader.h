@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAKEFOURCC
+#define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
+#endif
+
+// D3D11_RESOURCE_DIMENSION and D3D11_RESOURCE_MISC_TEXTURECUBE values of a DX10
+// header, kept as numbers so the headers can be read without D3D
+#define DDS_DIMENSION_TEXTURE1D 2
+#define DDS_DIMENSION_TEXTURE2D 3
+#define DDS_DIMENSION_TEXTURE3D 4
+#define DDS_MISC_TEXTURECUBE 0x4
+
+// What a DDS file's headers say, before any format is looked up. Format is the
+// DXGI_FORMAT of a DX10 header and 0 without one, when FourCC or the masks decide.
+struct DDSHeaderInfo
+{
+	uint32_t	Width;
+	uint32_t	Height;
+	uint32_t	Depth;
+	uint32_t	ArraySize;
+	uint32_t	MipCount;
+	uint32_t	FourCC;
+	uint32_t	Format;
+	bool		IsCubeMap;
+	size_t		DataOffset;		// where the first surface starts
+};
+
+// Reads the DDS and DX10 headers from plain bytes, with the checks
+// CreateDDSTextureFromMemoryEx makes before it needs a device
+namespace DDSHeader
+{
+	bool Parse(const uint8_t* data, size_t size, DDSHeaderInfo& info);
+}
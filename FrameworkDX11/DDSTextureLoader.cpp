@@ -23,6 +23,7 @@
 #include <memory>
 
 #include "DDSTextureLoader.h"
+#include "Profiler.h"
 
 #if !defined(NO_D3D11_DEBUG_NAME) && ( defined(_DEBUG) || defined(PROFILE) )
 #pragma comment(lib,"dxguid.lib")
@@ -1733,6 +1734,8 @@ HRESULT DirectX::CreateDDSTextureFromFileEx( ID3D11Device* d3dDevice,
                                              ID3D11ShaderResourceView** textureView,
                                              DDS_ALPHA_MODE* alphaMode )
 {
+    PROFILE_ZONE("LoadDDSTexture");
+
     if ( texture )
     {
         *texture = nullptr;
@@ -1,4 +1,5 @@
 #include "DrawableGameObject.h"
+#include "MeshVectors.h"
 
 using namespace std;
 using namespace DirectX;
@@ -14,6 +15,7 @@ DrawableGameObject::DrawableGameObject()
 
 	// Initialize the world matrix
 	XMStoreFloat4x4(&m_World, XMMatrixIdentity());
+	m_PreviousWorld = m_World;
 }
 
 DrawableGameObject::~DrawableGameObject()
@@ -43,11 +45,44 @@ void DrawableGameObject::cleanup()
 		m_pParallaxTexture->Release();
 	m_pParallaxTexture = nullptr;
 
-	if (m_pSamplerLinear)
-		m_pSamplerLinear->Release();
+	// Owned by the state cache
 	m_pSamplerLinear = nullptr;
 }
 
+RenderMaterial DrawableGameObject::GetDefaultMaterial()
+{
+	RenderMaterial material = {};
+	material.PixelResources[0] = m_pTextureResourceView;
+	material.PixelResources[1] = m_pNormalTexture;
+	material.PixelResources[2] = m_pParallaxTexture;
+	material.Sampler = m_pSamplerLinear;
+	return material;
+}
+
+void DrawableGameObject::SubmitPacket(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info, const RenderMaterial& material, UINT vertexCount, UINT startVertex)
+{
+	RenderMesh mesh = { m_pVertexBuffer, sizeof(SimpleVertex), D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST };
+
+	RenderPacket packet;
+	packet.Shader = info.Shader;
+	packet.Material = pBackend->GetMaterialId(material);
+	packet.Mesh = pBackend->GetMeshId(mesh);
+	packet.Object = info.Object;
+	packet.VertexCount = vertexCount;
+	packet.StartVertex = startVertex;
+	packet.Key = DrawKey::Make(info.Pass, info.Layer, info.Shader, packet.Material, info.Depth);
+	pQueue->Submit(packet);
+}
+
+void DrawableGameObject::SetWorld(FXMMATRIX world)
+{
+	// The first update has nothing to move from
+	XMFLOAT4X4 previous = m_World;
+	XMStoreFloat4x4(&m_World, world);
+	m_PreviousWorld = m_hasWorld ? previous : m_World;
+	m_hasWorld = true;
+}
+
 void DrawableGameObject::setPosition(XMFLOAT3 position)
 {
 	m_position = position;
@@ -64,7 +99,7 @@ void DrawableGameObject::update(float t, ID3D11DeviceContext* pContext)
 	XMMATRIX mTranslate = XMMatrixTranslation(m_position.x, m_position.y, m_position.z);
 	XMMATRIX mScale = XMMatrixScaling(m_scale.x, m_scale.y, m_scale.z);
 	XMMATRIX world = mScale * mSpin * mTranslate;
-	XMStoreFloat4x4(&m_World, world);
+	SetWorld(world);
 }
 
 void DrawableGameObject::update(ID3D11DeviceContext* pContext)
@@ -74,128 +109,15 @@ void DrawableGameObject::update(ID3D11DeviceContext* pContext)
 	XMMATRIX mTranslate = XMMatrixTranslation(m_position.x, m_position.y, m_position.z);
 	XMMATRIX mScale = XMMatrixScaling(m_scale.x, m_scale.y, m_scale.z);
 	XMMATRIX world = mScale * mSpin * mTranslate;
-	XMStoreFloat4x4(&m_World, world);
+	SetWorld(world);
 }
 
-// REFERENCE - this has largely been modified from "Mathematics for 3D Game Programmming and Computer Graphics" by Eric Lengyel
 void DrawableGameObject::CalculateModelVectors(SimpleVertex* vertices, int vertexCount)
 {
-	int faceCount, i, index;
-	SimpleVertex vertex1, vertex2, vertex3;
-	XMFLOAT3 tangent, binormal, normal;
-
-	// Calculate the number of faces in the model.
-	faceCount = vertexCount / 3;
-
-	// Initialize the index to the model data.
-	index = 0;
-
-	// Go through all the faces and calculate the the tangent, binormal, and normal vectors.
-	for (i = 0; i < faceCount; i++)
-	{
-		// Get the three vertices for this face from the model.
-		vertex1.Pos.x = vertices[index].Pos.x;
-		vertex1.Pos.y = vertices[index].Pos.y;
-		vertex1.Pos.z = vertices[index].Pos.z;
-		vertex1.TexCoord.x = vertices[index].TexCoord.x;
-		vertex1.TexCoord.y = vertices[index].TexCoord.y;
-		vertex1.Normal.x = vertices[index].Normal.x;
-		vertex1.Normal.y = vertices[index].Normal.y;
-		vertex1.Normal.z = vertices[index].Normal.z;
-		index++;
-
-		vertex2.Pos.x = vertices[index].Pos.x;
-		vertex2.Pos.y = vertices[index].Pos.y;
-		vertex2.Pos.z = vertices[index].Pos.z;
-		vertex2.TexCoord.x = vertices[index].TexCoord.x;
-		vertex2.TexCoord.y = vertices[index].TexCoord.y;
-		vertex2.Normal.x = vertices[index].Normal.x;
-		vertex2.Normal.y = vertices[index].Normal.y;
-		vertex2.Normal.z = vertices[index].Normal.z;
-		index++;
-
-		vertex3.Pos.x = vertices[index].Pos.x;
-		vertex3.Pos.y = vertices[index].Pos.y;
-		vertex3.Pos.z = vertices[index].Pos.z;
-		vertex3.TexCoord.x = vertices[index].TexCoord.x;
-		vertex3.TexCoord.y = vertices[index].TexCoord.y;
-		vertex3.Normal.x = vertices[index].Normal.x;
-		vertex3.Normal.y = vertices[index].Normal.y;
-		vertex3.Normal.z = vertices[index].Normal.z;
-		index++;
-
-		// Calculate the tangent and binormal of that face.
-		CalculateTangentBinormalLH(vertex1, vertex2, vertex3, normal, tangent, binormal);
-
-		// Store the normal, tangent, and binormal for this face back in the model structure.
-		vertices[index - 1].Normal.x = normal.x;
-		vertices[index - 1].Normal.y = normal.y;
-		vertices[index - 1].Normal.z = normal.z;
-		vertices[index - 1].Tangent.x = tangent.x;
-		vertices[index - 1].Tangent.y = tangent.y;
-		vertices[index - 1].Tangent.z = tangent.z;
-		vertices[index - 1].BiTangent.x = binormal.x;
-		vertices[index - 1].BiTangent.y = binormal.y;
-		vertices[index - 1].BiTangent.z = binormal.z;
-
-		vertices[index - 2].Normal.x = normal.x;
-		vertices[index - 2].Normal.y = normal.y;
-		vertices[index - 2].Normal.z = normal.z;
-		vertices[index - 2].Tangent.x = tangent.x;
-		vertices[index - 2].Tangent.y = tangent.y;
-		vertices[index - 2].Tangent.z = tangent.z;
-		vertices[index - 2].BiTangent.x = binormal.x;
-		vertices[index - 2].BiTangent.y = binormal.y;
-		vertices[index - 2].BiTangent.z = binormal.z;
-
-		vertices[index - 3].Normal.x = normal.x;
-		vertices[index - 3].Normal.y = normal.y;
-		vertices[index - 3].Normal.z = normal.z;
-		vertices[index - 3].Tangent.x = tangent.x;
-		vertices[index - 3].Tangent.y = tangent.y;
-		vertices[index - 3].Tangent.z = tangent.z;
-		vertices[index - 3].BiTangent.x = binormal.x;
-		vertices[index - 3].BiTangent.y = binormal.y;
-		vertices[index - 3].BiTangent.z = binormal.z;
-	}
+	MeshVectors::CalculateModelVectors(vertices, vertexCount);
 }
 
 void DrawableGameObject::CalculateTangentBinormalLH(SimpleVertex v0, SimpleVertex v1, SimpleVertex v2, XMFLOAT3& normal, XMFLOAT3& tangent, XMFLOAT3& binormal)
 {
-	XMFLOAT3 edge1(v1.Pos.x - v0.Pos.x, v1.Pos.y - v0.Pos.y, v1.Pos.z - v0.Pos.z);
-	XMFLOAT3 edge2(v2.Pos.x - v0.Pos.x, v2.Pos.y - v0.Pos.y, v2.Pos.z - v0.Pos.z);
-
-	XMFLOAT2 deltaUV1(v1.TexCoord.x - v0.TexCoord.x, v1.TexCoord.y - v0.TexCoord.y);
-	XMFLOAT2 deltaUV2(v2.TexCoord.x - v0.TexCoord.x, v2.TexCoord.y - v0.TexCoord.y);
-
-	float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-	tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-	tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-	tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-	XMVECTOR tn = XMLoadFloat3(&tangent);
-	tn = XMVector3Normalize(tn);
-	XMStoreFloat3(&tangent, tn);
-
-	binormal.x = f * (deltaUV1.x * edge2.x - deltaUV2.x * edge1.x);
-	binormal.y = f * (deltaUV1.x * edge2.y - deltaUV2.x * edge1.y);
-	binormal.z = f * (deltaUV1.x * edge2.z - deltaUV2.x * edge1.z);
-
-	tn = XMLoadFloat3(&binormal);
-	tn = XMVector3Normalize(tn);
-	XMStoreFloat3(&binormal, tn);
-
-
-	XMVECTOR vv0 = XMLoadFloat3(&v0.Pos);
-	XMVECTOR vv1 = XMLoadFloat3(&v1.Pos);
-	XMVECTOR vv2 = XMLoadFloat3(&v2.Pos);
-
-	XMVECTOR e0 = vv1 - vv0;
-	XMVECTOR e1 = vv2 - vv0;
-
-	XMVECTOR e01cross = XMVector3Cross(e0, e1);
-	e01cross = XMVector3Normalize(e01cross);
-	XMFLOAT3 normalOut;
-	XMStoreFloat3(&normalOut, e01cross);
-	normal = normalOut;
+	MeshVectors::CalculateTangentBinormalLH(v0, v1, v2, normal, tangent, binormal);
 }
\ No newline at end of file
@@ -3,15 +3,9 @@
 #include "DDSTextureLoader.h"
 //#include <iostream>
 #include "structures.h"
-
-struct SimpleVertex
-{
-	XMFLOAT3 Pos;
-	XMFLOAT3 Normal;
-	XMFLOAT2 TexCoord;
-	XMFLOAT3 Tangent;
-	XMFLOAT3 BiTangent;
-};
+#include "VertexTypes.h"
+#include "RenderStateCache.h"
+#include "D3D11RenderBackend.h"
 
 class DrawableGameObject
 {
@@ -26,10 +20,14 @@ public:
 	void								update(ID3D11DeviceContext* pContext);
 	virtual void						draw(ID3D11DeviceContext* pContext) = 0;
 	virtual void						draw(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* texture) = 0;
+	// Queues packets instead of drawing, objects that don't override it stay immediate only
+	virtual void						Submit(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info) {}
 	ID3D11Buffer*						getVertexBuffer() { return m_pVertexBuffer; }
 	ID3D11Buffer*						getIndexBuffer() { return m_pIndexBuffer; }
 	ID3D11ShaderResourceView**			getTextureResourceView() { return &m_pTextureResourceView; 	}
 	XMFLOAT4X4*							getTransform() { return &m_World; }
+	// The transform before the last update, the same as getTransform until the second one
+	XMFLOAT4X4*							getPreviousTransform() { return &m_PreviousWorld; }
 	XMFLOAT3							getPosition() { return m_position; }
 	ID3D11SamplerState**				getTextureSamplerState() { return &m_pSamplerLinear; }
 	void								setPosition(XMFLOAT3 position);
@@ -38,16 +36,25 @@ public:
 	void								CalculateTangentBinormalRH(SimpleVertex v0, SimpleVertex v1, SimpleVertex v2, XMFLOAT3& normal, XMFLOAT3& tangent, XMFLOAT3& binormal);
 	ID3D11SamplerState*					getSampler() { return m_pSamplerLinear; }
 	void								setScale(XMFLOAT3 scale) { m_scale = scale; }
+	void								SetStateCache(RenderStateCache* pStateCache) { m_pStateCache = pStateCache; }
 
 protected:
-	
+	// Diffuse, normal and parallax maps in t0-t2
+	RenderMaterial						GetDefaultMaterial();
+	void								SubmitPacket(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info, const RenderMaterial& material, UINT vertexCount, UINT startVertex = 0);
+	// Keeps the old transform as the previous one, once per frame
+	void								SetWorld(FXMMATRIX world);
+
 	XMFLOAT4X4							m_World;
+	XMFLOAT4X4							m_PreviousWorld;
+	bool								m_hasWorld = false;
 	ID3D11Buffer*						m_pVertexBuffer;
 	ID3D11Buffer*						m_pIndexBuffer;
 	ID3D11ShaderResourceView*			m_pTextureResourceView;
 	ID3D11ShaderResourceView*			m_pNormalTexture;
 	ID3D11ShaderResourceView*			m_pParallaxTexture;
 	ID3D11SamplerState *				m_pSamplerLinear;
+	RenderStateCache*					m_pStateCache = nullptr;
 	XMFLOAT3							m_position;
 	XMFLOAT3							m_scale = { 1.0f, 1.0f, 1.0f };
 };
\ No newline at end of file
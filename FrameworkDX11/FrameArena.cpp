@@ -0,0 +1,41 @@
+#include "FrameArena.h"
+
+FrameArena::FrameArena(size_t capacity)
+{
+	// Over-allocate so the start can be aligned without platform allocators
+	m_pBuffer = new uint8_t[capacity + FRAME_ARENA_ALIGNMENT];
+	uintptr_t address = reinterpret_cast<uintptr_t>(m_pBuffer);
+	m_pMemory = m_pBuffer + ((FRAME_ARENA_ALIGNMENT - (address % FRAME_ARENA_ALIGNMENT)) % FRAME_ARENA_ALIGNMENT);
+	m_capacity = capacity;
+	m_offset = 0;
+}
+
+FrameArena::~FrameArena()
+{
+	delete[] m_pBuffer;
+	m_pBuffer = nullptr;
+	m_pMemory = nullptr;
+}
+
+void* FrameArena::Allocate(size_t size)
+{
+	// Rounding every size keeps every allocation aligned
+	size = (size + FRAME_ARENA_ALIGNMENT - 1) & ~(size_t)(FRAME_ARENA_ALIGNMENT - 1);
+
+	size_t offset = m_offset.fetch_add(size, std::memory_order_relaxed);
+	if (offset + size > m_capacity)
+		return nullptr;
+
+	return m_pMemory + offset;
+}
+
+void FrameArena::Reset()
+{
+	size_t used = m_offset.load(std::memory_order_relaxed);
+	if (used > m_capacity)
+		used = m_capacity;
+	if (used > m_highWater)
+		m_highWater = used;
+
+	m_offset = 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_ARENA_ALIGNMENT 16
+
+// Linear allocator that is emptied once per frame. Allocation is a single
+// atomic add, so jobs on any thread can take scratch memory without locking.
+// Nothing is freed individually; Reset() must only be called between frames.
+class FrameArena
+{
+public:
+	FrameArena(size_t capacity);
+	~FrameArena();
+
+	// Returns nullptr when the arena is exhausted
+	void* Allocate(size_t size);
+
+	template<typename T>
+	T* Allocate(size_t count) { return static_cast<T*>(Allocate(sizeof(T) * count)); }
+
+	void Reset();
+
+	size_t GetUsed() const { return m_offset.load(std::memory_order_relaxed); }
+	size_t GetCapacity() const { return m_capacity; }
+	size_t GetHighWater() const { return m_highWater; }
+
+private:
+	uint8_t*				m_pBuffer;
+	uint8_t*				m_pMemory;
+	size_t					m_capacity;
+	size_t					m_highWater = 0;
+	std::atomic<size_t>		m_offset;
+};
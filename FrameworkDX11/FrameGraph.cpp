@@ -0,0 +1,187 @@
+#include "FrameGraph.h"
+#include "Profiler.h"
+#include <algorithm>
+
+void FrameGraph::Reset()
+{
+	m_textures.clear();
+	m_passes.clear();
+	m_physical.clear();
+	m_stats = {};
+}
+
+uint32_t FrameGraph::CreateTexture(const char* name, const FrameGraphTextureDesc& desc)
+{
+	m_textures.push_back({ name, desc, false, FRAME_GRAPH_NONE, FRAME_GRAPH_NONE, FRAME_GRAPH_NONE });
+	return (uint32_t)m_textures.size() - 1;
+}
+
+uint32_t FrameGraph::ImportTexture(const char* name)
+{
+	m_textures.push_back({ name, {}, true, FRAME_GRAPH_NONE, FRAME_GRAPH_NONE, FRAME_GRAPH_NONE });
+	return (uint32_t)m_textures.size() - 1;
+}
+
+uint32_t FrameGraph::AddPass(const char* name, const std::function<void()>& execute)
+{
+	Pass pass;
+	pass.Name = name;
+	pass.Execute = execute;
+	pass.Culled = false;
+	m_passes.push_back(pass);
+	return (uint32_t)m_passes.size() - 1;
+}
+
+void FrameGraph::Read(uint32_t pass, uint32_t texture)
+{
+	m_passes[pass].Reads.push_back(texture);
+}
+
+void FrameGraph::Write(uint32_t pass, uint32_t texture)
+{
+	m_passes[pass].Writes.push_back(texture);
+}
+
+uint64_t FrameGraph::GetTextureBytes(const FrameGraphTextureDesc& desc)
+{
+	return (uint64_t)desc.Width * desc.Height * desc.BytesPerPixel * (desc.SampleCount ? desc.SampleCount : 1);
+}
+
+bool FrameGraph::IsSameDesc(const FrameGraphTextureDesc& a, const FrameGraphTextureDesc& b)
+{
+	return a.Width == b.Width && a.Height == b.Height && a.Format == b.Format &&
+		a.SampleCount == b.SampleCount && a.SampleQuality == b.SampleQuality && a.UnorderedAccess == b.UnorderedAccess;
+}
+
+void FrameGraph::Compile()
+{
+	PROFILE_ZONE("FrameGraph::Compile");
+
+	const uint32_t passCount = (uint32_t)m_passes.size();
+	const uint32_t textureCount = (uint32_t)m_textures.size();
+
+	// Cull back to front: a pass lives if it writes an imported texture or something a
+	// later live pass reads. Passes only read what earlier passes wrote, so one sweep does.
+	std::vector<bool> needed(textureCount, false);
+	for (uint32_t p = passCount; p-- > 0;)
+	{
+		Pass& pass = m_passes[p];
+		pass.Culled = true;
+		for (uint32_t texture : pass.Writes)
+		{
+			if (m_textures[texture].Imported || needed[texture])
+				pass.Culled = false;
+		}
+		if (pass.Culled)
+			continue;
+
+		for (uint32_t texture : pass.Reads)
+		{
+			needed[texture] = true;
+		}
+	}
+
+	// Lifetimes over the live passes
+	for (Texture& texture : m_textures)
+	{
+		texture.FirstUse = texture.LastUse = texture.Physical = FRAME_GRAPH_NONE;
+	}
+	for (uint32_t p = 0; p < passCount; ++p)
+	{
+		const Pass& pass = m_passes[p];
+		if (pass.Culled)
+			continue;
+
+		auto use = [this, p](uint32_t index)
+		{
+			Texture& texture = m_textures[index];
+			if (texture.FirstUse == FRAME_GRAPH_NONE)
+				texture.FirstUse = p;
+			texture.LastUse = p;
+		};
+		for (uint32_t texture : pass.Reads)
+		{
+			use(texture);
+		}
+		for (uint32_t texture : pass.Writes)
+		{
+			use(texture);
+		}
+	}
+
+	// Textures are declared roughly in first use order, but a later declaration can be
+	// used earlier, so hand out physical textures in first use order. Each goes to the
+	// first free physical texture with the same description, else a new one.
+	std::vector<uint32_t> order;
+	for (uint32_t t = 0; t < textureCount; ++t)
+	{
+		if (!m_textures[t].Imported && m_textures[t].FirstUse != FRAME_GRAPH_NONE)
+			order.push_back(t);
+	}
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return m_textures[a].FirstUse < m_textures[b].FirstUse; });
+
+	m_physical.clear();
+	std::vector<uint32_t> physicalLastUse;
+	for (uint32_t t : order)
+	{
+		Texture& texture = m_textures[t];
+		for (uint32_t physical = 0; physical < m_physical.size(); ++physical)
+		{
+			if (physicalLastUse[physical] < texture.FirstUse && IsSameDesc(m_physical[physical], texture.Desc))
+			{
+				texture.Physical = physical;
+				break;
+			}
+		}
+		if (texture.Physical == FRAME_GRAPH_NONE)
+		{
+			texture.Physical = (uint32_t)m_physical.size();
+			m_physical.push_back(texture.Desc);
+			physicalLastUse.push_back(0);
+		}
+		physicalLastUse[texture.Physical] = texture.LastUse;
+	}
+
+	m_stats = {};
+	m_stats.Passes = passCount;
+	for (const Pass& pass : m_passes)
+	{
+		if (pass.Culled)
+			++m_stats.CulledPasses;
+	}
+	for (const Texture& texture : m_textures)
+	{
+		if (texture.Imported)
+			continue;
+
+		++m_stats.Textures;
+		m_stats.DeclaredBytes += GetTextureBytes(texture.Desc);
+		if (texture.FirstUse == FRAME_GRAPH_NONE)
+			++m_stats.UnusedTextures;
+	}
+	m_stats.PhysicalTextures = (uint32_t)m_physical.size();
+	for (const FrameGraphTextureDesc& desc : m_physical)
+	{
+		m_stats.AllocatedBytes += GetTextureBytes(desc);
+	}
+	for (uint32_t p = 0; p < passCount; ++p)
+	{
+		uint64_t live = 0;
+		for (uint32_t t : order)
+		{
+			if (m_textures[t].FirstUse <= p && p <= m_textures[t].LastUse)
+				live += GetTextureBytes(m_textures[t].Desc);
+		}
+		if (live > m_stats.PeakLiveBytes)
+			m_stats.PeakLiveBytes = live;
+	}
+}
+
+void FrameGraph::Execute()
+{
+	for (const Pass& pass : m_passes)
+	{
+		if (!pass.Culled && pass.Execute)
+			pass.Execute();
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define FRAME_GRAPH_NONE 0xffffffffu
+
+// Format is a DXGI_FORMAT, kept as a number so the graph compiles without D3D.
+// UnorderedAccess textures can also be written by compute shaders.
+struct FrameGraphTextureDesc
+{
+	uint32_t	Width;
+	uint32_t	Height;
+	uint32_t	Format;
+	uint32_t	BytesPerPixel;
+	uint32_t	SampleCount;
+	uint32_t	SampleQuality;
+	uint32_t	UnorderedAccess;
+};
+
+// Declared bytes are every transient with a texture of its own, the way the
+// targets used to be created. Allocated bytes are the physical textures left after
+// culling and sharing. Peak live bytes is the most memory in use across any one
+// pass, what aliasing could get down to if textures of any format shared memory.
+struct FrameGraphStats
+{
+	uint32_t	Passes;
+	uint32_t	CulledPasses;
+	uint32_t	Textures;
+	uint32_t	UnusedTextures;
+	uint32_t	PhysicalTextures;
+	uint64_t	DeclaredBytes;
+	uint64_t	AllocatedBytes;
+	uint64_t	PeakLiveBytes;
+};
+
+// Passes in submission order with the textures they read and write. Compile culls
+// every pass whose output nothing reads, works out when each transient texture is
+// first and last used and gives transients whose lifetimes don't overlap the same
+// physical texture if their descriptions match. Imported textures like the back
+// buffer live outside the graph, and a pass that writes one is never culled.
+// Rebuild the graph every frame: Reset, declare, Compile, then Execute.
+class FrameGraph
+{
+public:
+	void Reset();
+
+	uint32_t CreateTexture(const char* name, const FrameGraphTextureDesc& desc);
+	uint32_t ImportTexture(const char* name);
+
+	// Execute is called on the thread that calls FrameGraph::Execute, and only if the pass survives culling
+	uint32_t AddPass(const char* name, const std::function<void()>& execute);
+	void Read(uint32_t pass, uint32_t texture);
+	void Write(uint32_t pass, uint32_t texture);
+
+	void Compile();
+	void Execute();
+
+	bool IsCulled(uint32_t pass) const { return m_passes[pass].Culled; }
+	const char* GetPassName(uint32_t pass) const { return m_passes[pass].Name.c_str(); }
+	uint32_t GetPassCount() const { return (uint32_t)m_passes.size(); }
+
+	// Live pass range using a texture, FRAME_GRAPH_NONE if nothing live uses it
+	uint32_t GetFirstUse(uint32_t texture) const { return m_textures[texture].FirstUse; }
+	uint32_t GetLastUse(uint32_t texture) const { return m_textures[texture].LastUse; }
+
+	// Index into GetPhysicalTextures, FRAME_GRAPH_NONE for imported or unused textures
+	uint32_t GetPhysicalTexture(uint32_t texture) const { return m_textures[texture].Physical; }
+	const std::vector<FrameGraphTextureDesc>& GetPhysicalTextures() const { return m_physical; }
+
+	const FrameGraphStats& GetStats() const { return m_stats; }
+
+	static uint64_t GetTextureBytes(const FrameGraphTextureDesc& desc);
+	static bool IsSameDesc(const FrameGraphTextureDesc& a, const FrameGraphTextureDesc& b);
+
+private:
+	struct Texture
+	{
+		std::string				Name;
+		FrameGraphTextureDesc	Desc;
+		bool					Imported;
+		uint32_t				FirstUse;
+		uint32_t				LastUse;
+		uint32_t				Physical;
+	};
+
+	struct Pass
+	{
+		std::string				Name;
+		std::function<void()>	Execute;
+		std::vector<uint32_t>	Reads;
+		std::vector<uint32_t>	Writes;
+		bool					Culled;
+	};
+
+	std::vector<Texture> m_textures;
+	std::vector<Pass> m_passes;
+	std::vector<FrameGraphTextureDesc> m_physical;
+	FrameGraphStats m_stats = {};
+};
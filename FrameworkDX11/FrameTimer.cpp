@@ -0,0 +1,84 @@
+#include "FrameTimer.h"
+#include <algorithm>
+#include <chrono>
+
+FrameTimer::FrameTimer(double fixedStep, double minFrameSeconds, uint32_t maxSteps)
+{
+	m_fixedStep = fixedStep;
+	m_minFrameSeconds = minFrameSeconds;
+	m_maxSteps = maxSteps;
+	m_history.assign(FRAME_TIMER_HISTORY, 0.0f);
+}
+
+double FrameTimer::Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t FrameTimer::Tick(double now)
+{
+	if (!m_started)
+	{
+		m_started = true;
+		m_last = now;
+		m_delta = 0.0;
+		return 0;
+	}
+
+	m_delta = std::max(now - m_last, 0.0);
+	m_last = now;
+	m_history[m_frames % FRAME_TIMER_HISTORY] = (float)(m_delta * 1000.0);
+	++m_frames;
+
+	m_accumulator += m_delta;
+	uint64_t due = (uint64_t)(m_accumulator / m_fixedStep);
+	m_accumulator -= due * m_fixedStep;
+
+	// After a breakpoint or a stall the simulation slows down rather than spiralling
+	uint32_t steps = (uint32_t)std::min<uint64_t>(due, m_maxSteps);
+	m_droppedSteps += due - steps;
+	m_steps += steps;
+	return steps;
+}
+
+double FrameTimer::GetSecondsUntilNextFrame(double now) const
+{
+	if (!m_started)
+		return 0.0;
+	return std::max(m_last + m_minFrameSeconds - now, 0.0);
+}
+
+void FrameTimer::Reset()
+{
+	m_started = false;
+	m_delta = 0.0;
+	m_accumulator = 0.0;
+	m_steps = 0;
+	m_droppedSteps = 0;
+	m_frames = 0;
+}
+
+FrameTimerStats FrameTimer::GetStats() const
+{
+	FrameTimerStats stats = {};
+	stats.Frames = std::min<uint32_t>(m_frames, FRAME_TIMER_HISTORY);
+	stats.Steps = m_steps;
+	stats.DroppedSteps = m_droppedSteps;
+	if (stats.Frames == 0)
+		return stats;
+
+	std::vector<float> sorted(m_history.begin(), m_history.begin() + stats.Frames);
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0.0;
+	for (float milliseconds : sorted)
+	{
+		total += milliseconds;
+	}
+
+	stats.MeanMilliseconds = total / stats.Frames;
+	stats.MinMilliseconds = sorted.front();
+	stats.MaxMilliseconds = sorted.back();
+	stats.P95Milliseconds = sorted[(stats.Frames - 1) * 95 / 100];
+	stats.P99Milliseconds = sorted[(stats.Frames - 1) * 99 / 100];
+	return stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+#define FRAME_TIMER_HISTORY 240
+#define FRAME_TIMER_MAX_STEPS 5
+
+// Frame times over the last FRAME_TIMER_HISTORY frames, in milliseconds
+struct FrameTimerStats
+{
+	uint32_t	Frames;
+	double		MeanMilliseconds;
+	double		MinMilliseconds;
+	double		MaxMilliseconds;
+	double		P95Milliseconds;
+	double		P99Milliseconds;
+	uint64_t	Steps;
+	uint64_t	DroppedSteps;
+};
+
+// Fixed timestep accumulator. Each Tick adds the real time since the last one and
+// hands back how many fixed steps the simulation should run. Whatever is left over
+// becomes the alpha between the previous and current simulated state, so rendering
+// can interpolate instead of snapping to the last step. Times are passed in so the
+// same sequence of ticks always gives the same steps.
+class FrameTimer
+{
+public:
+	FrameTimer(double fixedStep, double minFrameSeconds = 0.0, uint32_t maxSteps = FRAME_TIMER_MAX_STEPS);
+
+	// Seconds on a steady clock, QueryPerformanceCounter with MSVC
+	static double Now();
+
+	// The first tick only starts the clock and runs no steps
+	uint32_t Tick(double now);
+
+	// How long the caller can sleep before the next frame is due, 0 when it already is
+	double GetSecondsUntilNextFrame(double now) const;
+
+	void Reset();
+
+	double GetFixedStep() const { return m_fixedStep; }
+	double GetAlpha() const { return m_accumulator / m_fixedStep; }
+	double GetDelta() const { return m_delta; }
+	double GetSimulatedTime() const { return m_steps * m_fixedStep; }
+
+	// Time of the interpolated state being drawn, one step behind the simulation
+	double GetPresentationTime() const { return GetSimulatedTime() - m_fixedStep + m_accumulator; }
+
+	void SetMinFrameSeconds(double seconds) { m_minFrameSeconds = seconds; }
+	FrameTimerStats GetStats() const;
+
+private:
+	double m_fixedStep;
+	double m_minFrameSeconds;
+	uint32_t m_maxSteps;
+
+	bool m_started = false;
+	double m_last = 0.0;
+	double m_delta = 0.0;
+	double m_accumulator = 0.0;
+	uint64_t m_steps = 0;
+	uint64_t m_droppedSteps = 0;
+
+	std::vector<float> m_history;
+	uint32_t m_frames = 0;
+};
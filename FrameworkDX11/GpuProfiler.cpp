@@ -0,0 +1,262 @@
+#include "GpuProfiler.h"
+#include <algorithm>
+#include <cstring>
+
+GpuProfiler::GpuProfiler(GpuQueryBackend* pBackend, uint32_t latency)
+{
+	m_pBackend = pBackend;
+	m_latency = latency;
+	m_slots.resize(latency);
+	for (FrameSlot& slot : m_slots)
+	{
+		slot.Pending = false;
+		slot.Frame = 0;
+		slot.Queries = 0;
+	}
+}
+
+void GpuProfiler::BeginFrame()
+{
+	Resolve();
+
+	// The GPU hasn't got through the frame that used this slot, skip rather than wait
+	uint32_t slotIndex = (uint32_t)(m_frame % m_latency);
+	FrameSlot& slot = m_slots[slotIndex];
+	m_active = !slot.Pending;
+	if (!m_active)
+	{
+		++m_stats.FramesSkipped;
+		return;
+	}
+
+	slot.Zones.clear();
+	slot.Queries = 0;
+	m_open.clear();
+	m_pBackend->BeginFrame(slotIndex);
+	BeginZone("Frame");
+}
+
+void GpuProfiler::EndFrame()
+{
+	if (m_active)
+	{
+		while (!m_open.empty())
+		{
+			EndZone();
+		}
+
+		uint32_t slotIndex = (uint32_t)(m_frame % m_latency);
+		m_pBackend->EndFrame(slotIndex);
+		m_slots[slotIndex].Pending = true;
+		m_slots[slotIndex].Frame = m_frame;
+		++m_stats.FramesIssued;
+		m_active = false;
+	}
+	++m_frame;
+
+	// Picks up the frame that just became readable without waiting for the next one
+	Resolve();
+}
+
+void GpuProfiler::BeginZone(const char* name)
+{
+	if (!m_active)
+		return;
+
+	FrameSlot& slot = m_slots[m_frame % m_latency];
+
+	// Room for this zone's pair and the end of every zone still open
+	if (slot.Queries + 2 + m_open.size() > GPU_PROFILER_MAX_QUERIES)
+	{
+		// Out of queries: keep the nesting but measure nothing
+		m_open.push_back(~0u);
+		return;
+	}
+
+	PendingZone zone = { GetZoneIndex(name), slot.Queries++, ~0u };
+	m_pBackend->Timestamp((uint32_t)(m_frame % m_latency), zone.BeginQuery);
+	m_open.push_back((uint32_t)slot.Zones.size());
+	slot.Zones.push_back(zone);
+}
+
+void GpuProfiler::EndZone()
+{
+	if (!m_active || m_open.empty())
+		return;
+
+	uint32_t open = m_open.back();
+	m_open.pop_back();
+	if (open == ~0u)
+		return;
+
+	FrameSlot& slot = m_slots[m_frame % m_latency];
+	PendingZone& zone = slot.Zones[open];
+	zone.EndQuery = slot.Queries++;
+	m_pBackend->Timestamp((uint32_t)(m_frame % m_latency), zone.EndQuery);
+}
+
+const GpuZoneTiming* GpuProfiler::FindZone(const char* name) const
+{
+	for (const GpuZoneTiming& zone : m_zones)
+	{
+		if (zone.Name == name)
+			return &zone;
+	}
+	return nullptr;
+}
+
+uint32_t GpuProfiler::GetZoneIndex(const char* name)
+{
+	for (uint32_t i = 0; i < (uint32_t)m_zones.size(); ++i)
+	{
+		if (m_zones[i].Name == name)
+			return i;
+	}
+
+	GpuZoneTiming zone;
+	zone.Name = name;
+	memset(zone.History, 0, sizeof(zone.History));
+	zone.HistoryOffset = 0;
+	zone.Samples = 0;
+	zone.LastMilliseconds = 0.0f;
+	zone.AverageMilliseconds = 0.0f;
+	zone.MaxMilliseconds = 0.0f;
+	m_zones.push_back(zone);
+	return (uint32_t)m_zones.size() - 1;
+}
+
+void GpuProfiler::Resolve()
+{
+	// Oldest first, the GPU finishes frames in order so a later one is never ready sooner
+	for (uint32_t i = 0; i < m_latency; ++i)
+	{
+		uint32_t oldest = ~0u;
+		for (uint32_t slot = 0; slot < m_latency; ++slot)
+		{
+			if (m_slots[slot].Pending && (oldest == ~0u || m_slots[slot].Frame < m_slots[oldest].Frame))
+				oldest = slot;
+		}
+		if (oldest == ~0u || !ResolveSlot(oldest))
+			return;
+	}
+}
+
+bool GpuProfiler::ResolveSlot(uint32_t slotIndex)
+{
+	FrameSlot& slot = m_slots[slotIndex];
+	uint64_t frequency = 0;
+	bool disjoint = false;
+	if (!m_pBackend->GetFrameData(slotIndex, frequency, disjoint))
+		return false;
+
+	// A clock change in the middle of the frame makes every timestamp in it meaningless
+	if (disjoint || frequency == 0)
+	{
+		++m_stats.FramesDisjoint;
+		slot.Pending = false;
+		return true;
+	}
+
+	std::vector<float> milliseconds(slot.Zones.size(), 0.0f);
+	for (size_t i = 0; i < slot.Zones.size(); ++i)
+	{
+		uint64_t begin = 0;
+		uint64_t end = 0;
+		if (!m_pBackend->GetTimestamp(slotIndex, slot.Zones[i].BeginQuery, begin) ||
+			!m_pBackend->GetTimestamp(slotIndex, slot.Zones[i].EndQuery, end))
+			return false;
+		milliseconds[i] = end > begin ? (float)((end - begin) * 1000.0 / frequency) : 0.0f;
+	}
+
+	// A zone entered more than once in the frame adds up
+	std::vector<float> totals(m_zones.size(), -1.0f);
+	for (size_t i = 0; i < slot.Zones.size(); ++i)
+	{
+		float& total = totals[slot.Zones[i].Zone];
+		total = std::max(total, 0.0f) + milliseconds[i];
+	}
+
+	for (size_t z = 0; z < m_zones.size(); ++z)
+	{
+		if (totals[z] < 0.0f)
+			continue;
+
+		GpuZoneTiming& zone = m_zones[z];
+		zone.History[zone.HistoryOffset] = totals[z];
+		zone.HistoryOffset = (zone.HistoryOffset + 1) % GPU_PROFILER_HISTORY;
+		zone.Samples = std::min<uint32_t>(zone.Samples + 1, GPU_PROFILER_HISTORY);
+		zone.LastMilliseconds = totals[z];
+
+		float sum = 0.0f;
+		float largest = 0.0f;
+		for (uint32_t i = 0; i < zone.Samples; ++i)
+		{
+			float sample = zone.History[(zone.HistoryOffset + GPU_PROFILER_HISTORY - 1 - i) % GPU_PROFILER_HISTORY];
+			sum += sample;
+			largest = std::max(largest, sample);
+		}
+		zone.AverageMilliseconds = sum / zone.Samples;
+		zone.MaxMilliseconds = largest;
+	}
+
+	m_stats.Latency = (uint32_t)(m_frame - slot.Frame);
+	++m_stats.FramesResolved;
+	slot.Pending = false;
+	return true;
+}
+
+FakeGpuQueryBackend::FakeGpuQueryBackend(uint32_t slots, uint32_t readyAfter, uint64_t frequency)
+{
+	m_slots.resize(slots);
+	for (Slot& slot : m_slots)
+	{
+		slot.EndedFrame = 0;
+		slot.Ended = false;
+		slot.Disjoint = false;
+		slot.Timestamps.assign(GPU_PROFILER_MAX_QUERIES, 0);
+	}
+	m_readyAfter = readyAfter;
+	m_frequency = frequency;
+}
+
+void FakeGpuQueryBackend::BeginFrame(uint32_t slot)
+{
+	m_slots[slot].Ended = false;
+	m_slots[slot].Disjoint = m_nextDisjoint;
+	m_nextDisjoint = false;
+}
+
+void FakeGpuQueryBackend::EndFrame(uint32_t slot)
+{
+	m_slots[slot].Ended = true;
+	m_slots[slot].EndedFrame = ++m_framesEnded;
+}
+
+void FakeGpuQueryBackend::Timestamp(uint32_t slot, uint32_t query)
+{
+	m_slots[slot].Timestamps[query] = m_clock;
+}
+
+bool FakeGpuQueryBackend::IsReady(uint32_t slot) const
+{
+	return m_slots[slot].Ended && m_framesEnded - m_slots[slot].EndedFrame >= m_readyAfter;
+}
+
+bool FakeGpuQueryBackend::GetFrameData(uint32_t slot, uint64_t& frequency, bool& disjoint)
+{
+	++m_polls;
+	if (!IsReady(slot))
+		return false;
+	frequency = m_frequency;
+	disjoint = m_slots[slot].Disjoint;
+	return true;
+}
+
+bool FakeGpuQueryBackend::GetTimestamp(uint32_t slot, uint32_t query, uint64_t& ticks)
+{
+	++m_polls;
+	if (!IsReady(slot))
+		return false;
+	ticks = m_slots[slot].Timestamps[query];
+	return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define GPU_PROFILER_LATENCY 3
+#define GPU_PROFILER_MAX_QUERIES 64
+#define GPU_PROFILER_HISTORY 120
+
+// Timestamp queries grouped by frame slot. Slot s holds the disjoint query and
+// timestamps of every frame whose number modulo the latency is s. The Get calls
+// must never wait: they return false until the GPU has got that far.
+class GpuQueryBackend
+{
+public:
+	virtual ~GpuQueryBackend() {}
+
+	virtual void BeginFrame(uint32_t slot) = 0;
+	virtual void EndFrame(uint32_t slot) = 0;
+	virtual void Timestamp(uint32_t slot, uint32_t query) = 0;
+
+	virtual bool GetFrameData(uint32_t slot, uint64_t& frequency, bool& disjoint) = 0;
+	virtual bool GetTimestamp(uint32_t slot, uint32_t query, uint64_t& ticks) = 0;
+};
+
+// Rolling GPU time of one named zone, History is a ring starting at HistoryOffset
+struct GpuZoneTiming
+{
+	std::string	Name;
+	float		History[GPU_PROFILER_HISTORY];
+	uint32_t	HistoryOffset;
+	uint32_t	Samples;
+	float		LastMilliseconds;
+	float		AverageMilliseconds;
+	float		MaxMilliseconds;
+};
+
+struct GpuProfilerStats
+{
+	uint64_t	FramesIssued;
+	uint64_t	FramesResolved;
+	uint64_t	FramesDisjoint;
+	uint64_t	FramesSkipped;
+	uint32_t	Latency;
+};
+
+// Brackets GPU work with timestamps and reads them back a few frames later. Each
+// frame uses the next of GPU_PROFILER_LATENCY query slots; if the GPU is so far
+// behind that the slot hasn't been read yet the frame goes unmeasured instead of
+// waiting. Every frame is a "Frame" zone, the others nest inside it.
+class GpuProfiler
+{
+public:
+	GpuProfiler(GpuQueryBackend* pBackend, uint32_t latency = GPU_PROFILER_LATENCY);
+
+	void BeginFrame();
+	void EndFrame();
+
+	void BeginZone(const char* name);
+	void EndZone();
+
+	// In the order the zones were first seen
+	const std::vector<GpuZoneTiming>& GetZones() const { return m_zones; }
+	const GpuZoneTiming* FindZone(const char* name) const;
+	const GpuProfilerStats& GetStats() const { return m_stats; }
+
+private:
+	struct PendingZone
+	{
+		uint32_t	Zone;
+		uint32_t	BeginQuery;
+		uint32_t	EndQuery;
+	};
+
+	struct FrameSlot
+	{
+		bool						Pending;
+		uint64_t					Frame;
+		uint32_t					Queries;
+		std::vector<PendingZone>	Zones;
+	};
+
+	void Resolve();
+	bool ResolveSlot(uint32_t slot);
+	uint32_t GetZoneIndex(const char* name);
+
+	GpuQueryBackend* m_pBackend;
+	uint32_t m_latency;
+	uint64_t m_frame = 0;
+	bool m_active = false;
+	std::vector<FrameSlot> m_slots;
+	std::vector<uint32_t> m_open;
+	std::vector<GpuZoneTiming> m_zones;
+	GpuProfilerStats m_stats = {};
+};
+
+// Fake GPU for checking the ring without a device. Timestamps read a clock that
+// only moves when Advance is called, and a frame's queries become readable once
+// readyAfter more frames have ended, as if the GPU ran that far behind.
+class FakeGpuQueryBackend : public GpuQueryBackend
+{
+public:
+	FakeGpuQueryBackend(uint32_t slots, uint32_t readyAfter, uint64_t frequency);
+
+	void Advance(uint64_t ticks) { m_clock += ticks; }
+	void SetReadyAfter(uint32_t frames) { m_readyAfter = frames; }
+	void SetNextDisjoint(bool disjoint) { m_nextDisjoint = disjoint; }
+	uint64_t GetPolls() const { return m_polls; }
+
+	void BeginFrame(uint32_t slot);
+	void EndFrame(uint32_t slot);
+	void Timestamp(uint32_t slot, uint32_t query);
+
+	bool GetFrameData(uint32_t slot, uint64_t& frequency, bool& disjoint);
+	bool GetTimestamp(uint32_t slot, uint32_t query, uint64_t& ticks);
+
+private:
+	bool IsReady(uint32_t slot) const;
+
+	struct Slot
+	{
+		uint64_t				EndedFrame;
+		bool					Ended;
+		bool					Disjoint;
+		std::vector<uint64_t>	Timestamps;
+	};
+
+	std::vector<Slot> m_slots;
+	uint32_t m_readyAfter;
+	uint64_t m_frequency;
+	uint64_t m_clock = 0;
+	uint64_t m_framesEnded = 0;
+	uint64_t m_polls = 0;
+	bool m_nextDisjoint = false;
+};
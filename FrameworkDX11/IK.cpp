@@ -0,0 +1,464 @@
+#include "IK.h"
+#include "JobSystem.h"
+#include <math.h>
+
+#define IK_GROUP_BATCH_SIZE 16
+#define IK_EPSILON 1e-6f
+
+// Three coordinates for four chains at once
+struct Vec3x4
+{
+	XMVECTOR x, y, z;
+};
+
+static inline Vec3x4 Add(const Vec3x4& a, const Vec3x4& b) { return { XMVectorAdd(a.x, b.x), XMVectorAdd(a.y, b.y), XMVectorAdd(a.z, b.z) }; }
+static inline Vec3x4 Sub(const Vec3x4& a, const Vec3x4& b) { return { XMVectorSubtract(a.x, b.x), XMVectorSubtract(a.y, b.y), XMVectorSubtract(a.z, b.z) }; }
+static inline Vec3x4 Scale(const Vec3x4& a, FXMVECTOR s) { return { XMVectorMultiply(a.x, s), XMVectorMultiply(a.y, s), XMVectorMultiply(a.z, s) }; }
+static inline Vec3x4 MultiplyAdd(const Vec3x4& a, FXMVECTOR s, const Vec3x4& b) { return { XMVectorMultiplyAdd(a.x, s, b.x), XMVectorMultiplyAdd(a.y, s, b.y), XMVectorMultiplyAdd(a.z, s, b.z) }; }
+
+static inline XMVECTOR Dot(const Vec3x4& a, const Vec3x4& b)
+{
+	return XMVectorMultiplyAdd(a.z, b.z, XMVectorMultiplyAdd(a.y, b.y, XMVectorMultiply(a.x, b.x)));
+}
+
+static inline Vec3x4 Cross(const Vec3x4& a, const Vec3x4& b)
+{
+	return { XMVectorNegativeMultiplySubtract(a.z, b.y, XMVectorMultiply(a.y, b.z)),
+			 XMVectorNegativeMultiplySubtract(a.x, b.z, XMVectorMultiply(a.z, b.x)),
+			 XMVectorNegativeMultiplySubtract(a.y, b.x, XMVectorMultiply(a.x, b.y)) };
+}
+
+static inline XMVECTOR Length(const Vec3x4& a)
+{
+	return XMVectorSqrt(Dot(a, a));
+}
+
+// Zero length lanes stay zero instead of becoming NaN
+static inline Vec3x4 Normalize(const Vec3x4& a, XMVECTOR* pLength = nullptr)
+{
+	XMVECTOR length = Length(a);
+	if (pLength)
+		*pLength = length;
+	XMVECTOR inverse = XMVectorReciprocal(XMVectorMax(length, XMVectorReplicate(IK_EPSILON)));
+	return Scale(a, inverse);
+}
+
+static inline Vec3x4 Select(const Vec3x4& a, const Vec3x4& b, FXMVECTOR control)
+{
+	return { XMVectorSelect(a.x, b.x, control), XMVectorSelect(a.y, b.y, control), XMVectorSelect(a.z, b.z, control) };
+}
+
+// Rodrigues rotation of v about a unit axis given the cosine and sine of the angle
+static inline Vec3x4 Rotate(const Vec3x4& v, const Vec3x4& axis, FXMVECTOR c, FXMVECTOR s)
+{
+	Vec3x4 result = Scale(v, c);
+	result = MultiplyAdd(Cross(axis, v), s, result);
+	return MultiplyAdd(axis, XMVectorMultiply(Dot(axis, v), XMVectorSubtract(XMVectorReplicate(1.0f), c)), result);
+}
+
+static inline bool AllLanes(FXMVECTOR mask)
+{
+	return XMVector4EqualInt(mask, XMVectorTrueInt());
+}
+
+// Working copy of one group of four chains
+struct IKGroup
+{
+	uint32_t	Group;
+	uint32_t	JointCount;
+	Vec3x4		Joints[MAX_IK_JOINTS];
+	XMVECTOR	Lengths[MAX_IK_JOINTS];
+	Vec3x4		Target;
+	Vec3x4		Pole;
+
+	void Load(const IKChainSet& chains, uint32_t group)
+	{
+		Group = group;
+		JointCount = chains.m_jointCount;
+		uint32_t base = group * JointCount;
+		for (uint32_t j = 0; j < JointCount; ++j)
+		{
+			Joints[j] = { XMLoadFloat4(&chains.m_x[base + j]), XMLoadFloat4(&chains.m_y[base + j]), XMLoadFloat4(&chains.m_z[base + j]) };
+			Lengths[j] = XMLoadFloat4(&chains.m_lengths[base + j]);
+		}
+		Target = { XMLoadFloat4(&chains.m_targetX[group]), XMLoadFloat4(&chains.m_targetY[group]), XMLoadFloat4(&chains.m_targetZ[group]) };
+		Pole = { XMLoadFloat4(&chains.m_poleX[group]), XMLoadFloat4(&chains.m_poleY[group]), XMLoadFloat4(&chains.m_poleZ[group]) };
+	}
+
+	void Store(IKChainSet& chains, FXMVECTOR converged, const uint32_t* iterations)
+	{
+		uint32_t base = Group * JointCount;
+		for (uint32_t j = 0; j < JointCount; ++j)
+		{
+			XMStoreFloat4(&chains.m_x[base + j], Joints[j].x);
+			XMStoreFloat4(&chains.m_y[base + j], Joints[j].y);
+			XMStoreFloat4(&chains.m_z[base + j], Joints[j].z);
+		}
+
+		uint32_t flags[IK_LANES];
+		XMStoreInt4(flags, converged);
+		for (uint32_t lane = 0; lane < IK_LANES; ++lane)
+		{
+			uint32_t chain = Group * IK_LANES + lane;
+			if (chain >= chains.m_chainCount)
+				break;
+			chains.m_converged[chain] = flags[lane] ? 1 : 0;
+			chains.m_iterations[chain] = iterations[lane];
+		}
+	}
+
+	XMVECTOR Converged(const IKSettings& settings) const
+	{
+		Vec3x4 error = Sub(Joints[JointCount - 1], Target);
+		return XMVectorLessOrEqual(Dot(error, error), XMVectorReplicate(settings.Tolerance * settings.Tolerance));
+	}
+
+	// Pulls the segment leaving joint back inside the cone around the previous segment
+	void ApplyLimit(const IKChainSet& chains, uint32_t joint, Vec3x4& direction) const
+	{
+		if (joint == 0)
+			return;
+		LimitDirection(chains, joint, Normalize(Sub(Joints[joint], Joints[joint - 1])), direction);
+	}
+
+	// Pulls direction back inside the joint's cone around the unit parent direction
+	static void LimitDirection(const IKChainSet& chains, uint32_t joint, const Vec3x4& parent, Vec3x4& direction)
+	{
+		if (chains.m_limitCos[joint] <= -1.0f)
+			return;
+
+		XMVECTOR c = Dot(parent, direction);
+		XMVECTOR limitCos = XMVectorReplicate(chains.m_limitCos[joint]);
+		XMVECTOR outside = XMVectorLess(c, limitCos);
+		if (XMVector4EqualInt(outside, XMVectorFalseInt()))
+			return;
+
+		// Perpendicular part of the direction, falling back to any axis when it folds straight back
+		Vec3x4 perpendicular = Sub(direction, Scale(parent, c));
+		XMVECTOR perpendicularLength;
+		perpendicular = Normalize(perpendicular, &perpendicularLength);
+		Vec3x4 fallback = Normalize(Cross(parent, { XMVectorReplicate(0.0f), XMVectorReplicate(0.0f), XMVectorReplicate(1.0f) }));
+		perpendicular = Select(perpendicular, fallback, XMVectorLess(perpendicularLength, XMVectorReplicate(IK_EPSILON)));
+
+		Vec3x4 limited = MultiplyAdd(perpendicular, XMVectorReplicate(chains.m_limitSin[joint]), Scale(parent, limitCos));
+		direction = Select(direction, limited, outside);
+	}
+};
+
+IKChainSet::IKChainSet(uint32_t chainCount, uint32_t jointCount)
+{
+	if (jointCount > MAX_IK_JOINTS)
+		jointCount = MAX_IK_JOINTS;
+
+	m_chainCount = chainCount;
+	m_jointCount = jointCount;
+	m_groupCount = (chainCount + IK_LANES - 1) / IK_LANES;
+
+	XMFLOAT4 zero(0.0f, 0.0f, 0.0f, 0.0f);
+	m_x.assign(m_groupCount * jointCount, zero);
+	m_y.assign(m_groupCount * jointCount, zero);
+	m_z.assign(m_groupCount * jointCount, zero);
+	m_lengths.assign(m_groupCount * jointCount, zero);
+	m_targetX.assign(m_groupCount, zero);
+	m_targetY.assign(m_groupCount, zero);
+	m_targetZ.assign(m_groupCount, zero);
+	m_poleX.assign(m_groupCount, zero);
+	m_poleY.assign(m_groupCount, zero);
+	m_poleZ.assign(m_groupCount, zero);
+	m_limitCos.assign(jointCount, -1.0f);
+	m_limitSin.assign(jointCount, 0.0f);
+	m_converged.assign(chainCount, 0);
+	m_iterations.assign(chainCount, 0);
+}
+
+static inline float& Lane(XMFLOAT4& v, uint32_t lane)
+{
+	return (&v.x)[lane];
+}
+
+static inline float Lane(const XMFLOAT4& v, uint32_t lane)
+{
+	return (&v.x)[lane];
+}
+
+void IKChainSet::SetChain(uint32_t chain, const XMFLOAT3* positions)
+{
+	uint32_t group = chain / IK_LANES;
+	uint32_t lane = chain % IK_LANES;
+	uint32_t base = group * m_jointCount;
+	for (uint32_t j = 0; j < m_jointCount; ++j)
+	{
+		Lane(m_x[base + j], lane) = positions[j].x;
+		Lane(m_y[base + j], lane) = positions[j].y;
+		Lane(m_z[base + j], lane) = positions[j].z;
+
+		float length = 0.0f;
+		if (j + 1 < m_jointCount)
+		{
+			XMVECTOR segment = XMVectorSubtract(XMLoadFloat3(&positions[j + 1]), XMLoadFloat3(&positions[j]));
+			length = XMVectorGetX(XMVector3Length(segment));
+		}
+		Lane(m_lengths[base + j], lane) = length;
+	}
+
+	SetTarget(chain, positions[m_jointCount - 1]);
+	SetPole(chain, positions[m_jointCount > 2 ? 1 : 0]);
+}
+
+void IKChainSet::GetChain(uint32_t chain, XMFLOAT3* positions) const
+{
+	uint32_t group = chain / IK_LANES;
+	uint32_t lane = chain % IK_LANES;
+	uint32_t base = group * m_jointCount;
+	for (uint32_t j = 0; j < m_jointCount; ++j)
+	{
+		positions[j] = XMFLOAT3(Lane(m_x[base + j], lane), Lane(m_y[base + j], lane), Lane(m_z[base + j], lane));
+	}
+}
+
+void IKChainSet::SetTarget(uint32_t chain, XMFLOAT3 target)
+{
+	uint32_t group = chain / IK_LANES;
+	uint32_t lane = chain % IK_LANES;
+	Lane(m_targetX[group], lane) = target.x;
+	Lane(m_targetY[group], lane) = target.y;
+	Lane(m_targetZ[group], lane) = target.z;
+}
+
+void IKChainSet::SetPole(uint32_t chain, XMFLOAT3 pole)
+{
+	uint32_t group = chain / IK_LANES;
+	uint32_t lane = chain % IK_LANES;
+	Lane(m_poleX[group], lane) = pole.x;
+	Lane(m_poleY[group], lane) = pole.y;
+	Lane(m_poleZ[group], lane) = pole.z;
+}
+
+void IKChainSet::SetJointLimit(uint32_t joint, float maxAngle)
+{
+	if (joint == 0 || joint >= m_jointCount)
+		return;
+	m_limitCos[joint] = cosf(maxAngle);
+	m_limitSin[joint] = sinf(maxAngle);
+}
+
+// Runs solveGroup over every group and counts the converged chains
+template<typename GroupSolver>
+static uint32_t SolveGroups(IKChainSet& chains, JobSystem* pJobs, const GroupSolver& solveGroup)
+{
+	auto job = [&](size_t begin, size_t end, unsigned)
+	{
+		IKGroup group;
+		for (size_t g = begin; g < end; ++g)
+		{
+			group.Load(chains, (uint32_t)g);
+			solveGroup(group);
+		}
+	};
+
+	if (pJobs)
+		pJobs->ParallelFor(chains.GetGroupCount(), IK_GROUP_BATCH_SIZE, job);
+	else
+		job(0, chains.GetGroupCount(), 0);
+
+	uint32_t converged = 0;
+	for (uint32_t i = 0; i < chains.GetChainCount(); ++i)
+	{
+		converged += chains.IsConverged(i) ? 1 : 0;
+	}
+	return converged;
+}
+
+uint32_t IK::SolveTwoBone(IKChainSet& chains, const IKSettings& settings, JobSystem* pJobs)
+{
+	if (chains.GetJointCount() != 3)
+		return 0;
+
+	return SolveGroups(chains, pJobs, [&](IKGroup& group)
+	{
+		const Vec3x4 root = group.Joints[0];
+		XMVECTOR a = group.Lengths[0];
+		XMVECTOR b = group.Lengths[1];
+
+		XMVECTOR distance;
+		Vec3x4 direction = Normalize(Sub(group.Target, root), &distance);
+
+		// Reach is limited by the straight chain and by the bend limit at the middle joint
+		float limitCos = chains.GetJointLimitCos(1);
+		XMVECTOR minReach = XMVectorSqrt(XMVectorMultiplyAdd(XMVectorMultiply(XMVectorAdd(a, a), b), XMVectorReplicate(limitCos),
+			XMVectorMultiplyAdd(a, a, XMVectorMultiply(b, b))));
+		XMVECTOR maxReach = XMVectorAdd(a, b);
+		distance = XMVectorClamp(distance, XMVectorMax(minReach, XMVectorReplicate(IK_EPSILON)), maxReach);
+
+		// Law of cosines for the angle at the root
+		XMVECTOR cosA = XMVectorDivide(XMVectorSubtract(XMVectorMultiplyAdd(a, a, XMVectorMultiply(distance, distance)), XMVectorMultiply(b, b)),
+			XMVectorMax(XMVectorMultiply(XMVectorAdd(a, a), distance), XMVectorReplicate(IK_EPSILON)));
+		cosA = XMVectorClamp(cosA, XMVectorReplicate(-1.0f), XMVectorReplicate(1.0f));
+		XMVECTOR sinA = XMVectorSqrt(XMVectorNegativeMultiplySubtract(cosA, cosA, XMVectorReplicate(1.0f)));
+
+		// Bend towards the pole, projected off the root to target line
+		Vec3x4 toPole = Sub(group.Pole, root);
+		XMVECTOR bendLength;
+		Vec3x4 bend = Normalize(Sub(toPole, Scale(direction, Dot(toPole, direction))), &bendLength);
+		Vec3x4 toMiddle = Sub(group.Joints[1], root);
+		Vec3x4 fallback = Normalize(Sub(toMiddle, Scale(direction, Dot(toMiddle, direction))));
+		bend = Select(bend, fallback, XMVectorLess(bendLength, XMVectorReplicate(IK_EPSILON)));
+
+		group.Joints[1] = MultiplyAdd(bend, XMVectorMultiply(a, sinA), MultiplyAdd(direction, XMVectorMultiply(a, cosA), root));
+		group.Joints[2] = MultiplyAdd(direction, distance, root);
+
+		const uint32_t iterations[IK_LANES] = { 1, 1, 1, 1 };
+		group.Store(chains, group.Converged(settings), iterations);
+	});
+}
+
+uint32_t IK::SolveCCD(IKChainSet& chains, const IKSettings& settings, JobSystem* pJobs)
+{
+	return SolveGroups(chains, pJobs, [&](IKGroup& group)
+	{
+		const uint32_t count = group.JointCount;
+		const uint32_t end = count - 1;
+		uint32_t iterations[IK_LANES] = { 0, 0, 0, 0 };
+		XMVECTOR maxStepCos = XMVectorReplicate(cosf(settings.CCDMaxStep));
+		XMVECTOR maxStepSin = XMVectorReplicate(sinf(settings.CCDMaxStep));
+
+		XMVECTOR done = group.Converged(settings);
+		for (uint32_t iteration = 0; iteration < settings.MaxIterations && !AllLanes(done); ++iteration)
+		{
+			for (uint32_t lane = 0; lane < IK_LANES; ++lane)
+				iterations[lane] += XMVectorGetIntByIndex(done, lane) ? 0 : 1;
+
+			Vec3x4 before[MAX_IK_JOINTS];
+			for (uint32_t j = 0; j < count; ++j)
+				before[j] = group.Joints[j];
+
+			for (int j = (int)end - 1; j >= 0; --j)
+			{
+				// Rotate everything below joint j so the end effector swings onto the target line
+				Vec3x4 pivot = group.Joints[j];
+				Vec3x4 toEnd = Normalize(Sub(group.Joints[end], pivot));
+				Vec3x4 toTarget = Normalize(Sub(group.Target, pivot));
+
+				XMVECTOR c = Dot(toEnd, toTarget);
+				XMVECTOR s;
+				Vec3x4 axis = Normalize(Cross(toEnd, toTarget), &s);
+				XMVECTOR damped = XMVectorLess(c, maxStepCos);
+				c = XMVectorSelect(c, maxStepCos, damped);
+				s = XMVectorSelect(s, maxStepSin, damped);
+				for (uint32_t k = j + 1; k < count; ++k)
+					group.Joints[k] = Add(pivot, Rotate(Sub(group.Joints[k], pivot), axis, c, s));
+
+				// Keep the new segment within its cone by rotating it back, children and all
+				Vec3x4 segment = Normalize(Sub(group.Joints[j + 1], pivot));
+				Vec3x4 limited = segment;
+				group.ApplyLimit(chains, j, limited);
+				c = Dot(segment, limited);
+				axis = Normalize(Cross(segment, limited), &s);
+				for (uint32_t k = j + 1; k < count; ++k)
+					group.Joints[k] = Add(pivot, Rotate(Sub(group.Joints[k], pivot), axis, c, s));
+			}
+
+			// Lanes that had already finished keep their old pose
+			for (uint32_t j = 0; j < count; ++j)
+				group.Joints[j] = Select(group.Joints[j], before[j], done);
+
+			done = XMVectorOrInt(done, group.Converged(settings));
+		}
+
+		group.Store(chains, group.Converged(settings), iterations);
+	});
+}
+
+uint32_t IK::SolveFABRIK(IKChainSet& chains, const IKSettings& settings, JobSystem* pJobs)
+{
+	return SolveGroups(chains, pJobs, [&](IKGroup& group)
+	{
+		const uint32_t count = group.JointCount;
+		const uint32_t end = count - 1;
+		const Vec3x4 root = group.Joints[0];
+		uint32_t iterations[IK_LANES] = { 0, 0, 0, 0 };
+		XMVECTOR stallDistance = XMVectorReplicate(settings.Tolerance * settings.Tolerance * 0.01f);
+
+		XMVECTOR done = group.Converged(settings);
+		for (uint32_t iteration = 0; iteration < settings.MaxIterations && !AllLanes(done); ++iteration)
+		{
+			for (uint32_t lane = 0; lane < IK_LANES; ++lane)
+				iterations[lane] += XMVectorGetIntByIndex(done, lane) ? 0 : 1;
+
+			Vec3x4 before[MAX_IK_JOINTS];
+			for (uint32_t j = 0; j < count; ++j)
+				before[j] = group.Joints[j];
+
+			// Backward pass from the target
+			group.Joints[end] = group.Target;
+			for (int j = (int)end - 1; j >= 0; --j)
+			{
+				// The same limits seen from the child side. Limiting only the forward pass lets
+				// the backward pass fold a straight chain into a zigzag the forward pass then
+				// clamps to the same place every iteration.
+				Vec3x4 direction = Normalize(Sub(group.Joints[j + 1], group.Joints[j]));
+				if (j + 1 < (int)end)
+					IKGroup::LimitDirection(chains, j + 1, Normalize(Sub(group.Joints[j + 2], group.Joints[j + 1])), direction);
+				group.Joints[j] = MultiplyAdd(direction, XMVectorNegate(group.Lengths[j]), group.Joints[j + 1]);
+			}
+
+			// Forward pass from the root, applying the joint limits
+			group.Joints[0] = root;
+			for (uint32_t j = 0; j < end; ++j)
+			{
+				Vec3x4 direction = Normalize(Sub(group.Joints[j + 1], group.Joints[j]));
+				group.ApplyLimit(chains, j, direction);
+				group.Joints[j + 1] = MultiplyAdd(direction, group.Lengths[j], group.Joints[j]);
+			}
+
+			for (uint32_t j = 0; j < count; ++j)
+				group.Joints[j] = Select(group.Joints[j], before[j], done);
+
+			// Unreachable targets stop once the end effector stops moving
+			Vec3x4 moved = Sub(group.Joints[end], before[end]);
+			XMVECTOR stalled = XMVectorLessOrEqual(Dot(moved, moved), stallDistance);
+			done = XMVectorOrInt(done, XMVectorOrInt(stalled, group.Converged(settings)));
+		}
+
+		group.Store(chains, group.Converged(settings), iterations);
+	});
+}
+
+void IK::PositionsToLocalRotations(const XMFLOAT3* restPositions, const XMFLOAT3* solvedPositions, uint32_t jointCount, XMFLOAT4* localRotations)
+{
+	XMVECTOR parentWorld = XMQuaternionIdentity();
+	for (uint32_t j = 0; j < jointCount; ++j)
+	{
+		if (j + 1 >= jointCount)
+		{
+			XMStoreFloat4(&localRotations[j], XMQuaternionIdentity());
+			break;
+		}
+
+		// Rest direction as the already rotated parents have left it
+		XMVECTOR rest = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&restPositions[j + 1]), XMLoadFloat3(&restPositions[j])));
+		rest = XMVector3Rotate(rest, parentWorld);
+		XMVECTOR solved = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&solvedPositions[j + 1]), XMLoadFloat3(&solvedPositions[j])));
+
+		// Shortest arc between the two, with any perpendicular axis for a half turn
+		float c = XMVectorGetX(XMVector3Dot(rest, solved));
+		XMVECTOR delta;
+		if (c < -1.0f + IK_EPSILON)
+		{
+			XMVECTOR axis = XMVector3Cross(rest, XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f));
+			if (XMVectorGetX(XMVector3LengthSq(axis)) < IK_EPSILON)
+				axis = XMVector3Cross(rest, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			delta = XMQuaternionRotationAxis(axis, XM_PI);
+		}
+		else
+		{
+			delta = XMQuaternionNormalize(XMVectorSetW(XMVector3Cross(rest, solved), 1.0f + c));
+		}
+
+		// world = local then parent world, so local = world * inverse(parent world)
+		XMVECTOR world = XMQuaternionMultiply(parentWorld, delta);
+		XMVECTOR local = XMQuaternionMultiply(world, XMQuaternionInverse(parentWorld));
+		XMStoreFloat4(&localRotations[j], XMQuaternionNormalize(local));
+		parentWorld = world;
+	}
+}
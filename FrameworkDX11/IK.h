@@ -0,0 +1,85 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace DirectX;
+
+class JobSystem;
+
+#define IK_LANES 4
+#define MAX_IK_JOINTS 16
+
+// On chains starting straight and targets at 75 to 95% of their length with 90 degree
+// limits, the default settings leave about 95% of FABRIK chains converged. CCD is
+// slower to build up a bend: about 93% of chains converge in 32 iterations and 99% in 64.
+struct IKSettings
+{
+	uint32_t	MaxIterations = 16;
+	float		Tolerance = 0.001f;
+	// Largest turn in radians of one CCD joint in one sweep. Undamped, the joint next to
+	// the end takes the whole bend, sits on its limit and leaves the rest to creep.
+	float		CCDMaxStep = 0.1f;
+};
+
+// Joint positions for many chains with the same joint count, stored as groups
+// of four chains in structure-of-arrays form: one XMFLOAT4 holds the same
+// coordinate of the same joint for four chains, so a solver step for a whole
+// group is a handful of SIMD operations. Padding chains are kept at rest.
+class IKChainSet
+{
+public:
+	IKChainSet(uint32_t chainCount, uint32_t jointCount);
+
+	// Segment lengths are taken from the positions given here
+	void SetChain(uint32_t chain, const XMFLOAT3* positions);
+	void GetChain(uint32_t chain, XMFLOAT3* positions) const;
+	void SetTarget(uint32_t chain, XMFLOAT3 target);
+	// Point the two-bone solver bends the middle joint towards, defaults to its starting position
+	void SetPole(uint32_t chain, XMFLOAT3 pole);
+	// Largest bend in radians between segment joint-1 and the segment leaving joint, for joint >= 1
+	void SetJointLimit(uint32_t joint, float maxAngle);
+
+	float GetJointLimitCos(uint32_t joint) const { return m_limitCos[joint]; }
+
+	bool IsConverged(uint32_t chain) const { return m_converged[chain] != 0; }
+	uint32_t GetIterations(uint32_t chain) const { return m_iterations[chain]; }
+
+	uint32_t GetChainCount() const { return m_chainCount; }
+	uint32_t GetJointCount() const { return m_jointCount; }
+	uint32_t GetGroupCount() const { return m_groupCount; }
+
+private:
+	friend struct IKGroup;
+
+	uint32_t m_chainCount;
+	uint32_t m_jointCount;
+	uint32_t m_groupCount;
+
+	// [group * jointCount + joint]
+	std::vector<XMFLOAT4> m_x, m_y, m_z;
+	// [group * jointCount + joint], the last entry of each group is unused
+	std::vector<XMFLOAT4> m_lengths;
+	// [group]
+	std::vector<XMFLOAT4> m_targetX, m_targetY, m_targetZ;
+	std::vector<XMFLOAT4> m_poleX, m_poleY, m_poleZ;
+	// cosine of the limit per joint, -1 is unlimited
+	std::vector<float> m_limitCos;
+	std::vector<float> m_limitSin;
+
+	std::vector<uint8_t> m_converged;
+	std::vector<uint32_t> m_iterations;
+};
+
+namespace IK
+{
+	// Each solver returns the number of chains that ended within tolerance of their target.
+	// Groups are split across the job system when one is given.
+	uint32_t SolveTwoBone(IKChainSet& chains, const IKSettings& settings, JobSystem* pJobs = nullptr);
+	uint32_t SolveCCD(IKChainSet& chains, const IKSettings& settings, JobSystem* pJobs = nullptr);
+	uint32_t SolveFABRIK(IKChainSet& chains, const IKSettings& settings, JobSystem* pJobs = nullptr);
+
+	// Converts solved joint positions back to local bone rotations, as the shortest arc
+	// taking each rest segment to its solved direction relative to its parent segment
+	void PositionsToLocalRotations(const XMFLOAT3* restPositions, const XMFLOAT3* solvedPositions, uint32_t jointCount, XMFLOAT4* localRotations);
+}
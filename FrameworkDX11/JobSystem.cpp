@@ -0,0 +1,97 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	m_threadCount = threadCount;
+	m_nextIndex = 0;
+
+	// Thread 0 is always the caller of ParallelFor
+	for (unsigned i = 1; i < m_threadCount; ++i)
+	{
+		m_workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); ++i)
+	{
+		m_workers[i].join();
+	}
+}
+
+void JobSystem::ParallelFor(size_t count, size_t batchSize, const RangeJob& job)
+{
+	if (count == 0)
+		return;
+
+	batchSize = std::max<size_t>(batchSize, 1);
+
+	// Not worth waking anyone up for a single batch
+	if (m_workers.empty() || count <= batchSize)
+	{
+		job(0, count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pJob = &job;
+		m_count = count;
+		m_batchSize = batchSize;
+		m_nextIndex = 0;
+		m_pendingWorkers = (unsigned)m_workers.size();
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	RunBatches(0);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_pendingWorkers == 0; });
+	m_pJob = nullptr;
+}
+
+void JobSystem::WorkerLoop(unsigned threadIndex)
+{
+	unsigned seenGeneration = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_quit || m_generation != seenGeneration; });
+			if (m_quit)
+				return;
+			seenGeneration = m_generation;
+		}
+
+		RunBatches(threadIndex);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_pendingWorkers == 0)
+			m_done.notify_one();
+	}
+}
+
+void JobSystem::RunBatches(unsigned threadIndex)
+{
+	for (;;)
+	{
+		size_t begin = m_nextIndex.fetch_add(m_batchSize);
+		if (begin >= m_count)
+			return;
+
+		size_t end = std::min(begin + m_batchSize, m_count);
+		(*m_pJob)(begin, end, threadIndex);
+	}
+}
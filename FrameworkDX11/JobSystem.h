@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads that splits an index range into batches.
+// The calling thread works through batches alongside the workers, so a pool
+// created with a single thread simply runs the job inline. Batches are claimed
+// with an atomic counter; the mutex is only taken to wake and retire workers.
+class JobSystem
+{
+public:
+	// begin/end are the index range of the batch, threadIndex is in [0, GetThreadCount())
+	// and can be used to select per-thread scratch memory
+	typedef std::function<void(size_t begin, size_t end, unsigned threadIndex)> RangeJob;
+
+	// threadCount includes the calling thread, 0 uses every hardware thread
+	JobSystem(unsigned threadCount = 0);
+	~JobSystem();
+
+	// Blocks until every batch has run. Not re-entrant: jobs must not call ParallelFor.
+	void ParallelFor(size_t count, size_t batchSize, const RangeJob& job);
+
+	unsigned GetThreadCount() const { return m_threadCount; }
+
+private:
+	void WorkerLoop(unsigned threadIndex);
+	void RunBatches(unsigned threadIndex);
+
+	std::vector<std::thread>	m_workers;
+	std::mutex					m_mutex;
+	std::condition_variable		m_wake;
+	std::condition_variable		m_done;
+
+	const RangeJob*				m_pJob = nullptr;
+	size_t						m_count = 0;
+	size_t						m_batchSize = 1;
+	std::atomic<size_t>			m_nextIndex;
+	unsigned					m_pendingWorkers = 0;
+	unsigned					m_generation = 0;
+	bool						m_quit = false;
+	unsigned					m_threadCount;
+};
@@ -0,0 +1,247 @@
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include "Culling.h"
+#include <algorithm>
+#include <math.h>
+
+// One box splatted across four lanes
+struct BoundsX4
+{
+	XMVECTOR	MinX, MinY, MinZ;
+	XMVECTOR	MaxX, MaxY, MaxZ;
+};
+
+static inline BoundsX4 Splat(const ClusterBounds& bounds)
+{
+	return { XMVectorReplicate(bounds.Min.x), XMVectorReplicate(bounds.Min.y), XMVectorReplicate(bounds.Min.z),
+			 XMVectorReplicate(bounds.Max.x), XMVectorReplicate(bounds.Max.y), XMVectorReplicate(bounds.Max.z) };
+}
+
+// How far each centre is outside the box along one axis, zero inside it
+static inline XMVECTOR Outside(FXMVECTOR centre, FXMVECTOR minimum, FXMVECTOR maximum)
+{
+	return XMVectorSubtract(centre, XMVectorClamp(centre, minimum, maximum));
+}
+
+LightClusterer::LightClusterer()
+	: m_bounds(LIGHT_CLUSTER_COUNT), m_slices(LIGHT_CLUSTERS_Z), m_ranges(LIGHT_CLUSTER_COUNT)
+{
+	for (float& depth : m_sliceDepths)
+	{
+		depth = 0.0f;
+	}
+}
+
+void LightClusterer::SetProjection(const XMFLOAT4X4& projection)
+{
+	float nearZ, farZ;
+	Culling::GetDepthRange(projection, nearZ, farZ);
+	float logRange = logf(farZ / nearZ);
+	m_sliceScale = LIGHT_CLUSTERS_Z / logRange;
+	m_sliceBias = -LIGHT_CLUSTERS_Z * logf(nearZ) / logRange;
+	for (uint32_t z = 0; z <= LIGHT_CLUSTERS_Z; ++z)
+	{
+		m_sliceDepths[z] = nearZ * powf(farZ / nearZ, (float)z / LIGHT_CLUSTERS_Z);
+	}
+	m_sliceDepths[LIGHT_CLUSTERS_Z] = farZ;
+
+	// Tile edges in NDC times depth over the projection's scale, at both ends of the slice
+	for (uint32_t z = 0; z < LIGHT_CLUSTERS_Z; ++z)
+	{
+		float nearDepth = m_sliceDepths[z], farDepth = m_sliceDepths[z + 1];
+		for (uint32_t y = 0; y < LIGHT_CLUSTERS_Y; ++y)
+		{
+			float top = 1.0f - 2.0f * y / LIGHT_CLUSTERS_Y;
+			float bottom = 1.0f - 2.0f * (y + 1) / LIGHT_CLUSTERS_Y;
+			float minY = std::min(bottom * nearDepth, bottom * farDepth) / projection._22;
+			float maxY = std::max(top * nearDepth, top * farDepth) / projection._22;
+			for (uint32_t x = 0; x < LIGHT_CLUSTERS_X; ++x)
+			{
+				float left = -1.0f + 2.0f * x / LIGHT_CLUSTERS_X;
+				float right = -1.0f + 2.0f * (x + 1) / LIGHT_CLUSTERS_X;
+				ClusterBounds& bounds = m_bounds[GetClusterIndex(x, y, z)];
+				bounds.Min = XMFLOAT3(std::min(left * nearDepth, left * farDepth) / projection._11, minY, nearDepth);
+				bounds.Max = XMFLOAT3(std::max(right * nearDepth, right * farDepth) / projection._11, maxY, farDepth);
+			}
+
+			ClusterBounds& row = m_rowBounds[z][y];
+			row.Min = XMFLOAT3(-farDepth / projection._11, minY, nearDepth);
+			row.Max = XMFLOAT3(farDepth / projection._11, maxY, farDepth);
+		}
+	}
+}
+
+bool LightClusterer::IsSphereInBounds(const ClusterBounds& bounds, const XMFLOAT4& sphere)
+{
+	float x = sphere.x - std::min(std::max(sphere.x, bounds.Min.x), bounds.Max.x);
+	float y = sphere.y - std::min(std::max(sphere.y, bounds.Min.y), bounds.Max.y);
+	float z = sphere.z - std::min(std::max(sphere.z, bounds.Min.z), bounds.Max.z);
+	return x * x + y * y + z * z <= sphere.w * sphere.w;
+}
+
+// Lanes that pass go on to the next list, packed four to a group again. Unused
+// lanes have a negative radius squared so no test passes them.
+void LightClusterer::AppendPassed(const LightGroup& group, FXMVECTOR passed, const uint32_t* lights, std::vector<LightGroup>& groups, std::vector<uint32_t>& indices)
+{
+	uint32_t lanes[4];
+	XMStoreInt4(lanes, passed);
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		if (!lanes[lane])
+			continue;
+		uint32_t slot = indices.size() & 3;
+		if (slot == 0)
+			groups.push_back({ XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f), XMFLOAT4(-1.0f, -1.0f, -1.0f, -1.0f) });
+		LightGroup& target = groups.back();
+		(&target.X.x)[slot] = (&group.X.x)[lane];
+		(&target.Y.x)[slot] = (&group.Y.x)[lane];
+		(&target.Z.x)[slot] = (&group.Z.x)[lane];
+		(&target.RadiusSq.x)[slot] = (&group.RadiusSq.x)[lane];
+		indices.push_back(lights[lane]);
+	}
+}
+
+void LightClusterer::Bin(const ClusterLight* lights, uint32_t count, const XMFLOAT4X4& view, JobSystem* pJobs)
+{
+	// Into view space four at a time, the last group padded with lanes nothing passes
+	m_lights.resize((count + 3) / 4);
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		XMFLOAT3 position;
+		XMStoreFloat3(&position, XMVector3Transform(XMLoadFloat3(&lights[i].Position), viewMatrix));
+		LightGroup& group = m_lights[i / 4];
+		uint32_t lane = i & 3;
+		(&group.X.x)[lane] = position.x;
+		(&group.Y.x)[lane] = position.y;
+		(&group.Z.x)[lane] = position.z;
+		(&group.RadiusSq.x)[lane] = lights[i].Range * lights[i].Range;
+	}
+	for (uint32_t i = count; i < m_lights.size() * 4; ++i)
+	{
+		LightGroup& group = m_lights[i / 4];
+		uint32_t lane = i & 3;
+		(&group.X.x)[lane] = (&group.Y.x)[lane] = (&group.Z.x)[lane] = 0.0f;
+		(&group.RadiusSq.x)[lane] = -1.0f;
+	}
+
+	if (pJobs)
+	{
+		pJobs->ParallelFor(LIGHT_CLUSTERS_Z, 1, [this](size_t begin, size_t end, unsigned)
+		{
+			for (size_t slice = begin; slice < end; ++slice)
+			{
+				BinSlice((uint32_t)slice);
+			}
+		});
+	}
+	else
+	{
+		for (uint32_t slice = 0; slice < LIGHT_CLUSTERS_Z; ++slice)
+		{
+			BinSlice(slice);
+		}
+	}
+
+	// Slices one after another in the index list
+	size_t total = 0;
+	for (const SliceBins& slice : m_slices)
+	{
+		total += slice.Indices.size();
+	}
+	m_indices.resize(total);
+	m_stats = {};
+	m_stats.Lights = count;
+	m_stats.Indices = (uint32_t)total;
+
+	uint32_t offset = 0;
+	for (uint32_t z = 0; z < LIGHT_CLUSTERS_Z; ++z)
+	{
+		const SliceBins& slice = m_slices[z];
+		std::copy(slice.Indices.begin(), slice.Indices.end(), m_indices.begin() + offset);
+		for (uint32_t i = 0; i < LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y; ++i)
+		{
+			ClusterRange& range = m_ranges[z * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y + i];
+			range.Offset = offset + slice.Ranges[i].Offset;
+			range.Count = slice.Ranges[i].Count;
+			m_stats.OccupiedClusters += range.Count > 0;
+			m_stats.MaxClusterLights = std::max(m_stats.MaxClusterLights, range.Count);
+		}
+		offset += (uint32_t)slice.Indices.size();
+	}
+
+	std::vector<uint8_t> visible(count, 0);
+	for (uint32_t index : m_indices)
+	{
+		m_stats.VisibleLights += visible[index] == 0;
+		visible[index] = 1;
+	}
+}
+
+void LightClusterer::BinSlice(uint32_t slice)
+{
+	SliceBins& bins = m_slices[slice];
+	bins.Candidates.clear();
+	bins.CandidateLights.clear();
+	bins.Indices.clear();
+
+	// Depth first, along z only
+	XMVECTOR nearZ = XMVectorReplicate(m_sliceDepths[slice]);
+	XMVECTOR farZ = XMVectorReplicate(m_sliceDepths[slice + 1]);
+	uint32_t lights[4];
+	for (uint32_t g = 0; g < m_lights.size(); ++g)
+	{
+		const LightGroup& group = m_lights[g];
+		XMVECTOR z = Outside(XMLoadFloat4(&group.Z), nearZ, farZ);
+		XMVECTOR passed = XMVectorLessOrEqual(XMVectorMultiply(z, z), XMLoadFloat4(&group.RadiusSq));
+		if (XMVector4EqualInt(passed, XMVectorFalseInt()))
+			continue;
+		for (uint32_t lane = 0; lane < 4; ++lane)
+		{
+			lights[lane] = g * 4 + lane;
+		}
+		AppendPassed(group, passed, lights, bins.Candidates, bins.CandidateLights);
+	}
+
+	// Then each row's box, then each cluster's
+	auto test = [](const LightGroup& group, const BoundsX4& bounds)
+	{
+		XMVECTOR x = Outside(XMLoadFloat4(&group.X), bounds.MinX, bounds.MaxX);
+		XMVECTOR y = Outside(XMLoadFloat4(&group.Y), bounds.MinY, bounds.MaxY);
+		XMVECTOR z = Outside(XMLoadFloat4(&group.Z), bounds.MinZ, bounds.MaxZ);
+		XMVECTOR distanceSq = XMVectorMultiplyAdd(z, z, XMVectorMultiplyAdd(y, y, XMVectorMultiply(x, x)));
+		return XMVectorLessOrEqual(distanceSq, XMLoadFloat4(&group.RadiusSq));
+	};
+	for (uint32_t y = 0; y < LIGHT_CLUSTERS_Y; ++y)
+	{
+		bins.RowCandidates.clear();
+		bins.RowCandidateLights.clear();
+		BoundsX4 row = Splat(m_rowBounds[slice][y]);
+		for (uint32_t g = 0; g < bins.Candidates.size(); ++g)
+		{
+			XMVECTOR passed = test(bins.Candidates[g], row);
+			if (!XMVector4EqualInt(passed, XMVectorFalseInt()))
+				AppendPassed(bins.Candidates[g], passed, &bins.CandidateLights[g * 4], bins.RowCandidates, bins.RowCandidateLights);
+		}
+
+		for (uint32_t x = 0; x < LIGHT_CLUSTERS_X; ++x)
+		{
+			ClusterRange& range = bins.Ranges[y * LIGHT_CLUSTERS_X + x];
+			range.Offset = (uint32_t)bins.Indices.size();
+			BoundsX4 cluster = Splat(m_bounds[GetClusterIndex(x, y, slice)]);
+			for (uint32_t g = 0; g < bins.RowCandidates.size(); ++g)
+			{
+				XMVECTOR passed = test(bins.RowCandidates[g], cluster);
+				if (XMVector4EqualInt(passed, XMVectorFalseInt()))
+					continue;
+				XMStoreInt4(lights, passed);
+				for (uint32_t lane = 0; lane < 4; ++lane)
+				{
+					if (lights[lane])
+						bins.Indices.push_back(bins.RowCandidateLights[g * 4 + lane]);
+				}
+			}
+			range.Count = (uint32_t)bins.Indices.size() - range.Offset;
+		}
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace DirectX;
+
+class JobSystem;
+
+// The view frustum's grid: tiles across the screen, slices in depth. shader.fx has the same.
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+// Most lights one frame bins, the size of the light structured buffer
+#define MAX_CLUSTERED_LIGHTS 4096
+
+// A point light as the pixel shader reads it from its StructuredBuffer, 32 bytes
+struct ClusterLight
+{
+	XMFLOAT3	Position;	// world space
+	float		Range;		// falls off to nothing here
+	XMFLOAT3	Colour;
+	float		Padding;
+};
+
+// Where one cluster's light indices start in the index list and how many there are
+struct ClusterRange
+{
+	uint32_t	Offset;
+	uint32_t	Count;
+};
+
+// View space box around one cluster, z into the screen
+struct ClusterBounds
+{
+	XMFLOAT3	Min;
+	XMFLOAT3	Max;
+};
+
+struct LightClusterStats
+{
+	uint32_t	Lights;
+	uint32_t	VisibleLights;		// touch at least one cluster
+	uint32_t	Indices;			// light and cluster pairs
+	uint32_t	OccupiedClusters;
+	uint32_t	MaxClusterLights;
+};
+
+// Bins point lights into the LIGHT_CLUSTERS_X x Y x Z grid of the view frustum.
+// Tiles split the screen evenly and slices split depth exponentially from the near
+// plane to the far one, so clusters stay roughly cube shaped. Each slice is binned
+// on its own: the lights are tested four at a time against the slice's depth range,
+// then what is left against each row's box and each cluster's box, with the sphere
+// to box distance test in SIMD lanes. Slices are split across the job system's threads.
+// A cluster's indices are in light order, the same order the reference test gives.
+class LightClusterer
+{
+public:
+	LightClusterer();
+
+	// The cluster boxes only change with the projection. Takes a row vector D3D
+	// perspective matrix, the same one the scene is drawn with.
+	void SetProjection(const XMFLOAT4X4& projection);
+
+	// Bins every light whose sphere overlaps a cluster's box, view is the camera's
+	void Bin(const ClusterLight* lights, uint32_t count, const XMFLOAT4X4& view, JobSystem* pJobs = nullptr);
+
+	const std::vector<ClusterRange>& GetRanges() const { return m_ranges; }
+	const std::vector<uint32_t>& GetIndices() const { return m_indices; }
+	const LightClusterStats& GetStats() const { return m_stats; }
+
+	const ClusterBounds& GetBounds(uint32_t cluster) const { return m_bounds[cluster]; }
+
+	// Slice = log(view z) * scale + bias, which is how the pixel shader finds its slice
+	float GetSliceScale() const { return m_sliceScale; }
+	float GetSliceBias() const { return m_sliceBias; }
+
+	// x and y count tiles from the top left of the screen
+	static uint32_t GetClusterIndex(uint32_t x, uint32_t y, uint32_t z) { return (z * LIGHT_CLUSTERS_Y + y) * LIGHT_CLUSTERS_X + x; }
+
+	// One sphere against one box, one lane of what Bin does. Sphere centre in xyz, radius in w.
+	static bool IsSphereInBounds(const ClusterBounds& bounds, const XMFLOAT4& sphere);
+
+private:
+	void BinSlice(uint32_t slice);
+
+	// Lights in view space, four to an element: x, y, z and radius squared
+	struct LightGroup
+	{
+		XMFLOAT4	X;
+		XMFLOAT4	Y;
+		XMFLOAT4	Z;
+		XMFLOAT4	RadiusSq;
+	};
+
+	static void AppendPassed(const LightGroup& group, FXMVECTOR passed, const uint32_t* lights, std::vector<LightGroup>& groups, std::vector<uint32_t>& indices);
+
+	// Scratch and output of one slice, merged into the lists once every slice is done
+	struct SliceBins
+	{
+		std::vector<LightGroup>		Candidates;
+		std::vector<uint32_t>		CandidateLights;
+		std::vector<LightGroup>		RowCandidates;
+		std::vector<uint32_t>		RowCandidateLights;
+		std::vector<uint32_t>		Indices;
+		ClusterRange				Ranges[LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y];
+	};
+
+	std::vector<ClusterBounds>	m_bounds;
+	ClusterBounds				m_rowBounds[LIGHT_CLUSTERS_Z][LIGHT_CLUSTERS_Y];
+	float						m_sliceDepths[LIGHT_CLUSTERS_Z + 1];
+	float						m_sliceScale = 0.0f;
+	float						m_sliceBias = 0.0f;
+
+	std::vector<LightGroup>		m_lights;
+	std::vector<SliceBins>		m_slices;
+
+	std::vector<ClusterRange>	m_ranges;
+	std::vector<uint32_t>		m_indices;
+	LightClusterStats			m_stats = {};
+};
@@ -0,0 +1,124 @@
+#include "MeshVectors.h"
+
+// REFERENCE - this has largely been modified from "Mathematics for 3D Game Programmming and Computer Graphics" by Eric Lengyel
+void MeshVectors::CalculateModelVectors(SimpleVertex* vertices, int vertexCount)
+{
+	int faceCount, i, index;
+	SimpleVertex vertex1, vertex2, vertex3;
+	XMFLOAT3 tangent, binormal, normal;
+
+	// Calculate the number of faces in the model.
+	faceCount = vertexCount / 3;
+
+	// Initialize the index to the model data.
+	index = 0;
+
+	// Go through all the faces and calculate the the tangent, binormal, and normal vectors.
+	for (i = 0; i < faceCount; i++)
+	{
+		// Get the three vertices for this face from the model.
+		vertex1.Pos.x = vertices[index].Pos.x;
+		vertex1.Pos.y = vertices[index].Pos.y;
+		vertex1.Pos.z = vertices[index].Pos.z;
+		vertex1.TexCoord.x = vertices[index].TexCoord.x;
+		vertex1.TexCoord.y = vertices[index].TexCoord.y;
+		vertex1.Normal.x = vertices[index].Normal.x;
+		vertex1.Normal.y = vertices[index].Normal.y;
+		vertex1.Normal.z = vertices[index].Normal.z;
+		index++;
+
+		vertex2.Pos.x = vertices[index].Pos.x;
+		vertex2.Pos.y = vertices[index].Pos.y;
+		vertex2.Pos.z = vertices[index].Pos.z;
+		vertex2.TexCoord.x = vertices[index].TexCoord.x;
+		vertex2.TexCoord.y = vertices[index].TexCoord.y;
+		vertex2.Normal.x = vertices[index].Normal.x;
+		vertex2.Normal.y = vertices[index].Normal.y;
+		vertex2.Normal.z = vertices[index].Normal.z;
+		index++;
+
+		vertex3.Pos.x = vertices[index].Pos.x;
+		vertex3.Pos.y = vertices[index].Pos.y;
+		vertex3.Pos.z = vertices[index].Pos.z;
+		vertex3.TexCoord.x = vertices[index].TexCoord.x;
+		vertex3.TexCoord.y = vertices[index].TexCoord.y;
+		vertex3.Normal.x = vertices[index].Normal.x;
+		vertex3.Normal.y = vertices[index].Normal.y;
+		vertex3.Normal.z = vertices[index].Normal.z;
+		index++;
+
+		// Calculate the tangent and binormal of that face.
+		CalculateTangentBinormalLH(vertex1, vertex2, vertex3, normal, tangent, binormal);
+
+		// Store the normal, tangent, and binormal for this face back in the model structure.
+		vertices[index - 1].Normal.x = normal.x;
+		vertices[index - 1].Normal.y = normal.y;
+		vertices[index - 1].Normal.z = normal.z;
+		vertices[index - 1].Tangent.x = tangent.x;
+		vertices[index - 1].Tangent.y = tangent.y;
+		vertices[index - 1].Tangent.z = tangent.z;
+		vertices[index - 1].BiTangent.x = binormal.x;
+		vertices[index - 1].BiTangent.y = binormal.y;
+		vertices[index - 1].BiTangent.z = binormal.z;
+
+		vertices[index - 2].Normal.x = normal.x;
+		vertices[index - 2].Normal.y = normal.y;
+		vertices[index - 2].Normal.z = normal.z;
+		vertices[index - 2].Tangent.x = tangent.x;
+		vertices[index - 2].Tangent.y = tangent.y;
+		vertices[index - 2].Tangent.z = tangent.z;
+		vertices[index - 2].BiTangent.x = binormal.x;
+		vertices[index - 2].BiTangent.y = binormal.y;
+		vertices[index - 2].BiTangent.z = binormal.z;
+
+		vertices[index - 3].Normal.x = normal.x;
+		vertices[index - 3].Normal.y = normal.y;
+		vertices[index - 3].Normal.z = normal.z;
+		vertices[index - 3].Tangent.x = tangent.x;
+		vertices[index - 3].Tangent.y = tangent.y;
+		vertices[index - 3].Tangent.z = tangent.z;
+		vertices[index - 3].BiTangent.x = binormal.x;
+		vertices[index - 3].BiTangent.y = binormal.y;
+		vertices[index - 3].BiTangent.z = binormal.z;
+	}
+}
+
+void MeshVectors::CalculateTangentBinormalLH(SimpleVertex v0, SimpleVertex v1, SimpleVertex v2, XMFLOAT3& normal, XMFLOAT3& tangent, XMFLOAT3& binormal)
+{
+	XMFLOAT3 edge1(v1.Pos.x - v0.Pos.x, v1.Pos.y - v0.Pos.y, v1.Pos.z - v0.Pos.z);
+	XMFLOAT3 edge2(v2.Pos.x - v0.Pos.x, v2.Pos.y - v0.Pos.y, v2.Pos.z - v0.Pos.z);
+
+	XMFLOAT2 deltaUV1(v1.TexCoord.x - v0.TexCoord.x, v1.TexCoord.y - v0.TexCoord.y);
+	XMFLOAT2 deltaUV2(v2.TexCoord.x - v0.TexCoord.x, v2.TexCoord.y - v0.TexCoord.y);
+
+	float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+
+	tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
+	tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
+	tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
+	XMVECTOR tn = XMLoadFloat3(&tangent);
+	tn = XMVector3Normalize(tn);
+	XMStoreFloat3(&tangent, tn);
+
+	binormal.x = f * (deltaUV1.x * edge2.x - deltaUV2.x * edge1.x);
+	binormal.y = f * (deltaUV1.x * edge2.y - deltaUV2.x * edge1.y);
+	binormal.z = f * (deltaUV1.x * edge2.z - deltaUV2.x * edge1.z);
+
+	tn = XMLoadFloat3(&binormal);
+	tn = XMVector3Normalize(tn);
+	XMStoreFloat3(&binormal, tn);
+
+
+	XMVECTOR vv0 = XMLoadFloat3(&v0.Pos);
+	XMVECTOR vv1 = XMLoadFloat3(&v1.Pos);
+	XMVECTOR vv2 = XMLoadFloat3(&v2.Pos);
+
+	XMVECTOR e0 = vv1 - vv0;
+	XMVECTOR e1 = vv2 - vv0;
+
+	XMVECTOR e01cross = XMVector3Cross(e0, e1);
+	e01cross = XMVector3Normalize(e01cross);
+	XMFLOAT3 normalOut;
+	XMStoreFloat3(&normalOut, e01cross);
+	normal = normalOut;
+}
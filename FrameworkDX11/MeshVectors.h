@@ -0,0 +1,11 @@
+#pragma once
+#include "VertexTypes.h"
+
+// Per-face normal, tangent and binormal for triangle lists. Only needs DirectXMath,
+// so mesh building can run and be timed without a device.
+namespace MeshVectors
+{
+	// vertexCount / 3 faces, every vertex of a face gets that face's vectors
+	void CalculateModelVectors(SimpleVertex* vertices, int vertexCount);
+	void CalculateTangentBinormalLH(SimpleVertex v0, SimpleVertex v1, SimpleVertex v2, XMFLOAT3& normal, XMFLOAT3& tangent, XMFLOAT3& binormal);
+}
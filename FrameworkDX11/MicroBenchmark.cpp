@@ -0,0 +1,433 @@
+#include "MicroBenchmark.h"
+#include "Benchmark.h"
+#include "TerrainHeightmap.h"
+#include "MeshVectors.h"
+#include "CameraPath.h"
+#include "Quaternion.h"
+#include "DDSHeader.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#define MICRO_SEED 1
+#define MICRO_DDS_HEADERS 4096
+#define MICRO_DDS_FORMAT_R16G16B16A16_FLOAT 10	// DXGI_FORMAT
+
+static const int g_microFaultSizes[] = { 65, 129, 257, 513 };
+static const int g_microDepositionSizes[] = { 129, 257, 513 };
+static const int g_microDiamondSquareSizes[] = { 129, 257, 513, 1025 };
+static const int g_microVertexCounts[] = { 3 * 1024, 3 * 16384, 3 * 131072, TERRAIN_GRID_SIZE * TERRAIN_GRID_SIZE * 6 };
+static const int g_microQuaternionCounts[] = { 1024, 65536, 1048576 };
+static const int g_microPoseCounts[] = { 1024, 65536 };
+
+// Every kernel folds its output in here so the optimiser can't drop the work
+static volatile float g_microSink;
+
+typedef std::chrono::steady_clock MicroClock;
+
+static float RandomRange(float low, float high)
+{
+	return low + (high - low) * rand() / (float)RAND_MAX;
+}
+
+int MicroBenchmark::Run(const std::string& commandLine)
+{
+	std::string name = Benchmark::GetArgument(commandLine, "-micro", "all");
+	std::string path = Benchmark::GetArgument(commandLine, "-out", MICRO_RESULTS_FILE);
+	std::string baselinePath = Benchmark::GetArgument(commandLine, "-baseline", "");
+	int warmup = atoi(Benchmark::GetArgument(commandLine, "-warmup", std::to_string(MICRO_DEFAULT_WARMUP)).c_str());
+	int repetitions = atoi(Benchmark::GetArgument(commandLine, "-reps", std::to_string(MICRO_DEFAULT_REPETITIONS)).c_str());
+	double threshold = atof(Benchmark::GetArgument(commandLine, "-threshold", std::to_string(MICRO_DEFAULT_THRESHOLD)).c_str());
+
+	if (warmup < 0 || repetitions <= 0 || threshold < 0.0)
+	{
+		fprintf(stderr, "Bad arguments: %s\n", commandLine.c_str());
+		return 1;
+	}
+
+	std::vector<MicroResult> results;
+	TerrainKernels(name, (uint32_t)warmup, (uint32_t)repetitions, results);
+	if (name == "all" || name == "modelvectors")
+		ModelVectorKernel((uint32_t)warmup, (uint32_t)repetitions, results);
+	if (name == "all" || name == "quaternion")
+		QuaternionKernel((uint32_t)warmup, (uint32_t)repetitions, results);
+	if (name == "all" || name == "camera")
+		CameraKernel((uint32_t)warmup, (uint32_t)repetitions, results);
+	if (name == "all" || name == "dds")
+		DDSHeaderKernel((uint32_t)warmup, (uint32_t)repetitions, results);
+
+	if (results.empty())
+	{
+		fprintf(stderr, "Unknown kernel: %s\nKernels: fault deposition diamondsquare modelvectors quaternion camera dds\n", name.c_str());
+		return 1;
+	}
+
+	for (const MicroResult& result : results)
+	{
+		printf("%s %llu: median %.4f ms, min %.4f ms, stddev %.4f ms\n", result.Kernel.c_str(),
+			(unsigned long long)result.Size, result.Median, result.Min, result.StdDev);
+	}
+
+	if (!WriteCsv(path, results))
+	{
+		fprintf(stderr, "Could not write %s\n", path.c_str());
+		return 1;
+	}
+
+	if (baselinePath.empty())
+		return 0;
+
+	std::vector<MicroResult> baseline;
+	if (!ReadCsv(baselinePath, baseline))
+	{
+		fprintf(stderr, "Could not read baseline %s\n", baselinePath.c_str());
+		return 1;
+	}
+
+	std::vector<MicroRegression> regressions = Compare(baseline, results, threshold);
+	for (const MicroRegression& regression : regressions)
+	{
+		fprintf(stderr, "Regression: %s %llu, median %.4f ms -> %.4f ms (+%.1f%%)\n", regression.Kernel.c_str(),
+			(unsigned long long)regression.Size, regression.Baseline, regression.Current, regression.ChangePercent);
+	}
+	printf("%zu regressions over %.1f%% against %s\n", regressions.size(), threshold, baselinePath.c_str());
+	return regressions.empty() ? 0 : 1;
+}
+
+MicroResult MicroBenchmark::Measure(const std::string& kernel, uint64_t size, uint64_t items, uint32_t warmup, uint32_t repetitions,
+	const std::function<void()>& prepare, const std::function<void()>& run)
+{
+	for (uint32_t i = 0; i < warmup; ++i)
+	{
+		prepare();
+		run();
+	}
+
+	std::vector<double> samples(repetitions);
+	for (uint32_t i = 0; i < repetitions; ++i)
+	{
+		prepare();
+		MicroClock::time_point start = MicroClock::now();
+		run();
+		samples[i] = std::chrono::duration<double, std::milli>(MicroClock::now() - start).count();
+	}
+
+	MicroResult result = {};
+	result.Kernel = kernel;
+	result.Size = size;
+	result.Items = items;
+	result.Repetitions = repetitions;
+
+	double sum = 0.0;
+	for (double sample : samples)
+	{
+		sum += sample;
+	}
+	result.Mean = sum / repetitions;
+
+	double variance = 0.0;
+	for (double sample : samples)
+	{
+		variance += (sample - result.Mean) * (sample - result.Mean);
+	}
+	result.StdDev = repetitions > 1 ? sqrt(variance / (repetitions - 1)) : 0.0;
+
+	std::sort(samples.begin(), samples.end());
+	result.Min = samples.front();
+	result.Max = samples.back();
+	result.Median = repetitions % 2 ? samples[repetitions / 2] : (samples[repetitions / 2 - 1] + samples[repetitions / 2]) * 0.5;
+	return result;
+}
+
+bool MicroBenchmark::WriteCsv(const std::string& path, const std::vector<MicroResult>& results)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "kernel,size,items,repetitions,median_ms,mean_ms,min_ms,max_ms,stddev_ms,items_per_s\n");
+	for (const MicroResult& result : results)
+	{
+		double itemsPerSecond = result.Median > 0.0 ? result.Items / (result.Median / 1000.0) : 0.0;
+		fprintf(file, "%s,%llu,%llu,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.0f\n", result.Kernel.c_str(), (unsigned long long)result.Size,
+			(unsigned long long)result.Items, result.Repetitions, result.Median, result.Mean, result.Min, result.Max, result.StdDev, itemsPerSecond);
+	}
+	return fclose(file) == 0;
+}
+
+bool MicroBenchmark::ReadCsv(const std::string& path, std::vector<MicroResult>& results)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::string line;
+	std::getline(file, line);
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string kernel;
+		if (!std::getline(stream, kernel, ','))
+			continue;
+
+		MicroResult result = {};
+		result.Kernel = kernel;
+		unsigned long long size = 0, items = 0;
+		if (sscanf(line.c_str() + kernel.size() + 1, "%llu,%llu,%u,%lf,%lf,%lf,%lf,%lf", &size, &items, &result.Repetitions,
+			&result.Median, &result.Mean, &result.Min, &result.Max, &result.StdDev) != 8)
+			continue;
+
+		result.Size = size;
+		result.Items = items;
+		results.push_back(result);
+	}
+	return true;
+}
+
+std::vector<MicroRegression> MicroBenchmark::Compare(const std::vector<MicroResult>& baseline, const std::vector<MicroResult>& current, double thresholdPercent)
+{
+	std::vector<MicroRegression> regressions;
+	for (const MicroResult& result : current)
+	{
+		for (const MicroResult& base : baseline)
+		{
+			if (base.Kernel != result.Kernel || base.Size != result.Size || base.Median <= 0.0)
+				continue;
+
+			double change = (result.Median - base.Median) / base.Median * 100.0;
+			if (change > thresholdPercent)
+				regressions.push_back({ result.Kernel, result.Size, base.Median, result.Median, change });
+			break;
+		}
+	}
+	return regressions;
+}
+
+void MicroBenchmark::TerrainKernels(const std::string& name, uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results)
+{
+	// Generate clears the grid first, the same as switching terrain in the Options window.
+	// The generators draw from rand(), so every pass is reseeded to do the same work.
+	// Items are cell updates for the fault lines and diamond square, particles dropped
+	// for the deposition.
+	struct TerrainKernel
+	{
+		const char*	Name;
+		int			Type;
+		const int*	Sizes;
+		size_t		SizeCount;
+		uint64_t	(*GetItems)(int size);
+	};
+	const TerrainKernel kernels[] =
+	{
+		{ "fault", TerrainFaultLines, g_microFaultSizes, sizeof(g_microFaultSizes) / sizeof(g_microFaultSizes[0]),
+			[](int size) { return (uint64_t)size * size * TERRAIN_FAULT_ITERATIONS; } },
+		{ "deposition", TerrainParticleDeposition, g_microDepositionSizes, sizeof(g_microDepositionSizes) / sizeof(g_microDepositionSizes[0]),
+			[](int) { return (uint64_t)TERRAIN_DEPOSITION_PARTICLES; } },
+		{ "diamondsquare", TerrainDiamondSquare, g_microDiamondSquareSizes, sizeof(g_microDiamondSquareSizes) / sizeof(g_microDiamondSquareSizes[0]),
+			[](int size) { return (uint64_t)size * size; } }
+	};
+
+	for (const TerrainKernel& kernel : kernels)
+	{
+		if (name != "all" && name != kernel.Name)
+			continue;
+
+		for (size_t i = 0; i < kernel.SizeCount; ++i)
+		{
+			int size = kernel.Sizes[i];
+			TerrainHeightmap heightmap(size);
+			results.push_back(Measure(kernel.Name, size, kernel.GetItems(size), warmup, repetitions,
+				[]() { srand(MICRO_SEED); },
+				[&]() { heightmap.Generate(kernel.Type); g_microSink = heightmap.GetHeights()[size / 2][size / 2]; }));
+		}
+	}
+}
+
+void MicroBenchmark::ModelVectorKernel(uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results)
+{
+	// Triangles scattered like a terrain's, rebuilt before every pass because the
+	// kernel writes the vectors back into the vertices
+	for (int count : g_microVertexCounts)
+	{
+		srand(MICRO_SEED);
+		std::vector<SimpleVertex> source(count);
+		for (SimpleVertex& v : source)
+		{
+			v.Pos = XMFLOAT3(RandomRange(-128.0f, 128.0f), RandomRange(0.0f, 25.0f), RandomRange(-128.0f, 128.0f));
+			v.TexCoord = XMFLOAT2(RandomRange(0.0f, 1.0f), RandomRange(0.0f, 1.0f));
+			v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		}
+
+		std::vector<SimpleVertex> vertices(count);
+		results.push_back(Measure("modelvectors", count, count, warmup, repetitions,
+			[&]() { vertices = source; },
+			[&]() { MeshVectors::CalculateModelVectors(vertices.data(), count); g_microSink = vertices[count - 1].Normal.y; }));
+	}
+}
+
+void MicroBenchmark::QuaternionKernel(uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results)
+{
+	// One integration step of a rigid body per item: spin, normalise, then the world matrix
+	for (int count : g_microQuaternionCounts)
+	{
+		srand(MICRO_SEED);
+		std::vector<Quaternion> orientations(count);
+		std::vector<XMFLOAT3> spins(count);
+		for (int i = 0; i < count; ++i)
+		{
+			orientations[i] = Quaternion(RandomRange(-1.0f, 1.0f), RandomRange(-1.0f, 1.0f), RandomRange(-1.0f, 1.0f), RandomRange(-1.0f, 1.0f));
+			orientations[i].normalise();
+			spins[i] = XMFLOAT3(RandomRange(-2.0f, 2.0f), RandomRange(-2.0f, 2.0f), RandomRange(-2.0f, 2.0f));
+		}
+		const Quaternion step(0.9998f, 0.01f, 0.0f, 0.01f);
+		const XMFLOAT3 position(1.0f, 2.0f, 3.0f);
+
+		results.push_back(Measure("quaternion", count, count, warmup, repetitions,
+			[]() {},
+			[&]()
+			{
+				XMMATRIX world = XMMatrixIdentity();
+				float sum = 0.0f;
+				for (int i = 0; i < count; ++i)
+				{
+					Quaternion& q = orientations[i];
+					q *= step;
+					q.addScaledVector(spins[i], 1.0f / 60.0f);
+					q.normalise();
+					CalculateTransformMatrix(world, position, q);
+					sum += XMVectorGetX(world.r[0]);
+				}
+				g_microSink = sum;
+			}));
+	}
+}
+
+void MicroBenchmark::CameraKernel(uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results)
+{
+	// Camera::GetMatrix1st builds its view from the pose with this
+	for (int count : g_microPoseCounts)
+	{
+		srand(MICRO_SEED);
+		std::vector<CameraPose> poses(count);
+		for (CameraPose& pose : poses)
+		{
+			pose.Eye = XMFLOAT3(RandomRange(-50.0f, 50.0f), RandomRange(0.0f, 10.0f), RandomRange(-50.0f, 50.0f));
+			pose.Pitch = RandomRange(-1.5f, 1.5f);
+			pose.Yaw = RandomRange(-3.14f, 3.14f);
+		}
+
+		results.push_back(Measure("camera", count, count, warmup, repetitions,
+			[]() {},
+			[&]()
+			{
+				float sum = 0.0f;
+				for (const CameraPose& pose : poses)
+				{
+					XMMATRIX view = CameraControl::GetViewMatrix(pose);
+					sum += XMVectorGetX(view.r[3]);
+				}
+				g_microSink = sum;
+			}));
+	}
+}
+
+static void WriteDDSValue(std::vector<uint8_t>& data, size_t offset, uint32_t value)
+{
+	memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+// A file with every surface present but zeroed, only the headers are parsed
+static std::vector<uint8_t> MakeDDSFile(uint32_t size, uint32_t mips, uint32_t fourCC, uint32_t dx10Format, bool cube)
+{
+	const size_t header = 4 + 124;
+	const size_t dx10 = fourCC == MAKEFOURCC('D', 'X', '1', '0') ? 20 : 0;
+	std::vector<uint8_t> data(header + dx10 + (size_t)size * size * 8 * 2 * (cube ? 6 : 1));
+
+	WriteDDSValue(data, 0, MAKEFOURCC('D', 'D', 'S', ' '));
+	WriteDDSValue(data, 4, 124);
+	WriteDDSValue(data, 8, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000);
+	WriteDDSValue(data, 12, size);
+	WriteDDSValue(data, 16, size);
+	WriteDDSValue(data, 28, mips);
+	WriteDDSValue(data, 76, 32);
+	if (fourCC)
+	{
+		WriteDDSValue(data, 80, 0x4);
+		WriteDDSValue(data, 84, fourCC);
+	}
+	else
+	{
+		// A8R8G8B8 by its masks
+		WriteDDSValue(data, 80, 0x40 | 0x1);
+		WriteDDSValue(data, 88, 32);
+		WriteDDSValue(data, 92, 0x000000ff);
+		WriteDDSValue(data, 96, 0x0000ff00);
+		WriteDDSValue(data, 100, 0x00ff0000);
+		WriteDDSValue(data, 104, 0xff000000);
+	}
+	WriteDDSValue(data, 108, 0x1000 | (mips > 1 ? 0x400008 : 0));
+
+	if (dx10)
+	{
+		WriteDDSValue(data, header, dx10Format);
+		WriteDDSValue(data, header + 4, DDS_DIMENSION_TEXTURE2D);
+		WriteDDSValue(data, header + 8, cube ? DDS_MISC_TEXTURECUBE : 0);
+		WriteDDSValue(data, header + 12, 1);
+	}
+	return data;
+}
+
+void MicroBenchmark::DDSHeaderKernel(uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results)
+{
+	// The kinds of file in Resources: block compressed, plain RGBA and a DX10 header.
+	// Size is the top mip's width, items are the headers parsed per pass.
+	struct DDSKernel
+	{
+		const char*	Name;
+		uint32_t	Size;
+		uint32_t	FourCC;
+		uint32_t	Format;
+		bool		Cube;
+	};
+	const DDSKernel kernels[] =
+	{
+		{ "dds_bc1", 1024, MAKEFOURCC('D', 'X', 'T', '1'), 0, false },
+		{ "dds_rgba8", 512, 0, 0, false },
+		{ "dds_dx10_cube", 256, MAKEFOURCC('D', 'X', '1', '0'), MICRO_DDS_FORMAT_R16G16B16A16_FLOAT, true }
+	};
+
+	for (const DDSKernel& kernel : kernels)
+	{
+		uint32_t mips = 1;
+		while ((kernel.Size >> mips) > 0)
+		{
+			++mips;
+		}
+		std::vector<uint8_t> file = MakeDDSFile(kernel.Size, mips, kernel.FourCC, kernel.Format, kernel.Cube);
+
+		DDSHeaderInfo info;
+		if (!DDSHeader::Parse(file.data(), file.size(), info))
+		{
+			fprintf(stderr, "%s: synthetic header rejected\n", kernel.Name);
+			continue;
+		}
+
+		results.push_back(Measure(kernel.Name, kernel.Size, MICRO_DDS_HEADERS, warmup, repetitions,
+			[]() {},
+			[&]()
+			{
+				size_t texels = 0;
+				for (uint32_t i = 0; i < MICRO_DDS_HEADERS; ++i)
+				{
+					DDSHeader::Parse(file.data(), file.size(), info);
+					texels += (size_t)info.Width * info.Height * info.ArraySize;
+				}
+				g_microSink = (float)texels;
+			}));
+	}
+}
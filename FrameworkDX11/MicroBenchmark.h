@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define MICRO_DEFAULT_WARMUP 2
+#define MICRO_DEFAULT_REPETITIONS 10
+#define MICRO_DEFAULT_THRESHOLD 10.0
+#define MICRO_RESULTS_FILE "micro_results.csv"
+
+// One kernel at one point of its sweep. Size is the swept parameter (grid size,
+// vertex count, operation count), Items the work done by one run for the throughput.
+// Times are milliseconds per run over the timed repetitions.
+struct MicroResult
+{
+	std::string	Kernel;
+	uint64_t	Size;
+	uint64_t	Items;
+	uint32_t	Repetitions;
+	double		Median;
+	double		Mean;
+	double		Min;
+	double		Max;
+	double		StdDev;
+};
+
+struct MicroRegression
+{
+	std::string	Kernel;
+	uint64_t	Size;
+	double		Baseline;
+	double		Current;
+	double		ChangePercent;
+};
+
+// Micro-benchmarks for the kernels the app runs at startup and per frame: the
+// terrain generators, model vectors, quaternion maths, the camera view matrix and
+// DDS header parsing. Every point of a sweep runs untimed warmup passes first, then
+// the timed repetitions. Results are CSV, and a previous CSV can be given as a
+// baseline: any median slower than it by more than the threshold is a regression.
+class MicroBenchmark
+{
+public:
+	// "-micro <kernel|all> [-warmup n] [-reps n] [-out file] [-baseline file] [-threshold percent]",
+	// returns 1 when anything regressed or the results can't be written
+	static int Run(const std::string& commandLine);
+
+	// prepare runs untimed before every pass, run is the timed part
+	static MicroResult Measure(const std::string& kernel, uint64_t size, uint64_t items, uint32_t warmup, uint32_t repetitions,
+		const std::function<void()>& prepare, const std::function<void()>& run);
+
+	static bool WriteCsv(const std::string& path, const std::vector<MicroResult>& results);
+	static bool ReadCsv(const std::string& path, std::vector<MicroResult>& results);
+
+	// Matches results by kernel and size, points missing from either side are skipped
+	static std::vector<MicroRegression> Compare(const std::vector<MicroResult>& baseline, const std::vector<MicroResult>& current, double thresholdPercent);
+
+private:
+	static void TerrainKernels(const std::string& name, uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results);
+	static void ModelVectorKernel(uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results);
+	static void QuaternionKernel(uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results);
+	static void CameraKernel(uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results);
+	static void DDSHeaderKernel(uint32_t warmup, uint32_t repetitions, std::vector<MicroResult>& results);
+};
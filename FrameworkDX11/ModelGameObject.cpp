@@ -1,9 +1,20 @@
 #include "ModelGameObject.h"
 
-ModelGameObject::ModelGameObject(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext)
+#define MODEL_BONE_LENGTH 1.0f
+#define MODEL_RADIUS 0.35f
+#define MODEL_SIDES 16
+#define MODEL_RINGS 25
+#define MODEL_ARENA_SIZE (16 * 1024)
+
+ModelGameObject::ModelGameObject(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext, JobSystem* pJobs)
 {
 	m_pRootBone = new Bone();
 	m_pRootBone->setPosition({ 12, 0.0f, 12 });
+	m_pJobs = pJobs;
+
+	BuildSkeleton();
+	BuildSkinnedMesh();
+	BuildBlendTree();
 }
 
 ModelGameObject::~ModelGameObject()
@@ -11,11 +22,183 @@ ModelGameObject::~ModelGameObject()
 	m_pRootBone->cleanup();
 	m_pRootBone = nullptr;
 	delete m_pRootBone;
+
+	for (int i = 0; i < MODEL_BONE_COUNT; ++i)
+	{
+		delete m_skeleton[i];
+		m_skeleton[i] = nullptr;
+	}
+
+	delete m_pSkinnedMesh;
+	m_pSkinnedMesh = nullptr;
+
+	delete m_pBlendTree;
+	m_pBlendTree = nullptr;
+	for (size_t i = 0; i < m_clips.size(); ++i)
+	{
+		delete m_clips[i];
+	}
+	m_clips.clear();
+
+	delete m_pFrameArena;
+	m_pFrameArena = nullptr;
+
+	delete m_pIKChain;
+	m_pIKChain = nullptr;
+}
+
+void ModelGameObject::BuildSkeleton()
+{
+	// A straight chain up the Y axis, one bone per unit
+	for (int i = 0; i < MODEL_BONE_COUNT; ++i)
+	{
+		m_skeleton[i] = new Bone();
+		m_skeleton[i]->SetLocalOffset({ 0.0f, i == 0 ? 0.0f : MODEL_BONE_LENGTH, 0.0f });
+		m_parents[i] = i - 1;
+		if (i > 0)
+			m_skeleton[i - 1]->AddChild(m_skeleton[i]);
+	}
+
+	m_skeleton[0]->UpdateSkeleton(XMMatrixIdentity());
+	for (int i = 0; i < MODEL_BONE_COUNT; ++i)
+	{
+		XMMATRIX bindPose = XMLoadFloat4x4(m_skeleton[i]->GetSkeletonTransform());
+		XMStoreFloat4x4(&m_inverseBindPose[i], XMMatrixInverse(nullptr, bindPose));
+		m_restJoints[i] = XMFLOAT3(0.0f, i * MODEL_BONE_LENGTH, 0.0f);
+	}
+	m_restJoints[MODEL_BONE_COUNT] = XMFLOAT3(0.0f, MODEL_BONE_COUNT * MODEL_BONE_LENGTH, 0.0f);
+
+	m_pIKChain = new IKChainSet(1, MODEL_BONE_COUNT + 1);
+	m_pIKChain->SetChain(0, m_restJoints);
+	for (int i = 1; i < MODEL_BONE_COUNT; ++i)
+	{
+		m_pIKChain->SetJointLimit(i, XM_PIDIV2);
+	}
+}
+
+void ModelGameObject::BuildSkinnedMesh()
+{
+	// Rings of a tube, weighted by distance to the middle of each bone
+	std::vector<SkinnedVertex> rings(MODEL_RINGS * (MODEL_SIDES + 1));
+	float height = MODEL_BONE_LENGTH * MODEL_BONE_COUNT;
+	for (int ring = 0; ring < MODEL_RINGS; ++ring)
+	{
+		float y = height * ring / (MODEL_RINGS - 1);
+
+		float weights[MODEL_BONE_COUNT];
+		for (int b = 0; b < MODEL_BONE_COUNT; ++b)
+		{
+			float centre = (b + 0.5f) * MODEL_BONE_LENGTH;
+			float weight = 1.0f - fabsf(y - centre) / MODEL_BONE_LENGTH;
+			weights[b] = weight > 0.0f ? weight : 0.0f;
+		}
+
+		// Two strongest influences
+		int first = 0;
+		for (int b = 1; b < MODEL_BONE_COUNT; ++b)
+			if (weights[b] > weights[first]) first = b;
+		int second = (first == 0) ? 1 : first - 1;
+		if (first + 1 < MODEL_BONE_COUNT && weights[first + 1] > weights[second])
+			second = first + 1;
+		float sum = weights[first] + weights[second];
+
+		for (int side = 0; side <= MODEL_SIDES; ++side)
+		{
+			float angle = XM_2PI * side / MODEL_SIDES;
+			float c = cosf(angle);
+			float s = sinf(angle);
+
+			SkinnedVertex& v = rings[ring * (MODEL_SIDES + 1) + side];
+			v.Pos = XMFLOAT3(c * MODEL_RADIUS, y, s * MODEL_RADIUS);
+			v.Normal = XMFLOAT3(c, 0.0f, s);
+			v.TexCoord = XMFLOAT2((float)side / MODEL_SIDES, y / height);
+			v.Tangent = XMFLOAT3(-s, 0.0f, c);
+			v.BiTangent = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			v.BoneIndices[0] = (uint8_t)first;
+			v.BoneIndices[1] = (uint8_t)second;
+			v.BoneIndices[2] = 0;
+			v.BoneIndices[3] = 0;
+			v.BoneWeights = XMFLOAT4(weights[first] / sum, weights[second] / sum, 0.0f, 0.0f);
+		}
+	}
+
+	// Unindexed triangle list, the tessellation stages take three control point patches
+	std::vector<SkinnedVertex> vertices;
+	vertices.reserve((MODEL_RINGS - 1) * MODEL_SIDES * 6);
+	for (int ring = 0; ring < MODEL_RINGS - 1; ++ring)
+	{
+		for (int side = 0; side < MODEL_SIDES; ++side)
+		{
+			const SkinnedVertex& v0 = rings[ring * (MODEL_SIDES + 1) + side];
+			const SkinnedVertex& v1 = rings[ring * (MODEL_SIDES + 1) + side + 1];
+			const SkinnedVertex& v2 = rings[(ring + 1) * (MODEL_SIDES + 1) + side];
+			const SkinnedVertex& v3 = rings[(ring + 1) * (MODEL_SIDES + 1) + side + 1];
+			vertices.push_back(v0);
+			vertices.push_back(v2);
+			vertices.push_back(v1);
+			vertices.push_back(v1);
+			vertices.push_back(v2);
+			vertices.push_back(v3);
+		}
+	}
+
+	m_pSkinnedMesh = new SkinnedMesh();
+	m_pSkinnedMesh->SetBindPose(vertices, MODEL_BONE_COUNT);
+}
+
+void ModelGameObject::BuildBlendTree()
+{
+	BoneTransform bindPose[MODEL_BONE_COUNT];
+	AnimationClip* pIdle = AnimationClip::CreateChainSwing(MODEL_BONE_COUNT, MODEL_BONE_LENGTH, { 0.0f, 0.0f, 1.0f }, 0.05f, 1.0f);
+	AnimationClip* pSway = AnimationClip::CreateChainSwing(MODEL_BONE_COUNT, MODEL_BONE_LENGTH, { 0.0f, 0.0f, 1.0f }, 0.5f, 1.0f);
+	AnimationClip* pBend = AnimationClip::CreateChainSwing(MODEL_BONE_COUNT, MODEL_BONE_LENGTH, { 1.0f, 0.0f, 0.0f }, 0.6f, 1.0f);
+	AnimationClip* pTwist = AnimationClip::CreateChainSwing(MODEL_BONE_COUNT, MODEL_BONE_LENGTH, { 0.0f, 1.0f, 0.0f }, 0.8f, 1.0f);
+	AnimationClip* pWave = AnimationClip::CreateChainSwing(MODEL_BONE_COUNT, MODEL_BONE_LENGTH, { 0.0f, 0.0f, 1.0f }, 1.0f, 2.0f);
+
+	// The twist is layered on top as a delta from the first idle frame
+	Pose::Copy(pIdle->GetFrame(0), bindPose, MODEL_BONE_COUNT);
+	pTwist->MakeAdditive(bindPose);
+	m_clips = { pIdle, pSway, pBend, pTwist, pWave };
+
+	m_pBlendTree = new BlendTree(MODEL_BONE_COUNT);
+	int idle = m_pBlendTree->AddClip(pIdle);
+	int sway = m_pBlendTree->AddClip(pSway);
+	int bend = m_pBlendTree->AddClip(pBend);
+	int space = m_pBlendTree->AddBlend2D(0, 1, { idle, sway, bend }, { XMFLOAT2(0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT2(0.0f, 1.0f) });
+	int twist = m_pBlendTree->AddAdditive(space, m_pBlendTree->AddClip(pTwist), 2);
+
+	// Only the top bone waves
+	std::vector<float> upperMask(MODEL_BONE_COUNT, 0.0f);
+	upperMask[MODEL_BONE_COUNT - 1] = 1.0f;
+	m_pBlendTree->SetRoot(m_pBlendTree->AddMasked(twist, m_pBlendTree->AddClip(pWave), upperMask, 3));
+
+	m_pFrameArena = new FrameArena(MODEL_ARENA_SIZE);
+
+	m_instance = {};
+	m_instance.pTree = m_pBlendTree;
+	m_instance.pParents = m_parents;
+	m_instance.Parameters[0] = 1.0f;
+	m_instance.Speed = 0.75f;
 }
 
 void ModelGameObject::Draw(ID3D11DeviceContext* pContext)
 {
 	m_pRootBone->draw(pContext);
+	m_pSkinnedMesh->draw(pContext);
+}
+
+XMFLOAT4 ModelGameObject::GetBoundingSphere()
+{
+	XMFLOAT4X4* pWorld = GetTransform();
+	XMMATRIX world = XMLoadFloat4x4(pWorld);
+	float scale = XMVectorGetX(XMVectorMax(XMVector3Length(world.r[0]), XMVectorMax(XMVector3Length(world.r[1]), XMVector3Length(world.r[2]))));
+	return XMFLOAT4(pWorld->_41, pWorld->_42, pWorld->_43, (MODEL_BONE_LENGTH * MODEL_BONE_COUNT + MODEL_RADIUS) * scale);
+}
+
+void ModelGameObject::Submit(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info)
+{
+	m_pRootBone->Submit(pQueue, pBackend, info);
+	m_pSkinnedMesh->Submit(pQueue, pBackend, info);
 }
 
 void ModelGameObject::Update(float t, ID3D11DeviceContext* pContext)
@@ -28,7 +211,79 @@ void ModelGameObject::Update(ID3D11DeviceContext* pContext)
 	m_pRootBone->update(pContext);
 }
 
+void ModelGameObject::Animate(float deltaTime, ID3D11DeviceContext* pContext)
+{
+	m_pFrameArena->Reset();
+	Animation::EvaluateInstances(&m_instance, 1, deltaTime, *m_pFrameArena);
+	if (!m_instance.pLocalPose)
+		return;
+
+	// Pose the bones from the blended local transforms
+	for (int i = 0; i < MODEL_BONE_COUNT; ++i)
+	{
+		const BoneTransform& local = m_instance.pLocalPose[i];
+		m_skeleton[i]->SetOrientation(Quaternion(local.Rotation.w, local.Rotation.x, local.Rotation.y, local.Rotation.z));
+		m_skeleton[i]->SetLocalOffset(local.Translation);
+	}
+	m_skeleton[0]->UpdateSkeleton(XMMatrixIdentity());
+
+	if (m_ikEnabled)
+		SolveIK();
+
+	XMFLOAT4X4 skinTransforms[MODEL_BONE_COUNT];
+	for (int i = 0; i < MODEL_BONE_COUNT; ++i)
+	{
+		XMMATRIX skin = XMLoadFloat4x4(&m_inverseBindPose[i]) * XMLoadFloat4x4(m_skeleton[i]->GetSkeletonTransform());
+		XMStoreFloat4x4(&skinTransforms[i], skin);
+	}
+
+	Skinning::BuildPalette(skinTransforms, MODEL_BONE_COUNT, m_palette);
+	m_pSkinnedMesh->Skin(pContext, m_palette, m_pJobs);
+}
+
+void ModelGameObject::SolveIK()
+{
+	// Start from the animated pose so the solve only has to correct it
+	XMFLOAT3 joints[MODEL_BONE_COUNT + 1];
+	for (int i = 0; i < MODEL_BONE_COUNT; ++i)
+	{
+		XMMATRIX transform = XMLoadFloat4x4(m_skeleton[i]->GetSkeletonTransform());
+		XMStoreFloat3(&joints[i], transform.r[3]);
+		if (i == MODEL_BONE_COUNT - 1)
+			XMStoreFloat3(&joints[i + 1], XMVector3Transform(XMVectorSet(0.0f, MODEL_BONE_LENGTH, 0.0f, 0.0f), transform));
+	}
+	m_pIKChain->SetChain(0, joints);
+
+	// Target into model space
+	XMMATRIX world = XMLoadFloat4x4(m_pRootBone->getTransform());
+	XMFLOAT3 target;
+	XMStoreFloat3(&target, XMVector3Transform(XMLoadFloat3(&m_ikTarget), XMMatrixInverse(nullptr, world)));
+	m_pIKChain->SetTarget(0, target);
+
+	IKSettings settings;
+	IK::SolveFABRIK(*m_pIKChain, settings);
+	m_pIKChain->GetChain(0, joints);
+
+	XMFLOAT4 rotations[MODEL_BONE_COUNT + 1];
+	IK::PositionsToLocalRotations(m_restJoints, joints, MODEL_BONE_COUNT + 1, rotations);
+	for (int i = 0; i < MODEL_BONE_COUNT; ++i)
+	{
+		m_skeleton[i]->SetOrientation(Quaternion(rotations[i].w, rotations[i].x, rotations[i].y, rotations[i].z));
+	}
+	m_skeleton[0]->UpdateSkeleton(XMMatrixIdentity());
+}
+
+void ModelGameObject::SetStateCache(RenderStateCache* pStateCache)
+{
+	m_pRootBone->SetStateCache(pStateCache);
+	m_pSkinnedMesh->SetStateCache(pStateCache);
+}
+
 HRESULT ModelGameObject::InitMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext)
 {
-	return m_pRootBone->initMesh(pd3dDevice, pContext);
-}
\ No newline at end of file
+	HRESULT hr = m_pRootBone->initMesh(pd3dDevice, pContext);
+	if (FAILED(hr))
+		return hr;
+
+	return m_pSkinnedMesh->initMesh(pd3dDevice, pContext);
+}
@@ -1,20 +1,69 @@
 #pragma once
 #include "Bone.h"
+#include "SkinnedMesh.h"
+#include "BlendTree.h"
+#include "FrameArena.h"
+#include "IK.h"
+
+class JobSystem;
+
+#define MODEL_BONE_COUNT 3
 
 class ModelGameObject
 {
 public:
 	ModelGameObject() {}
-	ModelGameObject(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext);
+	ModelGameObject(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext, JobSystem* pJobs = nullptr);
 	~ModelGameObject();
 
 	void Draw(ID3D11DeviceContext* pContext);
+	void Submit(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info);
 	void Update(float t, ID3D11DeviceContext* pContext);
 	void Update(ID3D11DeviceContext* pContext);
 
+	// Poses the skeleton and skins the mesh on the CPU
+	void Animate(float deltaTime, ID3D11DeviceContext* pContext);
+
 	XMFLOAT4X4* GetTransform() { return m_pRootBone->getTransform(); }
+	XMFLOAT4X4* GetPreviousTransform() { return m_pRootBone->getPreviousTransform(); }
+	// World space sphere around the root, wide enough for any pose the chain can bend into
+	XMFLOAT4 GetBoundingSphere();
 	HRESULT	InitMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext);
+	void SetStateCache(RenderStateCache* pStateCache);
+
+	// 0/1 position in the idle/sway/bend blend space, 2 twist layer weight, 3 wave layer weight
+	float* GetBlendParameters() { return m_instance.Parameters; }
+
+	// Bends the chain so its tip reaches a world space point, e.g. the terrain below it
+	void SetIKTarget(XMFLOAT3 worldTarget, bool enabled) { m_ikTarget = worldTarget; m_ikEnabled = enabled; }
+
+	void SetSkinningMode(SkinningMode mode) { m_pSkinnedMesh->SetMode(mode); }
+	SkinningMode GetSkinningMode() { return m_pSkinnedMesh->GetMode(); }
 
 private:
+	void BuildSkeleton();
+	void BuildSkinnedMesh();
+	void BuildBlendTree();
+	void SolveIK();
+
 	Bone* m_pRootBone;
-};
\ No newline at end of file
+
+	// Skeleton bones in parent-first order, m_skeleton[0] is the skeleton root
+	Bone* m_skeleton[MODEL_BONE_COUNT];
+	XMFLOAT4X4 m_inverseBindPose[MODEL_BONE_COUNT];
+	SkinnedMesh* m_pSkinnedMesh;
+	SkinningPalette m_palette;
+	JobSystem* m_pJobs;
+
+	std::vector<AnimationClip*> m_clips;
+	BlendTree* m_pBlendTree;
+	FrameArena* m_pFrameArena;
+	int m_parents[MODEL_BONE_COUNT];
+	AnimationInstance m_instance;
+
+	// The chain's joints plus its tip
+	IKChainSet* m_pIKChain;
+	XMFLOAT3 m_restJoints[MODEL_BONE_COUNT + 1];
+	XMFLOAT3 m_ikTarget = { 0.0f, 0.0f, 0.0f };
+	bool m_ikEnabled = false;
+};
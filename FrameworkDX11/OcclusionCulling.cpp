@@ -0,0 +1,301 @@
+#include "OcclusionCulling.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <float.h>
+#include <math.h>
+
+// Boxes one job tests
+#define OCCLUSION_TEST_BATCH 64
+
+OcclusionBuffer::OcclusionBuffer()
+	: m_depths(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f), m_tileDepths(OCCLUSION_TILES_X * OCCLUSION_TILES_Y, 1.0f)
+{
+	XMStoreFloat4x4(&m_viewProjection, XMMatrixIdentity());
+}
+
+void OcclusionBuffer::Begin(const XMFLOAT4X4& viewProjection)
+{
+	m_viewProjection = viewProjection;
+	std::fill(m_depths.begin(), m_depths.end(), 1.0f);
+	std::fill(m_tileDepths.begin(), m_tileDepths.end(), 1.0f);
+	m_stats = {};
+}
+
+void OcclusionBuffer::SetupMesh(const OcclusionMesh& mesh, ScreenTriangle* triangles) const
+{
+	XMMATRIX transform = XMLoadFloat4x4(&mesh.World) * XMLoadFloat4x4(&m_viewProjection);
+	for (uint32_t t = 0; t < mesh.IndexCount / 3; ++t)
+	{
+		ScreenTriangle& triangle = triangles[t];
+		triangle.MinY = 1;
+		triangle.MaxY = 0;
+
+		float x[3], y[3], z[3];
+		bool clipped = false;
+		for (int v = 0; v < 3; ++v)
+		{
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&mesh.pVertices[mesh.pIndices[t * 3 + v]]), transform));
+			clipped |= clip.z < 0.0f;
+			float w = clip.w > 0.0f ? clip.w : 1.0f;
+			x[v] = (clip.x / w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+			y[v] = (0.5f - clip.y / w * 0.5f) * OCCLUSION_HEIGHT;
+			z[v] = clip.z / w;
+		}
+		if (clipped)
+			continue;
+
+		// Either way round, an occluder hides things from both sides
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (fabsf(area) < 1e-6f)
+			continue;
+		if (area < 0.0f)
+		{
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(z[1], z[2]);
+			area = -area;
+		}
+
+		// Pixel centres are at half pixels
+		triangle.MinX = std::max((int)ceilf(std::min(x[0], std::min(x[1], x[2])) - 0.5f), 0);
+		triangle.MaxX = std::min((int)floorf(std::max(x[0], std::max(x[1], x[2])) - 0.5f), OCCLUSION_WIDTH - 1);
+		int minY = std::max((int)ceilf(std::min(y[0], std::min(y[1], y[2])) - 0.5f), 0);
+		int maxY = std::min((int)floorf(std::max(y[0], std::max(y[1], y[2])) - 0.5f), OCCLUSION_HEIGHT - 1);
+		if (triangle.MinX > triangle.MaxX || minY > maxY)
+			continue;
+
+		for (int e = 0; e < 3; ++e)
+		{
+			int a = e, b = (e + 1) % 3;
+			float edgeA = y[a] - y[b];
+			float edgeB = x[b] - x[a];
+			triangle.Edges[e][0] = edgeA;
+			triangle.Edges[e][1] = edgeB;
+			triangle.Edges[e][2] = -edgeA * x[a] - edgeB * y[a];
+		}
+
+		// Depth is planar in screen space, moved to the far corner of each pixel
+		float depthX = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+		float depthY = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+		triangle.Depth[0] = depthX;
+		triangle.Depth[1] = depthY;
+		triangle.Depth[2] = z[0] - depthX * x[0] - depthY * y[0] + 0.5f * (fabsf(depthX) + fabsf(depthY));
+		triangle.MaxDepth = std::max(z[0], std::max(z[1], z[2]));
+		triangle.MinY = minY;
+		triangle.MaxY = maxY;
+	}
+}
+
+void OcclusionBuffer::Rasterize(const OcclusionMesh* meshes, size_t count, JobSystem* pJobs)
+{
+	m_meshOffsets.resize(count + 1);
+	m_meshOffsets[0] = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		m_meshOffsets[i + 1] = m_meshOffsets[i] + meshes[i].IndexCount / 3;
+	}
+	m_triangles.resize(m_meshOffsets[count]);
+	m_stats.Occluders += (uint32_t)count;
+
+	if (pJobs)
+	{
+		pJobs->ParallelFor(count, 1, [this, meshes](size_t begin, size_t end, unsigned)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				SetupMesh(meshes[i], m_triangles.data() + m_meshOffsets[i]);
+			}
+		});
+	}
+	else
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			SetupMesh(meshes[i], m_triangles.data() + m_meshOffsets[i]);
+		}
+	}
+
+	// Every band a triangle's rows reach, in mesh order
+	for (std::vector<uint32_t>& bin : m_bins)
+	{
+		bin.clear();
+	}
+	for (uint32_t t = 0; t < m_triangles.size(); ++t)
+	{
+		const ScreenTriangle& triangle = m_triangles[t];
+		if (triangle.MinY > triangle.MaxY)
+			continue;
+		++m_stats.Triangles;
+		for (int band = triangle.MinY / OCCLUSION_TILE_SIZE; band <= triangle.MaxY / OCCLUSION_TILE_SIZE; ++band)
+		{
+			m_bins[band].push_back(t);
+		}
+	}
+
+	if (pJobs)
+	{
+		pJobs->ParallelFor(OCCLUSION_TILES_Y, 1, [this](size_t begin, size_t end, unsigned)
+		{
+			for (size_t band = begin; band < end; ++band)
+			{
+				RasterizeBand((uint32_t)band);
+			}
+		});
+	}
+	else
+	{
+		for (uint32_t band = 0; band < OCCLUSION_TILES_Y; ++band)
+		{
+			RasterizeBand(band);
+		}
+	}
+}
+
+void OcclusionBuffer::RasterizeBand(uint32_t band)
+{
+	int top = band * OCCLUSION_TILE_SIZE;
+	int bottom = top + OCCLUSION_TILE_SIZE - 1;
+	const XMVECTOR laneX = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	const XMVECTOR zero = XMVectorZero();
+	for (uint32_t index : m_bins[band])
+	{
+		const ScreenTriangle& triangle = m_triangles[index];
+		XMVECTOR edgeA[3], edgeRow[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			edgeA[e] = XMVectorReplicate(triangle.Edges[e][0]);
+		}
+		XMVECTOR depthA = XMVectorReplicate(triangle.Depth[0]);
+		XMVECTOR maxDepth = XMVectorReplicate(triangle.MaxDepth);
+
+		int firstX = triangle.MinX & ~3;
+		for (int y = std::max(triangle.MinY, top); y <= std::min(triangle.MaxY, bottom); ++y)
+		{
+			float centreY = y + 0.5f;
+			for (int e = 0; e < 3; ++e)
+			{
+				edgeRow[e] = XMVectorReplicate(triangle.Edges[e][1] * centreY + triangle.Edges[e][2]);
+			}
+			XMVECTOR depthRow = XMVectorReplicate(triangle.Depth[1] * centreY + triangle.Depth[2]);
+
+			float* row = m_depths.data() + y * OCCLUSION_WIDTH;
+			for (int x = firstX; x <= triangle.MaxX; x += 4)
+			{
+				XMVECTOR centreX = XMVectorAdd(laneX, XMVectorReplicate((float)x));
+				XMVECTOR inside = XMVectorGreaterOrEqual(XMVectorMultiplyAdd(edgeA[0], centreX, edgeRow[0]), zero);
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(edgeA[1], centreX, edgeRow[1]), zero));
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(edgeA[2], centreX, edgeRow[2]), zero));
+				if (XMVector4EqualInt(inside, XMVectorFalseInt()))
+					continue;
+
+				XMVECTOR depth = XMVectorMin(XMVectorMultiplyAdd(depthA, centreX, depthRow), maxDepth);
+				XMFLOAT4* pixels = reinterpret_cast<XMFLOAT4*>(row + x);
+				XMVECTOR current = XMLoadFloat4(pixels);
+				XMStoreFloat4(pixels, XMVectorSelect(current, XMVectorMin(current, depth), inside));
+			}
+		}
+	}
+
+	// The farthest depth left in each of the band's tiles
+	for (int tile = 0; tile < OCCLUSION_TILES_X; ++tile)
+	{
+		XMVECTOR farthest = zero;
+		for (int y = top; y <= bottom; ++y)
+		{
+			const float* row = m_depths.data() + y * OCCLUSION_WIDTH + tile * OCCLUSION_TILE_SIZE;
+			for (int x = 0; x < OCCLUSION_TILE_SIZE; x += 4)
+			{
+				farthest = XMVectorMax(farthest, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row + x)));
+			}
+		}
+		XMFLOAT4 lanes;
+		XMStoreFloat4(&lanes, farthest);
+		m_tileDepths[band * OCCLUSION_TILES_X + tile] = std::max(std::max(lanes.x, lanes.y), std::max(lanes.z, lanes.w));
+	}
+}
+
+bool OcclusionBuffer::IsVisible(const OcclusionBounds& bounds) const
+{
+	// The box's screen rectangle and its nearest depth
+	XMMATRIX viewProjection = XMLoadFloat4x4(&m_viewProjection);
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		XMVECTOR position = XMVectorSet(corner & 1 ? bounds.Max.x : bounds.Min.x, corner & 2 ? bounds.Max.y : bounds.Min.y,
+			corner & 4 ? bounds.Max.z : bounds.Min.z, 1.0f);
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector4Transform(position, viewProjection));
+		if (clip.z < 0.0f || clip.w <= 0.0f)
+			return true;
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float y = (0.5f - clip.y / clip.w * 0.5f) * OCCLUSION_HEIGHT;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip.z / clip.w);
+	}
+
+	// Every pixel the rectangle touches
+	int left = std::max((int)floorf(minX), 0), right = std::min((int)floorf(maxX), OCCLUSION_WIDTH - 1);
+	int top = std::max((int)floorf(minY), 0), bottom = std::min((int)floorf(maxY), OCCLUSION_HEIGHT - 1);
+	if (left > right || top > bottom)
+		return true;
+
+	for (int tileY = top / OCCLUSION_TILE_SIZE; tileY <= bottom / OCCLUSION_TILE_SIZE; ++tileY)
+	{
+		for (int tileX = left / OCCLUSION_TILE_SIZE; tileX <= right / OCCLUSION_TILE_SIZE; ++tileX)
+		{
+			if (m_tileDepths[tileY * OCCLUSION_TILES_X + tileX] < nearest)
+				continue;
+
+			// Only part of this tile is in front, down to its pixels
+			int fromY = std::max(top, tileY * OCCLUSION_TILE_SIZE), toY = std::min(bottom, tileY * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+			int fromX = std::max(left, tileX * OCCLUSION_TILE_SIZE), toX = std::min(right, tileX * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+			for (int y = fromY; y <= toY; ++y)
+			{
+				const float* row = m_depths.data() + y * OCCLUSION_WIDTH;
+				for (int x = fromX; x <= toX; ++x)
+				{
+					if (row[x] >= nearest)
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+uint32_t OcclusionBuffer::Test(const OcclusionBounds* bounds, size_t count, uint8_t* visible, JobSystem* pJobs)
+{
+	auto testRange = [&](size_t begin, size_t end)
+	{
+		uint32_t occluded = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			visible[i] = IsVisible(bounds[i]) ? 1 : 0;
+			occluded += 1 - visible[i];
+		}
+		return occluded;
+	};
+
+	uint32_t occluded = 0;
+	if (!pJobs || count <= OCCLUSION_TEST_BATCH)
+	{
+		occluded = testRange(0, count);
+	}
+	else
+	{
+		std::atomic<uint32_t> total(0);
+		pJobs->ParallelFor(count, OCCLUSION_TEST_BATCH, [&](size_t begin, size_t end, unsigned)
+		{
+			total.fetch_add(testRange(begin, end), std::memory_order_relaxed);
+		});
+		occluded = total.load();
+	}
+	m_stats.Tested += (uint32_t)count;
+	m_stats.Occluded += occluded;
+	return occluded;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace DirectX;
+
+class JobSystem;
+
+// The CPU depth buffer's size whatever the window's, rows a multiple of four pixels wide
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+// Pixels along each side of a tile: the coarse level of the hierarchy, and a row of
+// tiles is the band one job rasterises
+#define OCCLUSION_TILE_SIZE 8
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_SIZE)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_SIZE)
+
+// Triangles drawn into the buffer. They must lie inside whatever they stand for, so
+// something they hide really is hidden: the terrain's occluders sit under its surface.
+struct OcclusionMesh
+{
+	const XMFLOAT3*	pVertices;	// model space
+	const uint32_t*	pIndices;	// three per triangle
+	uint32_t		IndexCount;
+	XMFLOAT4X4		World;		// row vectors
+};
+
+// World space box around something that might be hidden
+struct OcclusionBounds
+{
+	XMFLOAT3	Min;
+	XMFLOAT3	Max;
+};
+
+struct OcclusionStats
+{
+	uint32_t	Occluders;
+	uint32_t	Triangles;	// made it past the near plane and into a band
+	uint32_t	Tested;
+	uint32_t	Occluded;
+};
+
+// Software occlusion culling: occluders are rasterised on the CPU into a small depth
+// buffer, then boxes are tested against it before their objects are submitted.
+// Occluder triangles are transformed and set up per mesh, binned into bands of tile
+// rows and each band is rasterised by one job, four pixels at a time in SIMD lanes.
+// Each pixel keeps the nearest occluder depth and each tile the farthest of its
+// pixels, so a box is rejected a whole tile at a time where it can be and a pixel at
+// a time where it can't. Depth is sampled at pixel centres and pushed back to the
+// farthest the triangle gets within the pixel. Triangles crossing the near plane are
+// dropped rather than clipped, which only ever hides less.
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer();
+
+	// Clears to the far plane. Row vector view projection with D3D's 0 to 1 clip depth.
+	void Begin(const XMFLOAT4X4& viewProjection);
+
+	// Draws the meshes into the buffer and rebuilds the tiles, split across the job system's threads
+	void Rasterize(const OcclusionMesh* meshes, size_t count, JobSystem* pJobs = nullptr);
+
+	// Sets visible[i] to 0 for every box hidden behind the occluders, 1 otherwise, and
+	// returns how many were hidden. Boxes crossing the near plane or off screen are visible.
+	uint32_t Test(const OcclusionBounds* bounds, size_t count, uint8_t* visible, JobSystem* pJobs = nullptr);
+	bool IsVisible(const OcclusionBounds& bounds) const;
+
+	// OCCLUSION_WIDTH x OCCLUSION_HEIGHT nearest depths, top row first
+	const float* GetDepths() const { return m_depths.data(); }
+	// OCCLUSION_TILES_X x OCCLUSION_TILES_Y farthest depths
+	const float* GetTileDepths() const { return m_tileDepths.data(); }
+	const OcclusionStats& GetStats() const { return m_stats; }
+
+private:
+	// Screen space, edge functions A x + B y + C are positive inside
+	struct ScreenTriangle
+	{
+		float		Edges[3][3];
+		float		Depth[3];		// the pixel's farthest depth is A x + B y + C at its centre
+		float		MaxDepth;		// no pixel's goes past the farthest vertex
+		int			MinX, MaxX;		// pixels whose centres it can cover, MinY > MaxY if none
+		int			MinY, MaxY;
+	};
+
+	void SetupMesh(const OcclusionMesh& mesh, ScreenTriangle* triangles) const;
+	void RasterizeBand(uint32_t band);
+
+	XMFLOAT4X4						m_viewProjection;
+	std::vector<float>				m_depths;
+	std::vector<float>				m_tileDepths;
+	std::vector<ScreenTriangle>		m_triangles;
+	std::vector<size_t>				m_meshOffsets;
+	std::vector<uint32_t>			m_bins[OCCLUSION_TILES_Y];
+	OcclusionStats					m_stats = {};
+};
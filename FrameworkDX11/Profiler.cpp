@@ -0,0 +1,345 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+
+struct ProfilerThread
+{
+	ProfilerEvent				Events[PROFILER_RING_EVENTS];
+	std::atomic<uint64_t>		Write;
+	std::atomic<uint64_t>		Read;
+	std::atomic<uint64_t>		Dropped;
+	std::atomic<bool>			InUse;
+	std::atomic<const char*>	Name;
+	uint32_t					Index;
+
+	// Only touched by the owning thread
+	const char*					StackNames[PROFILER_MAX_DEPTH];
+	uint64_t					StackBegins[PROFILER_MAX_DEPTH];
+	uint32_t					Depth;
+};
+
+// Hands the ring back when its thread exits, so short lived pools don't use up the slots
+struct ProfilerThreadSlot
+{
+	ProfilerThread* pThread = nullptr;
+	~ProfilerThreadSlot()
+	{
+		if (pThread)
+			pThread->InUse.store(false, std::memory_order_release);
+	}
+};
+
+// The mutex is only for registering a thread, the first time it opens a zone
+static std::mutex g_profilerMutex;
+static ProfilerThread* g_profilerThreads[PROFILER_MAX_THREADS];
+static std::atomic<uint32_t> g_profilerThreadCount(0);
+static thread_local ProfilerThreadSlot t_profilerThread;
+
+// Changes take effect at EndFrame so no zone begins enabled and ends disabled
+static std::atomic<bool> g_profilerEnabled(true);
+static bool g_profilerPendingEnabled = true;
+
+static std::vector<ProfilerEvent> g_frameEvents;
+static std::vector<ProfilerNode> g_frameTree;
+static std::vector<ProfilerEvent> g_captureEvents;
+static uint32_t g_captureFramesLeft = 0;
+static std::string g_capturePath;
+
+static ProfilerThread* GetProfilerThread()
+{
+	if (t_profilerThread.pThread)
+		return t_profilerThread.pThread;
+
+	std::lock_guard<std::mutex> lock(g_profilerMutex);
+	uint32_t count = g_profilerThreadCount.load(std::memory_order_relaxed);
+	ProfilerThread* pThread = nullptr;
+	for (uint32_t i = 0; i < count && !pThread; ++i)
+	{
+		if (!g_profilerThreads[i]->InUse.load(std::memory_order_acquire))
+			pThread = g_profilerThreads[i];
+	}
+
+	if (!pThread)
+	{
+		if (count == PROFILER_MAX_THREADS)
+			return nullptr;
+		pThread = new ProfilerThread();
+		pThread->Write = 0;
+		pThread->Read = 0;
+		pThread->Dropped = 0;
+		pThread->Index = count;
+		g_profilerThreads[count] = pThread;
+		g_profilerThreadCount.store(count + 1, std::memory_order_release);
+	}
+
+	pThread->InUse.store(true, std::memory_order_relaxed);
+	pThread->Name.store(nullptr, std::memory_order_relaxed);
+	pThread->Depth = 0;
+	t_profilerThread.pThread = pThread;
+	return pThread;
+}
+
+uint64_t Profiler::Now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Begin(const char* name)
+{
+	if (!g_profilerEnabled.load(std::memory_order_relaxed))
+		return;
+	ProfilerThread* pThread = GetProfilerThread();
+	if (!pThread)
+		return;
+
+	// Zones deeper than the stack still nest correctly, they just aren't recorded
+	if (pThread->Depth < PROFILER_MAX_DEPTH)
+	{
+		pThread->StackNames[pThread->Depth] = name;
+		pThread->StackBegins[pThread->Depth] = Now();
+	}
+	++pThread->Depth;
+}
+
+void Profiler::End()
+{
+	if (!g_profilerEnabled.load(std::memory_order_relaxed))
+		return;
+	ProfilerThread* pThread = t_profilerThread.pThread;
+	if (!pThread || pThread->Depth == 0)
+		return;
+
+	uint64_t end = Now();
+	uint32_t depth = --pThread->Depth;
+	if (depth >= PROFILER_MAX_DEPTH)
+		return;
+
+	uint64_t write = pThread->Write.load(std::memory_order_relaxed);
+	if (write - pThread->Read.load(std::memory_order_acquire) >= PROFILER_RING_EVENTS)
+	{
+		pThread->Dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	ProfilerEvent& event = pThread->Events[write % PROFILER_RING_EVENTS];
+	event.Name = pThread->StackNames[depth];
+	event.Begin = pThread->StackBegins[depth];
+	event.End = end;
+	event.Depth = depth;
+	event.Thread = pThread->Index;
+	pThread->Write.store(write + 1, std::memory_order_release);
+}
+
+void Profiler::SetEnabled(bool enabled)
+{
+	g_profilerPendingEnabled = enabled;
+}
+
+bool Profiler::IsEnabled()
+{
+	return g_profilerPendingEnabled;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	ProfilerThread* pThread = GetProfilerThread();
+	if (pThread)
+		pThread->Name.store(name, std::memory_order_relaxed);
+}
+
+size_t Profiler::EndFrame()
+{
+	g_profilerEnabled.store(g_profilerPendingEnabled, std::memory_order_relaxed);
+
+	g_frameEvents.clear();
+	uint32_t count = g_profilerThreadCount.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		ProfilerThread* pThread = g_profilerThreads[i];
+		uint64_t write = pThread->Write.load(std::memory_order_acquire);
+		for (uint64_t read = pThread->Read.load(std::memory_order_relaxed); read < write; ++read)
+		{
+			g_frameEvents.push_back(pThread->Events[read % PROFILER_RING_EVENTS]);
+		}
+		pThread->Read.store(write, std::memory_order_release);
+	}
+
+	BuildTree(g_frameEvents, g_frameTree);
+
+	if (g_captureFramesLeft > 0)
+	{
+		g_captureEvents.insert(g_captureEvents.end(), g_frameEvents.begin(), g_frameEvents.end());
+		if (--g_captureFramesLeft == 0)
+		{
+			std::ofstream file(g_capturePath);
+			WriteChromeTrace(file, g_captureEvents);
+			g_captureEvents.clear();
+		}
+	}
+	return g_frameEvents.size();
+}
+
+const std::vector<ProfilerEvent>& Profiler::GetFrameEvents()
+{
+	return g_frameEvents;
+}
+
+const std::vector<ProfilerNode>& Profiler::GetFrameTree()
+{
+	return g_frameTree;
+}
+
+uint64_t Profiler::GetDroppedEvents()
+{
+	uint64_t dropped = 0;
+	uint32_t count = g_profilerThreadCount.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		dropped += g_profilerThreads[i]->Dropped.load(std::memory_order_relaxed);
+	}
+	return dropped;
+}
+
+void Profiler::StartCapture(uint32_t frames, const std::string& path)
+{
+	g_captureEvents.clear();
+	g_captureFramesLeft = frames;
+	g_capturePath = path;
+}
+
+uint32_t Profiler::GetCaptureFramesLeft()
+{
+	return g_captureFramesLeft;
+}
+
+static void WriteJsonString(std::ostream& stream, const char* text)
+{
+	stream << '"';
+	for (const char* c = text; *c; ++c)
+	{
+		if (*c == '"' || *c == '\\')
+			stream << '\\' << *c;
+		else if ((unsigned char)*c < 0x20)
+			stream << ' ';
+		else
+			stream << *c;
+	}
+	stream << '"';
+}
+
+bool Profiler::WriteChromeTrace(std::ostream& stream, const std::vector<ProfilerEvent>& events)
+{
+	uint64_t origin = ~0ull;
+	uint32_t threads = 0;
+	for (const ProfilerEvent& event : events)
+	{
+		origin = std::min(origin, event.Begin);
+		threads = std::max(threads, event.Thread + 1);
+	}
+
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	uint32_t registered = g_profilerThreadCount.load(std::memory_order_acquire);
+	for (uint32_t thread = 0; thread < threads; ++thread)
+	{
+		const char* name = thread < registered ? g_profilerThreads[thread]->Name.load(std::memory_order_relaxed) : nullptr;
+		std::string fallback = "Thread " + std::to_string(thread);
+		stream << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"name\":";
+		WriteJsonString(stream, name ? name : fallback.c_str());
+		stream << "}}";
+		first = false;
+	}
+
+	// Microseconds with nanosecond decimals, relative to the earliest zone
+	stream.setf(std::ios::fixed);
+	stream.precision(3);
+	for (const ProfilerEvent& event : events)
+	{
+		stream << (first ? "\n" : ",\n") << "{\"name\":";
+		WriteJsonString(stream, event.Name);
+		stream << ",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":" << (event.Begin - origin) / 1000.0 << ",\"dur\":" << (event.End - event.Begin) / 1000.0
+			<< ",\"pid\":1,\"tid\":" << event.Thread << "}";
+		first = false;
+	}
+	stream << "\n]}\n";
+	return !stream.fail();
+}
+
+static void AppendDepthFirst(const std::vector<ProfilerNode>& nodes, const std::vector<std::vector<int32_t>>& children, int32_t node, int32_t parent, std::vector<ProfilerNode>& tree)
+{
+	int32_t index = (int32_t)tree.size();
+	tree.push_back(nodes[node]);
+	tree.back().Parent = parent;
+	for (int32_t child : children[node])
+	{
+		AppendDepthFirst(nodes, children, child, index, tree);
+	}
+}
+
+void Profiler::BuildTree(std::vector<ProfilerEvent>& events, std::vector<ProfilerNode>& tree)
+{
+	// Parents begin no later than their children, and at a lower depth when they tie
+	std::sort(events.begin(), events.end(), [](const ProfilerEvent& a, const ProfilerEvent& b)
+	{
+		if (a.Thread != b.Thread)
+			return a.Thread < b.Thread;
+		if (a.Begin != b.Begin)
+			return a.Begin < b.Begin;
+		return a.Depth < b.Depth;
+	});
+
+	std::vector<ProfilerNode> nodes;
+	std::vector<std::vector<int32_t>> children;
+	std::vector<int32_t> roots;
+	std::vector<int32_t> stack;
+	uint32_t thread = ~0u;
+	for (const ProfilerEvent& event : events)
+	{
+		if (event.Thread != thread)
+		{
+			thread = event.Thread;
+			stack.clear();
+		}
+		stack.resize(std::min<size_t>(stack.size(), event.Depth));
+		int32_t parent = stack.empty() ? -1 : stack.back();
+
+		// Same name under the same parent merges, whichever thread it came from
+		std::vector<int32_t>& siblings = parent < 0 ? roots : children[parent];
+		int32_t node = -1;
+		for (int32_t sibling : siblings)
+		{
+			if (strcmp(nodes[sibling].Name, event.Name) == 0)
+			{
+				node = sibling;
+				break;
+			}
+		}
+		if (node < 0)
+		{
+			node = (int32_t)nodes.size();
+			ProfilerNode created = { event.Name, parent < 0 ? 0 : nodes[parent].Depth + 1, parent, 0, 0.0, 0.0 };
+			nodes.push_back(created);
+			children.emplace_back();
+			(parent < 0 ? roots : children[parent]).push_back(node);
+		}
+
+		double milliseconds = (event.End - event.Begin) / 1000000.0;
+		nodes[node].Calls += 1;
+		nodes[node].TotalMilliseconds += milliseconds;
+		nodes[node].SelfMilliseconds += milliseconds;
+		if (parent >= 0)
+			nodes[parent].SelfMilliseconds -= milliseconds;
+		stack.push_back(node);
+	}
+
+	tree.clear();
+	for (int32_t root : roots)
+	{
+		AppendDepthFirst(nodes, children, root, -1, tree);
+	}
+}
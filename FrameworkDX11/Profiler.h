@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#define PROFILER_RING_EVENTS 16384
+#define PROFILER_MAX_DEPTH 32
+#define PROFILER_MAX_THREADS 64
+#define PROFILER_TRACE_FILE "profile_trace.json"
+
+// A finished zone. Names are not copied, so they must outlive the profiler
+// (string literals, or the pass names the command recorder keeps).
+struct ProfilerEvent
+{
+	const char*	Name;
+	uint64_t	Begin;
+	uint64_t	End;
+	uint32_t	Depth;
+	uint32_t	Thread;
+};
+
+// One entry of a frame's zone tree. Zones with the same name under the same parent
+// are merged whichever thread ran them, so Calls counts how many were merged.
+struct ProfilerNode
+{
+	const char*	Name;
+	uint32_t	Depth;
+	int32_t		Parent;
+	uint32_t	Calls;
+	double		TotalMilliseconds;
+	double		SelfMilliseconds;
+};
+
+// Scoped CPU zones. Each thread writes finished zones into its own ring with no
+// locks: the owning thread is the only writer and EndFrame, on the main thread, the
+// only reader. A full ring drops zones and counts them rather than waiting.
+// Timestamps are steady clock nanoseconds, which MSVC reads with QueryPerformanceCounter.
+class Profiler
+{
+public:
+	static uint64_t Now();
+
+	static void Begin(const char* name);
+	static void End();
+
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled();
+
+	// Shown in the trace instead of "Thread <n>", the name must outlive the profiler
+	static void SetThreadName(const char* name);
+
+	// Main thread, outside any zone: collects every thread's zones since the last call
+	// and builds the frame tree. Returns the number of zones collected.
+	static size_t EndFrame();
+
+	static const std::vector<ProfilerEvent>& GetFrameEvents();
+
+	// Depth first, children straight after their parent
+	static const std::vector<ProfilerNode>& GetFrameTree();
+
+	static uint64_t GetDroppedEvents();
+
+	// Keeps the zones of the next frames and writes them as a Chrome trace when done
+	static void StartCapture(uint32_t frames, const std::string& path = PROFILER_TRACE_FILE);
+	static uint32_t GetCaptureFramesLeft();
+
+	// Chrome trace event JSON, opens in chrome://tracing and Perfetto
+	static bool WriteChromeTrace(std::ostream& stream, const std::vector<ProfilerEvent>& events);
+	static void BuildTree(std::vector<ProfilerEvent>& events, std::vector<ProfilerNode>& tree);
+};
+
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name) { Profiler::Begin(name); }
+	~ProfileScope() { Profiler::End(); }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profileZone, __LINE__)(name)
@@ -20,8 +20,7 @@
 
 #include <float.h>
 #include <math.h>
-#include <directxmath.h>
-#include <d3d11_1.h>
+#include <DirectXMath.h>
 
 using namespace DirectX;
 
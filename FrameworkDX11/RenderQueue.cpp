@@ -0,0 +1,185 @@
+#include "RenderQueue.h"
+#include <string.h>
+
+#define DRAW_KEY_PASS_SHIFT 60
+#define DRAW_KEY_LAYER_SHIFT 58
+
+static uint64_t KeyField(uint32_t value, uint32_t bits, uint32_t shift)
+{
+	return (uint64_t)(value & ((1u << bits) - 1)) << shift;
+}
+
+uint32_t DrawKey::QuantizeDepth(float depth, float maxDepth)
+{
+	const uint32_t depthMax = (1u << DRAW_KEY_DEPTH_BITS) - 1;
+	if (!(depth > 0.0f) || maxDepth <= 0.0f)
+		return 0;
+	if (depth >= maxDepth)
+		return depthMax;
+	return (uint32_t)(depth / maxDepth * depthMax);
+}
+
+uint64_t DrawKey::Make(uint32_t pass, RenderLayer layer, uint32_t shader, uint32_t material, uint32_t depth)
+{
+	uint64_t key = KeyField(pass, DRAW_KEY_PASS_BITS, DRAW_KEY_PASS_SHIFT) | KeyField(layer, 2, DRAW_KEY_LAYER_SHIFT);
+	if (layer == RenderLayerOpaque || layer == RenderLayerCutout)
+	{
+		// State first, depth only breaks ties so nearby draws can still reject pixels early
+		key |= KeyField(shader, DRAW_KEY_SHADER_BITS, 48);
+		key |= KeyField(material, DRAW_KEY_MATERIAL_BITS, 32);
+		key |= KeyField(depth, DRAW_KEY_DEPTH_BITS, 8);
+	}
+	else
+	{
+		// Blending needs far to near whatever it costs in state changes
+		uint32_t inverted = ((1u << DRAW_KEY_DEPTH_BITS) - 1) - (depth & ((1u << DRAW_KEY_DEPTH_BITS) - 1));
+		key |= KeyField(inverted, DRAW_KEY_DEPTH_BITS, 34);
+		key |= KeyField(shader, DRAW_KEY_SHADER_BITS, 24);
+		key |= KeyField(material, DRAW_KEY_MATERIAL_BITS, 8);
+	}
+	return key;
+}
+
+uint32_t DrawKey::GetPass(uint64_t key)
+{
+	return (uint32_t)(key >> DRAW_KEY_PASS_SHIFT);
+}
+
+RenderLayer DrawKey::GetLayer(uint64_t key)
+{
+	return (RenderLayer)((key >> DRAW_KEY_LAYER_SHIFT) & 3);
+}
+
+void RenderStateFilter::Reset()
+{
+	m_shader = ~0u;
+	m_material = ~0u;
+	m_mesh = ~0u;
+	m_object = ~0u;
+}
+
+uint32_t RenderStateFilter::Filter(const RenderPacket& packet)
+{
+	uint32_t changes = 0;
+	if (packet.Shader != m_shader)
+	{
+		m_shader = packet.Shader;
+		changes |= RenderChangeShader;
+		++m_stats.ShaderBinds;
+	}
+	if (packet.Material != m_material)
+	{
+		m_material = packet.Material;
+		changes |= RenderChangeMaterial;
+		++m_stats.MaterialBinds;
+	}
+	if (packet.Mesh != m_mesh)
+	{
+		m_mesh = packet.Mesh;
+		changes |= RenderChangeMesh;
+		++m_stats.MeshBinds;
+	}
+	if (packet.Object != m_object)
+	{
+		m_object = packet.Object;
+		changes |= RenderChangeObject;
+		++m_stats.ObjectBinds;
+	}
+
+	// Four bindable parts per packet, count the ones that were already in place
+	uint32_t bound = 0;
+	for (uint32_t bits = changes; bits; bits &= bits - 1)
+		++bound;
+	m_stats.SkippedBinds += 4 - bound;
+	++m_stats.Packets;
+	return changes;
+}
+
+void RenderQueue::Reserve(size_t count)
+{
+	m_packets.reserve(count);
+	m_order.reserve(count);
+	m_scratch.reserve(count);
+}
+
+void RenderQueue::Clear()
+{
+	m_packets.clear();
+	m_order.clear();
+	m_sorted = true;
+}
+
+void RenderQueue::Sort()
+{
+	size_t count = m_packets.size();
+	m_order.resize(count);
+	m_scratch.resize(count);
+
+	// All eight byte histograms in one read of the keys
+	uint32_t histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint64_t key = m_packets[i].Key;
+		m_order[i] = { key, (uint32_t)i };
+		for (int b = 0; b < 8; ++b)
+			++histograms[b][(key >> (b * 8)) & 0xff];
+	}
+
+	SortEntry* pSource = m_order.data();
+	SortEntry* pDest = m_scratch.data();
+	for (int b = 0; b < 8; ++b)
+	{
+		uint32_t* histogram = histograms[b];
+		uint32_t shift = b * 8;
+
+		// Every key shares this byte, the pass would not move anything
+		if (count == 0 || histogram[(pSource[0].Key >> shift) & 0xff] == count)
+			continue;
+
+		uint32_t offsets[256];
+		uint32_t sum = 0;
+		for (int d = 0; d < 256; ++d)
+		{
+			offsets[d] = sum;
+			sum += histogram[d];
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const SortEntry& entry = pSource[i];
+			pDest[offsets[(entry.Key >> shift) & 0xff]++] = entry;
+		}
+
+		SortEntry* pSwap = pSource;
+		pSource = pDest;
+		pDest = pSwap;
+	}
+
+	// An odd number of passes leaves the result in the scratch buffer
+	if (pSource != m_order.data())
+		m_order.swap(m_scratch);
+
+	m_sorted = true;
+}
+
+void RenderQueue::Execute(RenderBackend& backend, RenderStateFilter& filter)
+{
+	if (!m_sorted || m_order.size() != m_packets.size())
+		Sort();
+
+	for (const SortEntry& entry : m_order)
+	{
+		const RenderPacket& packet = m_packets[entry.Index];
+		uint32_t changes = filter.Filter(packet);
+		if (changes & RenderChangeShader)
+			backend.BindShader(packet.Shader);
+		if (changes & RenderChangeMaterial)
+			backend.BindMaterial(packet.Material);
+		if (changes & RenderChangeMesh)
+			backend.BindMesh(packet.Mesh);
+		if (changes & RenderChangeObject)
+			backend.BindObject(packet.Object);
+		backend.Draw(packet);
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// 64-bit sort key, most significant field first:
+//   63..60 pass, 59..58 layer, then for opaque and cutout layers
+//   57..48 shader, 47..32 material, 31..8 depth (front to back), 7..0 unused
+//   and for the transparent and overlay layers
+//   57..34 inverted depth (back to front), 33..24 shader, 23..8 material
+enum RenderLayer
+{
+	RenderLayerOpaque = 0,
+	RenderLayerCutout,
+	RenderLayerTransparent,
+	RenderLayerOverlay
+};
+
+#define DRAW_KEY_PASS_BITS 4
+#define DRAW_KEY_SHADER_BITS 10
+#define DRAW_KEY_MATERIAL_BITS 16
+#define DRAW_KEY_DEPTH_BITS 24
+
+namespace DrawKey
+{
+	// Depth in [0, maxDepth] to 24 bits, clamped
+	uint32_t QuantizeDepth(float depth, float maxDepth);
+
+	uint64_t Make(uint32_t pass, RenderLayer layer, uint32_t shader, uint32_t material, uint32_t depth);
+
+	uint32_t GetPass(uint64_t key);
+	RenderLayer GetLayer(uint64_t key);
+}
+
+// One draw. Shader, material, mesh and object are indices the backend resolves,
+// so the queue itself never sees the device.
+struct RenderPacket
+{
+	uint64_t	Key;
+	uint32_t	Shader;
+	uint32_t	Material;
+	uint32_t	Mesh;
+	uint32_t	Object;
+	uint32_t	VertexCount;
+	uint32_t	StartVertex;
+};
+
+// What a drawable needs from the caller to build its packets
+struct RenderSubmitInfo
+{
+	uint32_t	Pass;
+	RenderLayer	Layer;
+	uint32_t	Shader;
+	uint32_t	Object;
+	uint32_t	Depth;
+};
+
+enum RenderStateChange
+{
+	RenderChangeShader = 1 << 0,
+	RenderChangeMaterial = 1 << 1,
+	RenderChangeMesh = 1 << 2,
+	RenderChangeObject = 1 << 3
+};
+
+struct RenderQueueStats
+{
+	uint32_t	Packets;
+	uint32_t	ShaderBinds;
+	uint32_t	MaterialBinds;
+	uint32_t	MeshBinds;
+	uint32_t	ObjectBinds;
+	uint32_t	SkippedBinds;
+};
+
+// Remembers what is bound and reports only the parts of a packet that differ
+class RenderStateFilter
+{
+public:
+	// Forget the bound state, e.g. after other code touched the context
+	void Reset();
+
+	// Returns the RenderStateChange bits that must be bound before drawing packet
+	uint32_t Filter(const RenderPacket& packet);
+
+	const RenderQueueStats& GetStats() const { return m_stats; }
+	void ResetStats() { m_stats = {}; }
+
+private:
+	uint32_t m_shader = ~0u;
+	uint32_t m_material = ~0u;
+	uint32_t m_mesh = ~0u;
+	uint32_t m_object = ~0u;
+	RenderQueueStats m_stats = {};
+};
+
+// Receives sorted, filtered packets. The D3D11 version binds real state, others
+// can count or record calls.
+class RenderBackend
+{
+public:
+	virtual ~RenderBackend() {}
+
+	virtual void BindShader(uint32_t shader) = 0;
+	virtual void BindMaterial(uint32_t material) = 0;
+	virtual void BindMesh(uint32_t mesh) = 0;
+	virtual void BindObject(uint32_t object) = 0;
+	virtual void Draw(const RenderPacket& packet) = 0;
+};
+
+// Collects packets in any order, sorts them by key and replays them through a
+// backend. Packets with equal keys keep their submission order.
+class RenderQueue
+{
+public:
+	void Reserve(size_t count);
+	void Clear();
+
+	void Submit(const RenderPacket& packet) { m_packets.push_back(packet); m_sorted = false; }
+	size_t GetSize() const { return m_packets.size(); }
+
+	// LSD radix sort on the keys, 8 bits per pass, passes where every key has the same byte are skipped
+	void Sort();
+
+	// Sorts if needed, then binds only changed state and draws every packet
+	void Execute(RenderBackend& backend, RenderStateFilter& filter);
+
+	// Packet at position i of the sorted order
+	const RenderPacket& GetSorted(size_t i) const { return m_packets[m_order[i].Index]; }
+
+private:
+	struct SortEntry
+	{
+		uint64_t	Key;
+		uint32_t	Index;
+	};
+
+	std::vector<RenderPacket> m_packets;
+	std::vector<SortEntry> m_order;
+	std::vector<SortEntry> m_scratch;
+	bool m_sorted = true;
+};
@@ -0,0 +1,112 @@
+#include "RenderStateCache.h"
+
+template <typename TState>
+static void ReleaseState(TState* pState)
+{
+	pState->Release();
+}
+
+template <typename TDesc, typename TState>
+static void AddStats(RenderStateCacheStats& stats, const StateCacheTable<TDesc, TState>& table)
+{
+	stats.States += (uint32_t)table.GetSize();
+	stats.Creations += table.GetCreations();
+	stats.Hits += table.GetHits();
+	stats.Failures += table.GetFailures();
+}
+
+RenderStateCache::RenderStateCache(ID3D11Device* pd3dDevice)
+{
+	m_pd3dDevice = pd3dDevice;
+}
+
+RenderStateCache::~RenderStateCache()
+{
+	Clear();
+}
+
+ID3D11RasterizerState* RenderStateCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+	// Every member is four bytes, so there is no padding to clear
+	return m_rasterizerStates.Get(desc, [this](const D3D11_RASTERIZER_DESC& d)
+	{
+		ID3D11RasterizerState* pState = nullptr;
+		return SUCCEEDED(m_pd3dDevice->CreateRasterizerState(&d, &pState)) ? pState : nullptr;
+	});
+}
+
+ID3D11BlendState* RenderStateCache::GetBlendState(const D3D11_BLEND_DESC& desc)
+{
+	// The UINT8 write masks leave padding behind them, copy field by field into zeroed memory
+	D3D11_BLEND_DESC key;
+	ZeroMemory(&key, sizeof(key));
+	key.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+	key.IndependentBlendEnable = desc.IndependentBlendEnable;
+	for (int i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+	{
+		const D3D11_RENDER_TARGET_BLEND_DESC& in = desc.RenderTarget[i];
+		D3D11_RENDER_TARGET_BLEND_DESC& out = key.RenderTarget[i];
+		out.BlendEnable = in.BlendEnable;
+		out.SrcBlend = in.SrcBlend;
+		out.DestBlend = in.DestBlend;
+		out.BlendOp = in.BlendOp;
+		out.SrcBlendAlpha = in.SrcBlendAlpha;
+		out.DestBlendAlpha = in.DestBlendAlpha;
+		out.BlendOpAlpha = in.BlendOpAlpha;
+		out.RenderTargetWriteMask = in.RenderTargetWriteMask;
+	}
+
+	return m_blendStates.Get(key, [this](const D3D11_BLEND_DESC& d)
+	{
+		ID3D11BlendState* pState = nullptr;
+		return SUCCEEDED(m_pd3dDevice->CreateBlendState(&d, &pState)) ? pState : nullptr;
+	});
+}
+
+ID3D11DepthStencilState* RenderStateCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	// Same for the two UINT8 stencil masks
+	D3D11_DEPTH_STENCIL_DESC key;
+	ZeroMemory(&key, sizeof(key));
+	key.DepthEnable = desc.DepthEnable;
+	key.DepthWriteMask = desc.DepthWriteMask;
+	key.DepthFunc = desc.DepthFunc;
+	key.StencilEnable = desc.StencilEnable;
+	key.StencilReadMask = desc.StencilReadMask;
+	key.StencilWriteMask = desc.StencilWriteMask;
+	key.FrontFace = desc.FrontFace;
+	key.BackFace = desc.BackFace;
+
+	return m_depthStencilStates.Get(key, [this](const D3D11_DEPTH_STENCIL_DESC& d)
+	{
+		ID3D11DepthStencilState* pState = nullptr;
+		return SUCCEEDED(m_pd3dDevice->CreateDepthStencilState(&d, &pState)) ? pState : nullptr;
+	});
+}
+
+ID3D11SamplerState* RenderStateCache::GetSamplerState(const D3D11_SAMPLER_DESC& desc)
+{
+	return m_samplerStates.Get(desc, [this](const D3D11_SAMPLER_DESC& d)
+	{
+		ID3D11SamplerState* pState = nullptr;
+		return SUCCEEDED(m_pd3dDevice->CreateSamplerState(&d, &pState)) ? pState : nullptr;
+	});
+}
+
+RenderStateCacheStats RenderStateCache::GetStats() const
+{
+	RenderStateCacheStats stats = {};
+	AddStats(stats, m_rasterizerStates);
+	AddStats(stats, m_blendStates);
+	AddStats(stats, m_depthStencilStates);
+	AddStats(stats, m_samplerStates);
+	return stats;
+}
+
+void RenderStateCache::Clear()
+{
+	m_rasterizerStates.Clear(ReleaseState<ID3D11RasterizerState>);
+	m_blendStates.Clear(ReleaseState<ID3D11BlendState>);
+	m_depthStencilStates.Clear(ReleaseState<ID3D11DepthStencilState>);
+	m_samplerStates.Clear(ReleaseState<ID3D11SamplerState>);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <d3d11_1.h>
+#include "StateCacheTable.h"
+
+struct RenderStateCacheStats
+{
+	uint32_t	States;
+	uint32_t	Creations;
+	uint32_t	Hits;
+	uint32_t	Failures;
+};
+
+// Owns every rasterizer, blend, depth-stencil and sampler state. Each distinct
+// descriptor is created on the device once, later lookups are a hash and compare.
+// Returned states are borrowed: don't Release them. Main thread only.
+class RenderStateCache
+{
+public:
+	RenderStateCache(ID3D11Device* pd3dDevice);
+	~RenderStateCache();
+
+	ID3D11RasterizerState* GetRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+	ID3D11BlendState* GetBlendState(const D3D11_BLEND_DESC& desc);
+	ID3D11DepthStencilState* GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+	ID3D11SamplerState* GetSamplerState(const D3D11_SAMPLER_DESC& desc);
+
+	RenderStateCacheStats GetStats() const;
+	void Clear();
+
+private:
+	ID3D11Device* m_pd3dDevice;
+
+	StateCacheTable<D3D11_RASTERIZER_DESC, ID3D11RasterizerState> m_rasterizerStates;
+	StateCacheTable<D3D11_BLEND_DESC, ID3D11BlendState> m_blendStates;
+	StateCacheTable<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> m_depthStencilStates;
+	StateCacheTable<D3D11_SAMPLER_DESC, ID3D11SamplerState> m_samplerStates;
+};
@@ -0,0 +1,100 @@
+#include "RenderTargetFormats.h"
+#include "BloomKernel.h"
+#include "VelocityTiles.h"
+
+static const uint32_t g_targetFormats[RenderTargetPrecisionCount] =
+{
+	RENDER_TARGET_FORMAT_R32G32B32A32_FLOAT, RENDER_TARGET_FORMAT_R16G16B16A16_FLOAT, RENDER_TARGET_FORMAT_R11G11B10_FLOAT
+};
+static const uint32_t g_targetBytesPerPixel[RenderTargetPrecisionCount] = { 16, 8, 4 };
+
+RenderTargetFormatPolicy RenderTargetFormats::GetFullPolicy()
+{
+	RenderTargetFormatPolicy policy;
+	for (uint8_t& precision : policy.Precision)
+	{
+		precision = PrecisionFull;
+	}
+	return policy;
+}
+
+RenderTargetFormatPolicy RenderTargetFormats::GetBandwidthPolicy()
+{
+	// The tint mode inverts alpha and the depth view needs more than packed floats'
+	// six bit mantissa, bloom and blur only ever add colour
+	RenderTargetFormatPolicy policy;
+	policy.Precision[TargetSceneColour] = PrecisionHalf;
+	policy.Precision[TargetDepthView] = PrecisionHalf;
+	policy.Precision[TargetBloom] = PrecisionPacked;
+	policy.Precision[TargetBlur] = PrecisionPacked;
+	return policy;
+}
+
+uint32_t RenderTargetFormats::GetFormat(RenderTargetPrecision precision)
+{
+	return g_targetFormats[precision];
+}
+
+uint32_t RenderTargetFormats::GetBytesPerPixel(RenderTargetPrecision precision)
+{
+	return g_targetBytesPerPixel[precision];
+}
+
+RenderTargetPrecision RenderTargetFormats::Select(const RenderTargetFormatPolicy& policy, RenderTargetUse use, uint32_t supportedMask)
+{
+	int precision = policy.Precision[use];
+	while (precision > PrecisionFull && !(supportedMask & (1u << precision)))
+	{
+		--precision;
+	}
+	return (RenderTargetPrecision)precision;
+}
+
+RenderTargetBudget RenderTargetFormats::GetBudget(const RenderTargetFormatPolicy& policy, uint32_t width, uint32_t height, uint32_t sampleCount,
+	uint32_t supportedMask, uint32_t msaaSupportedMask, bool motionBlur, bool blur, bool bloomChain, bool depthView)
+{
+	const uint64_t pixels = (uint64_t)width * height;
+	RenderTargetBudget budget = {};
+
+	// Scene at every sample, and its resolve in the same format. The resolve is never
+	// cleared and the depth view skips it.
+	uint64_t scene = pixels * GetBytesPerPixel(Select(policy, TargetSceneColour, msaaSupportedMask));
+	uint64_t sceneSamples = scene * (sampleCount ? sampleCount : 1);
+	budget.Bytes += sceneSamples + scene;
+	budget.TrafficBytes += sceneSamples * 2;
+	if (!depthView)
+		budget.TrafficBytes += sceneSamples + scene * 2;
+
+	uint64_t depth = pixels * GetBytesPerPixel(Select(policy, TargetDepthView, supportedMask));
+	budget.Bytes += depth;
+	if (depthView)
+		budget.TrafficBytes += depth * 3;
+
+	// Velocity is cleared, drawn and read by both the tile max and the gather, the two
+	// tile targets and the blurred scene are written once and read once
+	uint64_t velocity = pixels * RENDER_TARGET_VELOCITY_BYTES_PER_PIXEL;
+	uint64_t tiles = (uint64_t)VelocityTiles::GetTileCount(width) * VelocityTiles::GetTileCount(height) * RENDER_TARGET_VELOCITY_BYTES_PER_PIXEL * 2;
+	uint64_t blurTarget = pixels * GetBytesPerPixel(Select(policy, TargetBlur, supportedMask));
+	budget.Bytes += velocity + tiles + blurTarget;
+	if (motionBlur && !depthView)
+		budget.TrafficBytes += velocity * 4 + (tiles + blurTarget) * 2;
+
+	// Both directions of the separable blur are cleared, drawn and read
+	budget.Bytes += blurTarget * 2;
+	if (blur && !depthView)
+		budget.TrafficBytes += blurTarget * 2 * 3;
+
+	// Four targets a level, each written once and read once, the coarsest level's
+	// vertical blur stands in for its upsample
+	const uint32_t bloomBytesPerPixel = GetBytesPerPixel(Select(policy, TargetBloom, supportedMask));
+	for (uint32_t level = 0; level < BLOOM_LEVELS; ++level)
+	{
+		uint64_t levelBytes = (uint64_t)BloomKernel::GetLevelSize(width, level) * BloomKernel::GetLevelSize(height, level) * bloomBytesPerPixel;
+		uint32_t targets = level + 1 < BLOOM_LEVELS ? 4 : 3;
+		budget.Bytes += levelBytes * targets;
+		if (bloomChain && !depthView)
+			budget.TrafficBytes += levelBytes * targets * 2;
+	}
+
+	return budget;
+}
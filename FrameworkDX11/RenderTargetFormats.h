@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+
+// DXGI_FORMAT values, kept as numbers so the policy builds without D3D
+#define RENDER_TARGET_FORMAT_R32G32B32A32_FLOAT 2
+#define RENDER_TARGET_FORMAT_R16G16B16A16_FLOAT 10
+#define RENDER_TARGET_FORMAT_R11G11B10_FLOAT 26
+#define RENDER_TARGET_FORMAT_R16G16_FLOAT 34
+
+// Motion blur's velocity and tile targets are always R16G16_FLOAT, a few pixels'
+// error in a blur length doesn't show
+#define RENDER_TARGET_VELOCITY_BYTES_PER_PIXEL 4
+
+// What an offscreen target holds. The MSAA scene and the target it resolves into
+// always share a format, ResolveSubresource needs that.
+enum RenderTargetUse
+{
+	TargetSceneColour = 0,
+	TargetDepthView,
+	TargetBloom,
+	TargetBlur,
+	RenderTargetUseCount
+};
+
+// Most precise first, falling back goes up the list
+enum RenderTargetPrecision
+{
+	PrecisionFull = 0,	// R32G32B32A32_FLOAT
+	PrecisionHalf,		// R16G16B16A16_FLOAT
+	PrecisionPacked,	// R11G11B10_FLOAT, no alpha
+	RenderTargetPrecisionCount
+};
+
+// How the MSAA scene becomes the texture the screen quad samples
+enum ResolveMode
+{
+	ResolveHardware = 0,	// ResolveSubresource, a plain box filter
+	ResolveTonemapped,		// PS_Resolve, weights samples by 1 / (1 + luma) so bright ones don't alias
+	ResolveModeCount
+};
+
+struct RenderTargetFormatPolicy
+{
+	uint8_t		Precision[RenderTargetUseCount];
+};
+
+// Bytes of every target at once, and an estimate of a frame's traffic through them:
+// each target that runs is written and read once and cleared if its pass clears it,
+// every MSAA sample counts, and caches and compression are ignored.
+struct RenderTargetBudget
+{
+	uint64_t	Bytes;
+	uint64_t	TrafficBytes;
+};
+
+namespace RenderTargetFormats
+{
+	// R32G32B32A32_FLOAT everywhere, how the targets were first created
+	RenderTargetFormatPolicy GetFullPolicy();
+	// Half floats for the scene and depth view, packed floats for bloom and the blurs
+	RenderTargetFormatPolicy GetBandwidthPolicy();
+
+	uint32_t GetFormat(RenderTargetPrecision precision);
+	uint32_t GetBytesPerPixel(RenderTargetPrecision precision);
+
+	// The policy's precision for a use, or the nearest more precise one with its bit set
+	// in supportedMask (bit p for precision p). Full precision is always allowed.
+	RenderTargetPrecision Select(const RenderTargetFormatPolicy& policy, RenderTargetUse use, uint32_t supportedMask);
+
+	// The scene at sampleCount samples plus its resolve, the depth view, the motion blur and
+	// blur targets and the bloom chain. Only the targets a frame draws count towards the traffic.
+	RenderTargetBudget GetBudget(const RenderTargetFormatPolicy& policy, uint32_t width, uint32_t height, uint32_t sampleCount,
+		uint32_t supportedMask, uint32_t msaaSupportedMask, bool motionBlur, bool blur, bool bloomChain, bool depthView);
+}
@@ -0,0 +1,323 @@
+#include "ShaderCache.h"
+#include "JobSystem.h"
+#include "StateCacheTable.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+struct ShaderCacheHeader
+{
+	uint32_t	Magic;
+	uint32_t	Version;
+	uint32_t	Count;
+	uint32_t	Reserved;
+};
+
+struct ShaderCacheEntryHeader
+{
+	uint64_t	Key;
+	uint64_t	Checksum;
+	uint32_t	Size;
+	uint32_t	Reserved;
+};
+
+// Length first so "ab"+"c" and "a"+"bc" hash differently
+static uint64_t HashString(const std::string& value, uint64_t hash)
+{
+	uint64_t length = value.size();
+	hash = StateCache::HashBytes(&length, sizeof(length), hash);
+	return StateCache::HashBytes(value.data(), value.size(), hash);
+}
+
+static std::string GetDirectory(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+ShaderCache::ShaderCache(ShaderCompiler* pCompiler)
+{
+	m_pCompiler = pCompiler;
+}
+
+bool ShaderCache::Load(std::istream& stream)
+{
+	m_entries.clear();
+	m_dirty = false;
+
+	ShaderCacheHeader header = {};
+	if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	if (header.Magic != SHADER_CACHE_MAGIC || header.Version != SHADER_CACHE_VERSION)
+	{
+		m_dirty = true;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header.Count; ++i)
+	{
+		ShaderCacheEntryHeader entryHeader = {};
+		if (!stream.read(reinterpret_cast<char*>(&entryHeader), sizeof(entryHeader)) || entryHeader.Size > SHADER_CACHE_MAX_BLOB)
+		{
+			m_dirty = true;
+			return false;
+		}
+
+		Entry entry;
+		entry.Bytecode.resize(entryHeader.Size);
+		entry.Used = false;
+		if (!stream.read(reinterpret_cast<char*>(entry.Bytecode.data()), entryHeader.Size) ||
+			StateCache::HashBytes(entry.Bytecode.data(), entry.Bytecode.size()) != entryHeader.Checksum)
+		{
+			// Truncated or damaged, keep what came before and rewrite the file
+			m_dirty = true;
+			return false;
+		}
+
+		m_entries[entryHeader.Key] = std::move(entry);
+	}
+	return true;
+}
+
+bool ShaderCache::Save(std::ostream& stream) const
+{
+	ShaderCacheHeader header = { SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, (uint32_t)m_entries.size(), 0 };
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	// Sorted by key so the same contents always write the same file
+	std::vector<uint64_t> keys;
+	keys.reserve(m_entries.size());
+	for (const auto& pair : m_entries)
+	{
+		keys.push_back(pair.first);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	for (uint64_t key : keys)
+	{
+		const std::vector<uint8_t>& bytecode = m_entries.find(key)->second.Bytecode;
+		ShaderCacheEntryHeader entryHeader = { key, StateCache::HashBytes(bytecode.data(), bytecode.size()), (uint32_t)bytecode.size(), 0 };
+		stream.write(reinterpret_cast<const char*>(&entryHeader), sizeof(entryHeader));
+		stream.write(reinterpret_cast<const char*>(bytecode.data()), bytecode.size());
+	}
+	return !stream.fail();
+}
+
+bool ShaderCache::LoadFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		m_entries.clear();
+		m_dirty = false;
+		return false;
+	}
+	return Load(file);
+}
+
+bool ShaderCache::SaveFile(const std::string& path) const
+{
+	// Written aside and moved into place so a crash never leaves half a cache
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file || !Save(file))
+			return false;
+	}
+	std::remove(path.c_str());
+	return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+uint64_t ShaderCache::HashIncludes(const std::string& path, const std::string& source, uint64_t hash, std::vector<std::string>& visited)
+{
+	std::istringstream lines(source);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+			continue;
+
+		size_t open = line.find('"', start + 8);
+		size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		if (close == std::string::npos)
+			continue;
+
+		// Relative to the including file, like the compiler's default include handler
+		std::string includePath = GetDirectory(path) + line.substr(open + 1, close - open - 1);
+		if (std::find(visited.begin(), visited.end(), includePath) != visited.end())
+			continue;
+		visited.push_back(includePath);
+
+		// A missing include is hashed as missing, the compile reports the error
+		std::string include;
+		bool found = m_pCompiler->ReadSource(includePath, include);
+		hash = HashString(includePath, hash);
+		hash = StateCache::HashBytes(&found, sizeof(found), hash);
+		hash = HashString(include, hash);
+		hash = HashIncludes(includePath, include, hash, visited);
+	}
+	return hash;
+}
+
+bool ShaderCache::ComputeKey(const ShaderCompileRequest& request, uint64_t& key, std::string& source)
+{
+	if (!m_pCompiler->ReadSource(request.File, source))
+		return false;
+
+	uint32_t version = SHADER_CACHE_VERSION;
+	uint64_t compilerVersion = m_pCompiler->GetVersion();
+	uint64_t hash = StateCache::HashBytes(&version, sizeof(version));
+	hash = StateCache::HashBytes(&compilerVersion, sizeof(compilerVersion), hash);
+	hash = StateCache::HashBytes(&request.Flags, sizeof(request.Flags), hash);
+	hash = HashString(request.EntryPoint, hash);
+	hash = HashString(request.Profile, hash);
+	for (const ShaderDefine& define : request.Defines)
+	{
+		hash = HashString(define.Name, hash);
+		hash = HashString(define.Value, hash);
+	}
+	hash = HashString(source, hash);
+
+	std::vector<std::string> visited(1, request.File);
+	key = HashIncludes(request.File, source, hash, visited);
+	return true;
+}
+
+bool ShaderCache::Compile(const std::vector<ShaderCompileRequest>& requests, std::vector<ShaderCompileResult>& results, JobSystem* pJobs)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	results.assign(requests.size(), ShaderCompileResult());
+
+	std::vector<std::string> sources(requests.size());
+	std::vector<size_t> misses;
+	for (size_t i = 0; i < requests.size(); ++i)
+	{
+		ShaderCompileResult& result = results[i];
+		result.Key = 0;
+		result.Succeeded = false;
+		result.FromCache = false;
+
+		if (!ComputeKey(requests[i], result.Key, sources[i]))
+		{
+			result.Errors = "Cannot read " + requests[i].File;
+			continue;
+		}
+
+		auto found = m_entries.find(result.Key);
+		if (found != m_entries.end())
+		{
+			found->second.Used = true;
+			result.Bytecode = found->second.Bytecode;
+			result.Succeeded = true;
+			result.FromCache = true;
+		}
+		else
+		{
+			misses.push_back(i);
+		}
+	}
+	m_stats.KeyMilliseconds += MillisecondsSince(start);
+
+	// Each miss only writes its own result, the cache is updated afterwards on this thread
+	std::chrono::steady_clock::time_point compileStart = std::chrono::steady_clock::now();
+	auto compileRange = [&](size_t begin, size_t end, unsigned)
+	{
+		for (size_t m = begin; m < end; ++m)
+		{
+			size_t i = misses[m];
+			ShaderCompileResult& result = results[i];
+			result.Succeeded = m_pCompiler->Compile(requests[i], sources[i], result.Bytecode, result.Errors);
+		}
+	};
+	if (pJobs)
+		pJobs->ParallelFor(misses.size(), 1, compileRange);
+	else
+		compileRange(0, misses.size(), 0);
+	m_stats.CompileMilliseconds += MillisecondsSince(compileStart);
+
+	bool succeeded = true;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const ShaderCompileResult& result = results[i];
+		++m_stats.Requests;
+		if (result.FromCache)
+			++m_stats.Hits;
+		else
+			++m_stats.Misses;
+
+		if (!result.Succeeded)
+		{
+			++m_stats.Failures;
+			succeeded = false;
+		}
+		else if (!result.FromCache)
+		{
+			Entry& entry = m_entries[result.Key];
+			entry.Bytecode = result.Bytecode;
+			entry.Used = true;
+			m_dirty = true;
+		}
+	}
+	return succeeded;
+}
+
+void ShaderCache::RemoveUnused()
+{
+	for (auto it = m_entries.begin(); it != m_entries.end();)
+	{
+		if (it->second.Used)
+		{
+			++it;
+			continue;
+		}
+		it = m_entries.erase(it);
+		m_dirty = true;
+	}
+}
+
+void MemoryShaderCompiler::SetFile(const std::string& path, const std::string& source)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_files[path] = source;
+}
+
+bool MemoryShaderCompiler::ReadSource(const std::string& path, std::string& source)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto found = m_files.find(path);
+	if (found == m_files.end())
+		return false;
+	source = found->second;
+	return true;
+}
+
+bool MemoryShaderCompiler::Compile(const ShaderCompileRequest& request, const std::string& source, std::vector<uint8_t>& bytecode, std::string& errors)
+{
+	++m_compiles;
+
+	if (m_compileMilliseconds > 0.0)
+		std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(m_compileMilliseconds));
+
+	if (source.find("#error") != std::string::npos)
+	{
+		errors = request.File + ": " + request.EntryPoint + ": #error";
+		return false;
+	}
+
+	uint64_t hash = HashString(request.EntryPoint, HashString(request.Profile, StateCache::HashBytes(source.data(), source.size())));
+	for (const ShaderDefine& define : request.Defines)
+	{
+		hash = HashString(define.Value, HashString(define.Name, hash));
+	}
+	bytecode.assign(reinterpret_cast<const uint8_t*>(&hash), reinterpret_cast<const uint8_t*>(&hash) + sizeof(hash));
+	return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class JobSystem;
+
+#define SHADER_CACHE_MAGIC 0x31434853u // "SHC1"
+#define SHADER_CACHE_VERSION 1
+#define SHADER_CACHE_MAX_BLOB (16 * 1024 * 1024)
+
+struct ShaderDefine
+{
+	std::string	Name;
+	std::string	Value;
+};
+
+// One entry point of one file, everything that changes the bytecode besides the source
+struct ShaderCompileRequest
+{
+	std::string					File;
+	std::string					EntryPoint;
+	std::string					Profile;
+	std::vector<ShaderDefine>	Defines;
+	uint32_t					Flags;
+};
+
+struct ShaderCompileResult
+{
+	std::vector<uint8_t>	Bytecode;
+	std::string				Errors;
+	uint64_t				Key;
+	bool					Succeeded;
+	bool					FromCache;
+};
+
+struct ShaderCacheStats
+{
+	uint32_t	Requests;
+	uint32_t	Hits;
+	uint32_t	Misses;
+	uint32_t	Failures;
+	double		KeyMilliseconds;
+	double		CompileMilliseconds;
+};
+
+// Reads files and turns source into bytecode. D3DShaderCompiler calls D3DCompile,
+// MemoryShaderCompiler fakes both so the cache can be checked without a device or disk.
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler() {}
+
+	// Identifies the compiler build, part of every key so an update invalidates the cache
+	virtual uint64_t GetVersion() const = 0;
+
+	virtual bool ReadSource(const std::string& path, std::string& source) = 0;
+
+	// Called from worker threads, must not touch shared state
+	virtual bool Compile(const ShaderCompileRequest& request, const std::string& source, std::vector<uint8_t>& bytecode, std::string& errors) = 0;
+};
+
+// Bytecode keyed by a hash of the source, every file it includes, the defines,
+// entry point, profile, flags and compiler version. Any change to those is a
+// different key, so stale entries are never returned, they are just no longer used.
+// The cache file is a header followed by the entries, each with a checksum; a bad
+// header drops the whole file and a bad entry drops it and everything after it.
+class ShaderCache
+{
+public:
+	ShaderCache(ShaderCompiler* pCompiler);
+
+	bool Load(std::istream& stream);
+	bool Save(std::ostream& stream) const;
+	bool LoadFile(const std::string& path);
+	bool SaveFile(const std::string& path) const;
+
+	// Hashes the request and its sources, false if a file can't be read
+	bool ComputeKey(const ShaderCompileRequest& request, uint64_t& key, std::string& source);
+
+	// Fills one result per request. Hits are copied from the cache, misses are
+	// compiled on the job system (serially without one) and added to it.
+	bool Compile(const std::vector<ShaderCompileRequest>& requests, std::vector<ShaderCompileResult>& results, JobSystem* pJobs);
+
+	// Drops entries no Compile call asked for since the cache was loaded
+	void RemoveUnused();
+
+	size_t GetEntryCount() const { return m_entries.size(); }
+	bool IsDirty() const { return m_dirty; }
+	const ShaderCacheStats& GetStats() const { return m_stats; }
+	void ResetStats() { m_stats = {}; }
+
+private:
+	struct Entry
+	{
+		std::vector<uint8_t>	Bytecode;
+		bool					Used;
+	};
+
+	uint64_t HashIncludes(const std::string& path, const std::string& source, uint64_t hash, std::vector<std::string>& visited);
+
+	ShaderCompiler* m_pCompiler;
+	std::unordered_map<uint64_t, Entry> m_entries;
+	ShaderCacheStats m_stats = {};
+	bool m_dirty = false;
+};
+
+// Fake compiler over in-memory files. The "bytecode" is a hash of what was compiled,
+// each compile sleeps for a fixed time and a source containing "#error" fails.
+// Files can be edited while another thread reads them, as the hot reloader does.
+class MemoryShaderCompiler : public ShaderCompiler
+{
+public:
+	MemoryShaderCompiler(double compileMilliseconds = 0.0) : m_compileMilliseconds(compileMilliseconds) {}
+
+	void SetFile(const std::string& path, const std::string& source);
+	void SetVersion(uint64_t version) { m_version = version; }
+	uint32_t GetCompileCount() const { return m_compiles; }
+
+	uint64_t GetVersion() const { return m_version; }
+	bool ReadSource(const std::string& path, std::string& source);
+	bool Compile(const ShaderCompileRequest& request, const std::string& source, std::vector<uint8_t>& bytecode, std::string& errors);
+
+private:
+	std::mutex m_mutex;
+	std::map<std::string, std::string> m_files;
+	double m_compileMilliseconds;
+	uint64_t m_version = 1;
+	std::atomic<uint32_t> m_compiles{ 0 };
+};
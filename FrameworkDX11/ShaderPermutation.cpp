@@ -0,0 +1,103 @@
+#include "ShaderPermutation.h"
+
+static const char* g_featureDefines[SHADER_FEATURE_COUNT] =
+{
+	"TERRAIN",
+	"NORMAL_MAP",
+	"PARALLAX",
+	"PARALLAX_OCCLUSION",
+	"SELF_SHADOW",
+	"BLUR_HORIZONTAL",
+	"VELOCITY",
+	"DEPTH_ONLY",
+};
+
+uint32_t ShaderPermutation::GetIndex(uint32_t features, uint32_t mask)
+{
+	uint32_t index = 0;
+	uint32_t bit = 1;
+	for (uint32_t remaining = mask; remaining; remaining &= remaining - 1)
+	{
+		if (features & remaining & (0u - remaining))
+			index |= bit;
+		bit <<= 1;
+	}
+	return index;
+}
+
+uint32_t ShaderPermutation::GetFeatures(uint32_t index, uint32_t mask)
+{
+	uint32_t features = 0;
+	uint32_t bit = 1;
+	for (uint32_t remaining = mask; remaining; remaining &= remaining - 1)
+	{
+		if (index & bit)
+			features |= remaining & (0u - remaining);
+		bit <<= 1;
+	}
+	return features;
+}
+
+uint32_t ShaderPermutation::GetVariantCount(uint32_t mask)
+{
+	uint32_t bits = 0;
+	for (; mask; mask &= mask - 1)
+		++bits;
+	return 1u << bits;
+}
+
+bool ShaderPermutation::IsValid(uint32_t features)
+{
+	if ((features & (ShaderFeatureParallax | ShaderFeatureOcclusion | ShaderFeatureSelfShadow)) && !(features & ShaderFeatureNormalMap))
+		return false;
+	if ((features & ShaderFeatureParallax) && (features & ShaderFeatureOcclusion))
+		return false;
+	if ((features & ShaderFeatureSelfShadow) && !(features & ShaderFeatureOcclusion))
+		return false;
+	// The velocity buffer doesn't shade, so materials would only be duplicates
+	if ((features & ShaderFeatureVelocity) && (features & SHADER_FEATURES_MATERIAL))
+		return false;
+	// Neither does the shadow map, and it has no colour to write velocity into
+	if ((features & ShaderFeatureDepthOnly) && (features & (ShaderFeatureVelocity | SHADER_FEATURES_MATERIAL)))
+		return false;
+	return true;
+}
+
+uint32_t ShaderPermutation::GetMaterialFeatures(int materialSelection)
+{
+	switch (materialSelection)
+	{
+	case 1: return ShaderFeatureNormalMap;
+	case 2: return ShaderFeatureNormalMap | ShaderFeatureParallax;
+	case 3: return ShaderFeatureNormalMap | ShaderFeatureOcclusion;
+	case 4: return ShaderFeatureNormalMap | ShaderFeatureOcclusion | ShaderFeatureSelfShadow;
+	default: return 0;
+	}
+}
+
+const char* ShaderPermutation::GetDefineName(uint32_t feature)
+{
+	for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; ++i)
+	{
+		if (feature == (1u << i))
+			return g_featureDefines[i];
+	}
+	return nullptr;
+}
+
+void ShaderPermutation::GetDefines(uint32_t features, std::vector<ShaderDefine>& defines)
+{
+	defines.clear();
+	for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; ++i)
+	{
+		if (features & (1u << i))
+			defines.push_back({ g_featureDefines[i], "1" });
+	}
+}
+
+ShaderCompileRequest ShaderPermutation::MakeRequest(const char* file, const char* entryPoint, const char* profile, uint32_t features, uint32_t flags)
+{
+	ShaderCompileRequest request = { file, entryPoint, profile, {}, flags };
+	GetDefines(features, request.Defines);
+	return request;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ShaderCache.h"
+
+// Compile time switches in shader.fx. Each set bit is passed as a define with the
+// value 1, so the shader tests them with #ifdef instead of branching on a constant.
+enum ShaderFeature
+{
+	ShaderFeatureTerrain		= 1 << 0,	// TERRAIN: height blended terrain textures
+	ShaderFeatureNormalMap		= 1 << 1,	// NORMAL_MAP
+	ShaderFeatureParallax		= 1 << 2,	// PARALLAX: single sample offset
+	ShaderFeatureOcclusion		= 1 << 3,	// PARALLAX_OCCLUSION: layered ray march
+	ShaderFeatureSelfShadow		= 1 << 4,	// SELF_SHADOW: parallax self shadowing
+	ShaderFeatureHorizontal		= 1 << 5,	// BLUR_HORIZONTAL: blur along x instead of y
+	ShaderFeatureVelocity		= 1 << 6,	// VELOCITY: screen space motion instead of shading
+	ShaderFeatureDepthOnly		= 1 << 7,	// DEPTH_ONLY: position into the shadow map, no pixel shader
+};
+
+#define SHADER_FEATURE_COUNT 8
+#define SHADER_FEATURES_MATERIAL (ShaderFeatureNormalMap | ShaderFeatureParallax | ShaderFeatureOcclusion | ShaderFeatureSelfShadow)
+
+namespace ShaderPermutation
+{
+	// Packs the bits of features that are in mask down to [0, GetVariantCount(mask))
+	uint32_t GetIndex(uint32_t features, uint32_t mask);
+
+	// Inverse of GetIndex, spreads the index back out over the mask
+	uint32_t GetFeatures(uint32_t index, uint32_t mask);
+
+	uint32_t GetVariantCount(uint32_t mask);
+
+	// Rejects combinations the shader doesn't support, such as parallax without a normal map
+	bool IsValid(uint32_t features);
+
+	// The old UseTexture values: 0 diffuse, 1 normal map, 2 parallax, 3 occlusion, 4 self shadowing
+	uint32_t GetMaterialFeatures(int materialSelection);
+
+	const char* GetDefineName(uint32_t feature);
+	void GetDefines(uint32_t features, std::vector<ShaderDefine>& defines);
+
+	ShaderCompileRequest MakeRequest(const char* file, const char* entryPoint, const char* profile, uint32_t features, uint32_t flags);
+}
+
+// The variants of one entry point, a slot for every combination of the features in
+// its mask. Features outside the mask don't change the entry point, so they share a
+// slot and never compile twice. Variants come from the create function passed to Get
+// the first time a combination is asked for, and go through the release function
+// passed to Clear.
+template <typename T>
+class ShaderPermutationTable
+{
+public:
+	ShaderPermutationTable(uint32_t featureMask)
+	{
+		m_featureMask = featureMask;
+		m_variants.resize(ShaderPermutation::GetVariantCount(featureMask));
+		m_present.assign(m_variants.size(), 0);
+	}
+
+	// create(features, value) sees only the features in the mask and returns false on failure
+	template <typename TCreate>
+	bool Get(uint32_t features, T& value, TCreate create)
+	{
+		uint32_t index = ShaderPermutation::GetIndex(features, m_featureMask);
+		if (m_present[index])
+		{
+			++m_hits;
+			value = m_variants[index];
+			return true;
+		}
+
+		if (!create(features & m_featureMask, m_variants[index]))
+		{
+			++m_failures;
+			return false;
+		}
+
+		++m_creations;
+		m_present[index] = 1;
+		value = m_variants[index];
+		return true;
+	}
+
+	// Lookup only, for threads that must not create variants
+	bool Find(uint32_t features, T& value) const
+	{
+		uint32_t index = ShaderPermutation::GetIndex(features, m_featureMask);
+		if (!m_present[index])
+			return false;
+		value = m_variants[index];
+		return true;
+	}
+
+	// visit(features, value) for every variant created so far
+	template <typename TVisit>
+	void ForEach(TVisit visit)
+	{
+		for (uint32_t i = 0; i < (uint32_t)m_variants.size(); ++i)
+		{
+			if (m_present[i])
+				visit(ShaderPermutation::GetFeatures(i, m_featureMask), m_variants[i]);
+		}
+	}
+
+	template <typename TRelease>
+	void Clear(TRelease release)
+	{
+		for (size_t i = 0; i < m_variants.size(); ++i)
+		{
+			if (m_present[i])
+				release(m_variants[i]);
+			m_present[i] = 0;
+		}
+	}
+
+	uint32_t GetFeatureMask() const { return m_featureMask; }
+	uint32_t GetVariantCount() const { return (uint32_t)m_variants.size(); }
+	uint32_t GetCreations() const { return m_creations; }
+	uint32_t GetHits() const { return m_hits; }
+	uint32_t GetFailures() const { return m_failures; }
+
+private:
+	uint32_t m_featureMask;
+	std::vector<T> m_variants;
+	std::vector<uint8_t> m_present;
+	uint32_t m_creations = 0;
+	uint32_t m_hits = 0;
+	uint32_t m_failures = 0;
+};
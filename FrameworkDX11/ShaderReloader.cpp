@@ -0,0 +1,145 @@
+#include "ShaderReloader.h"
+
+bool ShaderReloader::ScanCompiler::ReadSource(const std::string& path, std::string& source)
+{
+	auto found = m_sources.find(path);
+	if (found == m_sources.end())
+	{
+		std::pair<bool, std::string> read;
+		read.first = m_pCompiler->ReadSource(path, read.second);
+		found = m_sources.emplace(path, read).first;
+	}
+	source = found->second.second;
+	return found->second.first;
+}
+
+bool ShaderReloader::ScanCompiler::Compile(const ShaderCompileRequest& request, const std::string& source, std::vector<uint8_t>& bytecode, std::string& errors)
+{
+	return m_pCompiler->Compile(request, source, bytecode, errors);
+}
+
+ShaderReloader::ShaderReloader(ShaderCompiler* pCompiler)
+	: m_scanCompiler(pCompiler), m_keys(&m_scanCompiler)
+{
+}
+
+ShaderReloader::~ShaderReloader()
+{
+	Stop();
+}
+
+uint32_t ShaderReloader::Watch(const ShaderCompileRequest& request)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_watched.push_back({ request, 0, false });
+	m_stats.Watched = (uint32_t)m_watched.size();
+	return (uint32_t)m_watched.size() - 1;
+}
+
+void ShaderReloader::Start(unsigned pollMilliseconds)
+{
+	if (m_thread.joinable())
+		return;
+
+	m_pollMilliseconds = pollMilliseconds;
+	m_stopping = false;
+	m_thread = std::thread(&ShaderReloader::ThreadLoop, this);
+}
+
+void ShaderReloader::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+void ShaderReloader::ThreadLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_wake.wait_for(lock, std::chrono::milliseconds(m_pollMilliseconds), [this] { return m_stopping; }))
+	{
+		lock.unlock();
+		Scan();
+		lock.lock();
+	}
+}
+
+void ShaderReloader::Scan()
+{
+	// Work on a copy so Watch and TakeReloads never wait on file reads or the compiler
+	std::vector<WatchedShader> watched;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		watched = m_watched;
+	}
+
+	// Every change this scan finds is timed from here, however long the compiles before it take
+	std::chrono::steady_clock::time_point scanned = std::chrono::steady_clock::now();
+	m_scanCompiler.Reset();
+	std::vector<ShaderReload> reloads;
+	for (size_t i = 0; i < watched.size(); ++i)
+	{
+		WatchedShader& shader = watched[i];
+		uint64_t key = 0;
+		std::string source;
+		if (!m_keys.ComputeKey(shader.Request, key, source))
+			continue;
+
+		bool changed = shader.HasKey && key != shader.Key;
+		shader.Key = key;
+		shader.HasKey = true;
+		if (!changed)
+			continue;
+
+		// A failed compile still moves the baseline, so a broken file is only reported once per edit
+		ShaderReload reload;
+		reload.Slot = (uint32_t)i;
+		reload.Detected = scanned;
+		reload.Result.Key = key;
+		reload.Result.FromCache = false;
+		std::chrono::steady_clock::time_point compileStart = std::chrono::steady_clock::now();
+		reload.Result.Succeeded = m_scanCompiler.Compile(shader.Request, source, reload.Result.Bytecode, reload.Result.Errors);
+		reload.CompileMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+		reloads.push_back(std::move(reload));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (size_t i = 0; i < watched.size(); ++i)
+	{
+		m_watched[i].Key = watched[i].Key;
+		m_watched[i].HasKey = watched[i].HasKey;
+	}
+	for (ShaderReload& reload : reloads)
+	{
+		++m_stats.Recompiles;
+		if (!reload.Result.Succeeded)
+			++m_stats.Failures;
+		m_reloads.push_back(std::move(reload));
+	}
+	++m_stats.Scans;
+}
+
+void ShaderReloader::TakeReloads(std::vector<ShaderReload>& reloads)
+{
+	std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+	if (!lock.owns_lock() || m_reloads.empty())
+		return;
+
+	for (ShaderReload& reload : m_reloads)
+	{
+		reloads.push_back(std::move(reload));
+	}
+	m_reloads.clear();
+}
+
+ShaderReloaderStats ShaderReloader::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ShaderCache.h"
+
+// A recompiled entry point waiting to be swapped in. Failed compiles are handed
+// over too, with the errors, so the old shader stays and the error can be shown.
+struct ShaderReload
+{
+	uint32_t								Slot;
+	ShaderCompileResult						Result;
+	double									CompileMilliseconds;
+	std::chrono::steady_clock::time_point	Detected;
+};
+
+struct ShaderReloaderStats
+{
+	uint32_t	Watched;
+	uint32_t	Scans;
+	uint32_t	Recompiles;
+	uint32_t	Failures;
+};
+
+// Watches the sources of a set of entry points on a background thread. Every poll
+// rehashes each watched request the way ShaderCache keys it, so an edit to a file or
+// anything it includes recompiles exactly the entry points whose key changed. Results
+// queue up until the main thread takes them at a frame boundary.
+class ShaderReloader
+{
+public:
+	ShaderReloader(ShaderCompiler* pCompiler);
+	~ShaderReloader();
+
+	// The first scan after this takes the current sources as the baseline
+	uint32_t Watch(const ShaderCompileRequest& request);
+
+	void Start(unsigned pollMilliseconds);
+	void Stop();
+
+	// What the background thread runs every poll. Call it directly only while stopped.
+	void Scan();
+
+	// Appends every finished recompile. Never waits: if the scanner holds the lock
+	// for its brief update, the reloads are picked up next frame.
+	void TakeReloads(std::vector<ShaderReload>& reloads);
+
+	ShaderReloaderStats GetStats();
+
+private:
+	// Reads each file once per scan however many entry points share it
+	class ScanCompiler : public ShaderCompiler
+	{
+	public:
+		ScanCompiler(ShaderCompiler* pCompiler) : m_pCompiler(pCompiler) {}
+		void Reset() { m_sources.clear(); }
+
+		uint64_t GetVersion() const { return m_pCompiler->GetVersion(); }
+		bool ReadSource(const std::string& path, std::string& source);
+		bool Compile(const ShaderCompileRequest& request, const std::string& source, std::vector<uint8_t>& bytecode, std::string& errors);
+
+	private:
+		ShaderCompiler* m_pCompiler;
+		std::map<std::string, std::pair<bool, std::string>> m_sources;
+	};
+
+	struct WatchedShader
+	{
+		ShaderCompileRequest	Request;
+		uint64_t				Key;
+		bool					HasKey;
+	};
+
+	void ThreadLoop();
+
+	ScanCompiler m_scanCompiler;
+	ShaderCache m_keys;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+	bool m_stopping = false;
+	unsigned m_pollMilliseconds = 0;
+
+	std::vector<WatchedShader> m_watched;
+	std::vector<ShaderReload> m_reloads;
+	ShaderReloaderStats m_stats = {};
+};
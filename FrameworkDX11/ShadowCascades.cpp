@@ -0,0 +1,103 @@
+#include "ShadowCascades.h"
+#include <float.h>
+#include <math.h>
+
+void ShadowCascades::ComputeSplits(float nearZ, float farZ, uint32_t count, float lambda, float* splits)
+{
+	for (uint32_t i = 0; i <= count; ++i)
+	{
+		float fraction = (float)i / count;
+		float logarithmic = nearZ * powf(farZ / nearZ, fraction);
+		float uniform = nearZ + (farZ - nearZ) * fraction;
+		splits[i] = lambda * logarithmic + (1.0f - lambda) * uniform;
+	}
+	splits[0] = nearZ;
+	splits[count] = farZ;
+}
+
+XMFLOAT4 ShadowCascades::GetSliceSphere(const XMFLOAT4X4& view, const XMFLOAT4X4& projection, float nearZ, float farZ)
+{
+	// A corner at depth d is d * sqrt(slope) from the view axis. The centre on the axis
+	// that is as far from the near corners as from the far ones, or the far plane's
+	// centre once the slice is wide enough for that to be past it.
+	float slope = 1.0f / (projection._11 * projection._11) + 1.0f / (projection._22 * projection._22);
+	float centre = fminf((farZ + nearZ) * (1.0f + slope) * 0.5f, farZ);
+	float radius = sqrtf(farZ * farZ * slope + (farZ - centre) * (farZ - centre));
+
+	XMMATRIX inverseView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&view));
+	XMFLOAT4 sphere;
+	XMStoreFloat4(&sphere, XMVector3Transform(XMVectorSet(0.0f, 0.0f, centre, 1.0f), inverseView));
+	sphere.w = radius;
+	return sphere;
+}
+
+void ShadowCascades::FitDirectional(const XMFLOAT4& sphere, const XMFLOAT3& lightDirection, uint32_t mapSize, ShadowCascade& cascade)
+{
+	// The light's rotation about the world origin, so a world point always lands at the same place in it
+	XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&lightDirection));
+	XMVECTOR up = fabsf(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMMATRIX lightView = XMMatrixLookToLH(XMVectorZero(), direction, up);
+
+	XMFLOAT3 centre;
+	XMStoreFloat3(&centre, XMVector3Transform(XMVectorSet(sphere.x, sphere.y, sphere.z, 1.0f), lightView));
+	float radius = sphere.w;
+	float texelSize = 2.0f * radius / mapSize;
+	centre.x = floorf(centre.x / texelSize + 0.5f) * texelSize;
+	centre.y = floorf(centre.y / texelSize + 0.5f) * texelSize;
+
+	XMMATRIX projection = XMMatrixOrthographicOffCenterLH(centre.x - radius, centre.x + radius, centre.y - radius, centre.y + radius,
+		centre.z - radius, centre.z + radius);
+	XMStoreFloat4x4(&cascade.ViewProjection, lightView * projection);
+	cascade.Sphere = sphere;
+	cascade.TexelSize = texelSize;
+
+	// Anything between the light and the map can still shadow it
+	Culling::ExtractFrustum(cascade.ViewProjection, cascade.Casters);
+	cascade.Casters.Planes[4] = XMFLOAT4(0.0f, 0.0f, 0.0f, FLT_MAX);
+}
+
+void ShadowCascades::FitCascades(const XMFLOAT4X4& view, const XMFLOAT4X4& projection, const XMFLOAT3& lightDirection, uint32_t count,
+	float lambda, float shadowDistance, uint32_t mapSize, ShadowCascade* cascades)
+{
+	float nearZ, farZ;
+	Culling::GetDepthRange(projection, nearZ, farZ);
+	farZ = fminf(farZ, shadowDistance);
+
+	float splits[SHADOW_MAX_CASCADES + 1];
+	ComputeSplits(nearZ, farZ, count, lambda, splits);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		FitDirectional(GetSliceSphere(view, projection, splits[i], splits[i + 1]), lightDirection, mapSize, cascades[i]);
+		cascades[i].SplitNear = splits[i];
+		cascades[i].SplitFar = splits[i + 1];
+	}
+}
+
+void ShadowCascades::FitSpot(const XMFLOAT3& position, const XMFLOAT3& direction, float angle, float range, ShadowCascade& cascade)
+{
+	XMVECTOR forward = XMVector3Normalize(XMLoadFloat3(&direction));
+	XMVECTOR up = fabsf(XMVectorGetY(forward)) > 0.99f ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMMATRIX lightView = XMMatrixLookToLH(XMLoadFloat3(&position), forward, up);
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(2.0f * angle, 1.0f, range * 0.001f, range);
+	XMStoreFloat4x4(&cascade.ViewProjection, lightView * projection);
+
+	cascade.Sphere = XMFLOAT4(position.x, position.y, position.z, range);
+	cascade.SplitNear = 0.0f;
+	cascade.SplitFar = FLT_MAX;
+	cascade.TexelSize = 0.0f;
+	Culling::ExtractFrustum(cascade.ViewProjection, cascade.Casters);
+}
+
+bool ShadowCascades::IsCasterVisible(const ShadowCascade& cascade, const XMFLOAT4& sphere)
+{
+	return Culling::IsSphereVisible(cascade.Casters, sphere);
+}
+
+void ShadowCascades::CullCasters(const ShadowCascade* cascades, uint32_t cascadeCount, const XMFLOAT4* spheres, size_t count,
+	uint8_t* visible, uint32_t* counts, JobSystem* pJobs)
+{
+	for (uint32_t i = 0; i < cascadeCount; ++i)
+	{
+		counts[i] = Culling::CullSpheres(cascades[i].Casters, spheres, count, visible + i * count, pJobs);
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "Culling.h"
+
+using namespace DirectX;
+
+class JobSystem;
+
+// Cascades a directional light's map is split into, shader.fx has the same maximum
+#define SHADOW_MIN_CASCADES 2
+#define SHADOW_MAX_CASCADES 4
+// Texels along each side of one cascade's map
+#define SHADOW_MAP_SIZE 2048
+// View depth the last cascade ends at, past this the scene is unshadowed
+#define SHADOW_DISTANCE 50.0f
+// Practical split scheme blend, 0 splits evenly and 1 logarithmically
+#define SHADOW_SPLIT_LAMBDA 0.75f
+
+// One shadow map and the part of the camera's view it covers
+struct ShadowCascade
+{
+	XMFLOAT4X4		ViewProjection;	// world to the map's clip space, row vectors
+	XMFLOAT4		Sphere;			// the camera slice it was fitted to, world space centre and radius
+	float			SplitNear;		// view depth range of that slice
+	float			SplitFar;
+	float			TexelSize;		// world units per map texel, 0 for a perspective map
+	CullingFrustum	Casters;		// where a caster has to be to land in the map
+};
+
+// Shadow map fitting for the key light. A directional light's view is cut into
+// slices along the camera's depth and each slice gets its own orthographic map.
+// Each map is fitted to the bounding sphere of its slice, which only changes size
+// with the projection, and its window moves across the light's view in whole
+// texels, so edges don't shimmer as the camera moves and turns. A spot light gets
+// one perspective map along its cone. Casters are culled per map: anything whose
+// bounds miss a map's volume, stretched back to the light, can't draw into it.
+namespace ShadowCascades
+{
+	// count + 1 view depths from nearZ to farZ, blended between even and logarithmic splits by lambda
+	void ComputeSplits(float nearZ, float farZ, uint32_t count, float lambda, float* splits);
+
+	// Smallest sphere around the camera frustum between two view depths, in world space.
+	// Takes a row vector D3D perspective matrix.
+	XMFLOAT4 GetSliceSphere(const XMFLOAT4X4& view, const XMFLOAT4X4& projection, float nearZ, float farZ);
+
+	// Orthographic map around the sphere looking along the light's direction, snapped
+	// to whole texels. Casters in front of the map are kept, the depth only pass clamps
+	// them onto its near plane instead of clipping them.
+	void FitDirectional(const XMFLOAT4& sphere, const XMFLOAT3& lightDirection, uint32_t mapSize, ShadowCascade& cascade);
+
+	// Splits the camera's view up to shadowDistance and fits a map to each slice
+	void FitCascades(const XMFLOAT4X4& view, const XMFLOAT4X4& projection, const XMFLOAT3& lightDirection, uint32_t count,
+		float lambda, float shadowDistance, uint32_t mapSize, ShadowCascade* cascades);
+
+	// Perspective map down a spot light's cone, angle is half the cone's
+	void FitSpot(const XMFLOAT3& position, const XMFLOAT3& direction, float angle, float range, ShadowCascade& cascade);
+
+	// Caster sphere centre in xyz, radius in w
+	bool IsCasterVisible(const ShadowCascade& cascade, const XMFLOAT4& sphere);
+
+	// visible holds a row of count flags per cascade, counts one total per cascade.
+	// Each cascade's casters are culled separately, split across the job system's threads.
+	void CullCasters(const ShadowCascade* cascades, uint32_t cascadeCount, const XMFLOAT4* spheres, size_t count,
+		uint8_t* visible, uint32_t* counts, JobSystem* pJobs = nullptr);
+}
@@ -0,0 +1,96 @@
+#include "SkinnedMesh.h"
+
+SkinnedMesh::SkinnedMesh() : DrawableGameObject()
+{
+
+}
+
+SkinnedMesh::~SkinnedMesh()
+{
+	cleanup();
+}
+
+void SkinnedMesh::SetBindPose(const std::vector<SkinnedVertex>& vertices, uint32_t boneCount)
+{
+	m_bindPose = vertices;
+	Skinning::ClampBoneIndices(m_bindPose.data(), m_bindPose.size(), boneCount);
+}
+
+HRESULT SkinnedMesh::initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext)
+{
+	if (m_bindPose.empty())
+		return E_FAIL;
+
+	// Dynamic so the skinned vertices can be rewritten every frame
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = sizeof(SimpleVertex) * (UINT)m_bindPose.size();
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	HRESULT hr = pd3dDevice->CreateBuffer(&bd, nullptr, &m_pVertexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	// load and setup textures
+	hr = CreateDDSTextureFromFile(pd3dDevice, L"Resources\\colorBone.dds", nullptr, &m_pTextureResourceView);
+	hr = CreateDDSTextureFromFile(pd3dDevice, L"Resources\\normals.dds", nullptr, &m_pNormalTexture);
+	hr = CreateDDSTextureFromFile(pd3dDevice, L"Resources\\displacement.dds", nullptr, &m_pParallaxTexture);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_SAMPLER_DESC sampDesc;
+	ZeroMemory(&sampDesc, sizeof(sampDesc));
+	sampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	sampDesc.MinLOD = 0;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	m_pSamplerLinear = m_pStateCache->GetSamplerState(sampDesc);
+
+	return m_pSamplerLinear ? S_OK : E_FAIL;
+}
+
+void SkinnedMesh::Skin(ID3D11DeviceContext* pContext, const SkinningPalette& palette, JobSystem* pJobs)
+{
+	if (!m_pVertexBuffer)
+		return;
+
+	// Discard hands back fresh memory, so the skinning jobs never wait on the GPU.
+	// The mapped memory is write-combined: every vertex is written once, in order.
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(pContext->Map(m_pVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+
+	Skinning::SkinVertices(m_bindPose.data(), static_cast<SimpleVertex*>(mapped.pData), m_bindPose.size(), palette, m_mode, pJobs);
+
+	pContext->Unmap(m_pVertexBuffer, 0);
+}
+
+void SkinnedMesh::draw(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* texture)
+{
+	draw(pContext);
+}
+
+void SkinnedMesh::draw(ID3D11DeviceContext* pContext)
+{
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+	pContext->IASetVertexBuffers(0, 1, &m_pVertexBuffer, &stride, &offset);
+	pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
+
+	pContext->PSSetShaderResources(0, 1, &m_pTextureResourceView);
+	pContext->PSSetShaderResources(1, 1, &m_pNormalTexture);
+	pContext->PSSetShaderResources(2, 1, &m_pParallaxTexture);
+	pContext->DSSetSamplers(0, 1, &m_pSamplerLinear);
+	pContext->PSSetSamplers(0, 1, &m_pSamplerLinear);
+
+	pContext->Draw((UINT)m_bindPose.size(), 0);
+}
+
+void SkinnedMesh::Submit(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info)
+{
+	SubmitPacket(pQueue, pBackend, info, GetDefaultMaterial(), (UINT)m_bindPose.size());
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "DrawableGameObject.h"
+#include "Skinning.h"
+#include <vector>
+
+class JobSystem;
+
+// Mesh deformed on the CPU by a bone palette. The skinned vertices are written
+// straight into a dynamic vertex buffer each frame using MAP_WRITE_DISCARD.
+class SkinnedMesh : public DrawableGameObject
+{
+public:
+	SkinnedMesh();
+	~SkinnedMesh();
+
+	// Bone indices past boneCount are clamped to its last bone
+	void SetBindPose(const std::vector<SkinnedVertex>& vertices, uint32_t boneCount);
+	HRESULT	initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext);
+
+	void Skin(ID3D11DeviceContext* pContext, const SkinningPalette& palette, JobSystem* pJobs);
+
+	void draw(ID3D11DeviceContext* pContext);
+	void draw(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* texture);
+	void Submit(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info);
+
+	void SetMode(SkinningMode mode) { m_mode = mode; }
+	SkinningMode GetMode() { return m_mode; }
+	UINT GetVertexCount() { return (UINT)m_bindPose.size(); }
+
+private:
+	std::vector<SkinnedVertex> m_bindPose;
+	SkinningMode m_mode = LinearBlendSkinning;
+};
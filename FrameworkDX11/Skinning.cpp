@@ -0,0 +1,285 @@
+#include "Skinning.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+#define SKINNING_BATCH_SIZE 1024
+// Vertices transformed together, one per SIMD lane
+#define SKINNING_LANES 4
+
+// One float3 attribute of SKINNING_LANES vertices, a vector per component
+struct SkinningLanes
+{
+	XMVECTOR	X;
+	XMVECTOR	Y;
+	XMVECTOR	Z;
+};
+
+static inline SkinningLanes LoadLanes(const SkinnedVertex* const* lanes, XMFLOAT3 SkinnedVertex::* attribute)
+{
+	XMMATRIX m = XMMatrixTranspose(XMMATRIX(XMLoadFloat3(&(lanes[0]->*attribute)), XMLoadFloat3(&(lanes[1]->*attribute)),
+		XMLoadFloat3(&(lanes[2]->*attribute)), XMLoadFloat3(&(lanes[3]->*attribute))));
+	return { m.r[0], m.r[1], m.r[2] };
+}
+
+// m[r].r[c] is element c of row r of every lane's float3x4, translation only for points
+static inline SkinningLanes TransformLanes(const XMMATRIX* m, const SkinningLanes& v, bool point)
+{
+	SkinningLanes out;
+	XMVECTOR* components[3] = { &out.X, &out.Y, &out.Z };
+	for (int r = 0; r < 3; ++r)
+	{
+		XMVECTOR result = point ? m[r].r[3] : XMVectorZero();
+		result = XMVectorMultiplyAdd(m[r].r[0], v.X, result);
+		result = XMVectorMultiplyAdd(m[r].r[1], v.Y, result);
+		*components[r] = XMVectorMultiplyAdd(m[r].r[2], v.Z, result);
+	}
+	return out;
+}
+
+// A zero length stays zero, as with XMVector3Normalize
+static inline SkinningLanes NormaliseLanes(const SkinningLanes& v)
+{
+	XMVECTOR lengthSq = XMVectorMultiplyAdd(v.Z, v.Z, XMVectorMultiplyAdd(v.Y, v.Y, XMVectorMultiply(v.X, v.X)));
+	XMVECTOR scale = XMVectorSelect(XMVectorZero(), XMVectorReciprocalSqrt(lengthSq), XMVectorGreater(lengthSq, XMVectorZero()));
+	return { XMVectorMultiply(v.X, scale), XMVectorMultiply(v.Y, scale), XMVectorMultiply(v.Z, scale) };
+}
+
+static inline SkinningLanes CrossLanes(const SkinningLanes& a, const SkinningLanes& b)
+{
+	return { XMVectorNegativeMultiplySubtract(a.Z, b.Y, XMVectorMultiply(a.Y, b.Z)),
+		XMVectorNegativeMultiplySubtract(a.X, b.Z, XMVectorMultiply(a.Z, b.X)),
+		XMVectorNegativeMultiplySubtract(a.Y, b.X, XMVectorMultiply(a.X, b.Y)) };
+}
+
+// Rotates v by the unit quaternion (q, w): v + 2w(q x v) + 2q x (q x v)
+static inline SkinningLanes RotateLanes(const SkinningLanes& v, const SkinningLanes& q, FXMVECTOR w)
+{
+	SkinningLanes t = CrossLanes(q, v);
+	t = { XMVectorAdd(t.X, t.X), XMVectorAdd(t.Y, t.Y), XMVectorAdd(t.Z, t.Z) };
+	SkinningLanes u = CrossLanes(q, t);
+	return { XMVectorAdd(XMVectorMultiplyAdd(w, t.X, v.X), u.X), XMVectorAdd(XMVectorMultiplyAdd(w, t.Y, v.Y), u.Y),
+		XMVectorAdd(XMVectorMultiplyAdd(w, t.Z, v.Z), u.Z) };
+}
+
+// Back to a vector per vertex, only the first count lanes are real vertices
+static inline void StoreLanes(SimpleVertex* output, const SkinnedVertex* const* lanes, size_t count,
+	const SkinningLanes& pos, const SkinningLanes& normal, const SkinningLanes& tangent, const SkinningLanes& binormal)
+{
+	XMMATRIX p = XMMatrixTranspose(XMMATRIX(pos.X, pos.Y, pos.Z, XMVectorZero()));
+	XMMATRIX n = XMMatrixTranspose(XMMATRIX(normal.X, normal.Y, normal.Z, XMVectorZero()));
+	XMMATRIX t = XMMatrixTranspose(XMMATRIX(tangent.X, tangent.Y, tangent.Z, XMVectorZero()));
+	XMMATRIX b = XMMatrixTranspose(XMMATRIX(binormal.X, binormal.Y, binormal.Z, XMVectorZero()));
+	for (size_t k = 0; k < count; ++k)
+	{
+		SimpleVertex& out = output[k];
+		XMStoreFloat3(&out.Pos, p.r[k]);
+		XMStoreFloat3(&out.Normal, n.r[k]);
+		out.TexCoord = lanes[k]->TexCoord;
+		XMStoreFloat3(&out.Tangent, t.r[k]);
+		XMStoreFloat3(&out.BiTangent, b.r[k]);
+	}
+}
+
+// A short last batch repeats its last vertex in the spare lanes, which aren't stored
+static inline size_t GetLanes(const SkinnedVertex* bindPose, size_t i, size_t end, const SkinnedVertex** lanes)
+{
+	size_t count = std::min<size_t>(SKINNING_LANES, end - i);
+	for (size_t k = 0; k < SKINNING_LANES; ++k)
+	{
+		lanes[k] = &bindPose[i + std::min(k, count - 1)];
+	}
+	return count;
+}
+
+void Skinning::BuildPalette(const XMFLOAT4X4* skinTransforms, uint32_t boneCount, SkinningPalette& palette)
+{
+	if (boneCount > MAX_BONES)
+		boneCount = MAX_BONES;
+	palette.BoneCount = boneCount;
+
+	for (uint32_t i = 0; i < boneCount; ++i)
+	{
+		XMMATRIX m = XMLoadFloat4x4(&skinTransforms[i]);
+
+		// Columns of the row-vector transform become the float3x4 rows
+		XMMATRIX t = XMMatrixTranspose(m);
+		XMStoreFloat4(&palette.Matrices[i * 3 + 0], t.r[0]);
+		XMStoreFloat4(&palette.Matrices[i * 3 + 1], t.r[1]);
+		XMStoreFloat4(&palette.Matrices[i * 3 + 2], t.r[2]);
+
+		// Real part is the rotation, dual part is half the translation times the rotation
+		XMVECTOR real = XMQuaternionNormalize(XMQuaternionRotationMatrix(m));
+		XMVECTOR translation = XMVectorSetW(m.r[3], 0.0f);
+		XMVECTOR dual = XMVectorScale(XMQuaternionMultiply(real, translation), 0.5f);
+		XMStoreFloat4(&palette.DualQuaternions[i * 2 + 0], real);
+		XMStoreFloat4(&palette.DualQuaternions[i * 2 + 1], dual);
+	}
+
+	// The rest are identity, so nothing in the palette is left unwritten
+	for (uint32_t i = boneCount; i < MAX_BONES; ++i)
+	{
+		palette.Matrices[i * 3 + 0] = XMFLOAT4(1.0f, 0.0f, 0.0f, 0.0f);
+		palette.Matrices[i * 3 + 1] = XMFLOAT4(0.0f, 1.0f, 0.0f, 0.0f);
+		palette.Matrices[i * 3 + 2] = XMFLOAT4(0.0f, 0.0f, 1.0f, 0.0f);
+		palette.DualQuaternions[i * 2 + 0] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+		palette.DualQuaternions[i * 2 + 1] = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+}
+
+size_t Skinning::ClampBoneIndices(SkinnedVertex* vertices, size_t vertexCount, uint32_t boneCount)
+{
+	uint32_t last = std::min(std::max(boneCount, 1u), (uint32_t)MAX_BONES) - 1;
+	size_t clamped = 0;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		for (int k = 0; k < MAX_BONE_INFLUENCES; ++k)
+		{
+			if (vertices[i].BoneIndices[k] > last)
+			{
+				vertices[i].BoneIndices[k] = (uint8_t)last;
+				++clamped;
+			}
+		}
+	}
+	return clamped;
+}
+
+void Skinning::SkinLinearBlend(const SkinnedVertex* bindPose, SimpleVertex* output, size_t begin, size_t end, const XMVECTOR* boneRows)
+{
+	for (size_t i = begin; i < end; i += SKINNING_LANES)
+	{
+		const SkinnedVertex* lanes[SKINNING_LANES];
+		size_t count = GetLanes(bindPose, i, end, lanes);
+
+		// Blend each vertex's four bone matrices, one SIMD multiply-add per row and influence
+		XMMATRIX rows[3];
+		for (int k = 0; k < SKINNING_LANES; ++k)
+		{
+			const SkinnedVertex& v = *lanes[k];
+			XMVECTOR weights = XMLoadFloat4(&v.BoneWeights);
+			const XMVECTOR* m0 = &boneRows[v.BoneIndices[0] * 3];
+			const XMVECTOR* m1 = &boneRows[v.BoneIndices[1] * 3];
+			const XMVECTOR* m2 = &boneRows[v.BoneIndices[2] * 3];
+			const XMVECTOR* m3 = &boneRows[v.BoneIndices[3] * 3];
+			XMVECTOR w0 = XMVectorSplatX(weights);
+			XMVECTOR w1 = XMVectorSplatY(weights);
+			XMVECTOR w2 = XMVectorSplatZ(weights);
+			XMVECTOR w3 = XMVectorSplatW(weights);
+			for (int r = 0; r < 3; ++r)
+			{
+				XMVECTOR row = XMVectorMultiply(m0[r], w0);
+				row = XMVectorMultiplyAdd(m1[r], w1, row);
+				row = XMVectorMultiplyAdd(m2[r], w2, row);
+				rows[r].r[k] = XMVectorMultiplyAdd(m3[r], w3, row);
+			}
+		}
+
+		// A lane per vertex from here on
+		XMMATRIX m[3] = { XMMatrixTranspose(rows[0]), XMMatrixTranspose(rows[1]), XMMatrixTranspose(rows[2]) };
+		SkinningLanes pos = TransformLanes(m, LoadLanes(lanes, &SkinnedVertex::Pos), true);
+		SkinningLanes normal = NormaliseLanes(TransformLanes(m, LoadLanes(lanes, &SkinnedVertex::Normal), false));
+		SkinningLanes tangent = NormaliseLanes(TransformLanes(m, LoadLanes(lanes, &SkinnedVertex::Tangent), false));
+		SkinningLanes binormal = NormaliseLanes(TransformLanes(m, LoadLanes(lanes, &SkinnedVertex::BiTangent), false));
+
+		StoreLanes(output + i, lanes, count, pos, normal, tangent, binormal);
+	}
+}
+
+void Skinning::SkinDualQuaternion(const SkinnedVertex* bindPose, SimpleVertex* output, size_t begin, size_t end, const SkinningPalette& palette)
+{
+	const XMFLOAT4* dq = palette.DualQuaternions;
+	for (size_t i = begin; i < end; i += SKINNING_LANES)
+	{
+		const SkinnedVertex* lanes[SKINNING_LANES];
+		size_t count = GetLanes(bindPose, i, end, lanes);
+
+		XMMATRIX reals, duals;
+		for (int lane = 0; lane < SKINNING_LANES; ++lane)
+		{
+			const SkinnedVertex& v = *lanes[lane];
+			const float weights[MAX_BONE_INFLUENCES] = { v.BoneWeights.x, v.BoneWeights.y, v.BoneWeights.z, v.BoneWeights.w };
+
+			XMVECTOR pivot = XMLoadFloat4(&dq[v.BoneIndices[0] * 2]);
+			XMVECTOR real = XMVectorZero();
+			XMVECTOR dual = XMVectorZero();
+			for (int k = 0; k < MAX_BONE_INFLUENCES; ++k)
+			{
+				XMVECTOR r = XMLoadFloat4(&dq[v.BoneIndices[k] * 2 + 0]);
+				XMVECTOR d = XMLoadFloat4(&dq[v.BoneIndices[k] * 2 + 1]);
+
+				// Keep every rotation in the same hemisphere as the first influence
+				float w = weights[k];
+				if (XMVectorGetX(XMVector4Dot(r, pivot)) < 0.0f)
+					w = -w;
+
+				XMVECTOR wv = XMVectorReplicate(w);
+				real = XMVectorMultiplyAdd(r, wv, real);
+				dual = XMVectorMultiplyAdd(d, wv, dual);
+			}
+			reals.r[lane] = real;
+			duals.r[lane] = dual;
+		}
+
+		// A lane per vertex from here on: normalise, then xyz and w of both parts
+		reals = XMMatrixTranspose(reals);
+		duals = XMMatrixTranspose(duals);
+		XMVECTOR lengthSq = XMVectorMultiply(reals.r[0], reals.r[0]);
+		for (int c = 1; c < 4; ++c)
+		{
+			lengthSq = XMVectorMultiplyAdd(reals.r[c], reals.r[c], lengthSq);
+		}
+		XMVECTOR invLength = XMVectorReciprocalSqrt(lengthSq);
+		SkinningLanes real = { XMVectorMultiply(reals.r[0], invLength), XMVectorMultiply(reals.r[1], invLength), XMVectorMultiply(reals.r[2], invLength) };
+		SkinningLanes dual = { XMVectorMultiply(duals.r[0], invLength), XMVectorMultiply(duals.r[1], invLength), XMVectorMultiply(duals.r[2], invLength) };
+		XMVECTOR realW = XMVectorMultiply(reals.r[3], invLength);
+		XMVECTOR dualW = XMVectorMultiply(duals.r[3], invLength);
+
+		// t = 2 * (w_r * d.xyz - w_d * r.xyz + r.xyz x d.xyz)
+		SkinningLanes translation = CrossLanes(real, dual);
+		translation.X = XMVectorNegativeMultiplySubtract(dualW, real.X, XMVectorMultiplyAdd(realW, dual.X, translation.X));
+		translation.Y = XMVectorNegativeMultiplySubtract(dualW, real.Y, XMVectorMultiplyAdd(realW, dual.Y, translation.Y));
+		translation.Z = XMVectorNegativeMultiplySubtract(dualW, real.Z, XMVectorMultiplyAdd(realW, dual.Z, translation.Z));
+
+		SkinningLanes pos = RotateLanes(LoadLanes(lanes, &SkinnedVertex::Pos), real, realW);
+		pos = { XMVectorAdd(pos.X, XMVectorAdd(translation.X, translation.X)), XMVectorAdd(pos.Y, XMVectorAdd(translation.Y, translation.Y)),
+			XMVectorAdd(pos.Z, XMVectorAdd(translation.Z, translation.Z)) };
+		SkinningLanes normal = RotateLanes(LoadLanes(lanes, &SkinnedVertex::Normal), real, realW);
+		SkinningLanes tangent = RotateLanes(LoadLanes(lanes, &SkinnedVertex::Tangent), real, realW);
+		SkinningLanes binormal = RotateLanes(LoadLanes(lanes, &SkinnedVertex::BiTangent), real, realW);
+
+		StoreLanes(output + i, lanes, count, pos, normal, tangent, binormal);
+	}
+}
+
+void Skinning::SkinVertices(const SkinnedVertex* bindPose, SimpleVertex* output, size_t vertexCount,
+	const SkinningPalette& palette, SkinningMode mode, JobSystem* pJobs)
+{
+	if (mode == DualQuaternionSkinning)
+	{
+		auto job = [&](size_t begin, size_t end, unsigned)
+		{
+			SkinDualQuaternion(bindPose, output, begin, end, palette);
+		};
+		if (pJobs)
+			pJobs->ParallelFor(vertexCount, SKINNING_BATCH_SIZE, job);
+		else
+			job(0, vertexCount, 0);
+		return;
+	}
+
+	// Load the palette rows into registers' layout once per call
+	XMVECTOR boneRows[MAX_BONES * 3];
+	for (uint32_t i = 0; i < MAX_BONES * 3; ++i)
+	{
+		boneRows[i] = XMLoadFloat4(&palette.Matrices[i]);
+	}
+
+	auto job = [&](size_t begin, size_t end, unsigned)
+	{
+		SkinLinearBlend(bindPose, output, begin, end, boneRows);
+	};
+	if (pJobs)
+		pJobs->ParallelFor(vertexCount, SKINNING_BATCH_SIZE, job);
+	else
+		job(0, vertexCount, 0);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "VertexTypes.h"
+
+using namespace DirectX;
+
+class JobSystem;
+
+#define MAX_BONES 64
+
+enum SkinningMode
+{
+	LinearBlendSkinning = 0,
+	DualQuaternionSkinning = 1
+};
+
+// Per-bone skinning transforms in the layout a shader would read them.
+// Matrices are stored as the three rows of the transposed affine transform
+// (float3x4 in HLSL, 48 bytes per bone) and dual quaternions as real/dual
+// pairs, so the palette can be copied straight into a constant buffer.
+struct SkinningPalette
+{
+	XMFLOAT4	Matrices[MAX_BONES * 3];
+	XMFLOAT4	DualQuaternions[MAX_BONES * 2];
+	uint32_t	BoneCount;
+	uint32_t	Padding[3];
+};
+
+namespace Skinning
+{
+	// skinTransforms are bone world transforms multiplied by the inverse bind pose.
+	// Dual quaternion skinning ignores scale, so the transforms should be rigid.
+	void BuildPalette(const XMFLOAT4X4* skinTransforms, uint32_t boneCount, SkinningPalette& palette);
+
+	// Clamps every influence to the last of boneCount bones, so a bad index skins with
+	// a real bone instead of reading past the palette. Returns how many were clamped.
+	size_t ClampBoneIndices(SkinnedVertex* vertices, size_t vertexCount, uint32_t boneCount);
+
+	// Skins vertexCount vertices from bindPose into output. With a job system the
+	// vertices are split into batches across its threads, otherwise runs inline.
+	// Bone indices must be below palette.BoneCount, see ClampBoneIndices.
+	void SkinVertices(const SkinnedVertex* bindPose, SimpleVertex* output, size_t vertexCount,
+		const SkinningPalette& palette, SkinningMode mode, JobSystem* pJobs = nullptr);
+
+	// Single threaded kernels for a vertex range, used by SkinVertices. Each blends
+	// its influences one vertex at a time, then transforms and normalises four
+	// vertices at once with a lane per vertex. boneRows are the palette's matrix rows.
+	void SkinLinearBlend(const SkinnedVertex* bindPose, SimpleVertex* output, size_t begin, size_t end,
+		const XMVECTOR* boneRows);
+	void SkinDualQuaternion(const SkinnedVertex* bindPose, SimpleVertex* output, size_t begin, size_t end,
+		const SkinningPalette& palette);
+}
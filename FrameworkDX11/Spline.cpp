@@ -1,25 +1,28 @@
 #include "Spline.h"
+#include <math.h>
 
 Spline::Spline(ID3D11Device* g_pd3dDevice)
 {
+	// Default curve winds around the centre of the scene
+	std::vector<XMFLOAT3> points;
 	for (size_t i = 0; i < POINT_COUNT; ++i)
 	{
-		m_Points[i] = { {0, 0, 0}, {0, 0} };
+		float angle = XM_2PI * i / (POINT_COUNT - 1);
+		points.push_back({ 12.0f + 4.0f * cosf(angle), 1.0f + sinf(angle * 2.0f), 12.0f + 4.0f * sinf(angle) });
 	}
+	m_curve.SetControlPoints(points);
 
 	D3D11_BUFFER_DESC bd = {};
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(SCREEN_VERTEX) * POINT_COUNT;
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = sizeof(SCREEN_VERTEX) * SPLINE_MAX_VERTICES;
 	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	bd.CPUAccessFlags = 0;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 
 	// Create vertex buffer
-	D3D11_SUBRESOURCE_DATA InitData = {};
-	InitData.pSysMem = m_Points;
-	HRESULT hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pSplineVB);
+	HRESULT hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pSplineVB);
 	if (FAILED(hr))
 	{
-
+		g_pSplineVB = nullptr;
 	}
 }
 
@@ -28,8 +31,51 @@ Spline::~Spline()
 	if (g_pSplineVB) g_pSplineVB->Release();
 }
 
+void Spline::Update(ID3D11DeviceContext* g_pImmediateContext, const SplineTessellationSettings& settings)
+{
+	if (!g_pSplineVB)
+		return;
+
+	// Quantise the allowed world space error so small camera moves don't re-tessellate
+	XMVECTOR centre = m_curve.Evaluate(0.5f * m_curve.GetSegmentCount());
+	float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(centre, XMLoadFloat3(&settings.CameraPosition))));
+	int errorLevel = (int)floorf(log2f(distance * settings.PixelError + 1e-3f));
+
+	if (m_uploadedVersion == m_curve.GetVersion() && m_errorLevel == errorLevel)
+		return;
+
+	m_tessellation.clear();
+	m_curve.Tessellate(settings, m_tessellation);
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(g_pImmediateContext->Map(g_pSplineVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+
+	m_vertexCount = (UINT)m_tessellation.size();
+	if (m_vertexCount > SPLINE_MAX_VERTICES)
+		m_vertexCount = SPLINE_MAX_VERTICES;
+
+	SCREEN_VERTEX* vertices = static_cast<SCREEN_VERTEX*>(mapped.pData);
+	for (UINT i = 0; i < m_vertexCount; ++i)
+	{
+		vertices[i] = { m_tessellation[i], { (float)i / m_vertexCount, 0.0f } };
+	}
+	g_pImmediateContext->Unmap(g_pSplineVB, 0);
+
+	m_uploadedVersion = m_curve.GetVersion();
+	m_errorLevel = errorLevel;
+	++m_uploadCount;
+}
+
 void Spline::Render(ID3D11DeviceContext* g_pImmediateContext, ID3D11InputLayout* g_pQuadLayout)
 {
+	if (!g_pSplineVB || m_vertexCount < 2)
+		return;
+
+	UINT stride = sizeof(SCREEN_VERTEX);
+	UINT offset = 0;
+	g_pImmediateContext->IASetVertexBuffers(0, 1, &g_pSplineVB, &stride, &offset);
 	g_pImmediateContext->IASetInputLayout(g_pQuadLayout);
 	g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP);
+	g_pImmediateContext->Draw(m_vertexCount, 0);
 }
@@ -1,10 +1,15 @@
 #pragma once
 #include "structures.h"
+#include "SplineCurve.h"
 #include <DirectXMath.h>
 #include <d3d11_1.h>
 
 #define POINT_COUNT 11
+#define SPLINE_MAX_VERTICES 4096
 
+// Draws a SplineCurve as a line strip. The curve is re-tessellated into a dynamic
+// vertex buffer only when its control points change, or when the camera distance
+// moves the allowed screen space error by more than a factor of two.
 class Spline
 {
 public:
@@ -12,10 +17,21 @@ public:
 	Spline(ID3D11Device* g_pd3dDevice);
 	~Spline();
 
+	SplineCurve* GetCurve() { return &m_curve; }
+
+	void Update(ID3D11DeviceContext* g_pImmediateContext, const SplineTessellationSettings& settings);
 	void Render(ID3D11DeviceContext* g_pImmediateContext, ID3D11InputLayout* g_pQuadLayout);
 
+	UINT GetVertexCount() { return m_vertexCount; }
+	UINT GetUploadCount() { return m_uploadCount; }
+
 private:
-	SCREEN_VERTEX m_Points[POINT_COUNT];
+	SplineCurve m_curve;
+	std::vector<XMFLOAT3> m_tessellation;
 
 	ID3D11Buffer* g_pSplineVB = nullptr;
-};
\ No newline at end of file
+	UINT m_vertexCount = 0;
+	UINT m_uploadCount = 0;
+	uint32_t m_uploadedVersion = ~0u;
+	int m_errorLevel = 0;
+};
@@ -0,0 +1,353 @@
+#include "SplineCurve.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <math.h>
+
+#define SPLINE_ARC_SAMPLES 16
+#define SPLINE_BATCH_SIZE 64
+#define SPLINE_CURVE_BATCH 16
+
+// Rows multiply [t^3 t^2 t 1], columns are the four control points
+static const XMFLOAT4 g_splineBasis[3][4] =
+{
+	// Catmull-Rom
+	{
+		{ -0.5f,  1.5f, -1.5f,  0.5f },
+		{  1.0f, -2.5f,  2.0f, -0.5f },
+		{ -0.5f,  0.0f,  0.5f,  0.0f },
+		{  0.0f,  1.0f,  0.0f,  0.0f },
+	},
+	// Bezier
+	{
+		{ -1.0f,  3.0f, -3.0f,  1.0f },
+		{  3.0f, -6.0f,  3.0f,  0.0f },
+		{ -3.0f,  3.0f,  0.0f,  0.0f },
+		{  1.0f,  0.0f,  0.0f,  0.0f },
+	},
+	// Uniform cubic B-spline
+	{
+		{ -1.0f / 6.0f,  3.0f / 6.0f, -3.0f / 6.0f, 1.0f / 6.0f },
+		{  3.0f / 6.0f, -6.0f / 6.0f,  3.0f / 6.0f, 0.0f },
+		{ -3.0f / 6.0f,  0.0f,         3.0f / 6.0f, 0.0f },
+		{  1.0f / 6.0f,  4.0f / 6.0f,  1.0f / 6.0f, 0.0f },
+	},
+};
+
+// Three point Gauss-Legendre rule on [0, 1]
+static const float g_gaussPoints[3] = { 0.1127017f, 0.5f, 0.8872983f };
+static const float g_gaussWeights[3] = { 0.2777778f, 0.4444444f, 0.2777778f };
+
+XMVECTOR SplineMath::Weights(SplineType type, float t)
+{
+	const XMFLOAT4* basis = g_splineBasis[type];
+	XMVECTOR w = XMLoadFloat4(&basis[3]);
+	w = XMVectorMultiplyAdd(XMVectorReplicate(t), XMLoadFloat4(&basis[2]), w);
+	w = XMVectorMultiplyAdd(XMVectorReplicate(t * t), XMLoadFloat4(&basis[1]), w);
+	return XMVectorMultiplyAdd(XMVectorReplicate(t * t * t), XMLoadFloat4(&basis[0]), w);
+}
+
+XMVECTOR SplineMath::DerivativeWeights(SplineType type, float t)
+{
+	const XMFLOAT4* basis = g_splineBasis[type];
+	XMVECTOR w = XMLoadFloat4(&basis[2]);
+	w = XMVectorMultiplyAdd(XMVectorReplicate(2.0f * t), XMLoadFloat4(&basis[1]), w);
+	return XMVectorMultiplyAdd(XMVectorReplicate(3.0f * t * t), XMLoadFloat4(&basis[0]), w);
+}
+
+static inline XMVECTOR Combine(FXMVECTOR weights, const XMVECTOR points[4])
+{
+	XMVECTOR p = XMVectorMultiply(XMVectorSplatX(weights), points[0]);
+	p = XMVectorMultiplyAdd(XMVectorSplatY(weights), points[1], p);
+	p = XMVectorMultiplyAdd(XMVectorSplatZ(weights), points[2], p);
+	return XMVectorMultiplyAdd(XMVectorSplatW(weights), points[3], p);
+}
+
+void SplineMath::EvaluateSegment(SplineType type, const XMVECTOR points[4], const float* t, size_t count, XMFLOAT3* out)
+{
+	const XMFLOAT4* basis = g_splineBasis[type];
+
+	// Control point coordinates replicated across the lanes
+	XMVECTOR px[4], py[4], pz[4];
+	for (int j = 0; j < 4; ++j)
+	{
+		px[j] = XMVectorSplatX(points[j]);
+		py[j] = XMVectorSplatY(points[j]);
+		pz[j] = XMVectorSplatZ(points[j]);
+	}
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		size_t lanes = std::min<size_t>(4, count - i);
+		XMFLOAT4 tLanes(t[i], t[i + (lanes > 1 ? 1 : 0)], t[i + (lanes > 2 ? 2 : 0)], t[i + (lanes > 3 ? 3 : 0)]);
+		XMVECTOR t1 = XMLoadFloat4(&tLanes);
+		XMVECTOR t2 = XMVectorMultiply(t1, t1);
+		XMVECTOR t3 = XMVectorMultiply(t2, t1);
+
+		// Four parameters per step: weight j for every lane, then the weighted sum per axis
+		XMVECTOR x = XMVectorZero();
+		XMVECTOR y = XMVectorZero();
+		XMVECTOR z = XMVectorZero();
+		for (int j = 0; j < 4; ++j)
+		{
+			XMVECTOR w = XMVectorReplicate((&basis[3].x)[j]);
+			w = XMVectorMultiplyAdd(t1, XMVectorReplicate((&basis[2].x)[j]), w);
+			w = XMVectorMultiplyAdd(t2, XMVectorReplicate((&basis[1].x)[j]), w);
+			w = XMVectorMultiplyAdd(t3, XMVectorReplicate((&basis[0].x)[j]), w);
+			x = XMVectorMultiplyAdd(w, px[j], x);
+			y = XMVectorMultiplyAdd(w, py[j], y);
+			z = XMVectorMultiplyAdd(w, pz[j], z);
+		}
+
+		XMFLOAT4 xs, ys, zs;
+		XMStoreFloat4(&xs, x);
+		XMStoreFloat4(&ys, y);
+		XMStoreFloat4(&zs, z);
+		for (size_t lane = 0; lane < lanes; ++lane)
+		{
+			out[i + lane] = XMFLOAT3((&xs.x)[lane], (&ys.x)[lane], (&zs.x)[lane]);
+		}
+	}
+}
+
+void SplineMath::EvaluateCurves(const SplineCurve* const* curves, size_t curveCount, uint32_t pointsPerCurve, XMFLOAT3* out, JobSystem* pJobs)
+{
+	auto job = [&](size_t begin, size_t end, unsigned)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			curves[i]->EvaluateUniform(pointsPerCurve, out + i * pointsPerCurve);
+		}
+	};
+
+	if (pJobs)
+		pJobs->ParallelFor(curveCount, SPLINE_CURVE_BATCH, job);
+	else
+		job(0, curveCount, 0);
+}
+
+SplineCurve::SplineCurve(SplineType type)
+{
+	m_type = type;
+}
+
+void SplineCurve::SetType(SplineType type)
+{
+	m_type = type;
+	++m_version;
+}
+
+void SplineCurve::SetControlPoints(const std::vector<XMFLOAT3>& points)
+{
+	m_points = points;
+	++m_version;
+}
+
+void SplineCurve::SetControlPoint(size_t index, XMFLOAT3 point)
+{
+	if (index >= m_points.size())
+		return;
+
+	XMFLOAT3& current = m_points[index];
+	if (current.x == point.x && current.y == point.y && current.z == point.z)
+		return;
+
+	current = point;
+	++m_version;
+}
+
+uint32_t SplineCurve::GetSegmentCount() const
+{
+	if (m_points.size() < 4)
+		return 0;
+	if (m_type == SplineBezier)
+		return (uint32_t)(m_points.size() - 1) / 3;
+	return (uint32_t)m_points.size() - 3;
+}
+
+void SplineCurve::GetSegment(uint32_t segment, XMVECTOR points[4]) const
+{
+	size_t first = (m_type == SplineBezier) ? segment * 3 : segment;
+	for (int j = 0; j < 4; ++j)
+	{
+		points[j] = XMLoadFloat3(&m_points[first + j]);
+	}
+}
+
+XMVECTOR SplineCurve::Evaluate(float u) const
+{
+	uint32_t segments = GetSegmentCount();
+	if (segments == 0)
+		return m_points.empty() ? XMVectorZero() : XMLoadFloat3(&m_points[0]);
+
+	u = std::max(0.0f, std::min(u, (float)segments));
+	uint32_t segment = std::min((uint32_t)u, segments - 1);
+
+	XMVECTOR points[4];
+	GetSegment(segment, points);
+	return Combine(SplineMath::Weights(m_type, u - segment), points);
+}
+
+XMVECTOR SplineCurve::EvaluateTangent(float u) const
+{
+	uint32_t segments = GetSegmentCount();
+	if (segments == 0)
+		return XMVectorZero();
+
+	u = std::max(0.0f, std::min(u, (float)segments));
+	uint32_t segment = std::min((uint32_t)u, segments - 1);
+
+	XMVECTOR points[4];
+	GetSegment(segment, points);
+	return Combine(SplineMath::DerivativeWeights(m_type, u - segment), points);
+}
+
+// Gauss-Legendre estimate of the length between u0 and u1 inside one segment
+static float IntegrateLength(const SplineCurve& curve, float u0, float u1)
+{
+	float length = 0.0f;
+	for (int k = 0; k < 3; ++k)
+	{
+		float u = u0 + (u1 - u0) * g_gaussPoints[k];
+		length += g_gaussWeights[k] * XMVectorGetX(XMVector3Length(curve.EvaluateTangent(u)));
+	}
+	return length * (u1 - u0);
+}
+
+void SplineCurve::BuildArcLengthTable()
+{
+	uint32_t samples = GetSegmentCount() * SPLINE_ARC_SAMPLES;
+	m_arcLengths.resize(samples + 1);
+	m_arcLengths[0] = 0.0f;
+	for (uint32_t i = 0; i < samples; ++i)
+	{
+		float u0 = (float)i / SPLINE_ARC_SAMPLES;
+		float u1 = (float)(i + 1) / SPLINE_ARC_SAMPLES;
+		m_arcLengths[i + 1] = m_arcLengths[i] + IntegrateLength(*this, u0, u1);
+	}
+	m_arcVersion = m_version;
+}
+
+float SplineCurve::GetLength()
+{
+	if (m_arcVersion != m_version)
+		BuildArcLengthTable();
+	return m_arcLengths.back();
+}
+
+float SplineCurve::DistanceToParameter(float distance)
+{
+	if (m_arcVersion != m_version)
+		BuildArcLengthTable();
+	if (m_arcLengths.size() < 2)
+		return 0.0f;
+
+	distance = std::max(0.0f, std::min(distance, m_arcLengths.back()));
+
+	// Table lookup, then one Newton step against the exact length
+	size_t upper = std::upper_bound(m_arcLengths.begin(), m_arcLengths.end(), distance) - m_arcLengths.begin();
+	size_t lower = std::min(upper, m_arcLengths.size() - 1) - 1;
+	float span = m_arcLengths[lower + 1] - m_arcLengths[lower];
+	float fraction = span > 0.0f ? (distance - m_arcLengths[lower]) / span : 0.0f;
+
+	float u0 = (float)lower / SPLINE_ARC_SAMPLES;
+	float u = u0 + fraction / SPLINE_ARC_SAMPLES;
+	float speed = XMVectorGetX(XMVector3Length(EvaluateTangent(u)));
+	if (speed > 1e-6f)
+	{
+		float error = m_arcLengths[lower] + IntegrateLength(*this, u0, u) - distance;
+		u -= error / speed;
+	}
+	return std::max(0.0f, std::min(u, (float)GetSegmentCount()));
+}
+
+XMVECTOR SplineCurve::EvaluateAtDistance(float distance)
+{
+	return Evaluate(DistanceToParameter(distance));
+}
+
+void SplineCurve::Tessellate(const SplineTessellationSettings& settings, std::vector<XMFLOAT3>& out) const
+{
+	uint32_t segments = GetSegmentCount();
+	for (uint32_t segment = 0; segment < segments; ++segment)
+	{
+		XMVECTOR p0 = Evaluate((float)segment);
+		XMVECTOR p1 = Evaluate((float)segment + 1.0f);
+		if (segment == 0)
+		{
+			XMFLOAT3 first;
+			XMStoreFloat3(&first, p0);
+			out.push_back(first);
+		}
+		Subdivide(segment, 0.0f, 1.0f, p0, p1, 0, settings, out);
+	}
+}
+
+void SplineCurve::Subdivide(uint32_t segment, float t0, float t1, FXMVECTOR p0, FXMVECTOR p1, uint32_t depth,
+	const SplineTessellationSettings& settings, std::vector<XMFLOAT3>& out) const
+{
+	float tm = 0.5f * (t0 + t1);
+	XMVECTOR pm = Evaluate(segment + tm);
+
+	bool split = false;
+	if (depth < settings.MaxDepth)
+	{
+		// Size of a pixel at the midpoint's distance from the camera
+		float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(pm, XMLoadFloat3(&settings.CameraPosition))));
+		float worldPerPixel = 2.0f * distance * tanf(0.5f * settings.FieldOfViewY) / settings.ViewportHeight;
+		float chordError = XMVectorGetX(XMVector3Length(XMVectorSubtract(pm, XMVectorScale(XMVectorAdd(p0, p1), 0.5f))));
+		split = chordError > settings.PixelError * worldPerPixel;
+
+		// Curvature: how far the tangent turns across the span
+		if (!split)
+		{
+			XMVECTOR d0 = XMVector3Normalize(EvaluateTangent(segment + t0));
+			XMVECTOR d1 = XMVector3Normalize(EvaluateTangent(segment + t1));
+			split = XMVectorGetX(XMVector3Dot(d0, d1)) < cosf(settings.MaxAngle);
+		}
+	}
+
+	if (split)
+	{
+		Subdivide(segment, t0, tm, p0, pm, depth + 1, settings, out);
+		Subdivide(segment, tm, t1, pm, p1, depth + 1, settings, out);
+		return;
+	}
+
+	XMFLOAT3 end;
+	XMStoreFloat3(&end, p1);
+	out.push_back(end);
+}
+
+void SplineCurve::EvaluateUniform(uint32_t pointCount, XMFLOAT3* out) const
+{
+	uint32_t segments = GetSegmentCount();
+	if (segments == 0 || pointCount < 2)
+	{
+		for (uint32_t i = 0; i < pointCount; ++i)
+			XMStoreFloat3(&out[i], Evaluate(0.0f));
+		return;
+	}
+
+	// Points arrive in order, so gather each segment's parameters and evaluate them together
+	float step = (float)segments / (pointCount - 1);
+	float t[SPLINE_BATCH_SIZE];
+	uint32_t i = 0;
+	while (i < pointCount)
+	{
+		uint32_t segment = std::min((uint32_t)(i * step), segments - 1);
+		uint32_t first = i;
+		uint32_t count = 0;
+		while (i < pointCount && count < SPLINE_BATCH_SIZE)
+		{
+			float u = std::min(i * step, (float)segments);
+			if (std::min((uint32_t)u, segments - 1) != segment)
+				break;
+			t[count++] = u - segment;
+			++i;
+		}
+
+		XMVECTOR points[4];
+		GetSegment(segment, points);
+		SplineMath::EvaluateSegment(m_type, points, t, count, out + first);
+	}
+}
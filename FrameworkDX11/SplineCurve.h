@@ -0,0 +1,86 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace DirectX;
+
+class JobSystem;
+
+enum SplineType
+{
+	SplineCatmullRom = 0,
+	SplineBezier,
+	SplineBSpline
+};
+
+struct SplineTessellationSettings
+{
+	XMFLOAT3	CameraPosition = { 0.0f, 0.0f, 0.0f };
+	float		PixelError = 0.5f;		// allowed distance from the true curve, in pixels
+	float		ViewportHeight = 720.0f;
+	float		FieldOfViewY = XM_PIDIV4;
+	float		MaxAngle = 0.15f;		// radians the tangent may turn across one line segment
+	uint32_t	MaxDepth = 10;
+};
+
+// Piecewise cubic curve. Catmull-Rom and B-splines use every run of four points
+// as a segment, Bezier segments share their end points (3n + 1 points).
+class SplineCurve
+{
+public:
+	SplineCurve(SplineType type = SplineCatmullRom);
+
+	void SetType(SplineType type);
+	void SetControlPoints(const std::vector<XMFLOAT3>& points);
+	void SetControlPoint(size_t index, XMFLOAT3 point);
+
+	SplineType GetType() const { return m_type; }
+	const std::vector<XMFLOAT3>& GetControlPoints() const { return m_points; }
+	uint32_t GetSegmentCount() const;
+
+	// Bumped on every change, so owners can tell when to rebuild derived data
+	uint32_t GetVersion() const { return m_version; }
+
+	// u runs from 0 to GetSegmentCount()
+	XMVECTOR Evaluate(float u) const;
+	XMVECTOR EvaluateTangent(float u) const;
+
+	// Constant speed evaluation through the arc-length table, distance in [0, GetLength()]
+	XMVECTOR EvaluateAtDistance(float distance);
+	float DistanceToParameter(float distance);
+	float GetLength();
+
+	// Adds a polyline to out that stays within the screen space error of the curve
+	void Tessellate(const SplineTessellationSettings& settings, std::vector<XMFLOAT3>& out) const;
+
+	// Evaluates pointCount points evenly spaced in u, four at a time
+	void EvaluateUniform(uint32_t pointCount, XMFLOAT3* out) const;
+
+private:
+	void BuildArcLengthTable();
+	void GetSegment(uint32_t segment, XMVECTOR points[4]) const;
+	void Subdivide(uint32_t segment, float t0, float t1, FXMVECTOR p0, FXMVECTOR p1, uint32_t depth,
+		const SplineTessellationSettings& settings, std::vector<XMFLOAT3>& out) const;
+
+	SplineType m_type;
+	std::vector<XMFLOAT3> m_points;
+	uint32_t m_version = 0;
+
+	// Cumulative length at SPLINE_ARC_SAMPLES steps per segment
+	std::vector<float> m_arcLengths;
+	uint32_t m_arcVersion = ~0u;
+};
+
+namespace SplineMath
+{
+	// Basis weights for the four control points at t, and their derivative
+	XMVECTOR Weights(SplineType type, float t);
+	XMVECTOR DerivativeWeights(SplineType type, float t);
+
+	// Evaluates one segment at count parameters, four lanes per SIMD step
+	void EvaluateSegment(SplineType type, const XMVECTOR points[4], const float* t, size_t count, XMFLOAT3* out);
+
+	// Evaluates pointsPerCurve points on every curve into out (curveCount * pointsPerCurve entries)
+	void EvaluateCurves(const SplineCurve* const* curves, size_t curveCount, uint32_t pointsPerCurve, XMFLOAT3* out, JobSystem* pJobs = nullptr);
+}
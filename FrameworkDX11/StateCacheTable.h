@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+
+namespace StateCache
+{
+	// 64-bit FNV-1a over the raw bytes of a descriptor. Pass the previous result as
+	// the seed to hash several pieces as one stream.
+	inline uint64_t HashBytes(const void* pData, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(pData);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	template <typename TDesc>
+	struct BytewiseHash
+	{
+		size_t operator()(const TDesc& desc) const { return (size_t)HashBytes(&desc, sizeof(TDesc)); }
+	};
+}
+
+// Maps plain descriptor structs to the state objects made from them. Descriptors
+// are hashed and compared bytewise, so callers must zero any padding first.
+// Knows nothing about the device: states come from the create function passed to
+// Get and go back through the release function passed to Clear. THash only picks the
+// bucket, equal hashes still compare the whole descriptor.
+template <typename TDesc, typename TState, typename THash = StateCache::BytewiseHash<TDesc>>
+class StateCacheTable
+{
+public:
+	// Returns the state for desc, calling create(desc) only on a miss
+	template <typename TCreate>
+	TState* Get(const TDesc& desc, TCreate create)
+	{
+		auto it = m_states.find(desc);
+		if (it != m_states.end())
+		{
+			++m_hits;
+			return it->second;
+		}
+
+		TState* pState = create(desc);
+		if (!pState)
+		{
+			++m_failures;
+			return nullptr;
+		}
+
+		++m_creations;
+		m_states.emplace(desc, pState);
+		return pState;
+	}
+
+	template <typename TRelease>
+	void Clear(TRelease release)
+	{
+		for (auto& entry : m_states)
+		{
+			release(entry.second);
+		}
+		m_states.clear();
+	}
+
+	size_t GetSize() const { return m_states.size(); }
+	uint32_t GetCreations() const { return m_creations; }
+	uint32_t GetHits() const { return m_hits; }
+	uint32_t GetFailures() const { return m_failures; }
+
+private:
+	struct DescEqual
+	{
+		bool operator()(const TDesc& a, const TDesc& b) const { return memcmp(&a, &b, sizeof(TDesc)) == 0; }
+	};
+
+	std::unordered_map<TDesc, TState*, THash, DescEqual> m_states;
+	uint32_t m_creations = 0;
+	uint32_t m_hits = 0;
+	uint32_t m_failures = 0;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "DrawableGameObject.h"
+#include "TerrainHeightmap.h"
+#include "OcclusionCulling.h"
 #include <vector>
 
 #define TERRAIN_TEX_SIZE 5
@@ -16,24 +18,36 @@ public:
 
 	void draw(ID3D11DeviceContext* pContext);
 	void draw(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* texture);
+	void Submit(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info);
+	// Only the chunks with visible[chunk] set, neighbouring chunks go out as one packet
+	void SubmitChunks(RenderQueue* pQueue, D3D11RenderBackend* pBackend, const RenderSubmitInfo& info, const uint8_t* visible);
 
-	void SetHeight(float h) { height = h; }
+	void SetHeight(float h) { m_heightmap.SetHeight(h); }
+
+	// World space height of the heightmap under x, z, bilinearly filtered
+	float GetHeight(float x, float z);
+
+	const TerrainHeightmap& GetHeightmap() const { return m_heightmap; }
+
+	// World space bounding spheres of the chunks under the last update's transform
+	void GetChunkSpheres(std::vector<XMFLOAT4>& spheres);
+	int GetChunkCount() const { return (int)m_chunkBounds.size(); }
+
+	// One occluder per chunk, its coarse mesh under the surface, see BuildChunkOccluder
+	void GetOccluders(std::vector<OcclusionMesh>& meshes);
+	// World space boxes around the chunks, in chunk order
+	void GetChunkOcclusionBounds(std::vector<OcclusionBounds>& bounds);
 
 private:
-	void LoadHeightMap();
-	void FaultAlgorithm();
-	void Deposit(int x, int y);
-	void ParticleDeposition();
-	void DiamondSquareAlgorithm();
-	void DiamondStage(int sideLength);
-	void SquareStage(int sideLength);
-	void Average(int x, int y, int sideLength);
+	RenderMaterial GetTerrainMaterial();
 
 	ID3D11ShaderResourceView* m_pTerrainTextures[TERRAIN_TEX_SIZE];
 	ID3D11ShaderResourceView* m_pHeightTexture;
 	ID3D11ShaderResourceView* m_pNormalTexture;
 
-	float height = 10.0f;
-	int range;
-	float** heightArray;
+	TerrainHeightmap m_heightmap;
+	std::vector<TerrainChunkBounds> m_chunkBounds;
+	std::vector<XMFLOAT3> m_occluderVertices;
+	std::vector<uint32_t> m_occluderIndices;
+	std::vector<uint32_t> m_occluderOffsets;	// first index of each chunk's occluder, then the total
 };
\ No newline at end of file
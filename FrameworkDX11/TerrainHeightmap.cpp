@@ -0,0 +1,443 @@
+#include "TerrainHeightmap.h"
+#include "MeshVectors.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+TerrainHeightmap::TerrainHeightmap(int gridSize)
+{
+    m_size = gridSize;
+    heightArray = new float*[m_size];
+    for (int i = 0; i < m_size; ++i)
+    {
+        heightArray[i] = new float[m_size];
+        for (int j = 0; j < m_size; ++j)
+        {
+            heightArray[i][j] = 0.0f;
+        }
+    }
+}
+
+TerrainHeightmap::~TerrainHeightmap()
+{
+    for (int i = 0; i < m_size; ++i)
+    {
+        delete[] heightArray[i];
+    }
+    delete[] heightArray;
+}
+
+static int Random(int min = 0, int max = 255)
+{
+    return min + (rand() % int(max - min + 1));
+}
+
+void TerrainHeightmap::FaultAlgorithm()
+{
+    PROFILE_ZONE("FaultAlgorithm");
+    const float bias = 0.0f;
+    const float initialDisp = 1.0f;
+    const float finalDisp = 0.0f;
+    const float totalIterations = TERRAIN_FAULT_ITERATIONS;
+    float displacement = initialDisp;
+    float v, a, b, c, x1, x2, y1, y2;
+
+    for (unsigned int k = 0; k < totalIterations; ++k)
+    {
+        x1 = Random(0, m_size) - m_size / 2;
+        y1 = Random(0, m_size) - m_size / 2;
+        x2 = Random(0, m_size) - m_size / 2;
+        y2 = Random(0, m_size) - m_size / 2;
+        a = (y2 - y1);
+        b = -(x2 - x1);
+        c = -x1 * (y2 - y1) + y1 * (x2 - x1);
+
+        for (int i = 0; i < m_size; ++i)
+        {
+            for (int j = 0; j < m_size; ++j)
+            {
+                if ((a * j) + (b * i) > c)
+                {
+                    heightArray[i][j] += (bias + displacement);
+                }
+                else
+                {
+                    heightArray[i][j] += (bias - displacement);
+                }
+            }
+        }
+
+        displacement = initialDisp + (k / totalIterations) * (finalDisp - initialDisp);
+    }
+}
+
+void TerrainHeightmap::Deposit(int x, int y)
+{
+    const float displacement = 1.0f;
+    int i, j, storedI, storedJ;
+    bool hasPlace = false;
+    for (i = -1; i <= 1; ++i)
+    {
+        for (j = -1; j <= 1; ++j)
+        {
+            if (i != 0 && j != 0 && x + i > -1 && x + i < m_size && y + j > -1 && y + j < m_size
+                && heightArray[x + i][y + j] < heightArray[x][y])
+            {
+                storedI = i;
+                storedJ = j;
+                hasPlace = true;
+            }
+        }
+    }
+
+    if (hasPlace)
+    {
+        Deposit(x + storedI, y + storedJ);
+    }
+    else
+    {
+        heightArray[x][y] += displacement;
+    }
+}
+
+void TerrainHeightmap::ParticleDeposition()
+{
+    PROFILE_ZONE("ParticleDeposition");
+    const float initDisp = 0.0f;
+    for (int i = 0; i < m_size; ++i)
+    {
+        for (int j = 0; j < m_size; ++j)
+        {
+            heightArray[i][j] = initDisp;
+        }
+    }
+    const int iterations = TERRAIN_DEPOSITION_PARTICLES;
+    int prevX = Random(0, m_size-1);
+    int prevY = Random(0, m_size-1);
+    int randDir;
+    for (unsigned int k = 0; k < iterations; ++k)
+    {
+        randDir = rand() % 4;
+        switch (randDir)
+        {
+        case 0:
+            --prevY;
+            if (prevY < 0)
+                prevY += m_size - 1;
+            break;
+        case 1:
+            ++prevY;
+            if (prevY > m_size - 1)
+                prevY -= m_size - 1;
+            break;
+        case 2:
+            --prevX;
+            if (prevX < 0)
+                prevX += m_size - 1;
+            break;
+        case 3:
+            ++prevX;
+            if (prevX > m_size - 1)
+                prevX -= m_size - 1;
+            break;
+        }
+        Deposit(prevX, prevY);
+    }
+}
+
+void TerrainHeightmap::Average(int x, int y, int sideLength)
+{
+    float counter = 0;
+    float acc = 0;
+    int halfSide = sideLength / 2;
+
+    if (x != 0)
+    {
+        ++counter;
+        acc += heightArray[y][x - halfSide];
+    }
+    if (y != 0)
+    {
+        ++counter;
+        acc += heightArray[y - halfSide][x];
+    }
+    if (x != m_size - 1)
+    {
+        ++counter;
+        acc += heightArray[y][x + halfSide];
+    }
+    if (y != m_size - 1)
+    {
+        ++counter;
+        acc += heightArray[y + halfSide][x];
+    }
+
+    heightArray[y][x] = acc / counter - Random(-range, range);
+}
+
+static void Clamp(float* value, int min, int max)
+{
+    if (*value < min)
+        *value = min;
+    else if (*value > max)
+        *value = max;
+}
+
+void TerrainHeightmap::DiamondStage(int sideLength)
+{
+    int halfSide = sideLength / 2;
+    int centerX, centerY;
+    for (int y = 0; y < m_size / (sideLength - 1); ++y)
+    {
+        centerY = y * (sideLength - 1) + halfSide;
+        centerX = halfSide - (sideLength - 1);
+        for (int x = 0; x < m_size / (sideLength - 1); ++x)
+        {
+            // Optimise this later!
+            //centerX = x * (sideLength - 1) + halfSide;
+            centerX += (sideLength - 1);
+
+            int average = ( heightArray[x * (sideLength - 1)][y * (sideLength - 1)] +
+                            heightArray[x * (sideLength - 1)][(y+1) * (sideLength - 1)] +
+                            heightArray[(x+1) * (sideLength - 1)][y * (sideLength - 1)] +
+                            heightArray[(x+1) * (sideLength - 1)][(y+1) * (sideLength - 1)]) / 4.0f;
+
+            heightArray[centerX][centerY] = average + Random(-range, range);
+        }
+    }
+}
+
+void TerrainHeightmap::SquareStage(int sideLength)
+{
+    int halfLength = sideLength / 2;
+    for (int y = 0; y < m_size / (sideLength - 1); ++y)
+    {
+        for (int x = 0; x < m_size / (sideLength - 1); ++x)
+        {
+            Average(x * (sideLength - 1) + halfLength, y * (sideLength - 1), sideLength);
+            Average((x+1) * (sideLength - 1), y * (sideLength - 1) + halfLength, sideLength);
+            Average(x * (sideLength - 1) + halfLength, (y+1) * (sideLength - 1), sideLength);
+            Average(x * (sideLength - 1), y * (sideLength - 1) + halfLength, sideLength);
+        }
+    }
+}
+
+void TerrainHeightmap::DiamondSquareAlgorithm()
+{
+    PROFILE_ZONE("DiamondSquare");
+    range = 32;
+
+    heightArray[0][0] = Random(0, 32);
+    heightArray[0][m_size - 1] = Random(0, 32);
+    heightArray[m_size - 1][0] = Random(0, 32);
+    heightArray[m_size - 1][m_size - 1] = Random(0, 32);
+
+    int sideLength = m_size / 2;
+
+    DiamondStage(m_size);
+    SquareStage(m_size);
+
+    range /= 2;
+
+    while (sideLength >= 2)
+    {
+        DiamondStage(sideLength + 1);
+        SquareStage(sideLength + 1);
+
+        sideLength /= 2;
+        range /= 2;
+    }
+
+    for (int i = 0; i < m_size; ++i)
+    {
+        for (int j = 0; j < m_size; ++j)
+        {
+            Clamp(&heightArray[i][j], 0, 255);
+        }
+    }
+}
+
+void TerrainHeightmap::Generate(int type)
+{
+    for (int i = 0; i < m_size; ++i)
+    {
+        for (int j = 0; j < m_size; ++j)
+        {
+            heightArray[i][j] = 0.0f;
+        }
+    }
+
+    switch (type)
+    {
+    case TerrainFromFile:
+        LoadHeightMap();
+        break;
+    case TerrainFaultLines:
+        FaultAlgorithm();
+        break;
+    case TerrainParticleDeposition:
+        ParticleDeposition();
+        break;
+    case TerrainDiamondSquare:
+        DiamondSquareAlgorithm();
+        break;
+    }
+}
+
+void TerrainHeightmap::BuildVertices(SimpleVertex* finalVertices) const
+{
+    std::vector<XMFLOAT3> positions;
+    std::vector<XMFLOAT2> texCoords;
+    positions.reserve(m_size * m_size);
+    for (int i = 0; i < m_size; ++i)
+    {
+        for (int j = 0; j < m_size; ++j)
+        {
+            positions.push_back({ (float)i - m_size / 4,
+                                    heightArray[i][j],
+                                    (float)j - m_size / 4 });
+        }
+    }
+    texCoords.push_back({ 0.0f, 0.0f });
+    texCoords.push_back({ 1.0f, 0.0f });
+    texCoords.push_back({ 0.0f, 1.0f });
+    texCoords.push_back({ 1.0f, 1.0f });
+
+    // Cells of a chunk in a row, chunks one after another. A chunk hanging off the
+    // grid's edge keeps its missing cells as degenerate triangles.
+    int chunksPerSide = GetChunksPerSide();
+    for (int i = 0; i < m_size - 1; ++i)
+    {
+        for (int j = 0; j < m_size - 1; ++j)
+        {
+            int chunk = (i / TERRAIN_CHUNK_CELLS) * chunksPerSide + j / TERRAIN_CHUNK_CELLS;
+            int cell = (i % TERRAIN_CHUNK_CELLS) * TERRAIN_CHUNK_CELLS + j % TERRAIN_CHUNK_CELLS;
+            SimpleVertex* quad = finalVertices + chunk * GetChunkVertexCount() + cell * 6;
+            quad[0] = { positions.at(i * m_size + j), {0,0,0}, texCoords.at(0) };
+            quad[1] = { positions.at(i * m_size + j + 1), {0,0,0}, texCoords.at(1) };
+            quad[2] = { positions.at((i + 1) * m_size + j), {0,0,0}, texCoords.at(2) };
+            quad[3] = { positions.at((i + 1) * m_size + j), {0,0,0}, texCoords.at(2) };
+            quad[4] = { positions.at(i * m_size + j + 1), {0,0,0}, texCoords.at(1) };
+            quad[5] = { positions.at((i + 1) * m_size + j + 1), {0,0,0}, texCoords.at(3) };
+        }
+    }
+
+    PROFILE_ZONE("CalculateModelVectors");
+    MeshVectors::CalculateModelVectors(finalVertices, GetVertexCount());
+}
+
+TerrainChunkBounds TerrainHeightmap::GetChunkBounds(int chunk) const
+{
+    // The chunk's vertices, one more than its cells along each side
+    int startI = (chunk / GetChunksPerSide()) * TERRAIN_CHUNK_CELLS;
+    int startJ = (chunk % GetChunksPerSide()) * TERRAIN_CHUNK_CELLS;
+    int endI = std::min(startI + TERRAIN_CHUNK_CELLS, m_size - 1);
+    int endJ = std::min(startJ + TERRAIN_CHUNK_CELLS, m_size - 1);
+
+    float minHeight = heightArray[startI][startJ];
+    float maxHeight = minHeight;
+    for (int i = startI; i <= endI; ++i)
+    {
+        for (int j = startJ; j <= endJ; ++j)
+        {
+            minHeight = std::min(minHeight, heightArray[i][j]);
+            maxHeight = std::max(maxHeight, heightArray[i][j]);
+        }
+    }
+
+    TerrainChunkBounds bounds;
+    bounds.Min = XMFLOAT3((float)startI - m_size / 4, minHeight, (float)startJ - m_size / 4);
+    bounds.Max = XMFLOAT3((float)endI - m_size / 4, maxHeight, (float)endJ - m_size / 4);
+    return bounds;
+}
+
+void TerrainHeightmap::BuildChunkOccluder(int chunk, std::vector<XMFLOAT3>& vertices, std::vector<uint32_t>& indices) const
+{
+    int startI = (chunk / GetChunksPerSide()) * TERRAIN_CHUNK_CELLS;
+    int startJ = (chunk % GetChunksPerSide()) * TERRAIN_CHUNK_CELLS;
+    int endI = std::min(startI + TERRAIN_CHUNK_CELLS, m_size - 1);
+    int endJ = std::min(startJ + TERRAIN_CHUNK_CELLS, m_size - 1);
+
+    // Grid lines of the coarse mesh, the chunk's last line even if the step misses it
+    std::vector<int> linesI, linesJ;
+    for (int i = startI; i < endI; i += TERRAIN_OCCLUDER_CELLS)
+        linesI.push_back(i);
+    linesI.push_back(endI);
+    for (int j = startJ; j < endJ; j += TERRAIN_OCCLUDER_CELLS)
+        linesJ.push_back(j);
+    linesJ.push_back(endJ);
+
+    // Each quad is flat between corners no higher than any vertex it covers, and the
+    // terrain over a quad is never lower than its lowest vertex
+    uint32_t first = (uint32_t)vertices.size();
+    for (size_t a = 0; a < linesI.size(); ++a)
+    {
+        int fromI = linesI[a > 0 ? a - 1 : a], toI = linesI[a + 1 < linesI.size() ? a + 1 : a];
+        for (size_t b = 0; b < linesJ.size(); ++b)
+        {
+            int fromJ = linesJ[b > 0 ? b - 1 : b], toJ = linesJ[b + 1 < linesJ.size() ? b + 1 : b];
+            float lowest = heightArray[linesI[a]][linesJ[b]];
+            for (int i = fromI; i <= toI; ++i)
+            {
+                for (int j = fromJ; j <= toJ; ++j)
+                {
+                    lowest = std::min(lowest, heightArray[i][j]);
+                }
+            }
+            vertices.push_back(XMFLOAT3((float)linesI[a] - m_size / 4, lowest, (float)linesJ[b] - m_size / 4));
+        }
+    }
+
+    // Same winding as BuildVertices
+    uint32_t columns = (uint32_t)linesJ.size();
+    for (uint32_t a = 0; a + 1 < linesI.size(); ++a)
+    {
+        for (uint32_t b = 0; b + 1 < columns; ++b)
+        {
+            uint32_t corner = first + a * columns + b;
+            uint32_t quad[6] = { corner, corner + 1, corner + columns, corner + columns, corner + 1, corner + columns + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+void TerrainHeightmap::LoadHeightMap()
+{
+    PROFILE_ZONE("LoadHeightMap");
+    // A height for each vertex 
+    std::vector<unsigned char> in(m_size * m_size);
+
+    // Open the file.
+    std::ifstream inFile;
+    inFile.open(TERRAIN_HEIGHT_MAP_FILE, std::ios_base::binary);
+
+    if (inFile)
+    {
+        // Read the RAW bytes.
+        inFile.read((char*)&in[0], (std::streamsize)in.size());
+        inFile.close();
+    }
+
+    for (int i = 0; i < m_size * m_size; ++i)
+    {
+        heightArray[i % m_size][i / m_size] = (1 - (in[i] / 255.0f)) * height;
+    }
+}
+
+float TerrainHeightmap::Sample(float u, float v) const
+{
+    Clamp(&u, 0, m_size - 1);
+    Clamp(&v, 0, m_size - 1);
+
+    int i = (int)u;
+    int j = (int)v;
+    int i1 = i + 1 < m_size ? i + 1 : i;
+    int j1 = j + 1 < m_size ? j + 1 : j;
+    float fu = u - i;
+    float fv = v - j;
+
+    float h0 = heightArray[i][j] + (heightArray[i1][j] - heightArray[i][j]) * fu;
+    float h1 = heightArray[i][j1] + (heightArray[i1][j1] - heightArray[i][j1]) * fu;
+    return h0 + (h1 - h0) * fv;
+}
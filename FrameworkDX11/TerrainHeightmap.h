@@ -0,0 +1,90 @@
+#pragma once
+#include "VertexTypes.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define TERRAIN_GRID_SIZE 513
+#define TERRAIN_HEIGHT_MAP_FILE "Resources\\rock_height.dds"
+#define TERRAIN_FAULT_ITERATIONS 1024
+#define TERRAIN_DEPOSITION_PARTICLES 1000000
+// Cells along each side of a chunk, the unit the terrain is culled in
+#define TERRAIN_CHUNK_CELLS 32
+// Cells along each side of one occluder quad, TERRAIN_CHUNK_CELLS should divide by it
+#define TERRAIN_OCCLUDER_CELLS 8
+
+// Model space box around one chunk's vertices
+struct TerrainChunkBounds
+{
+	XMFLOAT3	Min;
+	XMFLOAT3	Max;
+};
+
+// Matches the order of the terrain list in the Options window
+enum TerrainType
+{
+	TerrainFromFile = 0,
+	TerrainFaultLines,
+	TerrainParticleDeposition,
+	TerrainDiamondSquare,
+	TerrainTypeCount
+};
+
+// The terrain's height grid and the generators that fill it. Nothing here needs a
+// device, so terrains can be generated and meshed headless. The generators draw
+// from rand(), seed it first for a repeatable terrain.
+class TerrainHeightmap
+{
+public:
+	// Diamond square needs a power of two plus one
+	TerrainHeightmap(int gridSize = TERRAIN_GRID_SIZE);
+	~TerrainHeightmap();
+
+	TerrainHeightmap(const TerrainHeightmap&) = delete;
+	TerrainHeightmap& operator=(const TerrainHeightmap&) = delete;
+
+	void Generate(int type);
+
+	// Scale of the heights read from the heightmap file
+	void SetHeight(float h) { height = h; }
+
+	// Two triangles per cell with their model vectors, GetVertexCount() of them.
+	// Vertices are laid out from -GetSize() / 4 in whole units. Cells are grouped into
+	// TERRAIN_CHUNK_CELLS square chunks, each one GetChunkVertexCount() vertices long,
+	// so any chunk or row of neighbouring chunks draws as one vertex range.
+	void BuildVertices(SimpleVertex* finalVertices) const;
+	int GetVertexCount() const { return GetChunkCount() * GetChunkVertexCount(); }
+	int GetSize() const { return m_size; }
+
+	// Chunk c is row c / GetChunksPerSide() along x, column c % GetChunksPerSide() along z
+	int GetChunksPerSide() const { return (m_size - 2 + TERRAIN_CHUNK_CELLS) / TERRAIN_CHUNK_CELLS; }
+	int GetChunkCount() const { return GetChunksPerSide() * GetChunksPerSide(); }
+	int GetChunkVertexCount() const { return TERRAIN_CHUNK_CELLS * TERRAIN_CHUNK_CELLS * 6; }
+	TerrainChunkBounds GetChunkBounds(int chunk) const;
+
+	// A coarse model space mesh of one chunk for occlusion culling, appended to
+	// vertices and indices. A quad every TERRAIN_OCCLUDER_CELLS cells, each corner at the
+	// lowest height of the quads around it, so the mesh never rises above the terrain.
+	void BuildChunkOccluder(int chunk, std::vector<XMFLOAT3>& vertices, std::vector<uint32_t>& indices) const;
+
+	// Grid space height, bilinearly filtered and clamped to the edges
+	float Sample(float u, float v) const;
+
+	// heightArray[i][j], i along x and j along z
+	const float* const* GetHeights() const { return heightArray; }
+
+private:
+	void LoadHeightMap();
+	void FaultAlgorithm();
+	void Deposit(int x, int y);
+	void ParticleDeposition();
+	void DiamondSquareAlgorithm();
+	void DiamondStage(int sideLength);
+	void SquareStage(int sideLength);
+	void Average(int x, int y, int sideLength);
+
+	int m_size;
+	float height = 10.0f;
+	int range;
+	float** heightArray;
+};
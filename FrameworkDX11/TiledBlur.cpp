@@ -0,0 +1,116 @@
+#include "TiledBlur.h"
+#include <algorithm>
+#include <cmath>
+
+// Same as PS_Blur's, from learnopengl.com/Advanced-Lighting/Bloom
+static const float g_blurWeights[BLUR_MAX_RADIUS] =
+{
+	0.407027f, 0.287027f, 0.2605f, 0.23945946f, 0.2081f,
+	0.1616216f, 0.1526f, 0.114054f, 0.0952f, 0.066216f
+};
+
+uint32_t TiledBlur::GetRadius(float radius)
+{
+	return (uint32_t)std::min(std::max(fabsf(radius), 1.0f), (float)BLUR_MAX_RADIUS);
+}
+
+float TiledBlur::GetWeight(uint32_t i)
+{
+	return g_blurWeights[i];
+}
+
+// The centre is taken twice and every tap is divided by twice the weights' sum, as PS_Blur does
+static void Convolve(const float* const* texels, uint32_t radius, float* colour)
+{
+	float total[4] = {};
+	float weightSum = 0.0f;
+	for (uint32_t i = 0; i < radius; ++i)
+	{
+		const float* after = texels[radius - 1 + i];
+		const float* before = texels[radius - 1 - i];
+		for (int c = 0; c < 4; ++c)
+		{
+			total[c] += (after[c] + before[c]) * g_blurWeights[i];
+		}
+		weightSum += g_blurWeights[i];
+	}
+	for (int c = 0; c < 4; ++c)
+	{
+		colour[c] = total[c] / weightSum / 2.0f;
+	}
+}
+
+void TiledBlur::BlurReference(const BloomImage& source, uint32_t radius, bool horizontal, BloomImage& target)
+{
+	radius = std::min(std::max(radius, 1u), (uint32_t)BLUR_MAX_RADIUS);
+	target.Resize(source.Width, source.Height);
+
+	const float* texels[BLUR_MAX_RADIUS * 2 - 1];
+	int maxX = (int)source.Width - 1;
+	int maxY = (int)source.Height - 1;
+	for (uint32_t y = 0; y < source.Height; ++y)
+	{
+		for (uint32_t x = 0; x < source.Width; ++x)
+		{
+			for (int i = 0; i < (int)radius * 2 - 1; ++i)
+			{
+				int offset = i - ((int)radius - 1);
+				int sx = horizontal ? std::min(std::max((int)x + offset, 0), maxX) : (int)x;
+				int sy = horizontal ? (int)y : std::min(std::max((int)y + offset, 0), maxY);
+				texels[i] = source.GetPixel(sx, sy);
+			}
+			Convolve(texels, radius, target.GetPixel(x, y));
+		}
+	}
+}
+
+void TiledBlur::BlurTiled(const BloomImage& source, uint32_t radius, bool horizontal, BloomImage& target)
+{
+	radius = std::min(std::max(radius, 1u), (uint32_t)BLUR_MAX_RADIUS);
+	target.Resize(source.Width, source.Height);
+
+	uint32_t groupsX, groupsY;
+	GetDispatchSize(source.Width, source.Height, horizontal, groupsX, groupsY);
+	int length = (int)(horizontal ? source.Width : source.Height);
+
+	// One group's groupshared cache: the tile with the apron either side
+	std::vector<const float*> cache(BLUR_TILE_SIZE + BLUR_MAX_RADIUS * 2);
+	for (uint32_t groupY = 0; groupY < groupsY; ++groupY)
+	{
+		for (uint32_t groupX = 0; groupX < groupsX; ++groupX)
+		{
+			int tileStart = (int)(groupX * BLUR_TILE_SIZE);
+			for (int i = 0; i < (int)cache.size(); ++i)
+			{
+				int along = std::min(std::max(tileStart - BLUR_MAX_RADIUS + i, 0), length - 1);
+				cache[i] = horizontal ? source.GetPixel(along, groupY) : source.GetPixel(groupY, along);
+			}
+
+			for (int thread = 0; thread < BLUR_TILE_SIZE && tileStart + thread < length; ++thread)
+			{
+				const float* const* texels = &cache[BLUR_MAX_RADIUS + thread - (radius - 1)];
+				uint32_t along = tileStart + thread;
+				Convolve(texels, radius, horizontal ? target.GetPixel(along, groupY) : target.GetPixel(groupY, along));
+			}
+		}
+	}
+}
+
+void TiledBlur::GetDispatchSize(uint32_t width, uint32_t height, bool horizontal, uint32_t& groupsX, uint32_t& groupsY)
+{
+	uint32_t length = horizontal ? width : height;
+	groupsX = (length + BLUR_TILE_SIZE - 1) / BLUR_TILE_SIZE;
+	groupsY = horizontal ? height : width;
+}
+
+uint64_t TiledBlur::GetPixelShaderFetches(uint32_t width, uint32_t height, uint32_t radius)
+{
+	return (uint64_t)width * height * 2 * radius;
+}
+
+uint64_t TiledBlur::GetComputeShaderFetches(uint32_t width, uint32_t height, bool horizontal)
+{
+	uint32_t groupsX, groupsY;
+	GetDispatchSize(width, height, horizontal, groupsX, groupsY);
+	return (uint64_t)groupsX * groupsY * (BLUR_TILE_SIZE + BLUR_MAX_RADIUS * 2);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include "BloomKernel.h"
+
+// Widest PS_Blur and CS_Blur go, the GUI picks a radius up to this
+#define BLUR_MAX_RADIUS 10
+// Pixels along the blur one CS_Blur thread group writes, shader.fx has the same
+#define BLUR_TILE_SIZE 256
+
+// The separable Gaussian blur, on the CPU. PS_Blur fetches 2 * radius texels a pixel in
+// each direction; CS_Blur has each thread group load a row (or column) of
+// BLUR_TILE_SIZE pixels plus a BLUR_MAX_RADIUS apron either side into groupshared
+// memory once and convolves from there, so neighbouring pixels share their fetches.
+// Both clamp at the edges and give the same result.
+namespace TiledBlur
+{
+	// Radius for one axis of BlurProperties::Radius, as both shaders work it out
+	uint32_t GetRadius(float radius);
+
+	// Weight of the taps i texels out, i < BLUR_MAX_RADIUS
+	float GetWeight(uint32_t i);
+
+	// What PS_Blur does, every tap fetched on its own
+	void BlurReference(const BloomImage& source, uint32_t radius, bool horizontal, BloomImage& target);
+
+	// What CS_Blur does, group by group through a tile sized cache
+	void BlurTiled(const BloomImage& source, uint32_t radius, bool horizontal, BloomImage& target);
+
+	// Thread groups for one direction, x along the blur and y across it
+	void GetDispatchSize(uint32_t width, uint32_t height, bool horizontal, uint32_t& groupsX, uint32_t& groupsY);
+
+	// Texture fetches for one direction of each path
+	uint64_t GetPixelShaderFetches(uint32_t width, uint32_t height, uint32_t radius);
+	uint64_t GetComputeShaderFetches(uint32_t width, uint32_t height, bool horizontal);
+}
@@ -0,0 +1,123 @@
+#include "VelocityTiles.h"
+#include <algorithm>
+#include <cmath>
+
+XMFLOAT2 VelocityTiles::GetVelocity(FXMVECTOR position, CXMMATRIX world, CXMMATRIX previousWorld, CXMMATRIX viewProjection, CXMMATRIX previousViewProjection)
+{
+	XMVECTOR point = XMVectorSetW(position, 1.0f);
+	XMVECTOR current = XMVector4Transform(XMVector4Transform(point, world), viewProjection);
+	XMVECTOR previous = XMVector4Transform(XMVector4Transform(point, previousWorld), previousViewProjection);
+	XMVECTOR change = XMVectorSubtract(XMVectorDivide(current, XMVectorSplatW(current)), XMVectorDivide(previous, XMVectorSplatW(previous)));
+
+	XMFLOAT2 velocity;
+	XMStoreFloat2(&velocity, XMVectorMultiply(change, XMVectorSet(0.5f, -0.5f, 0.0f, 0.0f)));
+	return velocity;
+}
+
+void VelocityTiles::ScaleVelocity(const float* velocity, float scaleX, float scaleY, float* pixels)
+{
+	float x = velocity[0] * scaleX;
+	float y = velocity[1] * scaleY;
+	float length = sqrtf(x * x + y * y);
+	float scale = length > VELOCITY_TILE_SIZE ? VELOCITY_TILE_SIZE / length : 1.0f;
+	pixels[0] = x * scale;
+	pixels[1] = y * scale;
+}
+
+uint32_t VelocityTiles::GetTileCount(uint32_t size)
+{
+	return (size + VELOCITY_TILE_SIZE - 1) / VELOCITY_TILE_SIZE;
+}
+
+// Ties keep the one already there
+static void KeepLongest(const float* candidate, float* longest)
+{
+	if (candidate[0] * candidate[0] + candidate[1] * candidate[1] > longest[0] * longest[0] + longest[1] * longest[1])
+	{
+		longest[0] = candidate[0];
+		longest[1] = candidate[1];
+	}
+}
+
+void VelocityTiles::TileMax(const VelocityImage& velocity, float scaleX, float scaleY, VelocityImage& tiles)
+{
+	tiles.Resize(GetTileCount(velocity.Width), GetTileCount(velocity.Height));
+	for (uint32_t tileY = 0; tileY < tiles.Height; ++tileY)
+	{
+		for (uint32_t tileX = 0; tileX < tiles.Width; ++tileX)
+		{
+			float* longest = tiles.GetPixel(tileX, tileY);
+			uint32_t endX = std::min((tileX + 1) * VELOCITY_TILE_SIZE, velocity.Width);
+			uint32_t endY = std::min((tileY + 1) * VELOCITY_TILE_SIZE, velocity.Height);
+			for (uint32_t y = tileY * VELOCITY_TILE_SIZE; y < endY; ++y)
+			{
+				for (uint32_t x = tileX * VELOCITY_TILE_SIZE; x < endX; ++x)
+				{
+					float pixels[2];
+					ScaleVelocity(velocity.GetPixel(x, y), scaleX, scaleY, pixels);
+					KeepLongest(pixels, longest);
+				}
+			}
+		}
+	}
+}
+
+void VelocityTiles::NeighbourMax(const VelocityImage& tiles, VelocityImage& neighbourMax)
+{
+	neighbourMax.Resize(tiles.Width, tiles.Height);
+	int maxX = (int)tiles.Width - 1;
+	int maxY = (int)tiles.Height - 1;
+	for (uint32_t tileY = 0; tileY < tiles.Height; ++tileY)
+	{
+		for (uint32_t tileX = 0; tileX < tiles.Width; ++tileX)
+		{
+			float* longest = neighbourMax.GetPixel(tileX, tileY);
+			for (int y = -1; y <= 1; ++y)
+			{
+				for (int x = -1; x <= 1; ++x)
+				{
+					int sx = std::min(std::max((int)tileX + x, 0), maxX);
+					int sy = std::min(std::max((int)tileY + y, 0), maxY);
+					KeepLongest(tiles.GetPixel(sx, sy), longest);
+				}
+			}
+		}
+	}
+}
+
+void VelocityTiles::NeighbourMaxReference(const VelocityImage& velocity, float scaleX, float scaleY, VelocityImage& neighbourMax)
+{
+	neighbourMax.Resize(GetTileCount(velocity.Width), GetTileCount(velocity.Height));
+	for (uint32_t tileY = 0; tileY < neighbourMax.Height; ++tileY)
+	{
+		for (uint32_t tileX = 0; tileX < neighbourMax.Width; ++tileX)
+		{
+			float* longest = neighbourMax.GetPixel(tileX, tileY);
+			int startX = std::max((int)tileX - 1, 0) * VELOCITY_TILE_SIZE;
+			int startY = std::max((int)tileY - 1, 0) * VELOCITY_TILE_SIZE;
+			uint32_t endX = std::min((tileX + 2) * VELOCITY_TILE_SIZE, velocity.Width);
+			uint32_t endY = std::min((tileY + 2) * VELOCITY_TILE_SIZE, velocity.Height);
+			for (uint32_t y = startY; y < endY; ++y)
+			{
+				for (uint32_t x = startX; x < endX; ++x)
+				{
+					float pixels[2];
+					ScaleVelocity(velocity.GetPixel(x, y), scaleX, scaleY, pixels);
+					KeepLongest(pixels, longest);
+				}
+			}
+		}
+	}
+}
+
+uint32_t VelocityTiles::CountStaticTiles(const VelocityImage& neighbourMax, float minimumPixels)
+{
+	uint32_t count = 0;
+	for (size_t i = 0; i < neighbourMax.Pixels.size(); i += 2)
+	{
+		float x = neighbourMax.Pixels[i];
+		float y = neighbourMax.Pixels[i + 1];
+		count += x * x + y * y < minimumPixels * minimumPixels;
+	}
+	return count;
+}
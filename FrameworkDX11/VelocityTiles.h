@@ -0,0 +1,58 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace DirectX;
+
+// Pixels along each side of a motion blur tile, shader.fx has the same. A pixel's blur
+// is clamped to this many pixels so its neighbour max tile covers everything that reaches it.
+#define VELOCITY_TILE_SIZE 16
+// Gather samples across the neighbour max velocity
+#define MOTION_BLUR_SAMPLES 12
+// Tiles whose neighbour max is shorter than this many pixels skip the blur
+#define MOTION_BLUR_MIN_PIXELS 0.5f
+
+// Two floats a pixel, rows top to bottom, for the CPU reference passes
+struct VelocityImage
+{
+	uint32_t			Width;
+	uint32_t			Height;
+	std::vector<float>	Pixels;
+
+	void Resize(uint32_t width, uint32_t height) { Width = width; Height = height; Pixels.assign((size_t)width * height * 2, 0.0f); }
+	float* GetPixel(uint32_t x, uint32_t y) { return &Pixels[((size_t)y * Width + x) * 2]; }
+	const float* GetPixel(uint32_t x, uint32_t y) const { return &Pixels[((size_t)y * Width + x) * 2]; }
+};
+
+// Per object motion blur. The velocity pass writes how far each pixel's surface moved
+// in texture coordinates since the last frame. CS_VelocityTileMax keeps the longest
+// velocity in pixels of each VELOCITY_TILE_SIZE tile, PS_VelocityNeighbourMax the
+// longest of each tile's 3x3 neighbourhood, and PS_MotionBlur returns the scene
+// untouched wherever that is under MOTION_BLUR_MIN_PIXELS. These are the same steps
+// on the CPU, with a brute force neighbour max to check the two passes against.
+namespace VelocityTiles
+{
+	// What PS writes for a point in object space: the change in its texture
+	// coordinates from the previous matrices to these, y down like the texture
+	XMFLOAT2 GetVelocity(FXMVECTOR position, CXMMATRIX world, CXMMATRIX previousWorld, CXMMATRIX viewProjection, CXMMATRIX previousViewProjection);
+
+	// Velocity buffer units to pixels times the shutter, clamped to VELOCITY_TILE_SIZE
+	void ScaleVelocity(const float* velocity, float scaleX, float scaleY, float* pixels);
+
+	// Tiles along one axis, the last one can be partly off the image
+	uint32_t GetTileCount(uint32_t size);
+
+	// Longest scaled velocity of every tile, what CS_VelocityTileMax writes
+	void TileMax(const VelocityImage& velocity, float scaleX, float scaleY, VelocityImage& tiles);
+
+	// Longest of each tile's 3x3 neighbourhood, clamped at the edges
+	void NeighbourMax(const VelocityImage& tiles, VelocityImage& neighbourMax);
+
+	// The same result straight from the pixels of every 3x3 neighbourhood
+	void NeighbourMaxReference(const VelocityImage& velocity, float scaleX, float scaleY, VelocityImage& neighbourMax);
+
+	// Tiles PS_MotionBlur returns early on
+	uint32_t CountStaticTiles(const VelocityImage& neighbourMax, float minimumPixels);
+}
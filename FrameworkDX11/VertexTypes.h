@@ -0,0 +1,30 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+
+using namespace DirectX;
+
+struct SimpleVertex
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT2 TexCoord;
+	XMFLOAT3 Tangent;
+	XMFLOAT3 BiTangent;
+};
+
+#define MAX_BONE_INFLUENCES 4
+
+// Bind pose vertex with up to four bone influences. The influence layout matches
+// BLENDINDICES (R8G8B8A8_UINT) and BLENDWEIGHT (R32G32B32A32_FLOAT) so the same
+// buffer can be fed to a vertex shader for GPU skinning.
+struct SkinnedVertex
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT2 TexCoord;
+	XMFLOAT3 Tangent;
+	XMFLOAT3 BiTangent;
+	uint8_t  BoneIndices[MAX_BONE_INFLUENCES];
+	XMFLOAT4 BoneWeights;
+};
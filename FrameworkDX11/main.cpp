@@ -21,6 +21,18 @@
 #include "Camera.h"
 #include "Debug.h"
 #include "Spline.h"
+#include "JobSystem.h"
+#include "Benchmark.h"
+#include "CameraPath.h"
+#include "RenderStateCache.h"
+#include "D3D11CommandBackend.h"
+#include "CommandRecorder.h"
+#include "D3DShaderCompiler.h"
+#include "TiledBlur.h"
+#include "VelocityTiles.h"
+#include <chrono>
+#include <random>
+#include <fstream>
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -29,7 +41,29 @@
 int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow )
 {
     UNREFERENCED_PARAMETER( hPrevInstance );
-    UNREFERENCED_PARAMETER( lpCmdLine );
+
+    // Headless benchmarks skip the window and device entirely
+    std::string commandLine;
+    for (const WCHAR* c = lpCmdLine; *c; ++c)
+        commandLine += static_cast<char>(*c);
+    if (Benchmark::IsRequested(commandLine))
+        return Benchmark::Run(commandLine);
+
+    // Post-build step: compiles every shader into the cache and exits
+    if (commandLine.find("-precompile-shaders") != std::string::npos)
+        return PrecompileShaders(commandLine);
+
+    // Windowed flythrough: plays the default camera track once and writes per-frame CPU timings
+    if (commandLine.find("-flythrough") != std::string::npos)
+    {
+        g_isFlythrough = true;
+        g_flythroughPath = Benchmark::GetArgument(commandLine, "-out", "flythrough_frames.csv");
+    }
+
+    // "-trace" captures the first frames, startup zones included
+    Profiler::SetThreadName("Main");
+    if (commandLine.find("-trace") != std::string::npos)
+        Profiler::StartCapture(PROFILER_CAPTURE_FRAMES);
 
     if( FAILED( InitWindow( hInstance, nCmdShow ) ) )
         return 0;
@@ -40,19 +74,24 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
         return 0;
     }
 
-    // Main message loop
+    // Main message loop: everything queued is handled before each frame, then the
+    // thread sleeps until the frame is due instead of spinning
     MSG msg = {0};
     while( WM_QUIT != msg.message )
     {
-        if( PeekMessage( &msg, nullptr, 0, 0, PM_REMOVE ) )
+        while( PeekMessage( &msg, nullptr, 0, 0, PM_REMOVE ) )
         {
+            if( msg.message == WM_QUIT )
+                break;
             TranslateMessage( &msg );
             DispatchMessage( &msg );
         }
-        else
-        {
-            Render();
-        }
+        if( msg.message == WM_QUIT )
+            break;
+
+        WaitForNextFrame();
+        Render();
+        Profiler::EndFrame();
     }
 
     CleanupDevice();
@@ -103,43 +142,329 @@ HRESULT InitWindow( HINSTANCE hInstance, int nCmdShow )
 }
 
 //--------------------------------------------------------------------------------------
-// Helper for compiling shaders with D3DCompile
-//
-// With VS 11, we could load up prebuilt .cso files instead...
+// Every shader InitMesh creates. They are compiled as one batch through the cache
+// so only changed entry points compile, and those compile in parallel.
 //--------------------------------------------------------------------------------------
-HRESULT CompileShaderFromFile( const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut )
+void GetShaderRequests(std::vector<ShaderCompileRequest>& requests)
 {
-    HRESULT hr = S_OK;
+    static const char* shaders[][2] =
+    {
+        { "VS", "vs_5_0" }, { "RTT_VS", "vs_5_0" }, { "Terrain_VS", "vs_5_0" }, { "Line_VS", "vs_5_0" },
+        { "HS", "hs_5_0" },
+        { "GS", "gs_5_0" }, { "GS_BILL", "gs_5_0" }, { "GS_Depth", "gs_5_0" },
+        { "PS_BILL", "ps_5_0" }, { "PS_Depth", "ps_5_0" }, { "PS_Tint", "ps_5_0" },
+        { "RTT_PS", "ps_5_0" }, { "PS_Resolve", "ps_5_0" }, { "Line_PS", "ps_5_0" },
+        { "PS_BloomDownsample", "ps_5_0" }, { "PS_BloomBlur", "ps_5_0" }, { "PS_BloomUpsample", "ps_5_0" },
+        { "CS_VelocityTileMax", "cs_5_0" }, { "PS_VelocityNeighbourMax", "ps_5_0" }, { "PS_MotionBlur", "ps_5_0" },
+    };
 
-    DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#ifdef _DEBUG
-    // Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
-    // Setting this flag improves the shader debugging experience, but still allows 
-    // the shaders to be optimized and to run exactly the way they will run in 
-    // the release configuration of this program.
-    dwShaderFlags |= D3DCOMPILE_DEBUG;
-
-    // Disable optimizations to further improve shader debugging
-    dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
+    // Every valid feature combination of the permuted entry points, so none compile lazily
+    static const struct { const char* EntryPoint; const char* Profile; uint32_t FeatureMask; } permuted[] =
+    {
+        { "DS", "ds_5_0", ShaderFeatureTerrain | ShaderFeatureVelocity | ShaderFeatureDepthOnly },
+        { "PS", "ps_5_0", SHADER_FEATURES_SCENE_PS },
+        { "PS_Blur", "ps_5_0", ShaderFeatureHorizontal },
+        { "CS_Blur", "cs_5_0", ShaderFeatureHorizontal },
+    };
 
-    ID3DBlob* pErrorBlob = nullptr;
-    hr = D3DCompileFromFile( szFileName, nullptr, nullptr, szEntryPoint, szShaderModel, 
-        dwShaderFlags, 0, ppBlobOut, &pErrorBlob );
-    if( FAILED(hr) )
+    requests.clear();
+    for (const auto& shader : shaders)
     {
-        if( pErrorBlob )
+        ShaderCompileRequest request = { "shader.fx", shader[0], shader[1], {}, D3DShaderCompiler::GetDefaultFlags() };
+        requests.push_back(request);
+    }
+    for (const auto& shader : permuted)
+    {
+        for (uint32_t i = 0; i < ShaderPermutation::GetVariantCount(shader.FeatureMask); ++i)
         {
-            OutputDebugStringA( reinterpret_cast<const char*>( pErrorBlob->GetBufferPointer() ) );
-            pErrorBlob->Release();
+            uint32_t features = ShaderPermutation::GetFeatures(i, shader.FeatureMask);
+            if (ShaderPermutation::IsValid(features))
+                requests.push_back(ShaderPermutation::MakeRequest("shader.fx", shader.EntryPoint, shader.Profile, features, D3DShaderCompiler::GetDefaultFlags()));
         }
-        return hr;
     }
-    if( pErrorBlob ) pErrorBlob->Release();
+}
+
+//--------------------------------------------------------------------------------------
+// Loads the shader cache and fetches every shader InitMesh needs, compiling misses
+//--------------------------------------------------------------------------------------
+HRESULT PrepareShaders()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (!g_pShaderCache)
+    {
+        g_pShaderCompiler = new D3DShaderCompiler();
+        g_pShaderCache = new ShaderCache(g_pShaderCompiler);
+        g_pShaderCache->LoadFile(SHADER_CACHE_FILE);
+        g_pShaderReloader = new ShaderReloader(g_pShaderCompiler);
+    }
+
+    GetShaderRequests(g_shaderRequests);
+    g_pShaderCache->Compile(g_shaderRequests, g_shaderResults, g_pJobSystem);
+    if (g_pShaderCache->IsDirty())
+        g_pShaderCache->SaveFile(SHADER_CACHE_FILE);
+
+    g_shaderCacheStats = g_pShaderCache->GetStats();
+    g_shaderStartupMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    char message[160];
+    sprintf_s(message, "Shaders: %u requested, %u cached, %u compiled, %.1f ms\n", g_shaderCacheStats.Requests,
+        g_shaderCacheStats.Hits, g_shaderCacheStats.Misses, g_shaderStartupMilliseconds);
+    OutputDebugStringA(message);
+
+    // Failures are reported entry by entry as InitMesh asks for them
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+// "-precompile-shaders [-out <file>]": fills the cache without a window or device.
+// Returns non-zero if any shader fails so the build fails with it.
+//--------------------------------------------------------------------------------------
+int PrecompileShaders(const std::string& commandLine)
+{
+    std::string path = Benchmark::GetArgument(commandLine, "-out", SHADER_CACHE_FILE);
+
+    JobSystem jobs;
+    D3DShaderCompiler compiler;
+    ShaderCache cache(&compiler);
+    cache.LoadFile(path);
+
+    std::vector<ShaderCompileRequest> requests;
+    std::vector<ShaderCompileResult> results;
+    GetShaderRequests(requests);
+    bool succeeded = cache.Compile(requests, results, &jobs);
+    for (const ShaderCompileResult& result : results)
+    {
+        if (!result.Errors.empty())
+            OutputDebugStringA(result.Errors.c_str());
+    }
+
+    // Entry points that were removed or changed don't need to stay on disk
+    cache.RemoveUnused();
+    if (cache.IsDirty() && !cache.SaveFile(path))
+        return 1;
+    return succeeded ? 0 : 1;
+}
+
+static bool IsSameRequest(const ShaderCompileRequest& a, const ShaderCompileRequest& b)
+{
+    if (a.File != b.File || a.EntryPoint != b.EntryPoint || a.Profile != b.Profile || a.Flags != b.Flags || a.Defines.size() != b.Defines.size())
+        return false;
+    for (size_t i = 0; i < a.Defines.size(); ++i)
+    {
+        if (a.Defines[i].Name != b.Defines[i].Name || a.Defines[i].Value != b.Defines[i].Value)
+            return false;
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Hands out bytecode from the batch PrepareShaders fetched. Anything outside the
+// batch is compiled through the cache on its own.
+//--------------------------------------------------------------------------------------
+HRESULT CompileShaderRequest(const ShaderCompileRequest& request, ID3DBlob** ppBlobOut)
+{
+    const ShaderCompileResult* pResult = nullptr;
+    for (size_t i = 0; i < g_shaderRequests.size() && i < g_shaderResults.size(); ++i)
+    {
+        if (IsSameRequest(g_shaderRequests[i], request))
+            pResult = &g_shaderResults[i];
+    }
+
+    std::vector<ShaderCompileResult> single;
+    if (!pResult)
+    {
+        std::vector<ShaderCompileRequest> requests(1, request);
+        g_pShaderCache->Compile(requests, single, nullptr);
+        pResult = &single[0];
+    }
+
+    if (!pResult->Errors.empty())
+        OutputDebugStringA(pResult->Errors.c_str());
+    if (!pResult->Succeeded)
+        return E_FAIL;
+
+    HRESULT hr = D3DCreateBlob(pResult->Bytecode.size(), ppBlobOut);
+    if (FAILED(hr))
+        return hr;
+    memcpy((*ppBlobOut)->GetBufferPointer(), pResult->Bytecode.data(), pResult->Bytecode.size());
 
     return S_OK;
 }
 
+HRESULT CompileShaderFromFile( const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut )
+{
+    std::string file;
+    for (const WCHAR* c = szFileName; *c; ++c)
+        file += static_cast<char>(*c);
+
+    return CompileShaderRequest(ShaderCompileRequest{ file, szEntryPoint, szShaderModel, {}, D3DShaderCompiler::GetDefaultFlags() }, ppBlobOut);
+}
+
+HRESULT CreateShaderForProfile(const std::string& profile, const void* pBytecode, SIZE_T size, ID3D11DeviceChild** ppShader)
+{
+    switch (profile[0])
+    {
+    case 'v': return g_pd3dDevice->CreateVertexShader(pBytecode, size, nullptr, reinterpret_cast<ID3D11VertexShader**>(ppShader));
+    case 'h': return g_pd3dDevice->CreateHullShader(pBytecode, size, nullptr, reinterpret_cast<ID3D11HullShader**>(ppShader));
+    case 'd': return g_pd3dDevice->CreateDomainShader(pBytecode, size, nullptr, reinterpret_cast<ID3D11DomainShader**>(ppShader));
+    case 'g': return g_pd3dDevice->CreateGeometryShader(pBytecode, size, nullptr, reinterpret_cast<ID3D11GeometryShader**>(ppShader));
+    case 'p': return g_pd3dDevice->CreatePixelShader(pBytecode, size, nullptr, reinterpret_cast<ID3D11PixelShader**>(ppShader));
+    case 'c': return g_pd3dDevice->CreateComputeShader(pBytecode, size, nullptr, reinterpret_cast<ID3D11ComputeShader**>(ppShader));
+    default: return E_INVALIDARG;
+    }
+}
+
+// ppShader is where ApplyShaderReloads puts the recompiled shader, it must stay valid.
+// A vertex shader that has an input layout gives it here with the layout's elements.
+template <typename TShader>
+void WatchShader(const ShaderCompileRequest& request, TShader** ppShader, ID3D11InputLayout** ppInputLayout = nullptr,
+    const D3D11_INPUT_ELEMENT_DESC* pInputElements = nullptr, UINT inputElementCount = 0)
+{
+    if (!g_pShaderReloader)
+        return;
+    g_pShaderReloader->Watch(request);
+    g_hotReloadTargets.push_back({ request, reinterpret_cast<ID3D11DeviceChild**>(ppShader), std::string(), ppInputLayout, pInputElements, inputElementCount });
+}
+
+// Compiles a shader.fx variant straight into its table slot and watches the slot
+template <typename TShader>
+bool CreateShaderVariant(LPCSTR szEntryPoint, LPCSTR szShaderModel, uint32_t features, TShader*& pShader)
+{
+    ShaderCompileRequest request = ShaderPermutation::MakeRequest("shader.fx", szEntryPoint, szShaderModel, features, D3DShaderCompiler::GetDefaultFlags());
+    ID3DBlob* pBlob = nullptr;
+    if (FAILED(CompileShaderRequest(request, &pBlob)))
+        return false;
+
+    HRESULT hr = CreateShaderForProfile(request.Profile, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), reinterpret_cast<ID3D11DeviceChild**>(&pShader));
+    pBlob->Release();
+    if (FAILED(hr))
+        return false;
+
+    WatchShader(request, &pShader);
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Main thread only: builds and registers the scene program for these features the
+// first time they are drawn. Recording threads look programs up with Find.
+//--------------------------------------------------------------------------------------
+bool PrepareSceneProgram(uint32_t features)
+{
+    uint32_t program = 0;
+    return g_scenePrograms.Get(features, program, [](uint32_t sceneFeatures, uint32_t& sceneProgram)
+    {
+        ID3D11DomainShader* pDomainShader = nullptr;
+        ID3D11PixelShader* pPixelShader = nullptr;
+        if (!g_sceneDomainShaders.Get(sceneFeatures, pDomainShader, [](uint32_t domainFeatures, ID3D11DomainShader*& pShader) { return CreateShaderVariant("DS", "ds_5_0", domainFeatures, pShader); }))
+            return false;
+        if (!(sceneFeatures & ShaderFeatureDepthOnly) &&
+            !g_scenePixelShaders.Get(sceneFeatures, pPixelShader, [](uint32_t pixelFeatures, ID3D11PixelShader*& pShader) { return CreateShaderVariant("PS", "ps_5_0", pixelFeatures, pShader); }))
+            return false;
+
+        RenderShaderProgram description = { g_pVertexShader, g_pHullShader, pDomainShader, nullptr, pPixelShader, g_pVertexLayout };
+        sceneProgram = g_pCommandBackend->AddShaderProgram(description);
+        return true;
+    });
+}
+
+// Programs keep their own copies of the shader pointers, so they follow a reload
+void RefreshScenePrograms()
+{
+    g_scenePrograms.ForEach([](uint32_t features, uint32_t& program)
+    {
+        ID3D11DomainShader* pDomainShader = nullptr;
+        ID3D11PixelShader* pPixelShader = nullptr;
+        g_sceneDomainShaders.Find(features, pDomainShader);
+        if (!(features & ShaderFeatureDepthOnly))
+            g_scenePixelShaders.Find(features, pPixelShader);
+        RenderShaderProgram description = { g_pVertexShader, g_pHullShader, pDomainShader, nullptr, pPixelShader, g_pVertexLayout };
+        g_pCommandBackend->SetShaderProgram(program, description);
+    });
+}
+
+//--------------------------------------------------------------------------------------
+// The entry points InitMesh created, permutation variants watch themselves as they are made
+//--------------------------------------------------------------------------------------
+void WatchShaders()
+{
+    auto request = [](LPCSTR szEntryPoint, LPCSTR szShaderModel) { return ShaderCompileRequest{ "shader.fx", szEntryPoint, szShaderModel, {}, D3DShaderCompiler::GetDefaultFlags() }; };
+    WatchShader(request("VS", "vs_5_0"), &g_pVertexShader, &g_pVertexLayout, g_vertexLayoutElements, ARRAYSIZE(g_vertexLayoutElements));
+    WatchShader(request("RTT_VS", "vs_5_0"), &g_pQuadVS, &g_pQuadLayout, g_quadLayoutElements, ARRAYSIZE(g_quadLayoutElements));
+    WatchShader(request("Terrain_VS", "vs_5_0"), &g_pTerrainVS);
+    WatchShader(request("Line_VS", "vs_5_0"), &g_pLineVS, &g_pQuadLayout, g_quadLayoutElements, ARRAYSIZE(g_quadLayoutElements));
+    WatchShader(request("HS", "hs_5_0"), &g_pHullShader);
+    WatchShader(request("GS", "gs_5_0"), &g_GeometryShader);
+    WatchShader(request("GS_BILL", "gs_5_0"), &g_pGeometryBillboardShader);
+    WatchShader(request("GS_Depth", "gs_5_0"), &g_pDepthGS);
+    WatchShader(request("PS_BILL", "ps_5_0"), &g_pBillPS);
+    WatchShader(request("PS_Depth", "ps_5_0"), &g_pDepthPS);
+    WatchShader(request("PS_Tint", "ps_5_0"), &g_pTintPS);
+    WatchShader(request("RTT_PS", "ps_5_0"), &g_pQuadPS);
+    WatchShader(request("PS_Resolve", "ps_5_0"), &g_pResolvePS);
+    WatchShader(request("Line_PS", "ps_5_0"), &g_pLinePS);
+}
+
+//--------------------------------------------------------------------------------------
+// Frame boundary: swaps in whatever the reloader has finished. Only creating the new
+// shader object happens here, the compile already ran on the reloader's thread.
+//--------------------------------------------------------------------------------------
+void ApplyShaderReloads()
+{
+    PROFILE_ZONE("ApplyShaderReloads");
+
+    std::vector<ShaderReload> reloads;
+    g_pShaderReloader->TakeReloads(reloads);
+    if (reloads.empty())
+        return;
+
+    for (const ShaderReload& reload : reloads)
+    {
+        HotReloadTarget& target = g_hotReloadTargets[reload.Slot];
+        if (!reload.Result.Succeeded)
+        {
+            target.Error = reload.Result.Errors;
+            continue;
+        }
+
+        ID3D11DeviceChild* pShader = nullptr;
+        const std::vector<uint8_t>& bytecode = reload.Result.Bytecode;
+        if (FAILED(CreateShaderForProfile(target.Request.Profile, bytecode.data(), bytecode.size(), &pShader)))
+        {
+            target.Error = target.Request.EntryPoint + ": the device rejected the new bytecode";
+            continue;
+        }
+
+        // The old layout was validated against the old input signature, so a changed
+        // signature needs a new one. When the layout's elements no longer fit, keep the old shader.
+        ID3D11InputLayout* pInputLayout = nullptr;
+        if (target.ppInputLayout &&
+            FAILED(g_pd3dDevice->CreateInputLayout(target.pInputElements, target.InputElementCount, bytecode.data(), bytecode.size(), &pInputLayout)))
+        {
+            pShader->Release();
+            target.Error = target.Request.EntryPoint + ": the new input signature doesn't match the input layout";
+            continue;
+        }
+
+        if (*target.ppShader)
+            (*target.ppShader)->Release();
+        *target.ppShader = pShader;
+        if (pInputLayout)
+        {
+            if (*target.ppInputLayout)
+                (*target.ppInputLayout)->Release();
+            *target.ppInputLayout = pInputLayout;
+        }
+        target.Error.clear();
+
+        ++g_hotReloadSwaps;
+        g_hotReloadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reload.Detected).count();
+        g_hotReloadCompileMilliseconds = reload.CompileMilliseconds;
+    }
+
+    RefreshScenePrograms();
+}
+
 //--------------------------------------------------------------------------------------
 // Create Direct3D device and swap chain
 //--------------------------------------------------------------------------------------
@@ -313,62 +638,43 @@ HRESULT InitDevice()
     g_wfdescWireframe.ScissorEnable = false;
     g_wfdescWireframe.SlopeScaledDepthBias = 0.0f;
 
+    // States are created on first use and shared from then on
+    g_pStateCache = new RenderStateCache(g_pd3dDevice);
+
     // Week 6 - Render to texture
     // Code based on www.braynzarsoft.net/viewtutorial/q16390-35-render-to-texture
-    D3D11_TEXTURE2D_DESC textureDesc = {};
-    textureDesc.Width = width;
-    textureDesc.Height = height;
-    textureDesc.MipLevels = 1;
-    textureDesc.ArraySize = 1;
-    textureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-    textureDesc.SampleDesc.Count = 1;
-    textureDesc.Usage = D3D11_USAGE_DEFAULT;
-    textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-    textureDesc.SampleDesc.Count = sampleCount;
-    textureDesc.SampleDesc.Quality = maxQuality;
-    g_pd3dDevice->CreateTexture2D(&textureDesc, nullptr, &g_RTTTexture.texture);
-
-    // Depth mapping - texture
-    textureDesc.SampleDesc.Count = 1;
-    textureDesc.SampleDesc.Quality = 0;
-    g_pd3dDevice->CreateTexture2D(&textureDesc, nullptr, &g_DepthTexture.texture);
-    g_pd3dDevice->CreateTexture2D(&textureDesc, nullptr, &g_BloomTexture.texture);
-    g_pd3dDevice->CreateTexture2D(&textureDesc, nullptr, &g_BlurTextureHorizontal.texture);
-    g_pd3dDevice->CreateTexture2D(&textureDesc, nullptr, &g_BlurTextureVertical.texture);
-
-    // No MSAA - texture
-    g_pd3dDevice->CreateTexture2D(&textureDesc, nullptr, &g_NoMSAARTTTexture.texture);
-
-    D3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc = {};
-    renderTargetViewDesc.Format = textureDesc.Format;
-    renderTargetViewDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DMS;
-    hr = g_pd3dDevice->CreateRenderTargetView(g_RTTTexture.texture, &renderTargetViewDesc, &g_RTTTexture.view);
-
-    // Depth mapping - target
-    renderTargetViewDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-    hr = g_pd3dDevice->CreateRenderTargetView(g_DepthTexture.texture, &renderTargetViewDesc, &g_DepthTexture.view);
-    hr = g_pd3dDevice->CreateRenderTargetView(g_BloomTexture.texture, &renderTargetViewDesc, &g_BloomTexture.view);
-    hr = g_pd3dDevice->CreateRenderTargetView(g_BlurTextureHorizontal.texture, &renderTargetViewDesc, &g_BlurTextureHorizontal.view);
-    hr = g_pd3dDevice->CreateRenderTargetView(g_BlurTextureVertical.texture, &renderTargetViewDesc, &g_BlurTextureVertical.view);
-
-    // No MSAA - target
-    hr = g_pd3dDevice->CreateRenderTargetView(g_NoMSAARTTTexture.texture, &renderTargetViewDesc, &g_NoMSAARTTTexture.view);
-
-    D3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc = {};
-    shaderResourceViewDesc.Format = textureDesc.Format;
-    shaderResourceViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DMS;
-    shaderResourceViewDesc.Texture2D.MipLevels = 1;
-    hr = g_pd3dDevice->CreateShaderResourceView(g_RTTTexture.texture, &shaderResourceViewDesc, &g_RTTTexture.resource);
-
-    // Depth mapping - resource
-    shaderResourceViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-    hr = g_pd3dDevice->CreateShaderResourceView(g_DepthTexture.texture, &shaderResourceViewDesc, &g_DepthTexture.resource);
-    hr = g_pd3dDevice->CreateShaderResourceView(g_BloomTexture.texture, &shaderResourceViewDesc, &g_BloomTexture.resource);
-    hr = g_pd3dDevice->CreateShaderResourceView(g_BlurTextureHorizontal.texture, &shaderResourceViewDesc, &g_BlurTextureHorizontal.resource);
-    hr = g_pd3dDevice->CreateShaderResourceView(g_BlurTextureVertical.texture, &shaderResourceViewDesc, &g_BlurTextureVertical.resource);
-
-    // No MSAA - resource
-    hr = g_pd3dDevice->CreateShaderResourceView(g_NoMSAARTTTexture.texture, &shaderResourceViewDesc, &g_NoMSAARTTTexture.resource);
+    // The render to texture targets are frame graph transients, created by the pool
+    // as BuildFrameGraph declares them
+    g_sampleCount = sampleCount;
+    g_sampleQuality = maxQuality;
+
+    // Precisions the policy may pick, anything unsupported falls back to a more precise one
+    for (int precision = PrecisionHalf; precision < RenderTargetPrecisionCount; ++precision)
+    {
+        DXGI_FORMAT format = (DXGI_FORMAT)RenderTargetFormats::GetFormat((RenderTargetPrecision)precision);
+        const UINT required = D3D11_FORMAT_SUPPORT_RENDER_TARGET | D3D11_FORMAT_SUPPORT_SHADER_SAMPLE;
+        const UINT msaaRequired = D3D11_FORMAT_SUPPORT_MULTISAMPLE_RENDERTARGET | D3D11_FORMAT_SUPPORT_MULTISAMPLE_RESOLVE | D3D11_FORMAT_SUPPORT_MULTISAMPLE_LOAD;
+        UINT support = 0;
+        if (FAILED(g_pd3dDevice->CheckFormatSupport(format, &support)) || (support & required) != required)
+            continue;
+        g_targetSupport |= 1u << precision;
+
+        UINT levels = 0;
+        if ((sampleCount == 1 || (support & msaaRequired) == msaaRequired) &&
+            SUCCEEDED(g_pd3dDevice->CheckMultisampleQualityLevels(format, sampleCount, &levels)) && levels > maxQuality)
+            g_msaaTargetSupport |= 1u << precision;
+    }
+
+    // Formats the compute blur can write, without one it falls back to the pixel shader
+    for (int precision = PrecisionFull; precision < RenderTargetPrecisionCount; ++precision)
+    {
+        UINT support = 0;
+        if (SUCCEEDED(g_pd3dDevice->CheckFormatSupport((DXGI_FORMAT)RenderTargetFormats::GetFormat((RenderTargetPrecision)precision), &support)) &&
+            (support & D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW))
+            g_unorderedAccessSupport |= 1u << precision;
+    }
+    g_pFrameGraph = new FrameGraph();
+    g_pRenderTargets = new D3D11RenderTargetPool();
 
     // Default scene
     // Create depth stencil texture
@@ -399,6 +705,66 @@ HRESULT InitDevice()
     descDSV.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
     hr = g_pd3dDevice->CreateDepthStencilView(g_pNoMSAADepthStencilTexture, &descDSV, &g_pNoMSAARTTStencilView);
 
+    // Shadow maps, one slice per cascade, written as depth and sampled as float
+    D3D11_TEXTURE2D_DESC descShadow = {};
+    descShadow.Width = SHADOW_MAP_SIZE;
+    descShadow.Height = SHADOW_MAP_SIZE;
+    descShadow.MipLevels = 1;
+    descShadow.ArraySize = SHADOW_MAX_CASCADES;
+    descShadow.Format = DXGI_FORMAT_R32_TYPELESS;
+    descShadow.SampleDesc.Count = 1;
+    descShadow.Usage = D3D11_USAGE_DEFAULT;
+    descShadow.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+    hr = g_pd3dDevice->CreateTexture2D(&descShadow, nullptr, &g_pShadowMapTexture);
+    if (FAILED(hr))
+        return hr;
+
+    D3D11_DEPTH_STENCIL_VIEW_DESC descShadowDSV = {};
+    descShadowDSV.Format = DXGI_FORMAT_D32_FLOAT;
+    descShadowDSV.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+    descShadowDSV.Texture2DArray.ArraySize = 1;
+    for (UINT i = 0; i < SHADOW_MAX_CASCADES && SUCCEEDED(hr); ++i)
+    {
+        descShadowDSV.Texture2DArray.FirstArraySlice = i;
+        hr = g_pd3dDevice->CreateDepthStencilView(g_pShadowMapTexture, &descShadowDSV, &g_pShadowMapViews[i]);
+    }
+    if (FAILED(hr))
+        return hr;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC descShadowSRV = {};
+    descShadowSRV.Format = DXGI_FORMAT_R32_FLOAT;
+    descShadowSRV.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+    descShadowSRV.Texture2DArray.MipLevels = 1;
+    descShadowSRV.Texture2DArray.ArraySize = SHADOW_MAX_CASCADES;
+    hr = g_pd3dDevice->CreateShaderResourceView(g_pShadowMapTexture, &descShadowSRV, &g_pShadowMapResource);
+    if (FAILED(hr))
+        return hr;
+
+    g_shadowViewport = { 0.0f, 0.0f, (FLOAT)SHADOW_MAP_SIZE, (FLOAT)SHADOW_MAP_SIZE, 0.0f, 1.0f };
+
+    // Biased against acne, and casters in front of a cascade are flattened onto its
+    // near plane rather than clipped away
+    D3D11_RASTERIZER_DESC shadowRasterizerDesc = g_wfdescNormal;
+    shadowRasterizerDesc.AntialiasedLineEnable = false;
+    shadowRasterizerDesc.MultisampleEnable = false;
+    shadowRasterizerDesc.DepthClipEnable = false;
+    shadowRasterizerDesc.DepthBias = 1000;
+    shadowRasterizerDesc.SlopeScaledDepthBias = 2.0f;
+    g_pShadowRasterizerState = g_pStateCache->GetRasterizerState(shadowRasterizerDesc);
+
+    // Hardware 2x2 comparison, anything off the maps is lit
+    D3D11_SAMPLER_DESC shadowSamplerDesc = {};
+    shadowSamplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+    shadowSamplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_BORDER;
+    shadowSamplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
+    shadowSamplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
+    shadowSamplerDesc.BorderColor[0] = shadowSamplerDesc.BorderColor[1] = shadowSamplerDesc.BorderColor[2] = shadowSamplerDesc.BorderColor[3] = 1.0f;
+    shadowSamplerDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+    shadowSamplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+    g_pShadowSampler = g_pStateCache->GetSamplerState(shadowSamplerDesc);
+    if (!g_pShadowRasterizerState || !g_pShadowSampler)
+        return E_FAIL;
+
     // Setup the viewport
     D3D11_VIEWPORT vp;
     vp.Width = (FLOAT)width;
@@ -408,8 +774,14 @@ HRESULT InitDevice()
     vp.TopLeftX = 0;
     vp.TopLeftY = 0;
     g_pImmediateContext->RSSetViewports( 1, &vp );
+    g_viewport = vp;
+
+	// Created before the shaders so cache misses compile in parallel
+	g_pJobSystem = new JobSystem();
 
 	hr = InitMesh();
+	// Bytecode is in the shader objects now, the cache keeps its own copy
+	g_shaderResults.clear();
 	if (FAILED(hr))
 	{
 		MessageBox(nullptr,
@@ -417,6 +789,11 @@ HRESULT InitDevice()
 		return hr;
 	}
 
+	// Baseline taken here so edits from now on are seen, then polled off the main thread
+	WatchShaders();
+	g_pShaderReloader->Scan();
+	g_pShaderReloader->Start(SHADER_RELOAD_POLL_MS);
+
 	hr = InitWorld(width, height);
 	if (FAILED(hr))
 	{
@@ -453,9 +830,13 @@ HRESULT InitDevice()
 // ***************************************************************************************
 HRESULT	InitMesh()
 {
+	HRESULT hr = PrepareShaders();
+	if (FAILED(hr))
+		return hr;
+
 	// Compile the vertex shader
 	ID3DBlob* pVSBlob = nullptr;
-	HRESULT hr = CompileShaderFromFile(L"shader.fx", "VS", "vs_5_0", &pVSBlob);
+	hr = CompileShaderFromFile(L"shader.fx", "VS", "vs_5_0", &pVSBlob);
 	if (FAILED(hr))
 	{
 		MessageBox(nullptr, L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
@@ -518,21 +899,6 @@ HRESULT	InitMesh()
         return hr;
     }
 
-    // Compile the domain shader
-    ID3DBlob* pDSBlob = nullptr;
-    hr = CompileShaderFromFile(L"shader.fx", "DS", "ds_5_0", &pDSBlob);
-    if (FAILED(hr))
-    {
-        MessageBox(nullptr, L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-        return hr;
-    }
-    // Create the domain shader
-    hr = g_pd3dDevice->CreateDomainShader(pDSBlob->GetBufferPointer(), pDSBlob->GetBufferSize(), nullptr, &g_pDomainShader);
-    if (FAILED(hr))
-    {
-        pDSBlob->Release();
-        return hr;
-    }
 
 
     // Set up geometry shader
@@ -580,49 +946,19 @@ HRESULT	InitMesh()
     }
 
 
-	// Define the input layout
-	D3D11_INPUT_ELEMENT_DESC layout[] =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT , D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT , D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "BINORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-	};
-	UINT numElements = ARRAYSIZE(layout);
-	// Create the input layout
-	hr = g_pd3dDevice->CreateInputLayout(layout, numElements, pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(), &g_pVertexLayout);
+	// Create the input layout, its elements are in main.h so a reload can rebuild it
+	hr = g_pd3dDevice->CreateInputLayout(g_vertexLayoutElements, ARRAYSIZE(g_vertexLayoutElements), pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(), &g_pVertexLayout);
 	pVSBlob->Release();
 	if (FAILED(hr))
 		return hr;
 
-    // Define the RTT input layout
-    D3D11_INPUT_ELEMENT_DESC RTTlayout[] =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT , D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-    };
-    UINT RRTNumElements = ARRAYSIZE(RTTlayout);
     // Create the RTT input layout
-    hr = g_pd3dDevice->CreateInputLayout(RTTlayout, RRTNumElements, pRTTVSBlob->GetBufferPointer(), pRTTVSBlob->GetBufferSize(), &g_pQuadLayout);
+    hr = g_pd3dDevice->CreateInputLayout(g_quadLayoutElements, ARRAYSIZE(g_quadLayoutElements), pRTTVSBlob->GetBufferPointer(), pRTTVSBlob->GetBufferSize(), &g_pQuadLayout);
     pRTTVSBlob->Release();
     if (FAILED(hr))
         return hr;
 
 
-	// Compile the pixel shader
-	ID3DBlob* pPSBlob = nullptr;
-	hr = CompileShaderFromFile(L"shader.fx", "PS", "ps_5_0", &pPSBlob);
-	if (FAILED(hr))
-	{
-		MessageBox(nullptr, L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-		return hr;
-	}
-	// Create the pixel shader
-	hr = g_pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &g_pPixelShader);
-	pPSBlob->Release();
-	if (FAILED(hr))
-		return hr;
 
     // Compile the billboarding pixel shader
     ID3DBlob* pPSBillBlob = nullptr;
@@ -666,31 +1002,93 @@ HRESULT	InitMesh()
     if (FAILED(hr))
         return hr;
 
-    // Compile the blur pixel shader
-    ID3DBlob* pPSBlurBlob = nullptr;
-    hr = CompileShaderFromFile(L"shader.fx", "PS_Blur", "ps_5_0", &pPSBlurBlob);
+    // Both blur directions, the pass picks one instead of uploading a flag
+    auto createBlurShader = [](uint32_t features, ID3D11PixelShader*& pShader) { return CreateShaderVariant("PS_Blur", "ps_5_0", features, pShader); };
+    ID3D11PixelShader* pBlurPS = nullptr;
+    if (!g_blurShaders.Get(0, pBlurPS, createBlurShader) || !g_blurShaders.Get(ShaderFeatureHorizontal, pBlurPS, createBlurShader))
+        return E_FAIL;
+    auto createBlurComputeShader = [](uint32_t features, ID3D11ComputeShader*& pShader) { return CreateShaderVariant("CS_Blur", "cs_5_0", features, pShader); };
+    ID3D11ComputeShader* pBlurCS = nullptr;
+    if (!g_blurComputeShaders.Get(0, pBlurCS, createBlurComputeShader) || !g_blurComputeShaders.Get(ShaderFeatureHorizontal, pBlurCS, createBlurComputeShader))
+        return E_FAIL;
+
+    // Motion blur, the velocity buffer itself comes from the scene's VELOCITY programs
+    if (!CreateShaderVariant("CS_VelocityTileMax", "cs_5_0", 0, g_pVelocityTileMaxCS) ||
+        !CreateShaderVariant("PS_VelocityNeighbourMax", "ps_5_0", 0, g_pVelocityNeighbourMaxPS) ||
+        !CreateShaderVariant("PS_MotionBlur", "ps_5_0", 0, g_pMotionBlurPS))
+        return E_FAIL;
+
+    // Bloom chain shaders, both blur directions share one and take the step from the constants
+    if (!CreateShaderVariant("PS_BloomDownsample", "ps_5_0", 0, g_pBloomDownsamplePS) ||
+        !CreateShaderVariant("PS_BloomBlur", "ps_5_0", 0, g_pBloomBlurPS) ||
+        !CreateShaderVariant("PS_BloomUpsample", "ps_5_0", 0, g_pBloomUpsamplePS))
+        return E_FAIL;
+
+    // Linear clamp, so the blur doesn't pull in the opposite edge of the screen
+    D3D11_SAMPLER_DESC bloomSamplerDesc = {};
+    bloomSamplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    bloomSamplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+    bloomSamplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+    bloomSamplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+    bloomSamplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    bloomSamplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+    g_pBloomSampler = g_pStateCache->GetSamplerState(bloomSamplerDesc);
+    if (!g_pBloomSampler)
+        return E_FAIL;
+
+    // Compile the RTT pixel shader
+    ID3DBlob* pPSRTTBlob = nullptr;
+    hr = CompileShaderFromFile(L"shader.fx", "RTT_PS", "ps_5_0", &pPSRTTBlob);
     if (FAILED(hr))
     {
         MessageBox(nullptr, L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
         return hr;
     }
-    // Create the blur pixel shader
-    hr = g_pd3dDevice->CreatePixelShader(pPSBlurBlob->GetBufferPointer(), pPSBlurBlob->GetBufferSize(), nullptr, &g_pBlurPS);
-    pPSBlurBlob->Release();
+    // Create the RTT pixel shader
+    hr = g_pd3dDevice->CreatePixelShader(pPSRTTBlob->GetBufferPointer(), pPSRTTBlob->GetBufferSize(), nullptr, &g_pQuadPS);
+    pPSRTTBlob->Release();
     if (FAILED(hr))
         return hr;
 
-    // Compile the RTT pixel shader
-    ID3DBlob* pPSRTTBlob = nullptr;
-    hr = CompileShaderFromFile(L"shader.fx", "RTT_PS", "ps_5_0", &pPSRTTBlob);
+    // Compile the MSAA resolve pixel shader
+    ID3DBlob* pPSResolveBlob = nullptr;
+    hr = CompileShaderFromFile(L"shader.fx", "PS_Resolve", "ps_5_0", &pPSResolveBlob);
     if (FAILED(hr))
     {
         MessageBox(nullptr, L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
         return hr;
     }
-    // Create the RTT pixel shader
-    hr = g_pd3dDevice->CreatePixelShader(pPSRTTBlob->GetBufferPointer(), pPSRTTBlob->GetBufferSize(), nullptr, &g_pQuadPS);
-    pPSRTTBlob->Release();
+    // Create the MSAA resolve pixel shader
+    hr = g_pd3dDevice->CreatePixelShader(pPSResolveBlob->GetBufferPointer(), pPSResolveBlob->GetBufferSize(), nullptr, &g_pResolvePS);
+    pPSResolveBlob->Release();
+    if (FAILED(hr))
+        return hr;
+
+    // Compile the line vertex shader
+    ID3DBlob* pVSLineBlob = nullptr;
+    hr = CompileShaderFromFile(L"shader.fx", "Line_VS", "vs_5_0", &pVSLineBlob);
+    if (FAILED(hr))
+    {
+        MessageBox(nullptr, L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
+        return hr;
+    }
+    // Create the line vertex shader
+    hr = g_pd3dDevice->CreateVertexShader(pVSLineBlob->GetBufferPointer(), pVSLineBlob->GetBufferSize(), nullptr, &g_pLineVS);
+    pVSLineBlob->Release();
+    if (FAILED(hr))
+        return hr;
+
+    // Compile the line pixel shader
+    ID3DBlob* pPSLineBlob = nullptr;
+    hr = CompileShaderFromFile(L"shader.fx", "Line_PS", "ps_5_0", &pPSLineBlob);
+    if (FAILED(hr))
+    {
+        MessageBox(nullptr, L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
+        return hr;
+    }
+    // Create the line pixel shader
+    hr = g_pd3dDevice->CreatePixelShader(pPSLineBlob->GetBufferPointer(), pPSLineBlob->GetBufferSize(), nullptr, &g_pLinePS);
+    pPSLineBlob->Release();
     if (FAILED(hr))
         return hr;
 
@@ -734,7 +1132,7 @@ HRESULT	InitMesh()
         }
     }
 
-    //g_Spline = Spline(g_pd3dDevice);
+    g_pSpline = new Spline(g_pd3dDevice);
 
     bd.Usage = D3D11_USAGE_DEFAULT;
     bd.ByteWidth = sizeof(SCREEN_VERTEX) * g_numberOfSprites;
@@ -745,34 +1143,51 @@ HRESULT	InitMesh()
     InitData.pSysMem = g_SpriteArray;
     hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pSpriteVertexBuffer);
 
-	// Create the constant buffer
-	bd.ByteWidth = sizeof(ConstantBuffer);
-    bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pConstantBuffer);
-
-	// Create the light constant buffer
-	bd.ByteWidth = sizeof(LightPropertiesConstantBuffer);
-	hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pLightConstantBuffer);
-
-    // Create the billboard constant buffer
-    bd.ByteWidth = sizeof(BillboardConstantBuffer);
-    hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pSpriteConstantBuffer);
-
-    // Create the material constant buffer
-    bd.ByteWidth = sizeof(MaterialPropertiesConstantBuffer);
-    hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pMaterialConstantBuffer);
-
-    // Create the blur constant buffer
-    bd.ByteWidth = sizeof(BlurProperties);
-    hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pBlurConstantBuffer);
-
-    // Create the tesselation constant buffer
-    bd.ByteWidth = sizeof(TessProperties);
-    hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pTessConstantBuffer);
-
-    // Create the terrain constant buffer
-    bd.ByteWidth = sizeof(TerrainProperties);
-    hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pTerrainConstantBuffer);
+    // Per object constants live in each recording context's ring, these only upload when they change
+    g_pFrameConstants = new CachedConstantBuffer();
+    g_pLightConstants = new CachedConstantBuffer();
+    g_pBillboardConstants = new CachedConstantBuffer();
+    g_pTessConstants = new CachedConstantBuffer();
+    g_pBlurConstants = new CachedConstantBuffer();
+    g_pMaterialConstants = new CachedConstantBuffer();
+    g_pBloomConstants = new CachedConstantBuffer[BLOOM_LEVELS * BloomStepCount];
+    g_pMotionBlurConstants = new CachedConstantBuffer[MotionBlurStepCount];
+    g_pClusterConstants = new CachedConstantBuffer();
+    g_pShadowConstants = new CachedConstantBuffer();
+    g_pShadowPassConstants = new CachedConstantBuffer[SHADOW_MAX_CASCADES];
+
+    hr = g_pFrameConstants->Create(g_pd3dDevice, sizeof(FrameConstants), &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pLightConstants->Create(g_pd3dDevice, sizeof(LightPropertiesConstantBuffer), &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pBillboardConstants->Create(g_pd3dDevice, sizeof(BillboardConstantBuffer), &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pTessConstants->Create(g_pd3dDevice, sizeof(TessProperties), &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pBlurConstants->Create(g_pd3dDevice, sizeof(BlurProperties), &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pMaterialConstants->Create(g_pd3dDevice, sizeof(MaterialPropertiesConstantBuffer), &g_constantStats);
+    for (int i = 0; i < BLOOM_LEVELS * BloomStepCount && SUCCEEDED(hr); ++i)
+        hr = g_pBloomConstants[i].Create(g_pd3dDevice, sizeof(BloomProperties), &g_constantStats);
+    for (int i = 0; i < MotionBlurStepCount && SUCCEEDED(hr); ++i)
+        hr = g_pMotionBlurConstants[i].Create(g_pd3dDevice, sizeof(MotionBlurProperties), &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pClusterConstants->Create(g_pd3dDevice, sizeof(ClusterProperties), &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pShadowConstants->Create(g_pd3dDevice, sizeof(ShadowProperties), &g_constantStats);
+    for (int i = 0; i < SHADOW_MAX_CASCADES && SUCCEEDED(hr); ++i)
+        hr = g_pShadowPassConstants[i].Create(g_pd3dDevice, sizeof(ShadowPassProperties), &g_constantStats);
+
+    // The clustered lights and their bins, the index list grows when a frame needs more
+    g_pClusterLightBuffer = new DynamicStructuredBuffer();
+    g_pClusterRangeBuffer = new DynamicStructuredBuffer();
+    g_pClusterIndexBuffer = new DynamicStructuredBuffer();
+    if (SUCCEEDED(hr))
+        hr = g_pClusterLightBuffer->Create(g_pd3dDevice, sizeof(ClusterLight), MAX_CLUSTERED_LIGHTS, &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pClusterRangeBuffer->Create(g_pd3dDevice, sizeof(ClusterRange), LIGHT_CLUSTER_COUNT, &g_constantStats);
+    if (SUCCEEDED(hr))
+        hr = g_pClusterIndexBuffer->Create(g_pd3dDevice, sizeof(uint32_t), 64 * 1024, &g_constantStats);
 
 	return hr;
 }
@@ -786,8 +1201,38 @@ HRESULT	InitWorld(int width, int height)
     g_pDebug = new Debug();
     g_pGameObject = new CubeGameObject();
     g_pTerrainObject = new TerrainGameObject();
+    g_pGameObject->SetStateCache(g_pStateCache);
+    g_pTerrainObject->SetStateCache(g_pStateCache);
     g_pTerrainObject->initMesh(g_pd3dDevice, g_pImmediateContext, 0);
-    g_pModelObject = new ModelGameObject(g_pd3dDevice, g_pImmediateContext);
+    g_pModelObject = new ModelGameObject(g_pd3dDevice, g_pImmediateContext, g_pJobSystem);
+    g_pModelObject->SetStateCache(g_pStateCache);
+
+    // A recording context per worker, each with its own 64 KB object constant ring
+    g_pCommandBackend = new D3D11CommandBackend();
+    HRESULT hr = g_pCommandBackend->Create(g_pd3dDevice, g_pImmediateContext, g_pJobSystem->GetThreadCount(), 64 * 1024);
+    if (FAILED(hr))
+        return hr;
+    g_pCommandRecorder = new CommandRecorder(g_pCommandBackend, g_pJobSystem);
+
+    // Without timestamp queries the frame just goes untimed
+    g_pGpuQueries = new D3D11GpuQueryBackend();
+    if (SUCCEEDED(g_pGpuQueries->Create(g_pd3dDevice, g_pImmediateContext, GPU_PROFILER_LATENCY)))
+    {
+        g_pGpuProfiler = new GpuProfiler(g_pGpuQueries);
+        g_pCommandRecorder->SetGpuProfiler(g_pGpuProfiler);
+    }
+
+    g_pCameraTrack = new CameraTrack(CameraTrack::CreateDefault());
+    g_pCameraPlayer = new CameraPathPlayer();
+    g_pCameraPlayer->SetPose(g_pCamera->GetPose());
+    if (g_isFlythrough)
+        g_pCameraPlayer->PlayTrack(g_pCameraTrack);
+
+    // The flythrough renders every frame it can, it steps once per frame anyway
+    g_pFrameTimer = new FrameTimer(g_pCameraPlayer->GetTimestep(), g_isFlythrough ? 0.0 : 1.0 / FRAME_RATE_LIMIT);
+    g_hFrameWait = CreateWaitableTimerEx(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!g_hFrameWait)
+        g_hFrameWait = CreateWaitableTimerEx(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
 
     g_pGameObject->setPosition({ 12, 0.0f, 12 });
     g_pTerrainObject->setPosition({ 0.0f, -6.5f, 0.0f });
@@ -795,6 +1240,30 @@ HRESULT	InitWorld(int width, int height)
 
     g_LightPos = { 12, 10.0f, 12, 0.0f };
 
+    // Small coloured lights scattered just above the terrain, each circling its own spot
+    g_pLightClusterer = new LightClusterer();
+    g_pOcclusionBuffer = new OcclusionBuffer();
+    g_clusterLights.resize(MAX_CLUSTERED_LIGHTS);
+    g_clusterLightOrigins.resize(MAX_CLUSTERED_LIGHTS);
+    std::mt19937 random(26);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (uint32_t i = 0; i < MAX_CLUSTERED_LIGHTS; ++i)
+    {
+        float x = -12.8f + unit(random) * 51.2f;
+        float z = -12.8f + unit(random) * 51.2f;
+        float y = g_pTerrainObject->GetHeight(x, z) + 0.5f + unit(random) * 2.0f;
+        g_clusterLightOrigins[i] = XMFLOAT4(x, y, z, unit(random) * XM_2PI);
+
+        // One channel full, the others anywhere, so nothing comes out grey
+        float colour[3] = { unit(random), unit(random), unit(random) };
+        colour[i % 3] = 1.0f;
+        ClusterLight& light = g_clusterLights[i];
+        light.Position = XMFLOAT3(x, y, z);
+        light.Range = 1.5f + unit(random) * 2.5f;
+        light.Colour = XMFLOAT3(colour[0], colour[1], colour[2]);
+        light.Padding = 0.0f;
+    }
+
 	return S_OK;
 }
 
@@ -819,6 +1288,18 @@ void CleanupDevice()
     g_pModelObject = nullptr;
     delete g_pModelObject;
 
+    delete g_pJobSystem;
+    g_pJobSystem = nullptr;
+    delete g_pCameraPlayer;
+    g_pCameraPlayer = nullptr;
+    delete g_pCameraTrack;
+    g_pCameraTrack = nullptr;
+    delete g_pFrameTimer;
+    g_pFrameTimer = nullptr;
+    if (g_hFrameWait)
+        CloseHandle(g_hFrameWait);
+    g_hFrameWait = nullptr;
+
     // Remove any bound render target or depth/stencil buffer
     ID3D11RenderTargetView* nullViews[] = { nullptr };
     g_pImmediateContext->OMSetRenderTargets(_countof(nullViews), nullViews, nullptr);
@@ -828,11 +1309,44 @@ void CleanupDevice()
     if (g_pImmediateContext1) g_pImmediateContext1->Flush();
     g_pImmediateContext->Flush();
 
-    if (g_pLightConstantBuffer) g_pLightConstantBuffer->Release();
+    delete g_pStateCache;
+    g_pStateCache = nullptr;
+
     if (g_pVertexLayout) g_pVertexLayout->Release();
-    if( g_pConstantBuffer ) g_pConstantBuffer->Release();
+    delete g_pCommandRecorder;
+    delete g_pCommandBackend;
+    delete g_pGpuProfiler;
+    g_pGpuProfiler = nullptr;
+    delete g_pGpuQueries;
+    g_pGpuQueries = nullptr;
+    delete g_pShaderReloader;
+    g_pShaderReloader = nullptr;
+    delete g_pShaderCache;
+    g_pShaderCache = nullptr;
+    delete g_pShaderCompiler;
+    g_pShaderCompiler = nullptr;
+    delete g_pFrameConstants;
+    delete g_pLightConstants;
+    delete g_pBillboardConstants;
+    delete g_pTessConstants;
+    delete g_pBlurConstants;
+    delete g_pMaterialConstants;
+    delete[] g_pBloomConstants;
+    delete[] g_pMotionBlurConstants;
+    delete g_pClusterConstants;
+    delete g_pClusterLightBuffer;
+    delete g_pClusterRangeBuffer;
+    delete g_pClusterIndexBuffer;
+    delete g_pLightClusterer;
+    delete g_pOcclusionBuffer;
+    delete g_pShadowConstants;
+    delete[] g_pShadowPassConstants;
+    for (ID3D11DepthStencilView* pView : g_pShadowMapViews)
+        if (pView) pView->Release();
+    if (g_pShadowMapResource) g_pShadowMapResource->Release();
+    if (g_pShadowMapTexture) g_pShadowMapTexture->Release();
     if( g_pVertexShader ) g_pVertexShader->Release();
-    if( g_pPixelShader ) g_pPixelShader->Release();
+    g_scenePixelShaders.Clear([](ID3D11PixelShader* pShader) { pShader->Release(); });
     if (g_GeometryShader) g_GeometryShader->Release();
     if( g_pDepthStencilTexture) g_pDepthStencilTexture->Release();
     if( g_pDepthStencilView ) g_pDepthStencilView->Release();
@@ -841,50 +1355,42 @@ void CleanupDevice()
     if( g_pSwapChain ) g_pSwapChain->Release();
     if( g_pImmediateContext1 ) g_pImmediateContext1->Release();
     if( g_pImmediateContext ) g_pImmediateContext->Release();
-    if (g_RTTTexture.texture) g_RTTTexture.texture->Release();
-    if (g_RTTTexture.view) g_RTTTexture.view->Release();
-    if (g_RTTTexture.resource) g_RTTTexture.resource->Release();
     if (g_pRTTStencilView) g_pRTTStencilView->Release();
+    delete g_pRenderTargets;
+    g_pRenderTargets = nullptr;
+    delete g_pFrameGraph;
+    g_pFrameGraph = nullptr;
     if (g_pScreenQuadVB) g_pScreenQuadVB->Release();
     if (g_pQuadLayout) g_pQuadLayout->Release();
     if (g_pQuadVS) g_pQuadVS->Release();
     if (g_pQuadPS) g_pQuadPS->Release();
+    if (g_pResolvePS) g_pResolvePS->Release();
+    if (g_pBloomDownsamplePS) g_pBloomDownsamplePS->Release();
+    if (g_pBloomBlurPS) g_pBloomBlurPS->Release();
+    if (g_pBloomUpsamplePS) g_pBloomUpsamplePS->Release();
+    if (g_pVelocityTileMaxCS) g_pVelocityTileMaxCS->Release();
+    if (g_pVelocityNeighbourMaxPS) g_pVelocityNeighbourMaxPS->Release();
+    if (g_pMotionBlurPS) g_pMotionBlurPS->Release();
     if (g_pBillPS) g_pBillPS->Release();
     if (g_pSpriteVertexBuffer) g_pSpriteVertexBuffer->Release();
     if (g_pSpriteLayout) g_pSpriteLayout->Release();
     if (g_pGeometryBillboardShader) g_pGeometryBillboardShader->Release();
     if (g_pSpriteTexture) g_pSpriteTexture->Release();
-    if (g_pSpriteConstantBuffer) g_pSpriteConstantBuffer->Release();
-    if (g_DepthTexture.texture) g_DepthTexture.texture->Release();
-    if (g_DepthTexture.view) g_DepthTexture.view->Release();
-    if (g_DepthTexture.resource) g_DepthTexture.resource->Release();
     if (g_pDepthGS) g_pDepthGS->Release();
     if (g_pDepthPS) g_pDepthPS->Release();
-    if (g_NoMSAARTTTexture.texture) g_NoMSAARTTTexture.texture->Release();
-    if (g_NoMSAARTTTexture.view) g_NoMSAARTTTexture.view->Release();
-    if (g_NoMSAARTTTexture.resource) g_NoMSAARTTTexture.resource->Release();
     if (g_pNoMSAARTTStencilView) g_pNoMSAARTTStencilView->Release();
     if (g_pNoMSAADepthStencilTexture) g_pNoMSAADepthStencilTexture->Release();
     if (g_pTintPS) g_pTintPS->Release();
-    if (g_pMaterialConstantBuffer) g_pMaterialConstantBuffer->Release();
     if (g_pHullShader) g_pHullShader->Release();
-    if (g_pDomainShader) g_pDomainShader->Release();
-    if (g_pTessConstantBuffer) g_pTessConstantBuffer->Release();
-
-    if (g_BloomTexture.texture) g_BloomTexture.texture->Release();
-    if (g_BloomTexture.view) g_BloomTexture.view->Release();
-    if (g_BloomTexture.resource) g_BloomTexture.resource->Release();
-    if (g_BlurTextureHorizontal.texture) g_BlurTextureHorizontal.texture->Release();
-    if (g_BlurTextureHorizontal.view) g_BlurTextureHorizontal.view->Release();
-    if (g_BlurTextureHorizontal.resource) g_BlurTextureHorizontal.resource->Release();
-    if (g_BlurTextureVertical.texture) g_BlurTextureVertical.texture->Release();
-    if (g_BlurTextureVertical.view) g_BlurTextureVertical.view->Release();
-    if (g_BlurTextureVertical.resource) g_BlurTextureVertical.resource->Release();
-
-    if (g_pBlurPS) g_pBlurPS->Release();
-    if (g_pBlurConstantBuffer) g_pBlurConstantBuffer->Release();
-    if (g_pTerrainConstantBuffer) g_pTerrainConstantBuffer->Release();
+    g_sceneDomainShaders.Clear([](ID3D11DomainShader* pShader) { pShader->Release(); });
+
+    g_blurShaders.Clear([](ID3D11PixelShader* pShader) { pShader->Release(); });
+    g_blurComputeShaders.Clear([](ID3D11ComputeShader* pShader) { pShader->Release(); });
     if (g_pTerrainVS) g_pTerrainVS->Release();
+    if (g_pLineVS) g_pLineVS->Release();
+    if (g_pLinePS) g_pLinePS->Release();
+    delete g_pSpline;
+    g_pSpline = nullptr;
 
     ID3D11Debug* debugDevice = nullptr;
     g_pd3dDevice->QueryInterface(__uuidof(ID3D11Debug), reinterpret_cast<void**>(&debugDevice));
@@ -966,264 +1472,742 @@ LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam
     return 0;
 }
 
-float calculateDeltaTime()
+//--------------------------------------------------------------------------------------
+// Sleeps until the frame timer says the next frame is due. Any message wakes the
+// wait early so input is never held back, the loop then drains it and waits again.
+//--------------------------------------------------------------------------------------
+void WaitForNextFrame()
 {
-    // Update our time
-    static float deltaTime = 0.0f;
-    static ULONGLONG timeStart = 0;
-    ULONGLONG timeCur = GetTickCount64();
-    if (timeStart == 0)
-        timeStart = timeCur;
-    deltaTime = (timeCur - timeStart) / 1000.0f;
-    timeStart = timeCur;
-
-    float FPS60 = 1.0f / 60.0f;
-    static float cummulativeTime = 0;
-
-    // cap the framerate at 60 fps 
-    cummulativeTime += deltaTime;
-    if (cummulativeTime >= FPS60) 
-    {
-        cummulativeTime = cummulativeTime - FPS60;
-    }
-    else 
+    for (;;)
     {
-        return 0;
+        double remaining = g_pFrameTimer->GetSecondsUntilNextFrame(FrameTimer::Now());
+        if (remaining <= 0.0 || !g_hFrameWait)
+            return;
+
+        // Relative due time, negative and in 100 ns units
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(remaining * 10000000.0);
+        if (!SetWaitableTimer(g_hFrameWait, &due, 0, nullptr, nullptr, FALSE))
+            return;
+        if (MsgWaitForMultipleObjectsEx(1, &g_hFrameWait, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE) != WAIT_OBJECT_0)
+            return;
     }
-
-    return deltaTime;
 }
 
-void HandlePerFrameInput(float deltaTime)
+void HandlePerFrameInput(uint32_t steps, float alpha)
 {
+    // Gather this frame's input, the player turns it into fixed camera steps
+    CameraInputFrame input = { 0.0f, 0.0f, 0 };
     if (g_pCamera->GetActive())
     {
-        const float speed = 5.0f;
+        XMFLOAT2 mouse = g_pCamera->GetChange();
+        input.MouseX = mouse.x;
+        input.MouseY = mouse.y;
         if (GetAsyncKeyState('W'))
-        {
-            g_pCamera->CameraTranslate({ 0.0f, 0.0f, speed * deltaTime }, g_pCamera->GetPitch(), g_pCamera->GetYaw());
-        }
+            input.Keys |= CameraKeyForward;
         if (GetAsyncKeyState('A'))
-        {
-            g_pCamera->CameraTranslate({ -speed * deltaTime, 0.0f, 0.0f }, g_pCamera->GetPitch(), g_pCamera->GetYaw());
-        }
+            input.Keys |= CameraKeyLeft;
         if (GetAsyncKeyState('S'))
-        {
-            g_pCamera->CameraTranslate({ 0.0f, 0.0f, -speed * deltaTime }, g_pCamera->GetPitch(), g_pCamera->GetYaw());
-        }
+            input.Keys |= CameraKeyBack;
         if (GetAsyncKeyState('D'))
-        {
-            g_pCamera->CameraTranslate({ speed * deltaTime, 0.0f, 0.0f }, g_pCamera->GetPitch(), g_pCamera->GetYaw());
-        }
+            input.Keys |= CameraKeyRight;
         if (GetAsyncKeyState('Q'))
-        {
-            g_pCamera->CameraTranslate({ 0.0f, speed * deltaTime, 0.0f }, 0, 0);
-        }
+            input.Keys |= CameraKeyUp;
         if (GetAsyncKeyState('E'))
-        {
-            g_pCamera->CameraTranslate({ 0.0f, -speed * deltaTime, 0.0f }, 0, 0);
-        }
+            input.Keys |= CameraKeyDown;
     }
+
+    g_pCameraPlayer->RunSteps(steps, input);
+    g_pCamera->SetPose(g_pCameraPlayer->GetInterpolatedPose(alpha));
 }
 
-void setupConstantBuffers()
+// The light the scene is lit and shadowed by, in the mode the GUI picked
+Light GetKeyLight()
 {
-    LightPropertiesConstantBuffer lightProperties;
-
-    lightProperties.EyePosition = g_pCamera->GetEye();
-    lightProperties.Lights[0].Enabled = static_cast<int>(true);
-    lightProperties.Lights[0].LightType = PointLight;
-    lightProperties.Lights[0].Color = XMFLOAT4(Colors::White);
-    lightProperties.Lights[0].SpotAngle = XMConvertToRadians(45.0f);
-    lightProperties.Lights[0].ConstantAttenuation = 0.25;
-    lightProperties.Lights[0].LinearAttenuation = 0.25;
-    lightProperties.Lights[0].QuadraticAttenuation = 0.25;
-    lightProperties.Lights[0].Position = { g_LightPos.x + guiLightX, g_LightPos.y + guiLightY, g_LightPos.z + guiLightZ, 0.0f };
+    Light light;
+    light.Enabled = static_cast<int>(true);
+    light.LightType = PointLight;
+    light.Color = XMFLOAT4(Colors::White);
+    light.SpotAngle = XMConvertToRadians(45.0f);
+    light.ConstantAttenuation = 0.25;
+    light.LinearAttenuation = 0.25;
+    light.QuadraticAttenuation = 0.25;
+    light.Position = { g_LightPos.x + guiLightX, g_LightPos.y + guiLightY, g_LightPos.z + guiLightZ, 0.0f };
     XMVECTOR LightDirection = XMVectorSet(-(g_LightPos.x + guiLightX), -(g_LightPos.y + guiLightY), -(g_LightPos.z + guiLightZ), 0.0f);
     LightDirection = XMVector3Normalize(LightDirection);
-    XMStoreFloat4(&lightProperties.Lights[0].Direction, LightDirection);
+    XMStoreFloat4(&light.Direction, LightDirection);
 
-    g_pImmediateContext->UpdateSubresource(g_pLightConstantBuffer, 0, nullptr, &lightProperties, 0, 0);
-    g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
-    g_pImmediateContext->DSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+    if (guiKeyLight == KeyLightDirectional)
+    {
+        // Shining down from the sun's position in the sky
+        float azimuth = XMConvertToRadians(guiSunAzimuth);
+        float elevation = XMConvertToRadians(guiSunElevation);
+        light.LightType = DirectionalLight;
+        light.Direction = XMFLOAT4(-cosf(elevation) * sinf(azimuth), -sinf(elevation), -cosf(elevation) * cosf(azimuth), 0.0f);
+    }
+    else if (guiKeyLight == KeyLightSpot)
+    {
+        light.LightType = SpotLight;
+    }
+    return light;
+}
 
-    // Set up billboard
+// Uploads on the immediate context before any pass records, the passes only bind
+void setupConstantBuffers()
+{
+    PROFILE_ZONE("setupConstantBuffers");
+
+    // Per frame: camera, lights, billboards and tessellation
+    XMFLOAT4X4 v = g_pCamera->GetView();
+    XMFLOAT4X4 p = g_pCamera->GetProjection();
+    FrameConstants frameConstants;
+    frameConstants.mView = XMMatrixTranspose(XMLoadFloat4x4(&v));
+    frameConstants.mProjection = XMMatrixTranspose(XMLoadFloat4x4(&p));
+
+    // The first frame has no camera motion to measure
+    XMFLOAT4X4 viewProjection;
+    XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&v) * XMLoadFloat4x4(&p));
+    if (!g_hasPreviousViewProjection)
+        g_previousViewProjection = viewProjection;
+    frameConstants.mPreviousViewProjection = XMMatrixTranspose(XMLoadFloat4x4(&g_previousViewProjection));
+    g_previousViewProjection = viewProjection;
+    g_hasPreviousViewProjection = true;
+    g_pFrameConstants->Update(g_pImmediateContext, &frameConstants);
+
+    LightPropertiesConstantBuffer lightProperties;
+
+    lightProperties.EyePosition = g_pCamera->GetEye();
+    lightProperties.Lights[0] = GetKeyLight();
+
+    g_pLightConstants->Update(g_pImmediateContext, &lightProperties);
+
+    // Set up billboard
     BillboardConstantBuffer billboardProperties;
     billboardProperties.EyePos = g_pCamera->GetEye();
     billboardProperties.UpVector = g_pCamera->GetUp();
-    g_pImmediateContext->UpdateSubresource(g_pSpriteConstantBuffer, 0, nullptr, &billboardProperties, 0, 0);
-    g_pImmediateContext->HSSetConstantBuffers(3, 1, &g_pSpriteConstantBuffer);
+    g_pBillboardConstants->Update(g_pImmediateContext, &billboardProperties);
 
-    // Materials
+    // Tesselation
+    TessProperties tessProps;
+    tessProps.tessFactor = g_tessFactor;
+    tessProps.padding = { 0,0,0 };
+    g_pTessConstants->Update(g_pImmediateContext, &tessProps);
+
+    // Per material
     MaterialPropertiesConstantBuffer materialProperties;
     materialProperties.Material.Diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
     materialProperties.Material.Specular = XMFLOAT4(1.0f, 0.2f, 0.2f, 1.0f);
     materialProperties.Material.SpecularPower = 32.0f;
-    materialProperties.Material.UseTexture = materialSelection;
-    g_pImmediateContext->UpdateSubresource(g_pMaterialConstantBuffer, 0, nullptr, &materialProperties, 0, 0);
-    g_pImmediateContext->PSSetConstantBuffers(1, 1, &g_pMaterialConstantBuffer);
+    g_pMaterialConstants->Update(g_pImmediateContext, &materialProperties);
+}
 
-    // Blur
-    BlurProperties blurProps;
-    blurProps.isHorizontal = 0;
-    blurProps.mouseChange = g_pCamera->GetChange();
-    blurProps.Padding = 0;
-    g_pImmediateContext->UpdateSubresource(g_pBlurConstantBuffer, 0, nullptr, &blurProps, 0, 0);
-    g_pImmediateContext->PSSetConstantBuffers(4, 1, &g_pBlurConstantBuffer);
+// Moves the clustered lights to time t in seconds, bins the ones in use on the job system and uploads the bins
+void setupLightClusters(float t)
+{
+    PROFILE_ZONE("LightClusters");
 
-    // Tesselation
-    TessProperties tessProps;
-    tessProps.tessFactor = g_tessFactor;
-    tessProps.padding = { 0,0,0 };
-    g_pImmediateContext->UpdateSubresource(g_pTessConstantBuffer, 0, nullptr, &tessProps, 0, 0);
-    g_pImmediateContext->HSSetConstantBuffers(5, 1, &g_pTessConstantBuffer);
-
-    // Terrain
-    g_Terrain.IsTerrain = 0;
-    g_pImmediateContext->UpdateSubresource(g_pTerrainConstantBuffer, 0, nullptr, &g_Terrain, 0, 0);
-    g_pImmediateContext->PSSetConstantBuffers(6, 1, &g_pTerrainConstantBuffer);
-    g_pImmediateContext->DSSetConstantBuffers(6, 1, &g_pTerrainConstantBuffer);
+    uint32_t count = (uint32_t)guiClusterLights;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const XMFLOAT4& origin = g_clusterLightOrigins[i];
+        g_clusterLights[i].Position = XMFLOAT3(origin.x + cosf(t + origin.w) * 0.75f, origin.y, origin.z + sinf(t + origin.w) * 0.75f);
+    }
+
+    // The cluster boxes only have to be rebuilt when the projection changes
+    XMFLOAT4X4 projection = g_pCamera->GetProjection();
+    if (memcmp(&projection, &g_clusterProjection, sizeof(projection)) != 0)
+    {
+        g_pLightClusterer->SetProjection(projection);
+        g_clusterProjection = projection;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    g_pLightClusterer->Bin(g_clusterLights.data(), count, g_pCamera->GetView(), g_pJobSystem);
+    g_clusterMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const std::vector<ClusterRange>& ranges = g_pLightClusterer->GetRanges();
+    const std::vector<uint32_t>& indices = g_pLightClusterer->GetIndices();
+    g_pClusterLightBuffer->Update(g_pImmediateContext, g_clusterLights.data(), count);
+    g_pClusterRangeBuffer->Update(g_pImmediateContext, ranges.data(), (UINT)ranges.size());
+    g_pClusterIndexBuffer->Update(g_pImmediateContext, indices.data(), (UINT)indices.size());
+
+    ClusterProperties clusterProperties;
+    clusterProperties.TileScale = XMFLOAT2(LIGHT_CLUSTERS_X / g_viewport.Width, LIGHT_CLUSTERS_Y / g_viewport.Height);
+    clusterProperties.SliceScale = g_pLightClusterer->GetSliceScale();
+    clusterProperties.SliceBias = g_pLightClusterer->GetSliceBias();
+    g_pClusterConstants->Update(g_pImmediateContext, &clusterProperties);
+}
+
+// Fits the key light's maps to the camera, culls the scene's casters against each
+// of them on the job system and uploads what the pixel shader samples them with
+void setupShadows()
+{
+    PROFILE_ZONE("Shadows");
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Light light = GetKeyLight();
+    {
+        PROFILE_ZONE("ShadowCascades");
+        g_shadowCascadeCount = 0;
+        if (guiKeyLight == KeyLightDirectional)
+        {
+            g_shadowCascadeCount = (uint32_t)guiShadowCascades;
+            ShadowCascades::FitCascades(g_pCamera->GetView(), g_pCamera->GetProjection(), XMFLOAT3(light.Direction.x, light.Direction.y, light.Direction.z),
+                g_shadowCascadeCount, SHADOW_SPLIT_LAMBDA, SHADOW_DISTANCE, SHADOW_MAP_SIZE, g_shadowCascades);
+        }
+        else if (guiKeyLight == KeyLightSpot)
+        {
+            g_shadowCascadeCount = 1;
+            ShadowCascades::FitSpot(XMFLOAT3(light.Position.x, light.Position.y, light.Position.z), XMFLOAT3(light.Direction.x, light.Direction.y, light.Direction.z),
+                light.SpotAngle, SHADOW_SPOT_RANGE, g_shadowCascades[0]);
+        }
+    }
+
+    {
+        // The terrain's chunks, then the model
+        PROFILE_ZONE("ShadowCasterCulling");
+        memset(g_shadowCasterCounts, 0, sizeof(g_shadowCasterCounts));
+        g_pTerrainObject->GetChunkSpheres(g_shadowCasterSpheres);
+        g_shadowCasterSpheres.push_back(g_pModelObject->GetBoundingSphere());
+        g_shadowCasterVisible.resize(g_shadowCasterSpheres.size() * SHADOW_MAX_CASCADES);
+        ShadowCascades::CullCasters(g_shadowCascades, g_shadowCascadeCount, g_shadowCasterSpheres.data(), g_shadowCasterSpheres.size(),
+            g_shadowCasterVisible.data(), g_shadowCasterCounts, g_pJobSystem);
+    }
+    g_shadowMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    ShadowProperties shadowProperties = {};
+    float splits[SHADOW_MAX_CASCADES] = {};
+    for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+    {
+        shadowProperties.mCascadeViewProjection[i] = XMMatrixTranspose(XMLoadFloat4x4(&g_shadowCascades[i].ViewProjection));
+        splits[i] = g_shadowCascades[i].SplitFar;
+    }
+    shadowProperties.CascadeSplits = XMFLOAT4(splits[0], splits[1], splits[2], splits[3]);
+    shadowProperties.CascadeCount = g_shadowCascadeCount;
+    shadowProperties.TexelSize = 1.0f / SHADOW_MAP_SIZE;
+    g_pShadowConstants->Update(g_pImmediateContext, &shadowProperties);
 }
 
-void DrawScene(ConstantBuffer* cb)
+// Rasterises the terrain's occluders from the camera and tests what the scene passes
+// draw against them, both on the job system. Everything is visible while it is off.
+void setupOcclusion()
 {
-    g_Terrain.IsTerrain = 0;
-    g_pImmediateContext->UpdateSubresource(g_pTerrainConstantBuffer, 0, nullptr, &g_Terrain, 0, 0);
-
-    g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
-    g_pImmediateContext->GSSetShader(NULL, nullptr, 0);
-    g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
-    g_pImmediateContext->HSSetShader(g_pHullShader, nullptr, 0);
-    g_pImmediateContext->DSSetShader(g_pDomainShader, nullptr, 0);
-    g_pImmediateContext->IASetInputLayout(g_pVertexLayout);
-
-    XMMATRIX mGO = XMLoadFloat4x4(g_pModelObject->GetTransform());
-    cb->mWorld = XMMatrixTranspose(mGO);
-    g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, nullptr, cb, 0, 0);
-    g_pModelObject->Draw(g_pImmediateContext);
-
-    g_Terrain.IsTerrain = 1;
-    g_pImmediateContext->UpdateSubresource(g_pTerrainConstantBuffer, 0, nullptr, &g_Terrain, 0, 0);
-
-    mGO = XMLoadFloat4x4(g_pTerrainObject->getTransform());
-    cb->mWorld = XMMatrixTranspose(mGO);
-    g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, nullptr, cb, 0, 0);
-    g_pTerrainObject->draw(g_pImmediateContext);
+    PROFILE_ZONE("OcclusionCulling");
+
+    XMFLOAT4X4 view = g_pCamera->GetView();
+    XMFLOAT4X4 projection = g_pCamera->GetProjection();
+    XMFLOAT4X4 viewProjection;
+    XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+    g_pOcclusionBuffer->Begin(viewProjection);
+
+    g_pTerrainObject->GetChunkOcclusionBounds(g_occludees);
+    XMFLOAT4 modelSphere = g_pModelObject->GetBoundingSphere();
+    OcclusionBounds modelBounds = { XMFLOAT3(modelSphere.x - modelSphere.w, modelSphere.y - modelSphere.w, modelSphere.z - modelSphere.w),
+        XMFLOAT3(modelSphere.x + modelSphere.w, modelSphere.y + modelSphere.w, modelSphere.z + modelSphere.w) };
+    g_occludees.push_back(modelBounds);
+    g_occludeeVisible.assign(g_occludees.size(), 1);
+    g_occlusionRasterMilliseconds = g_occlusionTestMilliseconds = 0.0;
+    if (!guiOcclusionCulling)
+        return;
+
+    {
+        PROFILE_ZONE("OcclusionRasterize");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        g_occluders.clear();
+        g_pTerrainObject->GetOccluders(g_occluders);
+        g_pOcclusionBuffer->Rasterize(g_occluders.data(), g_occluders.size(), g_pJobSystem);
+        g_occlusionRasterMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    {
+        PROFILE_ZONE("OcclusionTest");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        g_pOcclusionBuffer->Test(g_occludees.data(), g_occludees.size(), g_occludeeVisible.data(), g_pJobSystem);
+        g_occlusionTestMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
 }
 
-void DrawSceneSprites()
+// Start of every pass: deferred contexts begin each command list from default state
+void BindFrameState(RecordingContext& rc)
 {
-    g_pImmediateContext->VSSetShader(g_pQuadVS, nullptr, 0);
-    g_pImmediateContext->HSSetShader(NULL, nullptr, 0);
-    g_pImmediateContext->DSSetShader(NULL, nullptr, 0);
-    g_pImmediateContext->GSSetShader(g_pGeometryBillboardShader, nullptr, 0);
-    g_pImmediateContext->PSSetShader(g_pBillPS, nullptr, 0);
+    ID3D11DeviceContext* pContext = rc.pContext;
+    pContext->RSSetViewports(1, &g_viewport);
+    pContext->RSSetState(g_pFrameRasterizerState);
+    g_pFrameConstants->Bind(pContext, 7, ShaderStageVS | ShaderStageGS | ShaderStageDS | ShaderStagePS);
+    g_pLightConstants->Bind(pContext, 2, ShaderStagePS | ShaderStageDS);
+    g_pBillboardConstants->Bind(pContext, 3, ShaderStageHS | ShaderStageGS);
+    g_pTessConstants->Bind(pContext, 5, ShaderStageHS);
+    g_pMaterialConstants->Bind(pContext, 1, ShaderStagePS);
+    g_pClusterConstants->Bind(pContext, 8, ShaderStagePS);
+    g_pClusterLightBuffer->Bind(pContext, 12, ShaderStagePS);
+    g_pClusterRangeBuffer->Bind(pContext, 13, ShaderStagePS);
+    g_pClusterIndexBuffer->Bind(pContext, 14, ShaderStagePS);
+    g_pShadowConstants->Bind(pContext, 9, ShaderStagePS);
+}
+
+// Per object constants go into a fresh slice of the recorder's ring for every draw
+void SetObjectConstants(RecordingContext& rc, FXMMATRIX world, XMFLOAT4 colour)
+{
+    ObjectConstants objectConstants;
+    objectConstants.mWorld = XMMatrixTranspose(world);
+    objectConstants.mPreviousWorld = objectConstants.mWorld;
+    objectConstants.vOutputColor = colour;
+    rc.pObjectConstants->Bind(rc.pContext, 0, ShaderStageAll, &objectConstants, sizeof(objectConstants));
+}
+
+// Distance in front of the camera, quantised for the sort key
+uint32_t GetSortDepth(const XMFLOAT4X4& world)
+{
+    XMFLOAT4X4 view = g_pCamera->GetView();
+    XMVECTOR position = XMVector3Transform(XMVectorSet(world._41, world._42, world._43, 1.0f), XMLoadFloat4x4(&view));
+    return DrawKey::QuantizeDepth(XMVectorGetZ(position), RENDER_MAX_DEPTH);
+}
+
+// features picks the programs: the material's for colour, ShaderFeatureVelocity for the velocity buffer
+void DrawScene(RecordingContext& rc, uint32_t features)
+{
+    PROFILE_ZONE("DrawScene");
+
+    // Every call is flushed straight away into the bound target, so it is all one pass
+    D3D11RenderBackend* pBackend = rc.pRenderBackend;
+    rc.Queue.Clear();
+    pBackend->ClearObjects();
+
+    RenderSubmitInfo info = { 0, RenderLayerOpaque, 0, 0, 0 };
+
+    // The key light's maps, unbound while it doesn't cast shadows
+    ID3D11ShaderResourceView* pShadowMap = g_shadowCascadeCount ? g_pShadowMapResource : nullptr;
+    rc.pContext->PSSetShaderResources(15, 1, &pShadowMap);
+    rc.pContext->PSSetSamplers(1, 1, &g_pShadowSampler);
+
+    // The terrain draws with its own permutation rather than a flag in its object constants.
+    // Its chunks and the model are left out where setupOcclusion found them hidden.
+    const uint8_t* visible = g_occludeeVisible.data();
+    if (visible[g_pTerrainObject->GetChunkCount()] && g_scenePrograms.Find(features, info.Shader))
+    {
+        XMFLOAT4X4* pModelWorld = g_pModelObject->GetTransform();
+        info.Object = pBackend->AddObject(XMLoadFloat4x4(pModelWorld), XMLoadFloat4x4(g_pModelObject->GetPreviousTransform()), XMFLOAT4(0, 0, 0, 0));
+        info.Depth = GetSortDepth(*pModelWorld);
+        g_pModelObject->Submit(&rc.Queue, pBackend, info);
+    }
+
+    if (g_scenePrograms.Find(features | ShaderFeatureTerrain, info.Shader))
+    {
+        XMFLOAT4X4* pTerrainWorld = g_pTerrainObject->getTransform();
+        info.Object = pBackend->AddObject(XMLoadFloat4x4(pTerrainWorld), XMLoadFloat4x4(g_pTerrainObject->getPreviousTransform()), XMFLOAT4(0, 0, 0, 0));
+        info.Depth = GetSortDepth(*pTerrainWorld);
+        g_pTerrainObject->SubmitChunks(&rc.Queue, pBackend, info, visible);
+    }
+
+    // Code outside the queue may have changed anything since the last flush
+    rc.Filter.Reset();
+    rc.Queue.Execute(*pBackend, rc.Filter);
+}
+
+// The casters setupShadows kept for one map, depth only
+void DrawShadowCasters(RecordingContext& rc, uint32_t cascade)
+{
+    PROFILE_ZONE("DrawShadowCasters");
+
+    D3D11RenderBackend* pBackend = rc.pRenderBackend;
+    rc.Queue.Clear();
+    pBackend->ClearObjects();
+
+    // The model's flag follows the terrain's chunks
+    const uint8_t* visible = g_shadowCasterVisible.data() + cascade * g_shadowCasterSpheres.size();
+    RenderSubmitInfo info = { 0, RenderLayerOpaque, 0, 0, 0 };
+    if (visible[g_pTerrainObject->GetChunkCount()] && g_scenePrograms.Find(ShaderFeatureDepthOnly, info.Shader))
+    {
+        info.Object = pBackend->AddObject(XMLoadFloat4x4(g_pModelObject->GetTransform()), XMLoadFloat4x4(g_pModelObject->GetPreviousTransform()), XMFLOAT4(0, 0, 0, 0));
+        g_pModelObject->Submit(&rc.Queue, pBackend, info);
+    }
+
+    if (g_scenePrograms.Find(ShaderFeatureDepthOnly | ShaderFeatureTerrain, info.Shader))
+    {
+        info.Object = pBackend->AddObject(XMLoadFloat4x4(g_pTerrainObject->getTransform()), XMLoadFloat4x4(g_pTerrainObject->getPreviousTransform()), XMFLOAT4(0, 0, 0, 0));
+        g_pTerrainObject->SubmitChunks(&rc.Queue, pBackend, info, visible);
+    }
+
+    rc.Filter.Reset();
+    rc.Queue.Execute(*pBackend, rc.Filter);
+}
+
+void DrawSceneSprites(RecordingContext& rc)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    pContext->VSSetShader(g_pQuadVS, nullptr, 0);
+    pContext->HSSetShader(NULL, nullptr, 0);
+    pContext->DSSetShader(NULL, nullptr, 0);
+    pContext->GSSetShader(g_pGeometryBillboardShader, nullptr, 0);
+    pContext->PSSetShader(g_pBillPS, nullptr, 0);
 
     /*UINT stride = sizeof(SCREEN_VERTEX);
     UINT offset = 0;
     ID3D11Buffer* pSpriteBuffers[1] = { g_pSpriteVertexBuffer };
-    g_pImmediateContext->IASetVertexBuffers(0, 1, pSpriteBuffers, &stride, &offset);
-    g_pImmediateContext->IASetInputLayout(g_pQuadLayout);
-    g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);*/
+    pContext->IASetVertexBuffers(0, 1, pSpriteBuffers, &stride, &offset);
+    pContext->IASetInputLayout(g_pQuadLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);*/
 
-    /*g_pImmediateContext->PSSetShaderResources(0, 1, &g_pSpriteTexture);
-    g_pImmediateContext->GSSetConstantBuffers(3, 1, &g_pSpriteConstantBuffer);
-    g_pImmediateContext->Draw(g_numberOfSprites, 0);*/
+    /*pContext->PSSetShaderResources(0, 1, &g_pSpriteTexture);
+    pContext->Draw(g_numberOfSprites, 0);*/
 }
 
-void Bloom(ConstantBuffer* cb)
+// A frame graph texture's views, only valid while the graph that declared it is executing
+TextureSet& GetTarget(uint32_t texture)
 {
-    /***********************************************
-    MARKING SCHEME: Advanced graphics techniques
-    DESCRIPTION: Gaussian blur, Motion blur
-    ***********************************************/
+    return g_pRenderTargets->Get(g_pFrameGraph->GetPhysicalTexture(texture));
+}
 
-    g_pImmediateContext->OMSetRenderTargets(1, &g_BloomTexture.view, g_pNoMSAARTTStencilView);
-    g_pImmediateContext->ClearRenderTargetView(g_BloomTexture.view, Colors::MidnightBlue);
-    g_pImmediateContext->ClearDepthStencilView(g_pNoMSAARTTStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+/***********************************************
+MARKING SCHEME: Advanced graphics techniques
+DESCRIPTION: Motion blur, per object from a velocity buffer
+***********************************************/
+// The scene again through the VELOCITY programs, into a single sample target of its own
+void VelocityPass(RecordingContext& rc)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    TextureSet& velocity = GetTarget(g_frameTargets.Velocity);
+    static const float still[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    pContext->OMSetRenderTargets(1, &velocity.view, g_pNoMSAARTTStencilView);
+    pContext->ClearRenderTargetView(velocity.view, still);
+    pContext->ClearDepthStencilView(g_pNoMSAARTTStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+
+    DrawScene(rc, ShaderFeatureVelocity);
+}
 
-    // Draw scene to target
-    DrawScene(cb);
+// Constants for the tile max and gather steps, the same every frame unless the window or the shutter changes
+void UpdateMotionBlurConstants(RecordingContext& rc, MotionBlurStep step)
+{
+    MotionBlurProperties motionBlurProps;
+    motionBlurProps.VelocityScale = XMFLOAT2(g_viewport.Width * guiMotionBlurShutter, g_viewport.Height * guiMotionBlurShutter);
+    motionBlurProps.MinimumVelocity = MOTION_BLUR_MIN_PIXELS;
+    motionBlurProps.SampleCount = MOTION_BLUR_SAMPLES;
+    g_pMotionBlurConstants[step].Update(rc.pContext, &motionBlurProps);
+    g_pMotionBlurConstants[step].Bind(rc.pContext, 11, step == MotionBlurTileMaxStep ? ShaderStageCS : ShaderStagePS);
+}
 
-    DrawSceneSprites();
+// One thread group a tile, each keeps its longest velocity
+void VelocityTileMax(RecordingContext& rc)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
 
-    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    // The velocity target may still be bound as the last pass's output on this context
+    pContext->OMSetRenderTargets(0, nullptr, nullptr);
 
-    g_pImmediateContext->OMSetRenderTargets(1, &g_BlurTextureHorizontal.view, g_pNoMSAARTTStencilView);
-    g_pImmediateContext->ClearRenderTargetView(g_BlurTextureHorizontal.view, Colors::Black);
-    g_pImmediateContext->ClearDepthStencilView(g_pNoMSAARTTStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+    pContext->CSSetShader(g_pVelocityTileMaxCS, nullptr, 0);
+    pContext->CSSetShaderResources(10, 1, &GetTarget(g_frameTargets.Velocity).resource);
+    pContext->CSSetUnorderedAccessViews(1, 1, &GetTarget(g_frameTargets.VelocityTileMax).access, nullptr);
+    UpdateMotionBlurConstants(rc, MotionBlurTileMaxStep);
 
-    g_pImmediateContext->VSSetShader(g_pQuadVS, nullptr, 0);
-    g_pImmediateContext->GSSetShader(NULL, nullptr, 0);
-    g_pImmediateContext->PSSetShader(g_pBlurPS, nullptr, 0);
+    pContext->Dispatch(VelocityTiles::GetTileCount((uint32_t)g_viewport.Width), VelocityTiles::GetTileCount((uint32_t)g_viewport.Height), 1);
+
+    ID3D11ShaderResourceView* nullSRV = { nullptr };
+    ID3D11UnorderedAccessView* nullUAV = { nullptr };
+    pContext->CSSetShaderResources(10, 1, &nullSRV);
+    pContext->CSSetUnorderedAccessViews(1, 1, &nullUAV, nullptr);
+    pContext->CSSetShader(nullptr, nullptr, 0);
+}
+
+// Full screen quad with a texel a tile, the viewport is put back after
+void DrawMotionBlurQuad(RecordingContext& rc, TextureSet& target, ID3D11PixelShader* pShader, const D3D11_VIEWPORT& viewport)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    pContext->OMSetRenderTargets(1, &target.view, nullptr);
+    pContext->RSSetViewports(1, &viewport);
+    pContext->VSSetShader(g_pQuadVS, nullptr, 0);
+    pContext->HSSetShader(NULL, nullptr, 0);
+    pContext->DSSetShader(NULL, nullptr, 0);
+    pContext->GSSetShader(NULL, nullptr, 0);
+    pContext->PSSetShader(pShader, nullptr, 0);
 
-    // Render to quad for 1st (horizontal) pass
     UINT stride = sizeof(SCREEN_VERTEX);
     UINT offset = 0;
     ID3D11Buffer* pBuffers[1] = { g_pScreenQuadVB };
-    g_pImmediateContext->IASetVertexBuffers(0, 1, pBuffers, &stride, &offset);
+    pContext->IASetVertexBuffers(0, 1, pBuffers, &stride, &offset);
+    pContext->IASetInputLayout(g_pQuadLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
 
-    g_pImmediateContext->IASetInputLayout(g_pQuadLayout);
-    g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-    g_pImmediateContext->PSSetShaderResources(0, 1, &g_BloomTexture.resource);
+    pContext->Draw(4, 0);
+    pContext->RSSetViewports(1, &g_viewport);
+}
 
-    g_pImmediateContext->Draw(4, 0);
+void VelocityNeighbourMax(RecordingContext& rc)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    D3D11_VIEWPORT tiles = g_viewport;
+    tiles.Width = (FLOAT)VelocityTiles::GetTileCount((uint32_t)g_viewport.Width);
+    tiles.Height = (FLOAT)VelocityTiles::GetTileCount((uint32_t)g_viewport.Height);
 
-    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    pContext->PSSetShaderResources(11, 1, &GetTarget(g_frameTargets.VelocityTileMax).resource);
+    DrawMotionBlurQuad(rc, GetTarget(g_frameTargets.VelocityNeighbourMax), g_pVelocityNeighbourMaxPS, tiles);
 
-    g_pImmediateContext->OMSetRenderTargets(1, &g_BlurTextureVertical.view, g_pNoMSAARTTStencilView);
-    g_pImmediateContext->ClearRenderTargetView(g_BlurTextureVertical.view, Colors::Black);
-    g_pImmediateContext->ClearDepthStencilView(g_pNoMSAARTTStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+    ID3D11ShaderResourceView* nullSRV = { nullptr };
+    pContext->PSSetShaderResources(11, 1, &nullSRV);
+}
 
+// Gathers along each tile's neighbour max, pixels in still tiles copy the scene
+void MotionBlurPass(RecordingContext& rc)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    ID3D11ShaderResourceView* pResources[] = { GetTarget(g_frameTargets.Velocity).resource, GetTarget(g_frameTargets.VelocityNeighbourMax).resource };
+    pContext->PSSetShaderResources(0, 1, &GetTarget(g_frameTargets.NoMSAARTT).resource);
+    pContext->PSSetShaderResources(10, 2, pResources);
+    UpdateMotionBlurConstants(rc, MotionBlurGatherStep);
+    DrawMotionBlurQuad(rc, GetTarget(g_frameTargets.MotionBlur), g_pMotionBlurPS, g_viewport);
+
+    ID3D11ShaderResourceView* nullSRVs[2] = {};
+    pContext->PSSetShaderResources(0, 1, nullSRVs);
+    pContext->PSSetShaderResources(10, 2, nullSRVs);
+}
+
+// CS_Blur, one thread group per BLUR_TILE_SIZE pixels of a row or column
+void BlurCompute(RecordingContext& rc, TextureSet& source, TextureSet& target, bool horizontal)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+
+    // The source may still be the output of the last pass on this context
+    pContext->OMSetRenderTargets(0, nullptr, nullptr);
+
+    ID3D11ComputeShader* pBlurCS = nullptr;
+    g_blurComputeShaders.Find(horizontal ? ShaderFeatureHorizontal : 0, pBlurCS);
+    pContext->CSSetShader(pBlurCS, nullptr, 0);
+    pContext->CSSetShaderResources(0, 1, &source.resource);
+    pContext->CSSetUnorderedAccessViews(0, 1, &target.access, nullptr);
+    g_pBlurConstants->Bind(pContext, 4, ShaderStageCS);
+
+    uint32_t groupsX, groupsY;
+    TiledBlur::GetDispatchSize((uint32_t)g_viewport.Width, (uint32_t)g_viewport.Height, horizontal, groupsX, groupsY);
+    pContext->Dispatch(groupsX, groupsY, 1);
+
+    ID3D11ShaderResourceView* nullSRV = { nullptr };
+    ID3D11UnorderedAccessView* nullUAV = { nullptr };
+    pContext->CSSetShaderResources(0, 1, &nullSRV);
+    pContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+    pContext->CSSetShader(nullptr, nullptr, 0);
+}
+
+// One direction of the separable blur, a pass of its own so the graph sees each target's lifetime
+void Blur(RecordingContext& rc, uint32_t source, uint32_t target, bool horizontal)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    TextureSet& targetSet = GetTarget(target);
+
+    // The radius is the GUI's, the direction is the shader variant
     BlurProperties blurProps;
-    blurProps.isHorizontal = 0;
-    blurProps.mouseChange = g_pCamera->GetChange();
-    blurProps.Padding = 0;
-    g_pImmediateContext->UpdateSubresource(g_pBlurConstantBuffer, 0, nullptr, &blurProps, 0, 0);
+    blurProps.Radius = { (float)guiBlurRadius, (float)guiBlurRadius };
+    blurProps.Padding = { 0.0f, 0.0f };
+    g_pBlurConstants->Update(pContext, &blurProps);
+
+    if (g_frameTargets.ComputeBlur)
+    {
+        BlurCompute(rc, GetTarget(source), targetSet, horizontal);
+        return;
+    }
+
+    pContext->OMSetRenderTargets(1, &targetSet.view, g_pNoMSAARTTStencilView);
+    pContext->ClearRenderTargetView(targetSet.view, Colors::Black);
+    pContext->ClearDepthStencilView(g_pNoMSAARTTStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-    // Render to quad for 2nd (vertical) pass
-    stride = sizeof(SCREEN_VERTEX);
-    offset = 0;
-    pBuffers[0] = { g_pScreenQuadVB };
-    g_pImmediateContext->IASetVertexBuffers(0, 1, pBuffers, &stride, &offset);
+    ID3D11PixelShader* pBlurPS = nullptr;
+    g_blurShaders.Find(horizontal ? ShaderFeatureHorizontal : 0, pBlurPS);
+    pContext->VSSetShader(g_pQuadVS, nullptr, 0);
+    pContext->GSSetShader(NULL, nullptr, 0);
+    pContext->PSSetShader(pBlurPS, nullptr, 0);
 
-    g_pImmediateContext->PSSetShaderResources(0, 1, &g_BlurTextureHorizontal.resource);
+    // Render to quad
+    UINT stride = sizeof(SCREEN_VERTEX);
+    UINT offset = 0;
+    ID3D11Buffer* pBuffers[1] = { g_pScreenQuadVB };
+    pContext->IASetVertexBuffers(0, 1, pBuffers, &stride, &offset);
 
-    g_pImmediateContext->Draw(4, 0);
+    pContext->IASetInputLayout(g_pQuadLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    pContext->PSSetShaderResources(0, 1, &GetTarget(source).resource);
+    g_pBlurConstants->Bind(pContext, 4, ShaderStagePS);
+
+    pContext->Draw(4, 0);
 
     ID3D11ShaderResourceView* nullSRV = { nullptr };
-    g_pImmediateContext->PSSetShaderResources(0, 1, &nullSRV);
+    pContext->PSSetShaderResources(0, 1, &nullSRV);
 }
 
-void RenderScreenQuad(ConstantBuffer* cb)
+// Blurs the motion blurred scene when that's on, the resolved scene otherwise
+void BlurHorizontal(RecordingContext& rc)
 {
+    Blur(rc, guiMotionBlur ? g_frameTargets.MotionBlur : g_frameTargets.NoMSAARTT, g_frameTargets.BlurHorizontal, true);
+}
+
+void BlurVertical(RecordingContext& rc)
+{
+    Blur(rc, g_frameTargets.BlurHorizontal, g_frameTargets.BlurVertical, false);
+}
+
+// Only RTT_PS adds bloom, the tint and depth modes don't
+bool IsBloomVisible()
+{
+    return guiBloom && guiSelection != 1 && guiSelection != 2;
+}
+
+// One step of the bloom chain on one level. Every step is a pass of its own so the
+// graph sees each level's lifetime and shares targets between levels of the same size.
+void BloomPass(RecordingContext& rc, uint32_t level, BloomStep step)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    const FrameTargets& targets = g_frameTargets;
+    uint32_t width = BloomKernel::GetLevelSize((uint32_t)g_viewport.Width, level);
+    uint32_t height = BloomKernel::GetLevelSize((uint32_t)g_viewport.Height, level);
+
+    BloomProperties bloomProps = {};
+    uint32_t source = 0;
+    uint32_t target = 0;
+    ID3D11PixelShader* pShader = g_pBloomBlurPS;
+    ID3D11ShaderResourceView* pCoarser = nullptr;
+    switch (step)
+    {
+    case BloomDownsampleStep:
+        // Level 0 thresholds the scene, the rest just halve the level above
+        source = level ? targets.BloomDownsample[level - 1] : targets.NoMSAARTT;
+        target = targets.BloomDownsample[level];
+        pShader = g_pBloomDownsamplePS;
+        bloomProps.TexelStep = level ? XMFLOAT2(1.0f / BloomKernel::GetLevelSize((uint32_t)g_viewport.Width, level - 1), 1.0f / BloomKernel::GetLevelSize((uint32_t)g_viewport.Height, level - 1))
+            : XMFLOAT2(1.0f / g_viewport.Width, 1.0f / g_viewport.Height);
+        bloomProps.Threshold = level ? 0.0f : guiBloomThreshold;
+        break;
+    case BloomHorizontalStep:
+    case BloomVerticalStep:
+    {
+        bool horizontal = step == BloomHorizontalStep;
+        source = horizontal ? targets.BloomDownsample[level] : targets.BloomHorizontal[level];
+        target = horizontal ? targets.BloomHorizontal[level] : targets.BloomVertical[level];
+        bloomProps.TexelStep = horizontal ? XMFLOAT2(1.0f / width, 0.0f) : XMFLOAT2(0.0f, 1.0f / height);
+
+        BloomTap taps[BLOOM_MAX_TAPS];
+        bloomProps.TapCount = BloomKernel::GetLinearTaps(guiBloomRadius, BloomKernel::GetSigma(guiBloomRadius), taps);
+        for (UINT i = 0; i < bloomProps.TapCount; ++i)
+            bloomProps.Taps[i] = XMFLOAT4(taps[i].Offset, taps[i].Weight, 0.0f, 0.0f);
+        break;
+    }
+    default:
+        // The sum of every level is scaled once, at the top
+        source = targets.BloomVertical[level];
+        target = targets.BloomUpsample[level];
+        pShader = g_pBloomUpsamplePS;
+        pCoarser = GetTarget(targets.BloomUpsample[level + 1]).resource;
+        bloomProps.Scale = level ? 1.0f : guiBloomIntensity / BLOOM_LEVELS;
+        break;
+    }
+
+    // Every pixel is written, so nothing needs clearing
+    D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (FLOAT)width, (FLOAT)height, 0.0f, 1.0f };
+    pContext->RSSetViewports(1, &viewport);
+    pContext->OMSetRenderTargets(1, &GetTarget(target).view, nullptr);
+    pContext->VSSetShader(g_pQuadVS, nullptr, 0);
+    pContext->HSSetShader(NULL, nullptr, 0);
+    pContext->DSSetShader(NULL, nullptr, 0);
+    pContext->GSSetShader(NULL, nullptr, 0);
+    pContext->PSSetShader(pShader, nullptr, 0);
+    pContext->PSSetSamplers(0, 1, &g_pBloomSampler);
+
+    UINT stride = sizeof(SCREEN_VERTEX);
+    UINT offset = 0;
+    ID3D11Buffer* pBuffers[1] = { g_pScreenQuadVB };
+    pContext->IASetVertexBuffers(0, 1, pBuffers, &stride, &offset);
+    pContext->IASetInputLayout(g_pQuadLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    pContext->PSSetShaderResources(0, 1, &GetTarget(source).resource);
+    pContext->PSSetShaderResources(3, 1, &pCoarser);
+
+    CachedConstantBuffer& constants = g_pBloomConstants[level * BloomStepCount + step];
+    constants.Update(pContext, &bloomProps);
+    constants.Bind(pContext, 6, ShaderStagePS);
+
+    pContext->Draw(4, 0);
+
+    ID3D11ShaderResourceView* nullSRVs[4] = {};
+    pContext->PSSetShaderResources(0, 4, nullSRVs);
+    pContext->RSSetViewports(1, &g_viewport);
+}
+
+// MSAA scene to single sample. The hardware resolve box filters, so one very bright
+// sample can make a whole edge pixel bright; PS_Resolve averages tonemapped samples
+// and undoes the tonemap after, which keeps HDR edges antialiased.
+void ResolveScene(RecordingContext& rc, TextureSet& source, TextureSet& target)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    if (guiResolveMode == ResolveHardware || g_sampleCount == 1)
+    {
+        pContext->ResolveSubresource(target.texture, 0, source.texture, 0, (DXGI_FORMAT)g_frameTargets.SceneFormat);
+        return;
+    }
+
+    pContext->OMSetRenderTargets(1, &target.view, nullptr);
+    pContext->VSSetShader(g_pQuadVS, nullptr, 0);
+    pContext->HSSetShader(NULL, nullptr, 0);
+    pContext->DSSetShader(NULL, nullptr, 0);
+    pContext->GSSetShader(NULL, nullptr, 0);
+    pContext->PSSetShader(g_pResolvePS, nullptr, 0);
+
+    UINT stride = sizeof(SCREEN_VERTEX);
+    UINT offset = 0;
+    ID3D11Buffer* pBuffers[1] = { g_pScreenQuadVB };
+    pContext->IASetVertexBuffers(0, 1, pBuffers, &stride, &offset);
+    pContext->IASetInputLayout(g_pQuadLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    pContext->PSSetShaderResources(9, 1, &source.resource);
+
+    pContext->Draw(4, 0);
+
+    ID3D11ShaderResourceView* nullSRV = { nullptr };
+    pContext->PSSetShaderResources(9, 1, &nullSRV);
+}
+
+// The scene into the MSAA target and resolved, which the bloom chain and the screen quad read
+void SceneColour(RecordingContext& rc)
+{
+    PROFILE_ZONE("SceneColour");
+
+    ID3D11DeviceContext* pContext = rc.pContext;
     /***********************************************
     MARKING SCHEME: Special effects pipeline
     DESCRIPTION: Render to texture implemented
     ***********************************************/
-    g_pImmediateContext->OMSetRenderTargets(1, &g_RTTTexture.view, g_pDepthStencilView);
-    g_pImmediateContext->ClearRenderTargetView(g_RTTTexture.view, Colors::MidnightBlue);
-    g_pImmediateContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+    TextureSet& rtt = GetTarget(g_frameTargets.RTT);
+    pContext->OMSetRenderTargets(1, &rtt.view, g_pDepthStencilView);
+    pContext->ClearRenderTargetView(rtt.view, Colors::MidnightBlue);
+    pContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
     // Draw scene to RTT target
-    DrawScene(cb);
+    DrawScene(rc, g_sceneFeatures);
+
+    DrawSceneSprites(rc);
 
-    DrawSceneSprites();
+    /***********************************************
+    MARKING SCHEME: Advanced graphics techniques
+    DESCRIPTION: MSAA
+    ***********************************************/
+    ResolveScene(rc, rtt, GetTarget(g_frameTargets.NoMSAARTT));
+}
+
+void RenderScreenQuad(RecordingContext& rc)
+{
+    PROFILE_ZONE("RenderScreenQuad");
+
+    ID3D11DeviceContext* pContext = rc.pContext;
 
     // Reset target
-    g_pImmediateContext->OMSetRenderTargets(1, &g_pRenderTargetView, g_pDepthStencilView);
+    pContext->OMSetRenderTargets(1, &g_pRenderTargetView, g_pDepthStencilView);
 
     // New shaders
-    g_pImmediateContext->VSSetShader(g_pQuadVS, nullptr, 0);
-    g_pImmediateContext->GSSetShader(NULL, nullptr, 0);
+    pContext->VSSetShader(g_pQuadVS, nullptr, 0);
+    pContext->GSSetShader(NULL, nullptr, 0);
     if (guiSelection == 2)
     {
         // Inverse tint
-        g_pImmediateContext->PSSetShader(g_pTintPS, nullptr, 0);
+        pContext->PSSetShader(g_pTintPS, nullptr, 0);
     }
     else
     {
-        g_pImmediateContext->PSSetShader(g_pQuadPS, nullptr, 0);
+        pContext->PSSetShader(g_pQuadPS, nullptr, 0);
     }
 
     /***********************************************
@@ -1233,50 +2217,272 @@ void RenderScreenQuad(ConstantBuffer* cb)
     UINT stride = sizeof(SCREEN_VERTEX);
     UINT offset = 0;
     ID3D11Buffer* pBuffers[1] = { g_pScreenQuadVB };
-    g_pImmediateContext->IASetVertexBuffers(0, 1, pBuffers, &stride, &offset);
+    pContext->IASetVertexBuffers(0, 1, pBuffers, &stride, &offset);
 
-    g_pImmediateContext->IASetInputLayout(g_pQuadLayout);
-    g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    pContext->IASetInputLayout(g_pQuadLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
 
     if (guiSelection == 1)
     {
         // Depth rendering
         ID3D11ShaderResourceView* nullSRV = { nullptr };
-        g_pImmediateContext->PSSetShaderResources(3, 1, &nullSRV);
-        g_pImmediateContext->PSSetShaderResources(0, 1, &g_DepthTexture.resource);
+        pContext->PSSetShaderResources(3, 1, &nullSRV);
+        pContext->PSSetShaderResources(0, 1, &GetTarget(g_frameTargets.Depth).resource);
     }
     else
     {
-        /***********************************************
-        MARKING SCHEME: Advanced graphics techniques
-        DESCRIPTION: MSAA
-        ***********************************************/
-        g_pImmediateContext->ResolveSubresource(g_NoMSAARTTTexture.texture, 0, g_RTTTexture.texture, 
-                                                0, DXGI_FORMAT_R32G32B32A32_FLOAT);
-        g_pImmediateContext->PSSetShaderResources(0, 1, &g_NoMSAARTTTexture.resource);
-        if (guiMotionBlur)
-        {
-            g_pImmediateContext->PSSetShaderResources(0, 1, &g_BlurTextureVertical.resource);
-        }
+        pContext->PSSetShaderResources(0, 1, &GetTarget(guiBlur ? g_frameTargets.BlurVertical :
+            guiMotionBlur ? g_frameTargets.MotionBlur : g_frameTargets.NoMSAARTT).resource);
+
+        // RTT_PS adds the top of the bloom chain, an unbound texture samples as black
+        ID3D11ShaderResourceView* pBloom = IsBloomVisible() ? GetTarget(g_frameTargets.BloomUpsample[0]).resource : nullptr;
+        pContext->PSSetShaderResources(3, 1, &pBloom);
     }
     
-    g_pImmediateContext->Draw(4, 0);
+    pContext->Draw(4, 0);
     ID3D11ShaderResourceView* nullSRV = { nullptr };
-    g_pImmediateContext->PSSetShaderResources(0, 1, &nullSRV);
-    g_pImmediateContext->PSSetShaderResources(3, 1, &nullSRV);
+    pContext->PSSetShaderResources(0, 1, &nullSRV);
+    pContext->PSSetShaderResources(3, 1, &nullSRV);
 }
 
-void DepthMap(ConstantBuffer* cb)
+void DepthMap(RecordingContext& rc)
 {
-    g_pImmediateContext->ClearRenderTargetView(g_DepthTexture.view, Colors::Black);
-    g_pImmediateContext->ClearDepthStencilView(g_pNoMSAARTTStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
-    g_pImmediateContext->OMSetRenderTargets(1, &g_DepthTexture.view, g_pNoMSAARTTStencilView);
+    ID3D11DeviceContext* pContext = rc.pContext;
+    TextureSet& depth = GetTarget(g_frameTargets.Depth);
+    pContext->ClearRenderTargetView(depth.view, Colors::Black);
+    pContext->ClearDepthStencilView(g_pNoMSAARTTStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+    pContext->OMSetRenderTargets(1, &depth.view, g_pNoMSAARTTStencilView);
 
     // Disabled for now to prevent error messages
     // I doubt I'll need this anyway
-    //DrawScene(cb);
+    //DrawScene(rc, g_sceneFeatures);
+
+    DrawSceneSprites(rc);
+}
+
+/***********************************************
+MARKING SCHEME: Advanced graphics techniques
+DESCRIPTION: Cascaded shadow maps, one depth only pass per cascade
+***********************************************/
+void ShadowPass(RecordingContext& rc, uint32_t cascade)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    pContext->ClearDepthStencilView(g_pShadowMapViews[cascade], D3D11_CLEAR_DEPTH, 1.0f, 0);
+    pContext->OMSetRenderTargets(0, nullptr, g_pShadowMapViews[cascade]);
+    pContext->RSSetViewports(1, &g_shadowViewport);
+    pContext->RSSetState(g_pShadowRasterizerState);
+
+    ShadowPassProperties passProperties;
+    passProperties.mShadowViewProjection = XMMatrixTranspose(XMLoadFloat4x4(&g_shadowCascades[cascade].ViewProjection));
+    CachedConstantBuffer& constants = g_pShadowPassConstants[cascade];
+    constants.Update(pContext, &passProperties);
+    constants.Bind(pContext, 10, ShaderStageDS);
+
+    DrawShadowCasters(rc, cascade);
+}
+
+void DrawSpline(RecordingContext& rc)
+{
+    ID3D11DeviceContext* pContext = rc.pContext;
+    pContext->VSSetShader(g_pLineVS, nullptr, 0);
+    pContext->HSSetShader(NULL, nullptr, 0);
+    pContext->DSSetShader(NULL, nullptr, 0);
+    pContext->GSSetShader(NULL, nullptr, 0);
+    pContext->PSSetShader(g_pLinePS, nullptr, 0);
+
+    // Control points are already in world space
+    SetObjectConstants(rc, XMMatrixIdentity(), XMFLOAT4(1.0f, 0.8f, 0.2f, 1.0f));
+
+    // Tessellate against the current camera
+    XMFLOAT4 eye = g_pCamera->GetEye();
+    SplineTessellationSettings settings;
+    settings.CameraPosition = XMFLOAT3(eye.x, eye.y, eye.z);
+    settings.ViewportHeight = (float)g_viewHeight;
+    settings.FieldOfViewY = XM_PIDIV2;
+    g_pSpline->Update(pContext, settings);
+    g_pSpline->Render(pContext, g_pQuadLayout);
+}
+
+void ScenePass(RecordingContext& rc)
+{
+    // Clear the back buffer
+    ID3D11DeviceContext* pContext = rc.pContext;
+    pContext->ClearRenderTargetView(g_pRenderTargetView, Colors::MidnightBlue);
+    pContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+    pContext->OMSetRenderTargets(1, &g_pRenderTargetView, g_pDepthStencilView);
+
+    DrawScene(rc, g_sceneFeatures);
+    DrawSceneSprites(rc);
+}
+
+void SplinePass(RecordingContext& rc)
+{
+    rc.pContext->OMSetRenderTargets(1, &g_pRenderTargetView, g_pDepthStencilView);
+    DrawSpline(rc);
+}
+
+// Queues a pass for the workers, it starts from the frame state on whichever context records it
+void AddRenderPass(const char* name, const std::function<void(RecordingContext&)>& pass)
+{
+    g_pCommandRecorder->AddPass(name, [name, pass](uint32_t recorder)
+    {
+        PROFILE_ZONE(name);
+        RecordingContext& rc = g_pCommandBackend->GetContext(recorder);
+        BindFrameState(rc);
+        pass(rc);
+    });
+}
+
+// The frame's passes with the targets they read and write. Everything is declared
+// every frame and the graph culls what this frame's settings don't use: the velocity
+// buffer and its tiles only run for motion blur, the separable blur only when it's on,
+// the bloom chain only when bloom is on, and the depth map only for the depth render mode.
+HRESULT BuildFrameGraph()
+{
+    PROFILE_ZONE("BuildFrameGraph");
+
+    FrameGraph& graph = *g_pFrameGraph;
+    FrameTargets& targets = g_frameTargets;
+    graph.Reset();
+
+    // Formats from the policy, the resolve target takes the scene's
+    auto getDesc = [](RenderTargetUse use, bool multisampled)
+    {
+        RenderTargetPrecision precision = RenderTargetFormats::Select(g_targetPolicy, use, multisampled ? g_msaaTargetSupport : g_targetSupport);
+        FrameGraphTextureDesc desc = { (uint32_t)g_viewport.Width, (uint32_t)g_viewport.Height, RenderTargetFormats::GetFormat(precision),
+            RenderTargetFormats::GetBytesPerPixel(precision), multisampled ? g_sampleCount : 1, multisampled ? g_sampleQuality : 0 };
+        return desc;
+    };
+    FrameGraphTextureDesc sceneDesc = getDesc(TargetSceneColour, true);
+    FrameGraphTextureDesc resolveDesc = sceneDesc;
+    resolveDesc.SampleCount = 1;
+    resolveDesc.SampleQuality = 0;
+    targets.SceneFormat = sceneDesc.Format;
+
+    targets.BackBuffer = graph.ImportTexture("Back Buffer");
+    targets.RTT = graph.CreateTexture("RTT", sceneDesc);
+    targets.NoMSAARTT = graph.CreateTexture("No MSAA RTT", resolveDesc);
+    targets.Depth = graph.CreateTexture("Depth", getDesc(TargetDepthView, false));
+    targets.MotionBlur = graph.CreateTexture("Motion Blur", getDesc(TargetBlur, false));
+
+    // The compute blur writes its targets through UAVs, the pixel shader doesn't need them
+    FrameGraphTextureDesc blurDesc = getDesc(TargetBlur, false);
+    targets.ComputeBlur = guiBlurPath == BlurComputeShader &&
+        (g_unorderedAccessSupport & (1u << RenderTargetFormats::Select(g_targetPolicy, TargetBlur, g_targetSupport)));
+    blurDesc.UnorderedAccess = targets.ComputeBlur ? 1 : 0;
+    targets.BlurHorizontal = graph.CreateTexture("Blur Horizontal", blurDesc);
+    targets.BlurVertical = graph.CreateTexture("Blur Vertical", blurDesc);
+
+    // Velocity and its tiles are two half floats whatever the policy, the tile max is written by a compute shader
+    FrameGraphTextureDesc velocityDesc = { (uint32_t)g_viewport.Width, (uint32_t)g_viewport.Height, RENDER_TARGET_FORMAT_R16G16_FLOAT,
+        RENDER_TARGET_VELOCITY_BYTES_PER_PIXEL, 1, 0, 0 };
+    targets.Velocity = graph.CreateTexture("Velocity", velocityDesc);
+    FrameGraphTextureDesc tileDesc = velocityDesc;
+    tileDesc.Width = VelocityTiles::GetTileCount(velocityDesc.Width);
+    tileDesc.Height = VelocityTiles::GetTileCount(velocityDesc.Height);
+    targets.VelocityNeighbourMax = graph.CreateTexture("Velocity Neighbour Max", tileDesc);
+    tileDesc.UnorderedAccess = 1;
+    targets.VelocityTileMax = graph.CreateTexture("Velocity Tile Max", tileDesc);
+
+    // Each bloom level half the size of the one above, level 0 half the scene
+    FrameGraphTextureDesc bloomDesc = getDesc(TargetBloom, false);
+    for (uint32_t level = 0; level < BLOOM_LEVELS; ++level)
+    {
+        FrameGraphTextureDesc levelDesc = bloomDesc;
+        levelDesc.Width = BloomKernel::GetLevelSize(bloomDesc.Width, level);
+        levelDesc.Height = BloomKernel::GetLevelSize(bloomDesc.Height, level);
+        targets.BloomDownsample[level] = graph.CreateTexture("Bloom Downsample", levelDesc);
+        targets.BloomHorizontal[level] = graph.CreateTexture("Bloom Horizontal", levelDesc);
+        targets.BloomVertical[level] = graph.CreateTexture("Bloom Vertical", levelDesc);
+        targets.BloomUpsample[level] = level + 1 < BLOOM_LEVELS ? graph.CreateTexture("Bloom Upsample", levelDesc) : targets.BloomVertical[level];
+    }
+
+    // Writing an imported texture keeps a pass, so only this frame's cascades are added
+    static const char* shadowPassNames[SHADOW_MAX_CASCADES] = { "Shadow Cascade 0", "Shadow Cascade 1", "Shadow Cascade 2", "Shadow Cascade 3" };
+    targets.ShadowMap = graph.ImportTexture("Shadow Map");
+    uint32_t pass = 0;
+    for (uint32_t cascade = 0; cascade < g_shadowCascadeCount; ++cascade)
+    {
+        const char* name = shadowPassNames[cascade];
+        pass = graph.AddPass(name, [name, cascade] { AddRenderPass(name, [cascade](RecordingContext& rc) { ShadowPass(rc, cascade); }); });
+        graph.Write(pass, targets.ShadowMap);
+    }
+
+    pass = graph.AddPass("Depth", [] { AddRenderPass("Depth", DepthMap); });
+    graph.Write(pass, targets.Depth);
+    pass = graph.AddPass("Scene", [] { AddRenderPass("Scene", ScenePass); });
+    graph.Read(pass, targets.ShadowMap);
+    graph.Write(pass, targets.BackBuffer);
+
+    // Scene Colour resolves the MSAA target itself, so that lives only inside it
+    pass = graph.AddPass("Scene Colour", [] { AddRenderPass("Scene Colour", SceneColour); });
+    graph.Read(pass, targets.ShadowMap);
+    graph.Write(pass, targets.RTT);
+    graph.Write(pass, targets.NoMSAARTT);
+
+    pass = graph.AddPass("Velocity", [] { AddRenderPass("Velocity", VelocityPass); });
+    graph.Write(pass, targets.Velocity);
+    pass = graph.AddPass("Velocity Tile Max", [] { AddRenderPass("Velocity Tile Max", VelocityTileMax); });
+    graph.Read(pass, targets.Velocity);
+    graph.Write(pass, targets.VelocityTileMax);
+    pass = graph.AddPass("Velocity Neighbour Max", [] { AddRenderPass("Velocity Neighbour Max", VelocityNeighbourMax); });
+    graph.Read(pass, targets.VelocityTileMax);
+    graph.Write(pass, targets.VelocityNeighbourMax);
+    pass = graph.AddPass("Motion Blur", [] { AddRenderPass("Motion Blur", MotionBlurPass); });
+    graph.Read(pass, targets.NoMSAARTT);
+    graph.Read(pass, targets.Velocity);
+    graph.Read(pass, targets.VelocityNeighbourMax);
+    graph.Write(pass, targets.MotionBlur);
+    pass = graph.AddPass("Blur Horizontal", [] { AddRenderPass("Blur Horizontal", BlurHorizontal); });
+    graph.Read(pass, guiMotionBlur ? targets.MotionBlur : targets.NoMSAARTT);
+    graph.Write(pass, targets.BlurHorizontal);
+    pass = graph.AddPass("Blur Vertical", [] { AddRenderPass("Blur Vertical", BlurVertical); });
+    graph.Read(pass, targets.BlurHorizontal);
+    graph.Write(pass, targets.BlurVertical);
+
+    // Downsample all the way first, then blur and upsample from the coarsest level
+    // up, so each level's targets are done with before the next level's start
+    for (uint32_t level = 0; level < BLOOM_LEVELS; ++level)
+    {
+        pass = graph.AddPass("Bloom Downsample", [level] { AddRenderPass("Bloom Downsample", [level](RecordingContext& rc) { BloomPass(rc, level, BloomDownsampleStep); }); });
+        graph.Read(pass, level ? targets.BloomDownsample[level - 1] : targets.NoMSAARTT);
+        graph.Write(pass, targets.BloomDownsample[level]);
+    }
+    for (uint32_t level = BLOOM_LEVELS; level-- > 0;)
+    {
+        pass = graph.AddPass("Bloom Horizontal", [level] { AddRenderPass("Bloom Horizontal", [level](RecordingContext& rc) { BloomPass(rc, level, BloomHorizontalStep); }); });
+        graph.Read(pass, targets.BloomDownsample[level]);
+        graph.Write(pass, targets.BloomHorizontal[level]);
+        pass = graph.AddPass("Bloom Vertical", [level] { AddRenderPass("Bloom Vertical", [level](RecordingContext& rc) { BloomPass(rc, level, BloomVerticalStep); }); });
+        graph.Read(pass, targets.BloomHorizontal[level]);
+        graph.Write(pass, targets.BloomVertical[level]);
+        if (level + 1 < BLOOM_LEVELS)
+        {
+            pass = graph.AddPass("Bloom Upsample", [level] { AddRenderPass("Bloom Upsample", [level](RecordingContext& rc) { BloomPass(rc, level, BloomUpsampleStep); }); });
+            graph.Read(pass, targets.BloomVertical[level]);
+            graph.Read(pass, targets.BloomUpsample[level + 1]);
+            graph.Write(pass, targets.BloomUpsample[level]);
+        }
+    }
+
+    pass = graph.AddPass("Screen Quad", [] { AddRenderPass("Screen Quad", RenderScreenQuad); });
+    graph.Write(pass, targets.BackBuffer);
+    if (guiSelection == 1)
+    {
+        graph.Read(pass, targets.Depth);
+    }
+    else
+    {
+        graph.Read(pass, guiBlur ? targets.BlurVertical : guiMotionBlur ? targets.MotionBlur : targets.NoMSAARTT);
+        if (IsBloomVisible())
+            graph.Read(pass, targets.BloomUpsample[0]);
+    }
 
-    DrawSceneSprites();
+    pass = graph.AddPass("Spline", [] { AddRenderPass("Spline", SplinePass); });
+    graph.Write(pass, targets.BackBuffer);
+
+    graph.Compile();
+    return g_pRenderTargets->Update(g_pd3dDevice, graph.GetPhysicalTextures());
 }
 
 //--------------------------------------------------------------------------------------
@@ -1284,65 +2490,83 @@ void DepthMap(ConstantBuffer* cb)
 //--------------------------------------------------------------------------------------
 void Render()
 {
-    float t = calculateDeltaTime(); // capped at 60 fps
-    if (t == 0.0f)
-        return;
+    PROFILE_ZONE("Render");
+
+    uint32_t steps = g_pFrameTimer->Tick(FrameTimer::Now());
+    float alpha = (float)g_pFrameTimer->GetAlpha();
 
-    // Draw mode
-    ID3D11RasterizerState* rsstate;
-    if (g_isWireframe)
+    // The flythrough steps the whole scene once per frame so every run matches
+    double animationTime = g_pFrameTimer->GetPresentationTime();
+    if (g_isFlythrough)
     {
-        g_pd3dDevice->CreateRasterizerState(&g_wfdescWireframe, &rsstate);
+        steps = 1;
+        alpha = 1.0f;
+        animationTime = g_animationTime + g_pFrameTimer->GetFixedStep();
     }
-    else
+    // Presentation time starts a step behind zero, the animation waits for it
+    float t = 0.0f;
+    if (animationTime > g_animationTime)
     {
-        g_pd3dDevice->CreateRasterizerState(&g_wfdescNormal, &rsstate);
+        t = (float)(animationTime - g_animationTime);
+        g_animationTime = animationTime;
     }
-    g_pImmediateContext->RSSetState(rsstate);
+    std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+
+    // Upload counters are shown for the last complete frame
+    g_lastConstantStats = g_constantStats;
+    g_constantStats = {};
+
+    // Skinning is on the CPU but uploads its vertex buffer below, so the GPU frame starts here
+    if (g_pGpuProfiler)
+        g_pGpuProfiler->BeginFrame();
+
+    // Draw mode, looked up here because the state cache is main thread only
+    g_pFrameRasterizerState = g_pStateCache->GetRasterizerState(g_isWireframe ? g_wfdescWireframe : g_wfdescNormal);
 
     // Update the cube transform, material etc.
     float tempT = (guiRotation ? t : 0);
     //g_pGameObject->update(tempT, g_pImmediateContext);
     g_pModelObject->Update(g_pImmediateContext);
+
+    // Plant the tip of the model on the terrain beside it
+    XMFLOAT4X4* pModelWorld = g_pModelObject->GetTransform();
+    XMFLOAT3 footTarget = { pModelWorld->_41 + 2.0f, 0.0f, pModelWorld->_43 };
+    footTarget.y = g_pTerrainObject->GetHeight(footTarget.x, footTarget.z);
+    g_pModelObject->SetIKTarget(footTarget, guiModelIK);
+    g_pModelObject->Animate(t, g_pImmediateContext);
     g_pTerrainObject->update(g_pImmediateContext);
     g_pCamera->Update(g_hWnd);
-    HandlePerFrameInput(t);
-
-    // Get the game object world transform
-    XMFLOAT4X4 v = g_pCamera->GetView();
-    XMFLOAT4X4 p = g_pCamera->GetProjection();
-
-    // Store this and the view / projection in a constant buffer for the vertex shader to use
-    ConstantBuffer cb1;
-    cb1.vOutputColor = XMFLOAT4(0, 0, 0, 0);
-    cb1.mView = XMMatrixTranspose(XMLoadFloat4x4(&v));
-    cb1.mProjection = XMMatrixTranspose(XMLoadFloat4x4(&p));
-    g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb1, 0, 0);
-    g_pImmediateContext->GSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-    g_pImmediateContext->HSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-    g_pImmediateContext->DSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+    HandlePerFrameInput(steps, alpha);
 
     setupConstantBuffers();
-
-    // Draw functions
-    /*if (guiMotionBlur)
-    {
-        Bloom(&cb1);
-    }
-    DepthMap(&cb1);*/
-
-    // Clear the back buffer
-    g_pImmediateContext->ClearRenderTargetView(g_pRenderTargetView, Colors::MidnightBlue);
-    g_pImmediateContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+    setupLightClusters((float)g_animationTime);
+    setupShadows();
+    setupOcclusion();
+
+    // Nothing has recorded yet, so this is where edited shaders can be swapped in
+    ApplyShaderReloads();
+
+    // Variants for this frame's material, made here because the passes can only look them up
+    g_sceneFeatures = ShaderPermutation::GetMaterialFeatures(materialSelection);
+    PrepareSceneProgram(g_sceneFeatures);
+    PrepareSceneProgram(g_sceneFeatures | ShaderFeatureTerrain);
+    PrepareSceneProgram(ShaderFeatureVelocity);
+    PrepareSceneProgram(ShaderFeatureVelocity | ShaderFeatureTerrain);
+    PrepareSceneProgram(ShaderFeatureDepthOnly);
+    PrepareSceneProgram(ShaderFeatureDepthOnly | ShaderFeatureTerrain);
+
+    // Draw functions, recorded in parallel and executed in this order. The pool has
+    // to match the compiled graph before anything records into its targets.
+    if (SUCCEEDED(BuildFrameGraph()))
+        g_pFrameGraph->Execute();
+    g_pCommandRecorder->Flush();
+
+    g_lastQueueStats = {};
+    g_pCommandBackend->CollectStats(g_constantStats, g_lastQueueStats);
+
+    // Executed command lists leave the immediate context in default state
     g_pImmediateContext->OMSetRenderTargets(1, &g_pRenderTargetView, g_pDepthStencilView);
-
-    DrawScene(&cb1);
-    DrawSceneSprites();
-
-    RenderScreenQuad(&cb1);
-
-    // Spline
-    //g_Spline.Render(g_pImmediateContext, g_pQuadLayout);
+    g_pImmediateContext->RSSetViewports(1, &g_viewport);
 
     // ImGui
     ImGui_ImplDX11_NewFrame();
@@ -1363,11 +2587,180 @@ void Render()
     ImGui::SliderFloat("Light X Pos", &guiLightX, -5.0f, 5.0f);
     ImGui::SliderFloat("Light Y Pos", &guiLightY, -5.0f, 5.0f);
     ImGui::SliderFloat("Light Z Pos", &guiLightZ, -5.0f, 5.0f);
-    //ImGui::Checkbox("Enable Motion Blur", &guiMotionBlur);
+    ImGui::SliderInt("Clustered Lights", &guiClusterLights, 0, MAX_CLUSTERED_LIGHTS);
+    static const char* keyLightItems[]{ "Point (no shadows)", "Directional (cascaded)", "Spot" };
+    ImGui::ListBox("Key Light", &guiKeyLight, keyLightItems, ARRAYSIZE(keyLightItems));
+    ImGui::SliderInt("Shadow Cascades", &guiShadowCascades, SHADOW_MIN_CASCADES, SHADOW_MAX_CASCADES);
+    ImGui::SliderFloat("Sun Azimuth", &guiSunAzimuth, -180.0f, 180.0f);
+    ImGui::SliderFloat("Sun Elevation", &guiSunElevation, 5.0f, 90.0f);
+    ImGui::Checkbox("Enable Motion Blur", &guiMotionBlur);
+    ImGui::Checkbox("Occlusion Culling", &guiOcclusionCulling);
+    ImGui::SliderFloat("Motion Blur Shutter", &guiMotionBlurShutter, 0.0f, 1.0f);
     //ImGui::Checkbox("Enable Rotation", &guiRotation);
     ImGui::Checkbox("Enable Wireframe", &g_isWireframe);
+    static const char* targetPolicyItems[]{ "Full (RGBA32F)", "Bandwidth (RGBA16F, R11G11B10F)" };
+    if (ImGui::ListBox("Target Formats", &guiTargetPolicy, targetPolicyItems, ARRAYSIZE(targetPolicyItems)))
+        g_targetPolicy = guiTargetPolicy ? RenderTargetFormats::GetBandwidthPolicy() : RenderTargetFormats::GetFullPolicy();
+    static const char* resolveItems[]{ "Hardware", "Tonemapped" };
+    ImGui::ListBox("MSAA Resolve", &guiResolveMode, resolveItems, ARRAYSIZE(resolveItems));
+    ImGui::Checkbox("Enable Blur", &guiBlur);
+    ImGui::SliderInt("Blur Radius", &guiBlurRadius, 1, BLUR_MAX_RADIUS);
+    static const char* blurPathItems[]{ "Pixel Shader", "Compute Shader (groupshared tiles)" };
+    ImGui::ListBox("Blur Path", &guiBlurPath, blurPathItems, ARRAYSIZE(blurPathItems));
+    ImGui::Checkbox("Enable Bloom", &guiBloom);
+    ImGui::SliderInt("Bloom Radius", &guiBloomRadius, 1, BLOOM_MAX_RADIUS);
+    ImGui::SliderFloat("Bloom Threshold", &guiBloomThreshold, 0.0f, 2.0f);
+    ImGui::SliderFloat("Bloom Intensity", &guiBloomIntensity, 0.0f, 4.0f);
     ImGui::SliderFloat("Tesselation Factor", &g_tessFactor, 0.001f, 2.0f);
     ImGui::SliderFloat("Height Factor", &g_heightFactor, 0.0f, 20.0f);
+    static const char* skinningItems[]{ "Linear Blend", "Dual Quaternion" };
+    if (ImGui::ListBox("Skinning", &guiSkinningMode, skinningItems, ARRAYSIZE(skinningItems)))
+        g_pModelObject->SetSkinningMode((SkinningMode)guiSkinningMode);
+    ImGui::Checkbox("Plant On Terrain (IK)", &guiModelIK);
+    float* blendParameters = g_pModelObject->GetBlendParameters();
+    ImGui::SliderFloat2("Sway / Bend", blendParameters, 0.0f, 1.0f);
+    ImGui::SliderFloat("Twist Layer", &blendParameters[2], 0.0f, 1.0f);
+    ImGui::SliderFloat("Wave Layer", &blendParameters[3], 0.0f, 1.0f);
+    static const char* splineItems[]{ "Catmull-Rom", "Bezier", "B-Spline" };
+    if (ImGui::ListBox("Spline", &guiSplineType, splineItems, ARRAYSIZE(splineItems)))
+        g_pSpline->GetCurve()->SetType((SplineType)guiSplineType);
+    if (ImGui::SliderFloat("Spline Height", &guiSplineHeight, 0.0f, 5.0f))
+    {
+        // Raise the middle control point
+        SplineCurve* pCurve = g_pSpline->GetCurve();
+        XMFLOAT3 point = pCurve->GetControlPoints()[POINT_COUNT / 2];
+        point.y = guiSplineHeight;
+        pCurve->SetControlPoint(POINT_COUNT / 2, point);
+    }
+    ImGui::Text("Spline: %u vertices, %u uploads", g_pSpline->GetVertexCount(), g_pSpline->GetUploadCount());
+    if (ImGui::Button("Record Input"))
+        g_pCameraPlayer->StartRecording();
+    ImGui::SameLine();
+    if (ImGui::Button("Replay Input"))
+        g_pCameraPlayer->StartReplay();
+    ImGui::SameLine();
+    if (ImGui::Button("Flythrough"))
+        g_pCameraPlayer->PlayTrack(g_pCameraTrack);
+    ImGui::SameLine();
+    if (ImGui::Button("Stop"))
+        g_pCameraPlayer->Stop();
+    if (ImGui::Button("Save Input"))
+    {
+        std::ofstream file("camera_input.txt");
+        g_pCameraPlayer->SaveRecording(file);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load Input"))
+    {
+        std::ifstream file("camera_input.txt");
+        g_pCameraPlayer->LoadRecording(file);
+    }
+    static const char* playerModes[]{ "Free", "Recording", "Replaying", "Flythrough" };
+    ImGui::Text("Camera: %s, step %u", playerModes[g_pCameraPlayer->GetMode()], g_pCameraPlayer->GetStep());
+    RenderStateCacheStats stateStats = g_pStateCache->GetStats();
+    FrameTimerStats frameStats = g_pFrameTimer->GetStats();
+    ImGui::Text("Frame: %.2f ms mean, %.2f p99, %.2f max, %llu steps, %llu dropped", frameStats.MeanMilliseconds,
+        frameStats.P99Milliseconds, frameStats.MaxMilliseconds, (unsigned long long)frameStats.Steps, (unsigned long long)frameStats.DroppedSteps);
+    const LightClusterStats& clusterStats = g_pLightClusterer->GetStats();
+    ImGui::Text("Clusters: %u of %u lights visible, %u indices, %u most in one, binned in %.2f ms", clusterStats.VisibleLights,
+        clusterStats.Lights, clusterStats.Indices, clusterStats.MaxClusterLights, g_clusterMilliseconds);
+    const OcclusionStats& occlusionStats = g_pOcclusionBuffer->GetStats();
+    ImGui::Text("Occlusion: %u occluders, %u triangles, %u of %u hidden, raster %.2f ms, test %.2f ms", occlusionStats.Occluders,
+        occlusionStats.Triangles, occlusionStats.Occluded, occlusionStats.Tested, g_occlusionRasterMilliseconds, g_occlusionTestMilliseconds);
+    ImGui::Text("Shadows: %u maps, casters %u/%u/%u/%u of %u, fitted and culled in %.2f ms", g_shadowCascadeCount, g_shadowCasterCounts[0],
+        g_shadowCasterCounts[1], g_shadowCasterCounts[2], g_shadowCasterCounts[3], (unsigned)g_shadowCasterSpheres.size(), g_shadowMilliseconds);
+    ImGui::Text("States: %u, %u created, %u hits", stateStats.States, stateStats.Creations, stateStats.Hits);
+    ImGui::Text("Constants: %u maps, %u skipped, %llu bytes%s", g_lastConstantStats.MapCalls, g_lastConstantStats.SkippedUploads,
+        (unsigned long long)g_lastConstantStats.BytesUploaded, g_pCommandBackend->GetContext(0).pObjectConstants->UsesOffsets() ? "" : " (11.0 fallback)");
+    ImGui::Text("Queue: %u packets, %u shader, %u material, %u mesh binds, %u skipped", g_lastQueueStats.Packets,
+        g_lastQueueStats.ShaderBinds, g_lastQueueStats.MaterialBinds, g_lastQueueStats.MeshBinds, g_lastQueueStats.SkippedBinds);
+    const FrameGraphStats& graphStats = g_pFrameGraph->GetStats();
+    ImGui::Text("Render targets: %u textures, %.1f MB (%.1f MB declared, %.1f MB peak live), %u of %u passes culled",
+        graphStats.PhysicalTextures, graphStats.AllocatedBytes / 1048576.0, graphStats.DeclaredBytes / 1048576.0,
+        graphStats.PeakLiveBytes / 1048576.0, graphStats.CulledPasses, graphStats.Passes);
+    RenderTargetBudget targetBudget = RenderTargetFormats::GetBudget(g_targetPolicy, (uint32_t)g_viewport.Width, (uint32_t)g_viewport.Height,
+        g_sampleCount, g_targetSupport, g_msaaTargetSupport, guiMotionBlur, guiBlur, IsBloomVisible(), guiSelection == 1);
+    RenderTargetBudget fullBudget = RenderTargetFormats::GetBudget(RenderTargetFormats::GetFullPolicy(), (uint32_t)g_viewport.Width, (uint32_t)g_viewport.Height,
+        g_sampleCount, g_targetSupport, g_msaaTargetSupport, guiMotionBlur, guiBlur, IsBloomVisible(), guiSelection == 1);
+    ImGui::Text("Target traffic: ~%.1f MB per frame, %.1f MB with every target RGBA32F", targetBudget.TrafficBytes / 1048576.0, fullBudget.TrafficBytes / 1048576.0);
+    const CommandRecorderStats& recorderStats = g_pCommandRecorder->GetStats();
+    ImGui::Text("Passes: %u on %u %s, record %.2f ms, execute %.2f ms", recorderStats.Passes, recorderStats.Recorders,
+        g_pCommandBackend->IsDeferred() ? (g_pCommandBackend->HasDriverCommandLists() ? "deferred contexts" : "emulated deferred contexts") : "immediate context",
+        recorderStats.RecordMilliseconds, recorderStats.ExecuteMilliseconds);
+    ImGui::Text("Shaders: %u cached, %u compiled, %.1f ms at startup, %u scene variants", g_shaderCacheStats.Hits, g_shaderCacheStats.Misses,
+        g_shaderStartupMilliseconds, g_scenePrograms.GetCreations());
+    ShaderReloaderStats reloadStats = g_pShaderReloader->GetStats();
+    ImGui::Text("Hot reload: %u watched, %u swapped, last %.0f ms after the change was seen (compile %.0f ms)", reloadStats.Watched,
+        g_hotReloadSwaps, g_hotReloadMilliseconds, g_hotReloadCompileMilliseconds);
+    for (const HotReloadTarget& target : g_hotReloadTargets)
+    {
+        if (target.Error.empty())
+            continue;
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.4f, 0.4f, 1.0f));
+        ImGui::TextWrapped("%s", target.Error.c_str());
+        ImGui::PopStyleColor();
+    }
+
+    // GPU time per pass, a few frames old
+    if (g_pGpuProfiler)
+    {
+        const GpuProfilerStats& gpuStats = g_pGpuProfiler->GetStats();
+        ImGui::Text("GPU: %u frames behind, %llu skipped, %llu disjoint", gpuStats.Latency,
+            (unsigned long long)gpuStats.FramesSkipped, (unsigned long long)gpuStats.FramesDisjoint);
+        // Velocity is a scene draw, the rest is what the tiles save or cost
+        const GpuZoneTiming* pVelocity = g_pGpuProfiler->FindZone("Velocity");
+        const GpuZoneTiming* pTileMax = g_pGpuProfiler->FindZone("Velocity Tile Max");
+        const GpuZoneTiming* pNeighbourMax = g_pGpuProfiler->FindZone("Velocity Neighbour Max");
+        const GpuZoneTiming* pMotionBlur = g_pGpuProfiler->FindZone("Motion Blur");
+        if (guiMotionBlur && pVelocity && pTileMax && pNeighbourMax && pMotionBlur)
+        {
+            ImGui::Text("Motion blur: %.3f ms velocity, %.3f ms tiles, %.3f ms gather", pVelocity->AverageMilliseconds,
+                pTileMax->AverageMilliseconds + pNeighbourMax->AverageMilliseconds, pMotionBlur->AverageMilliseconds);
+        }
+        // Both blur directions per megapixel, to compare the two blur paths at any window size
+        const GpuZoneTiming* pBlurHorizontal = g_pGpuProfiler->FindZone("Blur Horizontal");
+        const GpuZoneTiming* pBlurVertical = g_pGpuProfiler->FindZone("Blur Vertical");
+        if (guiBlur && pBlurHorizontal && pBlurVertical)
+        {
+            float megapixels = g_viewport.Width * g_viewport.Height / 1000000.0f;
+            ImGui::Text("Blur (%s): %.3f ms per megapixel", g_frameTargets.ComputeBlur ? "compute" : "pixel shader",
+                (pBlurHorizontal->AverageMilliseconds + pBlurVertical->AverageMilliseconds) / megapixels);
+        }
+        for (const GpuZoneTiming& zone : g_pGpuProfiler->GetZones())
+        {
+            char overlay[64];
+            sprintf_s(overlay, "%.3f ms avg, %.3f max", zone.AverageMilliseconds, zone.MaxMilliseconds);
+            ImGui::PlotHistogram(zone.Name.c_str(), zone.History, GPU_PROFILER_HISTORY, zone.HistoryOffset, overlay,
+                0.0f, zone.MaxMilliseconds * 1.1f + 0.001f, ImVec2(0.0f, 32.0f));
+        }
+        // Every level's pass adds up into one zone a step, the whole chain is what bloom costs a frame
+        const GpuZoneTiming* pBloomDownsample = g_pGpuProfiler->FindZone("Bloom Downsample");
+        const GpuZoneTiming* pBloomHorizontal = g_pGpuProfiler->FindZone("Bloom Horizontal");
+        const GpuZoneTiming* pBloomVertical = g_pGpuProfiler->FindZone("Bloom Vertical");
+        const GpuZoneTiming* pBloomUpsample = g_pGpuProfiler->FindZone("Bloom Upsample");
+        if (IsBloomVisible() && pBloomDownsample && pBloomHorizontal && pBloomVertical && pBloomUpsample)
+        {
+            float blurMilliseconds = pBloomHorizontal->AverageMilliseconds + pBloomVertical->AverageMilliseconds;
+            ImGui::Text("Bloom chain: %.3f ms, %.3f ms downsample, %.3f ms blur, %.3f ms upsample",
+                pBloomDownsample->AverageMilliseconds + blurMilliseconds + pBloomUpsample->AverageMilliseconds,
+                pBloomDownsample->AverageMilliseconds, blurMilliseconds, pBloomUpsample->AverageMilliseconds);
+        }
+    }
+    ImGui::End();
+
+    // Zones of the previous frame, this one is still open
+    ImGui::Begin("CPU Profiler");
+    uint32_t captureFramesLeft = Profiler::GetCaptureFramesLeft();
+    if (captureFramesLeft > 0)
+        ImGui::Text("Capturing, %u frames left", captureFramesLeft);
+    else if (ImGui::Button("Capture Trace"))
+        Profiler::StartCapture(PROFILER_CAPTURE_FRAMES);
+    ImGui::SameLine();
+    ImGui::Text("%s, %llu zones dropped", PROFILER_TRACE_FILE, (unsigned long long)Profiler::GetDroppedEvents());
+    for (const ProfilerNode& node : Profiler::GetFrameTree())
+    {
+        ImGui::Text("%*s%s: %.3f ms, self %.3f ms, %u calls", node.Depth * 2, "", node.Name, node.TotalMilliseconds, node.SelfMilliseconds, node.Calls);
+    }
     ImGui::End();
 
     /*if (prevHeight != g_heightFactor)
@@ -1382,8 +2775,30 @@ void Render()
     }
 
     ImGui::Render();
+    if (g_pGpuProfiler)
+        g_pGpuProfiler->BeginZone("ImGui");
     ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+    if (g_pGpuProfiler)
+    {
+        g_pGpuProfiler->EndZone();
+        g_pGpuProfiler->EndFrame();
+    }
 
     // Present our back buffer to our front buffer
     g_pSwapChain->Present(0, 0);
+
+    if (g_isFlythrough)
+    {
+        CameraPose pose = g_pCameraPlayer->GetPose();
+        double cpuMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        FrameTiming frame = { (unsigned)g_flythroughFrames.size(), g_pCameraPlayer->GetTime(), { pose.Eye.x, pose.Eye.y, pose.Eye.z }, cpuMilliseconds };
+        g_flythroughFrames.push_back(frame);
+
+        if (g_pCameraPlayer->IsFinished())
+        {
+            Benchmark::WriteFrameTimings(g_flythroughPath, g_flythroughFrames);
+            g_isFlythrough = false;
+            PostQuitMessage(0);
+        }
+    }
 }
\ No newline at end of file
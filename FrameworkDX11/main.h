@@ -17,6 +17,23 @@
 #include "imgui-master/imgui_impl_dx11.h"
 
 #include <vector>
+#include <string>
+
+#include "Benchmark.h"
+#include "FrameTimer.h"
+#include "Profiler.h"
+#include "D3D11GpuQueryBackend.h"
+#include "D3D11RenderTargetPool.h"
+#include "FrameGraph.h"
+#include "RenderTargetFormats.h"
+#include "ConstantBuffers.h"
+#include "RenderQueue.h"
+#include "ShaderCache.h"
+#include "ShaderPermutation.h"
+#include "ShaderReloader.h"
+#include "LightClusters.h"
+#include "ShadowCascades.h"
+#include "OcclusionCulling.h"
 
 class Camera;
 class DrawableGameObject;
@@ -24,12 +41,23 @@ class CubeGameObject;
 class TerrainGameObject;
 class ModelGameObject;
 class Debug;
+class JobSystem;
+class Spline;
+class CameraPathPlayer;
+class CameraTrack;
+class RenderStateCache;
+class D3D11CommandBackend;
+class CommandRecorder;
+class D3DShaderCompiler;
 
 typedef vector<DrawableGameObject*> vecDrawables;
 
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
 
+// Matches the camera's far plane, view depth is quantised over this range for the sort keys
+#define RENDER_MAX_DEPTH 100.0f
+
 //--------------------------------------------------------------------------------------
 // Global Variables
 //--------------------------------------------------------------------------------------
@@ -49,21 +77,125 @@ ID3D11RenderTargetView*		g_pRenderTargetView = nullptr;
 ID3D11DepthStencilView*		g_pDepthStencilView = nullptr;
 
 ID3D11VertexShader*			g_pVertexShader = nullptr;
-ID3D11PixelShader*			g_pPixelShader = nullptr;
 ID3D11GeometryShader*		g_GeometryShader = nullptr;
 
 ID3D11InputLayout*			g_pVertexLayout = nullptr;
-ID3D11Buffer*				g_pConstantBuffer = nullptr;
-ID3D11Buffer*				g_pLightConstantBuffer = nullptr;
-ID3D11Buffer*				g_pMaterialConstantBuffer = nullptr;
-ID3D11Buffer*				g_pTessConstantBuffer = nullptr;
+const D3D11_INPUT_ELEMENT_DESC	g_vertexLayoutElements[] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT , D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT , D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BINORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+// Constant buffers by update frequency: per object (a ring per recording context), per frame, per pass, per material
+CachedConstantBuffer*		g_pFrameConstants = nullptr;
+CachedConstantBuffer*		g_pLightConstants = nullptr;
+CachedConstantBuffer*		g_pBillboardConstants = nullptr;
+CachedConstantBuffer*		g_pTessConstants = nullptr;
+CachedConstantBuffer*		g_pBlurConstants = nullptr;
+CachedConstantBuffer*		g_pMaterialConstants = nullptr;
+ConstantUploadStats			g_constantStats = {};
+ConstantUploadStats			g_lastConstantStats = {};
+
+// Passes record on the workers into deferred contexts and execute in order. Scene
+// draws inside a pass are queued as packets, sorted by key and replayed without redundant binds.
+D3D11CommandBackend*		g_pCommandBackend = nullptr;
+CommandRecorder*			g_pCommandRecorder = nullptr;
+RenderQueueStats			g_lastQueueStats = {};
+
+// Every pass is timed on the GPU, read back GPU_PROFILER_LATENCY frames later
+D3D11GpuQueryBackend*		g_pGpuQueries = nullptr;
+GpuProfiler*				g_pGpuProfiler = nullptr;
+
+// Shader bytecode comes from SHADER_CACHE_FILE, misses compile on the job system.
+// "-precompile-shaders" fills the cache after every build.
+#define SHADER_CACHE_FILE "shader_cache.bin"
+D3DShaderCompiler*					g_pShaderCompiler = nullptr;
+ShaderCache*						g_pShaderCache = nullptr;
+std::vector<ShaderCompileRequest>	g_shaderRequests;
+std::vector<ShaderCompileResult>	g_shaderResults;
+ShaderCacheStats					g_shaderCacheStats = {};
+double								g_shaderStartupMilliseconds = 0.0;
+
+// Hot reload: the reloader rescans shader sources on its own thread and Render swaps
+// finished recompiles in before anything records. A failed compile keeps the old
+// shader and its error stays in the ImGui window until the next good compile. A
+// vertex shader with an input layout gets the layout rebuilt from its new bytecode.
+#define SHADER_RELOAD_POLL_MS 250
+struct HotReloadTarget
+{
+	ShaderCompileRequest			Request;
+	ID3D11DeviceChild**				ppShader;
+	std::string						Error;
+	ID3D11InputLayout**				ppInputLayout;
+	const D3D11_INPUT_ELEMENT_DESC*	pInputElements;
+	UINT							InputElementCount;
+};
+ShaderReloader*						g_pShaderReloader = nullptr;
+std::vector<HotReloadTarget>		g_hotReloadTargets;
+uint32_t							g_hotReloadSwaps = 0;
+double								g_hotReloadMilliseconds = 0.0;
+double								g_hotReloadCompileMilliseconds = 0.0;
+
+// Scene shader variants by feature bits, see ShaderPermutation.h. Programs are
+// registered on the main thread before the passes record, DrawScene only looks them up.
+// Depth only programs have no pixel shader.
+#define SHADER_FEATURES_SCENE_PS (ShaderFeatureTerrain | ShaderFeatureVelocity | SHADER_FEATURES_MATERIAL)
+#define SHADER_FEATURES_SCENE (SHADER_FEATURES_SCENE_PS | ShaderFeatureDepthOnly)
+ShaderPermutationTable<ID3D11DomainShader*>	g_sceneDomainShaders(ShaderFeatureTerrain | ShaderFeatureVelocity | ShaderFeatureDepthOnly);
+ShaderPermutationTable<ID3D11PixelShader*>	g_scenePixelShaders(SHADER_FEATURES_SCENE_PS);
+ShaderPermutationTable<uint32_t>			g_scenePrograms(SHADER_FEATURES_SCENE);
+uint32_t									g_sceneFeatures = 0;
+
+// Frame state every pass binds for itself, deferred contexts start from defaults
+D3D11_VIEWPORT				g_viewport;
+ID3D11RasterizerState*		g_pFrameRasterizerState = nullptr;
+
+// Render to texture targets are frame graph transients: declared every frame, culled
+// when unused and shared between passes whose lifetimes don't overlap
+struct FrameTargets
+{
+	uint32_t	BackBuffer;
+	uint32_t	RTT;
+	uint32_t	NoMSAARTT;
+	uint32_t	Depth;
+	uint32_t	BlurHorizontal;
+	uint32_t	BlurVertical;
+	uint32_t	SceneFormat;
+	bool		ComputeBlur;
+	uint32_t	ShadowMap;		// imported, written by one pass per cascade
+
+	// Motion blur, the tile targets are a texel a VELOCITY_TILE_SIZE tile
+	uint32_t	Velocity;
+	uint32_t	VelocityTileMax;
+	uint32_t	VelocityNeighbourMax;
+	uint32_t	MotionBlur;
+
+	// Bloom levels, BloomUpsample of the coarsest level is its vertical blur
+	uint32_t	BloomDownsample[BLOOM_LEVELS];
+	uint32_t	BloomHorizontal[BLOOM_LEVELS];
+	uint32_t	BloomVertical[BLOOM_LEVELS];
+	uint32_t	BloomUpsample[BLOOM_LEVELS];
+};
+FrameGraph*					g_pFrameGraph = nullptr;
+D3D11RenderTargetPool*		g_pRenderTargets = nullptr;
+FrameTargets				g_frameTargets = {};
+UINT						g_sampleCount = 1;
+UINT						g_sampleQuality = 0;
+
+// Target formats by pass, see RenderTargetFormats.h. Support has a bit per precision,
+// found at startup; MSAA support also needs the depth buffer's quality level.
+RenderTargetFormatPolicy	g_targetPolicy = RenderTargetFormats::GetBandwidthPolicy();
+uint32_t					g_targetSupport = 1;
+uint32_t					g_msaaTargetSupport = 1;
+ID3D11PixelShader*			g_pResolvePS = nullptr;
 
 // RTT
-TextureSet					g_RTTTexture;
 ID3D11DepthStencilView*		g_pRTTStencilView = nullptr;
 
 // No MSAA
-TextureSet					g_NoMSAARTTTexture;
 ID3D11DepthStencilView*		g_pNoMSAARTTStencilView = nullptr;
 ID3D11Texture2D*			g_pNoMSAADepthStencilTexture = nullptr;
 
@@ -74,27 +206,73 @@ ID3D11InputLayout*			g_pSpriteLayout = nullptr;
 ID3D11ShaderResourceView*	g_pSpriteTexture = nullptr;
 const int					g_numberOfSprites = 125;
 SCREEN_VERTEX				g_SpriteArray[g_numberOfSprites];
-ID3D11Buffer*				g_pSpriteConstantBuffer = nullptr;
 ID3D11PixelShader*			g_pBillPS = nullptr;
 
 ID3D11Buffer*				g_pScreenQuadVB = nullptr;
 ID3D11InputLayout*			g_pQuadLayout = nullptr;
+const D3D11_INPUT_ELEMENT_DESC	g_quadLayoutElements[] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT , D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
 ID3D11VertexShader*			g_pQuadVS = nullptr;
 ID3D11PixelShader*			g_pQuadPS = nullptr;
 SCREEN_VERTEX				g_ScreenQuad[4];
 
 // Depth Mapping
-TextureSet					g_DepthTexture;
 ID3D11GeometryShader*		g_pDepthGS = nullptr;
 ID3D11PixelShader*			g_pDepthPS = nullptr;
 ID3D11PixelShader*			g_pTintPS = nullptr;
 
+// Motion blur from the velocity buffer, see VelocityTiles.h. The velocity pass draws
+// the scene with the VELOCITY programs.
+enum MotionBlurStep
+{
+	MotionBlurTileMaxStep = 0,
+	MotionBlurGatherStep,
+	MotionBlurStepCount
+};
+ID3D11ComputeShader*		g_pVelocityTileMaxCS = nullptr;
+ID3D11PixelShader*			g_pVelocityNeighbourMaxPS = nullptr;
+ID3D11PixelShader*			g_pMotionBlurPS = nullptr;
+// One per step that has constants, so passes recording on different threads never share one
+CachedConstantBuffer*		g_pMotionBlurConstants = nullptr;
+// Last frame's camera, velocities are measured from it
+XMFLOAT4X4					g_previousViewProjection;
+bool						g_hasPreviousViewProjection = false;
+
+// Separable Gaussian blur of the finished scene, after motion blur when that's on
+ShaderPermutationTable<ID3D11PixelShader*>	g_blurShaders(ShaderFeatureHorizontal);
+ShaderPermutationTable<ID3D11ComputeShader*>	g_blurComputeShaders(ShaderFeatureHorizontal);
+enum BlurPath
+{
+	BlurPixelShader = 0,
+	BlurComputeShader,
+	BlurPathCount
+};
+// Precisions with typed UAV stores, the compute blur needs its targets' format in here
+uint32_t					g_unorderedAccessSupport = 0;
+
 // Bloom
-TextureSet					g_BloomTexture;
-TextureSet					g_BlurTextureHorizontal;
-TextureSet					g_BlurTextureVertical;
-ID3D11PixelShader*			g_pBlurPS = nullptr;
-ID3D11Buffer*				g_pBlurConstantBuffer = nullptr;
+enum BloomStep
+{
+	BloomDownsampleStep = 0,
+	BloomHorizontalStep,
+	BloomVerticalStep,
+	BloomUpsampleStep,
+	BloomStepCount
+};
+ID3D11PixelShader*			g_pBloomDownsamplePS = nullptr;
+ID3D11PixelShader*			g_pBloomBlurPS = nullptr;
+ID3D11PixelShader*			g_pBloomUpsamplePS = nullptr;
+ID3D11SamplerState*			g_pBloomSampler = nullptr;
+// One per level and step, so passes recording on different threads never share one
+CachedConstantBuffer*		g_pBloomConstants = nullptr;
+
+// Spline
+Spline*						g_pSpline = nullptr;
+ID3D11VertexShader*			g_pLineVS = nullptr;
+ID3D11PixelShader*			g_pLinePS = nullptr;
 
 int							g_viewWidth;
 int							g_viewHeight;
@@ -104,31 +282,118 @@ TerrainGameObject*			g_pTerrainObject;
 ModelGameObject*			g_pModelObject;
 Camera*						g_pCamera;
 Debug*						g_pDebug;
+JobSystem*					g_pJobSystem = nullptr;
+CameraPathPlayer*			g_pCameraPlayer = nullptr;
+CameraTrack*				g_pCameraTrack = nullptr;
+
+// The simulation steps at the camera player's fixed rate and draws interpolated
+// between steps. Frames are capped at FRAME_RATE_LIMIT, the loop sleeps on
+// g_hFrameWait until the next one is due or a message arrives.
+#define FRAME_RATE_LIMIT 120.0
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+FrameTimer*					g_pFrameTimer = nullptr;
+HANDLE						g_hFrameWait = nullptr;
+double						g_animationTime = 0.0;
+
+// Frames written to PROFILER_TRACE_FILE by the profiler's capture button or "-trace"
+#define PROFILER_CAPTURE_FRAMES 120
 XMFLOAT4					g_LightPos;
 
+// Clustered point lights, see LightClusters.h. Binned on the job system every frame
+// and read by the scene's pixel shader from structured buffers.
+LightClusterer*				g_pLightClusterer = nullptr;
+std::vector<ClusterLight>	g_clusterLights;
+std::vector<XMFLOAT4>		g_clusterLightOrigins;	// xyz the centre each light circles, w its phase
+XMFLOAT4X4					g_clusterProjection = {};
+DynamicStructuredBuffer*	g_pClusterLightBuffer = nullptr;
+DynamicStructuredBuffer*	g_pClusterRangeBuffer = nullptr;
+DynamicStructuredBuffer*	g_pClusterIndexBuffer = nullptr;
+CachedConstantBuffer*		g_pClusterConstants = nullptr;
+double						g_clusterMilliseconds = 0.0;
+
+// The key light's shadows, see ShadowCascades.h. Maps are fitted and their casters
+// culled on the CPU every frame, then each map is a depth only pass into its own
+// slice of one texture array.
+enum KeyLightMode
+{
+	KeyLightPoint = 0,		// unshadowed, the way it always lit the scene
+	KeyLightDirectional,	// guiShadowCascades cascades
+	KeyLightSpot			// one perspective map
+};
+// How far the spot light's map reaches
+#define SHADOW_SPOT_RANGE 60.0f
+ID3D11Texture2D*			g_pShadowMapTexture = nullptr;
+ID3D11DepthStencilView*		g_pShadowMapViews[SHADOW_MAX_CASCADES] = {};
+ID3D11ShaderResourceView*	g_pShadowMapResource = nullptr;
+ID3D11SamplerState*			g_pShadowSampler = nullptr;
+ID3D11RasterizerState*		g_pShadowRasterizerState = nullptr;
+D3D11_VIEWPORT				g_shadowViewport;
+CachedConstantBuffer*		g_pShadowConstants = nullptr;
+CachedConstantBuffer*		g_pShadowPassConstants = nullptr;	// one per cascade
+ShadowCascade				g_shadowCascades[SHADOW_MAX_CASCADES];
+uint32_t					g_shadowCascadeCount = 0;			// this frame's, 0 without shadows
+std::vector<XMFLOAT4>		g_shadowCasterSpheres;				// the terrain's chunks, then the model
+std::vector<uint8_t>		g_shadowCasterVisible;				// a row of casters per cascade
+uint32_t					g_shadowCasterCounts[SHADOW_MAX_CASCADES] = {};
+double						g_shadowMilliseconds = 0.0;
+
+// Software occlusion culling, see OcclusionCulling.h. The terrain's chunks occlude,
+// and its chunks and the model are tested before the camera's passes submit them.
+OcclusionBuffer*				g_pOcclusionBuffer = nullptr;
+std::vector<OcclusionMesh>		g_occluders;
+std::vector<OcclusionBounds>	g_occludees;			// the terrain's chunks, then the model
+std::vector<uint8_t>			g_occludeeVisible;
+double							g_occlusionRasterMilliseconds = 0.0;
+double							g_occlusionTestMilliseconds = 0.0;
+
 // ImGui
 int							guiSelection = 0;
 int							materialSelection = 0;
 bool						guiRotation = true;
 bool						guiMotionBlur = false;
+bool						guiBloom = true;
+int							guiBloomRadius = 4;
+float						guiBloomThreshold = 0.8f;
+float						guiBloomIntensity = 1.0f;
+int							guiTargetPolicy = 1;
+int							guiResolveMode = ResolveHardware;
+int							guiBlurPath = BlurComputeShader;
+bool						guiBlur = false;
+int							guiBlurRadius = 4;
+float						guiMotionBlurShutter = 0.5f;
 float						guiLightX = 0.0f;
 float						guiLightY = 0.0f;
 float						guiLightZ = 0.0f;
+int							guiClusterLights = 512;
+int							guiKeyLight = KeyLightDirectional;
+int							guiShadowCascades = SHADOW_MAX_CASCADES;
+float						guiSunAzimuth = 40.0f;
+float						guiSunElevation = 35.0f;
+bool						guiOcclusionCulling = true;
 int							guiTerrainType = 0;
+int							guiSkinningMode = 0;
+bool						guiModelIK = false;
+int							guiSplineType = 0;
+float						guiSplineHeight = 1.0f;
+
+// Flythrough benchmark, started with "-flythrough [-out <file>]"
+bool						g_isFlythrough = false;
+std::string					g_flythroughPath;
+std::vector<FrameTiming>	g_flythroughFrames;
 
 MaterialPropertiesConstantBuffer	g_Material;
 
 ID3D11HullShader*			g_pHullShader = nullptr;
-ID3D11DomainShader*			g_pDomainShader = nullptr;
 
+RenderStateCache*			g_pStateCache = nullptr;
 D3D11_RASTERIZER_DESC		g_wfdescNormal;
 D3D11_RASTERIZER_DESC		g_wfdescWireframe;
 bool						g_isWireframe = false;
 float						g_tessFactor = 1.0f;
 
 ID3D11VertexShader*			g_pTerrainVS = nullptr;
-TerrainProperties			g_Terrain;
-ID3D11Buffer*				g_pTerrainConstantBuffer = nullptr;
 float						g_heightFactor = 5.0f;
 
 //--------------------------------------------------------------------------------------
@@ -138,6 +403,13 @@ HRESULT		InitWindow(HINSTANCE hInstance, int nCmdShow);
 HRESULT		InitDevice();
 HRESULT		InitMesh();
 HRESULT		InitWorld(int width, int height);
+void		GetShaderRequests(std::vector<ShaderCompileRequest>& requests);
+HRESULT		PrepareShaders();
+int			PrecompileShaders(const std::string& commandLine);
+bool		PrepareSceneProgram(uint32_t features);
+void		WatchShaders();
+void		ApplyShaderReloads();
 void		CleanupDevice();
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
-void		Render();
\ No newline at end of file
+void		Render();
+void		WaitForNextFrame();
\ No newline at end of file
@@ -9,12 +9,23 @@
 //--------------------------------------------------------------------------------------
 // Constant Buffer Variables
 //--------------------------------------------------------------------------------------
-cbuffer ConstantBuffer : register( b0 )
+// Per object, sub-allocated from the constant ring for every draw
+cbuffer ObjectConstants : register( b0 )
 {
 	matrix World;
+	matrix PreviousWorld;
+	float4 vOutputColor;
+}
+
+// Permutation defines, set by ShaderPermutation::GetDefines from the feature bits:
+// TERRAIN, NORMAL_MAP, PARALLAX, PARALLAX_OCCLUSION, SELF_SHADOW, BLUR_HORIZONTAL, VELOCITY, DEPTH_ONLY
+
+// Per frame
+cbuffer FrameConstants : register( b7 )
+{
 	matrix View;
 	matrix Projection;
-	float4 vOutputColor;
+	matrix PreviousViewProjection;
 }
 
 Texture2D txDiffuse : register(t0);
@@ -27,8 +38,30 @@ Texture2D txGrass : register(t5);
 Texture2D txLightDirt : register(t6);
 Texture2D txSnow : register(t7);
 Texture2D txHeightMap : register(t8);
+Texture2DMS<float4> txSceneMS : register(t9);
+Texture2D<float2> txVelocity : register(t10);
+Texture2D<float2> txVelocityTiles : register(t11);
+
+RWTexture2D<float4> rwTarget : register(u0);
+RWTexture2D<float2> rwVelocityTiles : register(u1);
+
+// Clustered point lights, LightClusterer bins them on the CPU every frame
+struct ClusterLight
+{
+	float3 Position;
+	float Range;
+	float3 Colour;
+	float Padding;
+};
+StructuredBuffer<ClusterLight> ClusterLights : register(t12);
+StructuredBuffer<uint2> ClusterRanges : register(t13);			// offset and count into ClusterLightIndices
+StructuredBuffer<uint> ClusterLightIndices : register(t14);
+
+// The key light's shadow maps, a slice per cascade
+Texture2DArray<float> txShadowMap : register(t15);
 
 SamplerState samLinear : register(s0);
+SamplerComparisonState samShadow : register(s1);
 
 #define MAX_LIGHTS 1
 // Light types.
@@ -47,7 +80,7 @@ struct _Material
 	float4  Specular;       // 16 bytes
 							//----------------------------------- (16 byte boundary)
 	float   SpecularPower;  // 4 bytes
-	int		UseTexture;		// 4 bytes
+	int		UseTexture;		// 4 bytes, unused: the texture features are permutations
 	float2  Padding;        // 8 bytes
 							//----------------------------------- (16 byte boundary)
 };  // Total:               // 80 bytes ( 5 * 16 )
@@ -93,9 +126,45 @@ cbuffer BillboardProperties : register(b3)
 
 cbuffer BlurProperties : register(b4)
 {
-	int isHorizontal;
-	float2 mouseChange;
-	float Padding;
+	float2 BlurRadius;
+	float2 Padding;
+}
+
+// Same grid as LightClusters.h
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+
+cbuffer ClusterProperties : register(b8)
+{
+	float2 ClusterTileScale;	// clusters per pixel across and down
+	float ClusterSliceScale;	// slice = log(view z) * scale + bias
+	float ClusterSliceBias;
+}
+
+// Same maximum as ShadowCascades.h
+#define SHADOW_MAX_CASCADES 4
+
+cbuffer ShadowProperties : register(b9)
+{
+	matrix CascadeViewProjection[SHADOW_MAX_CASCADES];
+	float4 CascadeSplits;		// view depth each cascade ends at
+	uint CascadeCount;			// 0 without shadows
+	float ShadowTexelSize;		// one texel in shadow map texture coordinates
+	float2 ShadowPadding;
+}
+
+// The one map a depth only pass is drawing
+cbuffer ShadowPassProperties : register(b10)
+{
+	matrix ShadowViewProjection;
+}
+
+cbuffer MotionBlurProperties : register(b11)
+{
+	float2 VelocityScale;		// velocity buffer to pixels, times the shutter
+	float MotionBlurMinimum;	// tiles whose neighbour max is shorter than this many pixels skip the blur
+	uint MotionBlurSamples;
 }
 
 cbuffer TessProperties : register(b5)
@@ -104,10 +173,17 @@ cbuffer TessProperties : register(b5)
 	float3 padding;
 }
 
-cbuffer TerrainProperties : register(b6)
+#define BLOOM_MAX_TAPS 8
+
+// One bloom pass, weights from BloomKernel::GetLinearTaps
+cbuffer BloomProperties : register(b6)
 {
-	int IsTerrain;
-	float3 Padding_;
+	float4 BloomTaps[BLOOM_MAX_TAPS];	// x offset in texels, y weight
+	float2 BloomTexelStep;				// the source's texel size, only along the blur direction when blurring
+	float BloomThreshold;				// first downsample only, 0 keeps everything
+	float BloomScale;					// upsample only
+	uint BloomTapCount;
+	float3 BloomPadding;
 }
 
 //--------------------------------------------------------------------------------------
@@ -135,6 +211,12 @@ struct PS_INPUT
 	float2 Tex : TEXCOORD0;
 	float3 eyeVectorTS : POSITION4;
 	float3 lightVectorTS : POSITION5;
+	float3 Tangent : TANGENT;			// world space, with Norm for the clustered lights
+	float3 Binormal : BINORMAL;
+#ifdef VELOCITY
+	float4 CurrentPos : POSITION6;
+	float4 PreviousPos : POSITION7;
+#endif
 };
 
 struct RTT_PS_INPUT
@@ -220,6 +302,13 @@ LightingResult DoPointLight(Light light, float3 vertexToEye, float3 N, float3 ve
 	return result;
 }
 
+// Towards the key light from a world space point, along its direction for a directional light
+float3 GetVertexToLight(float3 worldPos)
+{
+	return Lights[0].LightType == DIRECTIONAL_LIGHT ? -Lights[0].Direction.xyz : Lights[0].Position.xyz - worldPos;
+}
+
+// Lights[0] is the key light, in tangent space so parallax self shadowing can use it
 LightingResult ComputeLighting(float3 N, float3 vertexToEye, float3 vertexToLight)
 {
 	LightingResult result = DoPointLight(Lights[0], vertexToEye, N, vertexToLight);
@@ -227,6 +316,89 @@ LightingResult ComputeLighting(float3 N, float3 vertexToEye, float3 vertexToLigh
 	return result;
 }
 
+/***********************************************
+MARKING SCHEME: Advanced graphics techniques
+DESCRIPTION: Clustered forward lighting
+***********************************************/
+// Every point light binned into this pixel's cluster, in world space. They fade to
+// nothing at their range, which is the sphere they were binned with.
+LightingResult ComputeClusterLighting(float2 pixel, float3 worldPos, float3 N, float3 vertexToEye)
+{
+	LightingResult result;
+	result.Diffuse = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	result.Specular = float4(0.0f, 0.0f, 0.0f, 0.0f);
+
+	float viewZ = mul(float4(worldPos, 1.0f), View).z;
+	int slice = clamp((int)(log(max(viewZ, 1e-4f)) * ClusterSliceScale + ClusterSliceBias), 0, LIGHT_CLUSTERS_Z - 1);
+	uint2 tile = min((uint2)(pixel * ClusterTileScale), uint2(LIGHT_CLUSTERS_X - 1, LIGHT_CLUSTERS_Y - 1));
+	uint2 range = ClusterRanges[(slice * LIGHT_CLUSTERS_Y + tile.y) * LIGHT_CLUSTERS_X + tile.x];
+
+	for (uint i = 0; i < range.y; ++i)
+	{
+		ClusterLight light = ClusterLights[ClusterLightIndices[range.x + i]];
+		float3 toLight = light.Position - worldPos;
+		float distanceSq = dot(toLight, toLight);
+		float falloff = saturate(1.0f - distanceSq / (light.Range * light.Range));
+		falloff *= falloff;
+
+		float3 L = toLight * rsqrt(max(distanceSq, 1e-6f));
+		float4 colour = float4(light.Colour, 1.0f);
+		result.Diffuse += DoDiffuse(colour, L, N) * falloff;
+		result.Specular += colour * DoSpecular(vertexToEye, -L, N) * falloff;
+	}
+
+	return result;
+}
+
+/***********************************************
+MARKING SCHEME: Advanced graphics techniques
+DESCRIPTION: Cascaded shadow maps
+***********************************************/
+// How much of the key light reaches a world space point: the cascade its view depth
+// falls in, 3x3 comparison samples around it. Past the last cascade it is lit.
+float ComputeShadow(float3 worldPos)
+{
+	if (CascadeCount == 0)
+		return 1.0f;
+
+	float viewZ = mul(float4(worldPos, 1.0f), View).z;
+	if (viewZ > CascadeSplits[CascadeCount - 1])
+		return 1.0f;
+	uint cascade = 0;
+	[unroll]
+	for (uint i = 0; i < SHADOW_MAX_CASCADES - 1; ++i)
+	{
+		cascade += i + 1 < CascadeCount && viewZ > CascadeSplits[i];
+	}
+
+	float4 shadowPos = mul(float4(worldPos, 1.0f), CascadeViewProjection[cascade]);
+	shadowPos.xyz /= shadowPos.w;
+	float2 uv = shadowPos.xy * float2(0.5f, -0.5f) + 0.5f;
+	if (any(uv < 0.0f) || any(uv > 1.0f) || shadowPos.z > 1.0f)
+		return 1.0f;
+
+	float lit = 0.0f;
+	[unroll]
+	for (int y = -1; y <= 1; ++y)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; ++x)
+		{
+			lit += txShadowMap.SampleCmpLevelZero(samShadow, float3(uv + float2(x, y) * ShadowTexelSize, cascade), shadowPos.z);
+		}
+	}
+	return lit / 9.0f;
+}
+
+// A spot light's cone, softened over its outer fifth
+float ComputeSpotCone(float3 worldPos)
+{
+	if (Lights[0].LightType != SPOT_LIGHT)
+		return 1.0f;
+	float cosine = dot(normalize(worldPos - Lights[0].Position.xyz), Lights[0].Direction.xyz);
+	return smoothstep(cos(Lights[0].SpotAngle), cos(Lights[0].SpotAngle * 0.8f), cosine);
+}
+
 float ParallaxSelfShadowing(float3 lightDir, float2 texCoords, float parallaxScale)
 {
 	/***********************************************
@@ -306,6 +478,19 @@ RTT_PS_INPUT RTT_VS( RTT_VS_INPUT input )
 	return output;
 }
 
+// World space line strips (splines), coloured by vOutputColor
+RTT_PS_INPUT Line_VS( RTT_VS_INPUT input )
+{
+	RTT_PS_INPUT output = (RTT_PS_INPUT)0;
+
+	output.Pos = mul(float4(input.Pos.xyz, 1.0f), World);
+	output.Pos = mul(output.Pos, View);
+	output.Pos = mul(output.Pos, Projection);
+	output.Tex = input.Tex;
+
+	return output;
+}
+
 PS_INPUT Terrain_VS(VS_INPUT input)
 {
 	PS_INPUT output;
@@ -325,9 +510,11 @@ PS_INPUT Terrain_VS(VS_INPUT input)
 	float3 B = mul(float4(input.Binorm, 0), World).xyz;
 	float3x3 TBN = float3x3(T, B, output.Norm);
 	float3x3 TBN_Inv = transpose(TBN);
+	output.Tangent = T;
+	output.Binormal = B;
 
 	output.eyeVectorTS = normalize(mul((EyePosition - output.worldPos).xyz, TBN_Inv));
-	output.lightVectorTS = mul((Lights[0].Position - output.worldPos).xyz, TBN_Inv);
+	output.lightVectorTS = mul(GetVertexToLight(output.worldPos.xyz), TBN_Inv);
 
 	return output;
 }
@@ -359,9 +546,11 @@ void GS(triangle VS_INPUT input[3], inout TriangleStream<PS_INPUT> OutputStream)
 		float3 B = mul(float4(input[i].Binorm, 0), World).xyz;
 		float3x3 TBN = float3x3(T, B, output.Norm);
 		float3x3 TBN_Inv = transpose(TBN);
+		output.Tangent = T;
+		output.Binormal = B;
 
 		output.eyeVectorTS = normalize(mul((EyePosition - output.worldPos).xyz, TBN_Inv));
-		output.lightVectorTS = mul((Lights[0].Position - output.worldPos).xyz, TBN_Inv);
+		output.lightVectorTS = mul(GetVertexToLight(output.worldPos.xyz), TBN_Inv);
 
 		// Tesselation map
 		/*float displacement = txParallax.SampleLevel(samLinear, output.Tex, 0).x;
@@ -440,9 +629,9 @@ float4 Standard_PS(PS_INPUT IN)
 	float4 texNormal = float4(0.0f, 0.0f, 1.0f, 0.0f);
 	float2 texCoords = IN.Tex;
 	const float parallaxScale = 0.1f;
-	if (Material.UseTexture > 0)
+#ifdef NORMAL_MAP
 	{
-		if (Material.UseTexture == 2)
+#if defined(PARALLAX)
 		{
 			/***********************************************
 			MARKING SCHEME: Parallax Mapping
@@ -454,7 +643,7 @@ float4 Standard_PS(PS_INPUT IN)
 			float2 p = viewDir.xy / viewDir.z * height * parallaxScale;
 			texCoords = texCoords - p;
 		}
-		else if (Material.UseTexture == 3 || Material.UseTexture == 4)
+#elif defined(PARALLAX_OCCLUSION)
 		{
 			/***********************************************
 			MARKING SCHEME: Parallax Mapping
@@ -483,6 +672,7 @@ float4 Standard_PS(PS_INPUT IN)
 			float weight = nextHeight / (nextHeight - prevHeight);
 			texCoords = prevTexCoords * weight + (1.0f - weight) * texCoords;
 		}
+#endif
 
 		/***********************************************
 		MARKING SCHEME: Normal Mapping
@@ -492,23 +682,30 @@ float4 Standard_PS(PS_INPUT IN)
 		texNormal = mul(texNormal, 2) - 1;
 		texNormal = normalize(texNormal);
 	}
+#endif
 
 	if (texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
 		discard;
 
 	LightingResult lit = ComputeLighting(texNormal.xyz, IN.eyeVectorTS, IN.lightVectorTS);
 
+	// The same normal in world space for the clustered lights
+	float3x3 TBN = float3x3(normalize(IN.Tangent), normalize(IN.Binormal), normalize(IN.Norm));
+	float3 worldNormal = normalize(mul(texNormal.xyz, TBN));
+	LightingResult clustered = ComputeClusterLighting(IN.Pos.xy, IN.worldPos.xyz, worldNormal, EyePosition.xyz - IN.worldPos.xyz);
+
 	float4 emissive = Material.Emissive;
 	float4 ambient = Material.Ambient * GlobalAmbient;
 	float4 diffuse = Material.Diffuse * lit.Diffuse;
 	float4 specular = Material.Specular * lit.Specular;
+	float4 clusteredLight = Material.Diffuse * clustered.Diffuse + Material.Specular * clustered.Specular;
 
 	float4 texColor;
-	if (IsTerrain == 0)
+#ifndef TERRAIN
 	{
 		texColor = txDiffuse.Sample(samLinear, texCoords);
 	}
-	else
+#else
 	{
 		if (IN.worldPos.y < 2.0f-8)
 		{
@@ -527,22 +724,24 @@ float4 Standard_PS(PS_INPUT IN)
 			texColor = txSnow.Sample(samLinear, texCoords);
 		}
 	}
+#endif
 
-	float shadowMultiplier;
-	if (Material.UseTexture == 4)
-	{
-		shadowMultiplier = ParallaxSelfShadowing(normalize(IN.lightVectorTS), texCoords, parallaxScale);
-	}
-	else
-	{
-		shadowMultiplier = 1.0f;
-	}
-	return (emissive + ambient + diffuse * shadowMultiplier + specular * shadowMultiplier) * texColor;
+	float shadowMultiplier = ComputeShadow(IN.worldPos.xyz) * ComputeSpotCone(IN.worldPos.xyz);
+#ifdef SELF_SHADOW
+	shadowMultiplier *= ParallaxSelfShadowing(normalize(IN.lightVectorTS), texCoords, parallaxScale);
+#endif
+	return (emissive + ambient + diffuse * shadowMultiplier + specular * shadowMultiplier + clusteredLight) * texColor;
 }
 
 float4 PS(PS_INPUT IN) : SV_TARGET
 {
+#ifdef VELOCITY
+	// How far the surface moved in texture coordinates since the last frame
+	float2 velocity = (IN.CurrentPos.xy / IN.CurrentPos.w - IN.PreviousPos.xy / IN.PreviousPos.w) * float2(0.5f, -0.5f);
+	return float4(velocity, 0.0f, 0.0f);
+#else
 	return Standard_PS(IN);
+#endif
 }
 
 float4 PS_BILL(RTT_PS_INPUT IN) : SV_TARGET
@@ -560,31 +759,50 @@ float4 RTT_PS(RTT_PS_INPUT IN) : SV_TARGET
 	return texColor + bloomColor;
 }
 
+float4 PS_Resolve(RTT_PS_INPUT IN) : SV_TARGET
+{
+	// Samples weighted by 1 / (1 + luma), the average of Reinhard tonemapped samples
+	// mapped back to HDR, so a single very bright sample can't swamp an edge pixel
+	uint width, height, samples;
+	txSceneMS.GetDimensions(width, height, samples);
+
+	int2 pixel = int2(IN.Pos.xy);
+	float4 total = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float totalWeight = 0.0f;
+	for (uint i = 0; i < samples; ++i)
+	{
+		float4 colour = txSceneMS.Load(pixel, i);
+		float weight = 1.0f / (1.0f + dot(max(colour.rgb, 0.0f), float3(0.2126f, 0.7152f, 0.0722f)));
+		total += colour * weight;
+		totalWeight += weight;
+	}
+
+	return total / totalWeight;
+}
+
+// Bloom code based on learnopengl.com/Advanced-Lighting/Bloom
+#define BLUR_MAX_RADIUS 10
+static const float BlurWeights[BLUR_MAX_RADIUS] = { 0.407027, 0.287027f, 0.2605, 0.23945946f, 0.2081,
+													0.1616216f, 0.1526, 0.114054f, 0.0952, 0.066216f };
+
 float4 PS_Blur(RTT_PS_INPUT IN) : SV_TARGET
 {
 	/***********************************************
 	MARKING SCHEME: Advanced graphics techniques
-	DESCRIPTION: Gaussian blur, Motion blur, Bloom
+	DESCRIPTION: Gaussian blur
 	***********************************************/
 
-	// Bloom code based on learnopengl.com/Advanced-Lighting/Bloom
-	const float weights[10] = { 0.407027, 0.287027f, 0.2605, 0.23945946f, 0.2081, 
-								0.1616216f, 0.1526, 0.114054f, 0.0952, 0.066216f };
-
 	int r = 1;
 	int width, height;
 	txDiffuse.GetDimensions(width, height);
 	float2 pixelSize;
-	if (isHorizontal == 1)
-	{
-		pixelSize = float2(1.0f / width, 0.0f);
-		r = min(max(abs(mouseChange.x), 1), 10);
-	}
-	else
-	{
-		pixelSize = float2(0.0f, 1.0f / height);
-		r = min(max(abs(mouseChange.y), 1), 10);
-	}
+#ifdef BLUR_HORIZONTAL
+	pixelSize = float2(1.0f / width, 0.0f);
+	r = min(max(abs(BlurRadius.x), 1), BLUR_MAX_RADIUS);
+#else
+	pixelSize = float2(0.0f, 1.0f / height);
+	r = min(max(abs(BlurRadius.y), 1), BLUR_MAX_RADIUS);
+#endif
 	float4 bloomColor;
 	float4 totalBloom = float4(0.0f, 0.0f, 0.0f, 0.0f);
 	float2 texCoords;
@@ -593,18 +811,208 @@ float4 PS_Blur(RTT_PS_INPUT IN) : SV_TARGET
 	{
 		texCoords = IN.Tex + float2(pixelSize.x * i, pixelSize.y * i);
 		bloomColor = txDiffuse.Sample(samLinear, texCoords);
-		totalBloom += bloomColor * weights[i];
+		totalBloom += bloomColor * BlurWeights[i];
 
 		texCoords = IN.Tex - float2(pixelSize.x * i, pixelSize.y * i);
 		bloomColor = txDiffuse.Sample(samLinear, texCoords);
-		totalBloom += bloomColor * weights[i];
+		totalBloom += bloomColor * BlurWeights[i];
 
-		d += weights[i];
+		d += BlurWeights[i];
 	}
 
 	return totalBloom / d / 2;
 }
 
+/***********************************************
+MARKING SCHEME: Advanced graphics techniques
+DESCRIPTION: Bloom, downsampled mip chain with a separable Gaussian
+***********************************************/
+float4 PS_BloomDownsample(RTT_PS_INPUT IN) : SV_TARGET
+{
+	// Four bilinear taps a source texel out from the centre average a 4x4 box
+	float4 colour = (txDiffuse.Sample(samLinear, IN.Tex + float2(-BloomTexelStep.x, -BloomTexelStep.y)) +
+		txDiffuse.Sample(samLinear, IN.Tex + float2(BloomTexelStep.x, -BloomTexelStep.y)) +
+		txDiffuse.Sample(samLinear, IN.Tex + float2(-BloomTexelStep.x, BloomTexelStep.y)) +
+		txDiffuse.Sample(samLinear, IN.Tex + float2(BloomTexelStep.x, BloomTexelStep.y))) * 0.25f;
+
+	if (BloomThreshold > 0.0f)
+	{
+		float brightness = max(colour.r, max(colour.g, colour.b));
+		colour *= max(brightness - BloomThreshold, 0.0f) / max(brightness, 1e-4f);
+	}
+	return colour;
+}
+
+float4 PS_BloomBlur(RTT_PS_INPUT IN) : SV_TARGET
+{
+	// Each tap lands between two texels so the bilinear filter weights both
+	float4 total = txDiffuse.Sample(samLinear, IN.Tex) * BloomTaps[0].y;
+	for (uint i = 1; i < BloomTapCount; ++i)
+	{
+		float2 offset = BloomTexelStep * BloomTaps[i].x;
+		total += (txDiffuse.Sample(samLinear, IN.Tex + offset) + txDiffuse.Sample(samLinear, IN.Tex - offset)) * BloomTaps[i].y;
+	}
+	return total;
+}
+
+float4 PS_BloomUpsample(RTT_PS_INPUT IN) : SV_TARGET
+{
+	return (txDiffuse.Sample(samLinear, IN.Tex) + txBloom.Sample(samLinear, IN.Tex)) * BloomScale;
+}
+
+// PS_Blur as a compute shader. A group loads its row (or column) of the tile plus
+// the apron into groupshared memory, one texel a thread, then every thread
+// convolves from there instead of fetching each tap. Dispatched with
+// TiledBlur::GetDispatchSize: x along the blur, y across it.
+#define BLUR_TILE_SIZE 256
+groupshared float4 BlurCache[BLUR_TILE_SIZE + BLUR_MAX_RADIUS * 2];
+
+[numthreads(BLUR_TILE_SIZE, 1, 1)]
+void CS_Blur(uint3 groupId : SV_GroupID, uint3 threadId : SV_GroupThreadID)
+{
+	int width, height;
+	txDiffuse.GetDimensions(width, height);
+	int r;
+#ifdef BLUR_HORIZONTAL
+	int length = width;
+	r = min(max(abs(BlurRadius.x), 1), BLUR_MAX_RADIUS);
+#else
+	int length = height;
+	r = min(max(abs(BlurRadius.y), 1), BLUR_MAX_RADIUS);
+#endif
+
+	// Clamped like the sampler, the apron's texels past the edge repeat the edge
+	int tileStart = groupId.x * BLUR_TILE_SIZE;
+	for (int i = threadId.x; i < BLUR_TILE_SIZE + BLUR_MAX_RADIUS * 2; i += BLUR_TILE_SIZE)
+	{
+		int along = clamp(tileStart - BLUR_MAX_RADIUS + i, 0, length - 1);
+#ifdef BLUR_HORIZONTAL
+		BlurCache[i] = txDiffuse.Load(int3(along, groupId.y, 0));
+#else
+		BlurCache[i] = txDiffuse.Load(int3(groupId.y, along, 0));
+#endif
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	int along = tileStart + threadId.x;
+	if (along >= length)
+		return;
+
+	int centre = BLUR_MAX_RADIUS + threadId.x;
+	float4 total = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float d = 0;
+	for (int j = 0; j < r; ++j)
+	{
+		total += (BlurCache[centre + j] + BlurCache[centre - j]) * BlurWeights[j];
+		d += BlurWeights[j];
+	}
+
+#ifdef BLUR_HORIZONTAL
+	rwTarget[int2(along, groupId.y)] = total / d / 2;
+#else
+	rwTarget[int2(groupId.y, along)] = total / d / 2;
+#endif
+}
+
+/***********************************************
+MARKING SCHEME: Advanced graphics techniques
+DESCRIPTION: Motion blur, per object from a velocity buffer
+***********************************************/
+// Tile max, neighbour max and a gather along the neighbour max velocity, after
+// McGuire et al. 2012 without the depth comparison. VelocityTiles.h has the same
+// steps on the CPU.
+#define VELOCITY_TILE_SIZE 16
+groupshared float2 VelocityCache[VELOCITY_TILE_SIZE * VELOCITY_TILE_SIZE];
+
+// In pixels, no longer than a tile so the neighbour max covers every pixel that can reach this one
+float2 LoadVelocity(int2 pixel)
+{
+	float2 velocity = txVelocity.Load(int3(pixel, 0)) * VelocityScale;
+	float speed = length(velocity);
+	return speed > VELOCITY_TILE_SIZE ? velocity * (VELOCITY_TILE_SIZE / speed) : velocity;
+}
+
+float2 Longest(float2 a, float2 b)
+{
+	return dot(b, b) > dot(a, a) ? b : a;
+}
+
+// One group a tile, each thread loads a pixel and the group halves the cache down to the longest
+[numthreads(VELOCITY_TILE_SIZE, VELOCITY_TILE_SIZE, 1)]
+void CS_VelocityTileMax(uint3 groupId : SV_GroupID, uint3 threadId : SV_GroupThreadID, uint threadIndex : SV_GroupIndex)
+{
+	int width, height;
+	txVelocity.GetDimensions(width, height);
+	int2 pixel = groupId.xy * VELOCITY_TILE_SIZE + threadId.xy;
+	VelocityCache[threadIndex] = all(pixel < int2(width, height)) ? LoadVelocity(pixel) : float2(0.0f, 0.0f);
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint stride = VELOCITY_TILE_SIZE * VELOCITY_TILE_SIZE / 2; stride > 0; stride >>= 1)
+	{
+		if (threadIndex < stride)
+			VelocityCache[threadIndex] = Longest(VelocityCache[threadIndex], VelocityCache[threadIndex + stride]);
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (threadIndex == 0)
+		rwVelocityTiles[groupId.xy] = VelocityCache[0];
+}
+
+float4 PS_VelocityNeighbourMax(RTT_PS_INPUT IN) : SV_TARGET
+{
+	int width, height;
+	txVelocityTiles.GetDimensions(width, height);
+	int2 tile = int2(IN.Pos.xy);
+	float2 longest = float2(0.0f, 0.0f);
+	for (int y = -1; y <= 1; ++y)
+	{
+		for (int x = -1; x <= 1; ++x)
+		{
+			int2 neighbour = clamp(tile + int2(x, y), int2(0, 0), int2(width - 1, height - 1));
+			longest = Longest(longest, txVelocityTiles.Load(int3(neighbour, 0)));
+		}
+	}
+	return float4(longest, 0.0f, 0.0f);
+}
+
+// How much a sample distance away smears over the pixel, for a surface moving at speed
+float Cone(float distance, float speed)
+{
+	return saturate(1.0f - distance / max(speed * 0.5f, 1e-3f));
+}
+
+float4 PS_MotionBlur(RTT_PS_INPUT IN) : SV_TARGET
+{
+	int2 pixel = int2(IN.Pos.xy);
+	float4 colour = txDiffuse.Load(int3(pixel, 0));
+
+	// Nothing that can reach this tile moves, a still frame ends here for every pixel
+	float2 neighbourMax = txVelocityTiles.Load(int3(pixel / VELOCITY_TILE_SIZE, 0));
+	if (length(neighbourMax) < MotionBlurMinimum)
+		return colour;
+
+	int width, height;
+	txDiffuse.GetDimensions(width, height);
+	float centreSpeed = length(LoadVelocity(pixel));
+	float totalWeight = 1.0f / max(centreSpeed, 1.0f);
+	float4 total = colour * totalWeight;
+
+	// Samples spread evenly across the dominant velocity, centred on the pixel. Each
+	// counts if it moves far enough to smear over this pixel, or this pixel over it.
+	for (uint i = 0; i < MotionBlurSamples; ++i)
+	{
+		float2 offset = neighbourMax * ((i + 0.5f) / MotionBlurSamples - 0.5f);
+		int2 samplePixel = clamp(int2(IN.Pos.xy + offset), int2(0, 0), int2(width - 1, height - 1));
+		float distance = length(offset);
+		float weight = Cone(distance, length(LoadVelocity(samplePixel))) + Cone(distance, centreSpeed);
+		total += txDiffuse.Load(int3(samplePixel, 0)) * weight;
+		totalWeight += weight;
+	}
+
+	return total / totalWeight;
+}
+
 float4 PS_Depth(RTT_PS_INPUT IN) : SV_TARGET
 {
 	float depth = IN.Pos.z / IN.Pos.w;
@@ -630,6 +1038,11 @@ float4 PSSolid(PS_INPUT input) : SV_Target
 	return vOutputColor;
 }
 
+float4 Line_PS(RTT_PS_INPUT input) : SV_Target
+{
+	return vOutputColor;
+}
+
 //--------------------------------------------------------------------------------------
 // Hull Shader
 //--------------------------------------------------------------------------------------
@@ -675,7 +1088,7 @@ HS_CONSTANT_DATA_OUTPUT PassThroughConstantHS(InputPatch<VS_INPUT, 3> ip, uint P
 [domain("tri")]
 PS_INPUT DS(HS_CONSTANT_DATA_OUTPUT input, float3 BarycentricCoordinates : SV_DomainLocation, const OutputPatch<VS_INPUT, 3> TrianglePatch)
 {
-	PS_INPUT output;
+	PS_INPUT output = (PS_INPUT)0;
 
 	float3 vPos = BarycentricCoordinates.x * TrianglePatch[0].Pos + BarycentricCoordinates.y * TrianglePatch[1].Pos + BarycentricCoordinates.z * TrianglePatch[2].Pos;
 	output.Pos = float4(vPos, 1.0f);
@@ -689,7 +1102,7 @@ PS_INPUT DS(HS_CONSTANT_DATA_OUTPUT input, float3 BarycentricCoordinates : SV_Do
 	output.Norm = mul(float4(output.Norm, 0), World).xyz;
 	output.Pos = mul(output.Pos, World);
 
-	if (IsTerrain == 1)
+#ifdef TERRAIN
 	{
 		output.Pos = float4(output.Pos.xyz + output.Norm * 0.0f, 1.0f);
 
@@ -706,18 +1119,34 @@ PS_INPUT DS(HS_CONSTANT_DATA_OUTPUT input, float3 BarycentricCoordinates : SV_Do
 		//	float3 direction = float3(0, -1, 0);
 		//	output.Pos += float4(direction * displacement, 0);
 	}
+#endif
+
+#ifdef DEPTH_ONLY
+	// Only the position matters, and only in the map this pass is drawing
+	output.Pos = mul(output.Pos, ShadowViewProjection);
+	return output;
+#endif
 
 	float3 T = mul(float4(tan, 0), World).xyz;
 	float3 B = mul(float4(binorm, 0), World).xyz;
 	float3x3 TBN = float3x3(T, B, output.Norm);
 	float3x3 TBN_Inv = transpose(TBN);
+	output.Tangent = T;
+	output.Binormal = B;
 
 	output.worldPos = output.Pos;
 	output.Pos = mul(output.Pos, View);
 	output.Pos = mul(output.Pos, Projection);
 
 	output.eyeVectorTS = normalize(mul((EyePosition - output.worldPos).xyz, TBN_Inv));
-	output.lightVectorTS = mul((Lights[0].Position - output.worldPos).xyz, TBN_Inv);
+	output.lightVectorTS = mul(GetVertexToLight(output.worldPos.xyz), TBN_Inv);
+
+#ifdef VELOCITY
+	// Where the same point was last frame. Skinning happens before the vertex buffer,
+	// so only the object's and the camera's motion show up.
+	output.CurrentPos = output.Pos;
+	output.PreviousPos = mul(mul(float4(vPos, 1.0f), PreviousWorld), PreviousViewProjection);
+#endif
 
 	return output;
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include <DirectXMath.h>
 #include <d3d11_1.h>
+#include "BloomKernel.h"
+#include "ShadowCascades.h"
 using namespace std;
 using namespace DirectX;
 
@@ -9,12 +11,20 @@ using namespace DirectX;
 //--------------------------------------------------------------------------------------
 
 
-struct ConstantBuffer
+// b0, written for every draw
+struct ObjectConstants
 {
 	XMMATRIX mWorld;
+	XMMATRIX mPreviousWorld;	// last frame's, for the velocity buffer
+	XMFLOAT4 vOutputColor;
+};
+
+// b7, written once per frame
+struct FrameConstants
+{
 	XMMATRIX mView;
 	XMMATRIX mProjection;
-	XMFLOAT4 vOutputColor;
+	XMMATRIX mPreviousViewProjection;
 };
 
 struct SCREEN_VERTEX
@@ -32,6 +42,7 @@ struct _Material
 		, Specular(1.0f, 1.0f, 1.0f, 1.0f)
 		, SpecularPower(128.0f)
 		, UseTexture(0)
+		, Padding{ 0.0f, 0.0f }
 	{}
 
 	DirectX::XMFLOAT4   Emissive;
@@ -43,7 +54,7 @@ struct _Material
 	DirectX::XMFLOAT4   Specular;
 	//----------------------------------- (16 byte boundary)
 	float               SpecularPower;
-	// Add some padding complete the 16 byte boundary.
+	// Unused by the shaders now, the texture features are permutations
 	int                 UseTexture;
 	// Add some padding to complete the 16 byte boundary.
 	float               Padding[2];
@@ -57,9 +68,40 @@ struct MaterialPropertiesConstantBuffer
 
 struct BlurProperties
 {
-	int isHorizontal;
-	XMFLOAT2 mouseChange;
-	float Padding;
+	XMFLOAT2 Radius;	// texels each way along x and y, TiledBlur::GetRadius clamps it
+	XMFLOAT2 Padding;
+};
+
+// b11, one per motion blur pass
+struct MotionBlurProperties
+{
+	XMFLOAT2 VelocityScale;
+	float MinimumVelocity;
+	UINT SampleCount;
+};
+
+// b8, how the pixel shader finds its light cluster
+struct ClusterProperties
+{
+	XMFLOAT2 TileScale;
+	float SliceScale;
+	float SliceBias;
+};
+
+// b9, the key light's shadow maps for the scene's pixel shader
+struct ShadowProperties
+{
+	XMMATRIX mCascadeViewProjection[SHADOW_MAX_CASCADES];
+	XMFLOAT4 CascadeSplits;		// view depth each cascade ends at
+	UINT CascadeCount;			// 0 without shadows
+	float TexelSize;			// one texel in shadow map texture coordinates
+	XMFLOAT2 Padding;
+};
+
+// b10, one per shadow map pass, the map its depth only draws go into
+struct ShadowPassProperties
+{
+	XMMATRIX mShadowViewProjection;
 };
 
 struct TessProperties
@@ -68,10 +110,15 @@ struct TessProperties
 	XMFLOAT3 padding;
 };
 
-struct TerrainProperties
+// b6, one per bloom pass, see BloomKernel.h
+struct BloomProperties
 {
-	int IsTerrain;
-	XMFLOAT3 Padding_;
+	XMFLOAT4 Taps[BLOOM_MAX_TAPS];
+	XMFLOAT2 TexelStep;
+	float Threshold;
+	float Scale;
+	UINT TapCount;
+	XMFLOAT3 Padding;
 };
 
 struct TextureSet
@@ -79,11 +126,13 @@ struct TextureSet
 	ID3D11Texture2D* texture;
 	ID3D11RenderTargetView* view;
 	ID3D11ShaderResourceView* resource;
+	ID3D11UnorderedAccessView* access;
 	TextureSet()
 	{
 		texture = nullptr;
 		view = nullptr;
 		resource = nullptr;
+		access = nullptr;
 	}
 };
 
@@ -108,6 +157,7 @@ struct Light
 		, QuadraticAttenuation(0.0f)
 		, LightType(DirectionalLight)
 		, Enabled(0)
+		, Padding{ 0, 0 }
 	{}
 
 	DirectX::XMFLOAT4    Position;